@@ -21,6 +21,7 @@ class HomestoreConan(ConanFile):
                 "sanitize": ['True', 'False'],
                 "testing" : ['coverage', 'full', 'min', 'off', 'epoll_mode', 'spdk_mode'],
                 "skip_testing": ['True', 'False'],
+                "usdt": ['True', 'False'],
             }
     default_options = {
                 'shared': False,
@@ -28,6 +29,7 @@ class HomestoreConan(ConanFile):
                 'sanitize': False,
                 'testing': 'epoll_mode',
                 'skip_testing': False,
+                'usdt': False,
                 'sisl:prerelease': True,
             }
 
@@ -76,6 +78,8 @@ class HomestoreConan(ConanFile):
             definitions['MEMORY_SANITIZER_ON'] = 'ON'
 
         definitions['TEST_TARGET'] = self.options.testing
+        if self.options.usdt:
+            definitions['ENABLE_USDT'] = 'ON'
         if self.options.testing == 'coverage':
             test_target = 'coverage'
 
@@ -99,6 +103,8 @@ class HomestoreConan(ConanFile):
 
     def package_info(self):
         self.cpp_info.libs = ["homestore"]
+        if self.options.usdt:
+            self.cpp_info.defines.append("HS_USDT_ENABLED")
         if self.options.sanitize:
             self.cpp_info.sharedlinkflags.append("-fsanitize=address")
             self.cpp_info.exelinkflags.append("-fsanitize=address")
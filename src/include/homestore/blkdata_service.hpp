@@ -32,6 +32,7 @@ class VirtualDev;
 struct vdev_info_block;
 struct stream_info_t;
 class BlkReadTracker;
+class DataTierMgr;
 struct blk_alloc_hints;
 
 struct async_info {
@@ -50,19 +51,30 @@ public:
     ~BlkDataService();
 
     /**
-     * @brief : called during recovery to open existing vdev for data service
+     * @brief : called during recovery to open existing vdev for data service, or its fast tier vdev
      *
      * @param vb : vdev info blk containing the details of this blkstore
      */
     void open_vdev(vdev_info_block* vb);
 
     /**
-     * @brief : called in non-recovery mode to create a new vdev for data service
+     * @brief : called in non-recovery mode to create a new vdev for data service. If data devices are hdd and fast
+     * tier is configured, a fast tier vdev is also created on ssd devices, on which the working set of data is placed;
      *
      * @param size : size of this vdev
      */
     void create_vdev(uint64_t size);
 
+    /**
+     * @brief : start the data service, called after vdev is created/opened and checkpoint manager is initialized
+     */
+    void start();
+
+    /**
+     * @brief : stop the data service, blks which are freed and waiting for their discard are discarded and freed;
+     */
+    void stop();
+
     /**
      * @brief : asynchronous write without input block ids. Block ids will be allocated by this api and returned;
      *
@@ -99,6 +111,18 @@ public:
     void async_read(const BlkId& bid, sisl::sg_list& sgs, uint32_t size, const io_completion_cb_t& cb,
                     bool part_of_batch = false);
 
+    /**
+     * @brief : asynchronous read of multiple block ids (say a striped write), reads on all of them are issued in
+     * parallel and callback is triggered once all of them are completed;
+     *
+     * @param in_blkids : block ids to read, in the order they are placed in sgs
+     * @param sgs : the read buffer stored, its size is expected to be the total size of all in_blkids
+     * @param cb : callback that will be triggered after all reads complete, with the error of any failed read
+     * @param part_of_batch : is this read part of batch;
+     */
+    void async_read(const std::vector< BlkId >& in_blkids, sisl::sg_list& sgs, const io_completion_cb_t& cb,
+                    bool part_of_batch = false);
+
     /**
      * @brief : commit a block, usually called during recovery
      *
@@ -117,7 +141,8 @@ public:
 
     /**
      * @brief : asynchronous free block, it is asynchronous because it might need to wait for pending read to complete
-     * if same block is being read and not completed yet;
+     * if same block is being read and not completed yet. If discard is enabled, block is discarded on the drive and
+     * becomes available for allocation only after the next checkpoint is committed;
      *
      * @param bid : the block id to free
      * @param cb : the callback that will be triggered after free block completes;
@@ -173,11 +198,17 @@ private:
      */
     void init();
 
+    void issue_readv(iovec* iovs, int iovcnt, uint32_t size, const BlkId& bid, async_info* as_info,
+                     bool part_of_batch);
+    void issue_writev(const iovec* iovs, int iovcnt, const BlkId& bid, async_info* as_info, bool part_of_batch);
+
 private:
     static void process_data_completion(std::error_condition ec, void* cookie);
 
 private:
     std::unique_ptr< VirtualDev > m_vdev;
+    std::unique_ptr< VirtualDev > m_fast_vdev; // Fast tier of data, only if tiering is enabled
+    std::unique_ptr< DataTierMgr > m_tier_mgr; // Declared after vdevs, so that its mover is stopped before them
     std::unique_ptr< BlkReadTracker > m_blk_read_tracker;
     uint32_t m_page_size;
 };
@@ -25,6 +25,7 @@
 #include <sisl/logging/logging.h>
 #include <sisl/fds/buffer.hpp>
 
+#include <homestore/homestore_probes.hpp>
 #include <homestore/btree/btree.hpp>
 #include <homestore/btree/detail/btree_common.ipp>
 #include <homestore/btree/detail/btree_node_mgr.ipp>
@@ -490,6 +490,7 @@ btree_status_t Btree< K, V >::split_node(const BtreeNodePtr& parent_node, const
     BT_NODE_DBG_ASSERT_GT(child_node2->get_first_key< K >().compare(*out_split_key), 0, child_node2);
     BT_NODE_LOG(DEBUG, parent_node, "Split child_node={} with new_child_node={}, split_key={}", child_node1->node_id(),
                 child_node2->node_id(), out_split_key->to_string());
+    HS_PROBE(btree_split, child_node1->node_id(), child_node2->node_id(), parent_node->node_id(), res);
 
     ret = transact_write_nodes({child_node2}, child_node1, parent_node, context);
 
@@ -573,6 +573,8 @@ btree_status_t Btree< K, V >::merge_nodes(const BtreeNodePtr& parent_node, const
     }
 
 out:
+    HS_PROBE(btree_merge, parent_node->node_id(), leftmost_node->node_id(), old_nodes.size(), new_nodes.size(),
+             s_cast< int >(ret));
     // Do free/unlock based on success/failure in reverse order
     if (ret == btree_status_t::success) {
         for (auto it = old_nodes.rbegin(); it != old_nodes.rend(); ++it) {
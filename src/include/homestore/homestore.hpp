@@ -49,7 +49,7 @@ class CPManager;
 typedef std::shared_ptr< HomeStore > HomeStoreSafePtr;
 
 VENUM(blkstore_type, uint32_t, DATA_STORE = 1, INDEX_STORE = 2, SB_STORE = 3, DATA_LOGDEV_STORE = 4,
-      CTRL_LOGDEV_STORE = 5, META_STORE = 6);
+      CTRL_LOGDEV_STORE = 5, META_STORE = 6, DATA_FAST_TIER_STORE = 7);
 
 #pragma pack(1)
 struct blkstore_blob {
@@ -59,6 +59,26 @@ struct blkstore_blob {
 struct sb_blkstore_blob : blkstore_blob {
     BlkId blkid;
 };
+
+// Journal vdev of a logdev shard. Vdevs created before sharding have these zeroed, which is same as a single shard.
+// Format generation is picked afresh on every format of the journal and is stamped on every log group written on it.
+// Vdevs created before it have it zeroed, on which generation of log groups is not checked.
+struct logdev_blkstore_blob : blkstore_blob {
+    uint16_t shard_idx;
+    uint16_t nshards;
+    uint32_t format_gen;
+};
+
+// Fast tier vdev of data service. Tier id is picked afresh when it is created and is stamped on every extent header
+// written on it, so that headers left on the ssd by an earlier format are not recovered. Extent headers are written
+// only in the runs of blks set aside for them when the tier is first started, which are recorded here.
+struct data_tier_blkstore_blob : blkstore_blob {
+    static constexpr uint32_t max_hdr_runs{256};
+
+    uint32_t tier_id;
+    uint32_t nhdr_runs;
+    uint64_t hdr_runs[max_hdr_runs]; // BlkIds of the runs of header blks
+};
 #pragma pack()
 
 typedef std::function< void(void) > hs_init_done_cb_t;
@@ -0,0 +1,47 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#pragma once
+
+/*
+ * USDT (user space statically defined tracing) probes of homestore, which give bpftrace/perf stable probe points
+ * across builds, e.g.
+ *     bpftrace -e 'usdt:./libhomestore.so:homestore:vdev_complete { @lat_us[arg1] = hist(arg3); }'
+ *
+ * Probes are compiled in only if built with HS_USDT_ENABLED (cmake option ENABLE_USDT, which needs sys/sdt.h from
+ * systemtap sdt headers). Otherwise HS_PROBE expands to nothing and its arguments are not evaluated at all.
+ *
+ * Probes of provider "homestore" and their arguments:
+ *   vdev_submit           (request_id, op_type, size, dev_offset)
+ *   vdev_complete         (request_id, op_type, error, latency_us)
+ *   blkalloc_alloc        (allocator_name, nblks_requested, nblks_allocated, status)
+ *   blkalloc_free         (allocator_name, blk_num, nblks)
+ *   blkalloc_sweep_start  (allocator_name, session_id)
+ *   blkalloc_sweep_done   (allocator_name, session_id, nblks_refilled, latency_us)
+ *   logdev_append         (family_id, store_id, log_idx, size)
+ *   logdev_flush_start    (family_id, from_log_idx, nrecords, size)
+ *   logdev_flush_done     (family_id, from_log_idx, upto_log_idx, latency_us)
+ *   cp_phase              (cp_id, cp_status, us_since_cp_trigger)
+ *   wbcache_read_miss     (node_id, size, latency_us)
+ *   wbcache_flush_start   (cp_id, ndirty_bufs)
+ *   wbcache_flush_done    (cp_id, latency_us)
+ *   btree_split           (child_node_id, new_node_id, parent_node_id, nentries_moved)
+ *   btree_merge           (parent_node_id, leftmost_node_id, nold_nodes, nnew_nodes, status)
+ */
+#ifdef HS_USDT_ENABLED
+#include <sys/sdt.h>
+#define HS_PROBE(name, ...) STAP_PROBEV(homestore, name, ##__VA_ARGS__)
+#else
+#define HS_PROBE(name, ...)
+#endif
@@ -132,6 +132,50 @@ public:
      */
     logstore_seq_num_t append_async(const sisl::io_blob& b, void* cookie, const log_write_comp_cb_t& completion_cb);
 
+    /**
+     * @brief This method appends all the blobs into the log as consecutive seq numbers and makes one callback at the
+     * end of the append of all of them. It is cheaper than appending them one by one, since the seq numbers and the
+     * log ids of the entire batch are reserved at once and the batch is checked for flush only once.
+     *
+     * @param blobs Blobs of data to append, which are expected to be valid till the completion callback.
+     * @param cookie Passed as is to the completion callback
+     * @param completion_cb Completion callback which contains the first seqnum of the batch, number of records, logdev
+     * key of the last record of the batch and cookie.
+     * @return first seq number of the batch, the rest of the batch follows it
+     */
+    logstore_seq_num_t append_batch_async(const std::vector< sisl::io_blob >& blobs, void* cookie,
+                                          const log_batch_write_comp_cb_t& completion_cb);
+
+    /**
+     * @brief Reserve a buffer for a record to be appended, which the caller serializes the record into in place and
+     * then appends it with commit_append_async. The buffer is dma aligned and padded upto the flush size of the logdev,
+     * so that the record is written to the device right from this buffer, instead of copying it into the log group.
+     *
+     * @param max_size Max size of the record to be serialized into the buffer
+     * @return Reserved buffer, whose size is max_size
+     */
+    sisl::io_blob reserve_append(uint32_t max_size);
+
+    /**
+     * @brief Append the record serialized into a buffer reserved by reserve_append. The buffer is owned by the log
+     * store from now on and freed after the completion callback.
+     *
+     * @param reserved Buffer returned by reserve_append
+     * @param size Actual size of the record serialized into the buffer, which is not more than the reserved size
+     * @param cookie Passed as is to the completion callback
+     * @param completion_cb Completion callback which contains the seqnum, status and cookie
+     * @return internally generated sequence number
+     */
+    logstore_seq_num_t commit_append_async(const sisl::io_blob& reserved, uint32_t size, void* cookie,
+                                           const log_write_comp_cb_t& completion_cb);
+
+    /**
+     * @brief Release a buffer reserved by reserve_append, without appending anything from it.
+     *
+     * @param reserved Buffer returned by reserve_append
+     */
+    void cancel_append(const sisl::io_blob& reserved);
+
     /**
      * @brief Read the log provided the sequence number synchronously. This is not the most efficient way to read
      * as reader will be blocked until read is completed. In addition, it is built on-top of async system by doing
@@ -146,9 +190,9 @@ public:
 
     /**
      * @brief Read the log based on the logstore_req prepared. In case callback is supplied, it uses the callback
-     * to provide the data it has read. If not overridden, use default callback registered during initialization.
+     * to provide the data it has read. If not overridden, use default log found callback registered.
      *
-     * @param req Request containing seq_num
+     * @param req Request containing seq_num and cookie
      * @param cb [OPTIONAL] Callback to get the data back, if it needs to be different from the default registered
      * one.
      */
@@ -157,12 +201,35 @@ public:
     /**
      * @brief Read the log for the seq_num and make the callback with the data
      *
+     * Throws: std::out_of_range exception if seq_num is already truncated or never inserted before
+     *
      * @param seq_num Seqnumber to read the log from
      * @param cookie Any cookie or context which will passed back in the callback
-     * @param cb Callback which contains seq_num, cookie and
+     * @param cb Callback which contains seq_num, data read and cookie
      */
     void read_async(logstore_seq_num_t seq_num, void* cookie, const log_found_cb_t& cb);
 
+    /**
+     * @brief Read the logs of all the seq_nums and make the callback with the data of each of them. Logs which are in
+     * the same log group are read from device together. The device reads do not block the caller, the callback is
+     * called on the same io reactor which issued the read. Logs found in the tail cache are called back right away
+     * (before this method returns), so the callbacks are not necessarily in the order of seq_nums.
+     *
+     * If any seq_num is appended but not flushed yet, a flush is triggered and the read is queued until the seq_num is
+     * flushed, without waiting for it. The queued read is issued again on the io reactor which issued this read.
+     *
+     * Throws: std::out_of_range exception if any of the seq_num is already truncated or never inserted before, in
+     * which case none of them is read.
+     *
+     * @param seq_nums Seqnumbers to read the logs from
+     * @param cookie Any cookie or context which will passed back in the callback
+     * @param cb Callback which is called once for every seq_num with the data read and cookie
+     * @param err_cb [OPTIONAL] Callback for every seq_num which could not be read (device error or the log group
+     * failing validation). If not supplied, such seq_num is called back on cb with an empty buffer.
+     */
+    void read_async(const std::vector< logstore_seq_num_t >& seq_nums, void* cookie, const log_found_cb_t& cb,
+                    const log_read_err_cb_t& err_cb = nullptr);
+
     /**
      * @brief Truncate the logs for this log store upto the seq_num provided (inclusive). Once truncated, the reads
      * on seq_num <= upto_seq_num will return an error. The truncation in general is a 2 step process, where first
@@ -260,6 +327,7 @@ public:
      * @brief Rollback the given instance to the given sequence number
      *
      * @param seq_num Sequence number back which logs are to be rollbacked
+     * @param cb Callback once the rollback is persisted, which could be called in the meta thread of the logdev
      * @return True on success
      */
     uint64_t rollback_async(logstore_seq_num_t to_lsn, on_rollback_cb_t cb);
@@ -268,11 +336,14 @@ public:
 
     LogStoreFamily& get_family() { return m_logstore_family; }
 
+    // Logdev shard of the family this store is on and the id this store is known by to that logdev
+    LogDev& get_logdev() { return m_logdev; }
+    logstore_id_t get_logdev_store_id() const { return m_logdev_store_id; }
+
     nlohmann::json dump_log_store(const log_dump_req& dump_req = log_dump_req());
 
     nlohmann::json get_status(int verbosity) const;
 
-    const truncation_info& pre_device_truncation();
     void post_device_truncation(const logdev_key& trunc_upto_key);
     void on_write_completion(logstore_req* req, const logdev_key& ld_key);
     void on_read_completion(logstore_req* req, const logdev_key& ld_key);
@@ -281,12 +352,24 @@ public:
     void on_batch_completion(const logdev_key& flush_batch_ld_key);
 
 private:
+    // Key of the record to read, after flushing it if it is not completed yet. Throws if it cannot be read
+    logdev_key read_key(logstore_seq_num_t seq_num);
+
+    // Read of a completed record, from the tail cache of the logdev if present there, else from the logdev
+    log_buffer read_record(logstore_seq_num_t seq_num, const logdev_key& ld_key);
+
+    // Async read of the records, all of which are expected to be completed
+    void do_read_async(const std::vector< logstore_seq_num_t >& seq_nums, void* cookie, const log_found_cb_t& cb,
+                       const log_read_err_cb_t& err_cb);
+    void resume_pending_reads();
     void do_truncate(logstore_seq_num_t upto_seq_num);
+    void update_truncation_heap();
     int search_max_le(logstore_seq_num_t input_sn);
 
     logstore_id_t m_store_id;
     LogStoreFamily& m_logstore_family;
     LogDev& m_logdev;
+    logstore_id_t m_logdev_store_id;
     sisl::StreamTracker< logstore_record > m_records;
     bool m_append_mode{false};
     log_req_comp_cb_t m_comp_cb;
@@ -305,6 +388,11 @@ private:
     std::mutex m_sync_flush_mtx;
     std::condition_variable m_sync_flush_cv;
 
+    // Async reads waiting for the flush of the lsns they read, with the max such lsn of each of them
+    std::mutex m_pending_reads_mtx;
+    std::vector< std::pair< logstore_seq_num_t, std::function< void() > > > m_pending_reads;
+    std::atomic< uint32_t > m_npending_reads{0};
+
     std::vector< seq_ld_key_pair > m_truncation_barriers; // List of truncation barriers
     truncation_info m_safe_truncation_boundary;
 };
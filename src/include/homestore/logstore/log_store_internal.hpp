@@ -23,6 +23,7 @@
 #include <memory>
 #include <mutex>
 #include <set>
+#include <system_error>
 #include <unordered_map>
 #include <vector>
 
@@ -47,7 +48,10 @@ typedef uint8_t logstore_family_id_t;
 
 typedef std::function< void(logstore_req*, logdev_key) > log_req_comp_cb_t;
 typedef std::function< void(logstore_seq_num_t, sisl::io_blob&, logdev_key, void*) > log_write_comp_cb_t;
+typedef std::function< void(logstore_seq_num_t /* start_lsn */, uint32_t /* nrecords */, logdev_key, void*) >
+    log_batch_write_comp_cb_t;
 typedef std::function< void(logstore_seq_num_t, log_buffer, void*) > log_found_cb_t;
+typedef std::function< void(logstore_seq_num_t, std::error_condition, void*) > log_read_err_cb_t;
 typedef std::function< void(std::shared_ptr< HomeLogStore >) > log_store_opened_cb_t;
 typedef std::function< void(std::shared_ptr< HomeLogStore >, logstore_seq_num_t) > log_replay_done_cb_t;
 
@@ -122,6 +126,7 @@ struct logstore_req {
     void* cookie;               // User generated cookie (considered as opaque)
     bool is_write;              // Directon of IO
     bool is_internal_req;       // If the req is created internally by HomeLogStore itself
+    bool is_reserved_buf;       // Data is in a buffer from reserve_append, which is written along with its padding
     log_req_comp_cb_t cb;       // Callback upon completion of write (overridden than default)
     Clock::time_point start_time;
 
@@ -144,6 +149,7 @@ struct logstore_req {
         req->data = data;
         req->is_write = is_write_req;
         req->is_internal_req = true;
+        req->is_reserved_buf = false;
         req->cb = nullptr;
 
         return req;
@@ -22,12 +22,15 @@
 #include <limits>
 #include <memory>
 #include <mutex>
+#include <string>
+#include <vector>
 
 #include <iomgr/iomgr.hpp>
 #include <sisl/metrics/metrics.hpp>
 #include <nlohmann/json.hpp>
 
 #include <homestore/logstore/log_store.hpp>
+#include <homestore/small_function.hpp>
 
 namespace homestore {
 
@@ -47,7 +50,7 @@ struct logdev_key;
 class JournalVirtualDev;
 struct vdev_info_block;
 struct log_dump_req;
-typedef std::function< void(std::error_condition, void* /* cookie */) > vdev_io_comp_cb_t;
+typedef small_function< void(std::error_condition, void* /* cookie */) > vdev_io_comp_cb_t;
 
 class LogStoreService {
     friend class HomeLogStore;
@@ -58,6 +61,9 @@ public:
     static constexpr logstore_family_id_t DATA_LOG_FAMILY_IDX{0};
     static constexpr logstore_family_id_t CTRL_LOG_FAMILY_IDX{1};
     static constexpr size_t num_log_families = CTRL_LOG_FAMILY_IDX + 1;
+
+    // Keys the families are truncated upto. For a family sharded into multiple logdevs, it is the minimum across its
+    // shards
     typedef std::function< void(const std::array< logdev_key, num_log_families >&) > device_truncate_cb_t;
 
     LogStoreService();
@@ -89,6 +95,9 @@ public:
      * @param append_mode: If the log store have to be in append mode, user can call append_async and do not need to
      * maintain the log_idx. Else user is expected to keep track of the log idx. Default to false
      *
+     * NOTE: With logstore.batch_meta_persist_on, the log store is durable once any of its records is, or upon the next
+     * CP flush or persist_meta_async completion, whichever is earlier.
+     *
      * @return std::shared_ptr< HomeLogStore >
      */
     std::shared_ptr< HomeLogStore > create_new_log_store(const logstore_family_id_t family_id,
@@ -134,6 +143,14 @@ public:
     void device_truncate(const device_truncate_cb_t& cb = nullptr, const bool wait_till_done = false,
                          const bool dry_run = false);
 
+    /**
+     * @brief Persist the metadata updates batched so far by all the logdevs, such as log stores created or rolled back.
+     * It is done on every CP flush as well.
+     *
+     * @param cb [OPTIONAL] Callback once the updates of all the logdevs are persisted
+     */
+    void persist_meta_async(const std::function< void() >& cb = nullptr);
+
     void create_vdev(uint64_t size, logstore_family_id_t family, vdev_io_comp_cb_t format_cb);
     bool open_vdev(vdev_info_block* vb, logstore_family_id_t family);
 
@@ -144,25 +161,38 @@ public:
     LogStoreFamily* data_log_family() { return m_logstore_families[DATA_LOG_FAMILY_IDX].get(); }
     LogStoreFamily* ctrl_log_family() { return m_logstore_families[CTRL_LOG_FAMILY_IDX].get(); }
 
+    // First logdev shard of the family
     LogDev& data_logdev();
     LogDev& ctrl_logdev();
 
     uint32_t used_size() const;
     uint32_t total_size() const;
-    iomgr::io_thread_t& flush_thread() { return m_flush_thread; }
+
+    // Every logdev shard flushes in its own thread, shard i of all the families share the flush thread i
+    iomgr::io_thread_t& flush_thread(uint32_t shard_idx = 0) {
+        return m_flush_threads[shard_idx % m_flush_threads.size()];
+    }
     iomgr::io_thread_t& truncate_thread() { return m_truncate_thread; }
 
+    // Logdev shard i of all the families persist their batched metadata updates, which is sync IO, in meta thread i
+    iomgr::io_thread_t& meta_thread(uint32_t shard_idx = 0) {
+        return m_meta_threads[shard_idx % m_meta_threads.size()];
+    }
+
 private:
+    JournalVirtualDev* add_logdev_vdev(logstore_family_id_t family, uint32_t shard_idx, uint32_t nshards,
+                                       std::unique_ptr< JournalVirtualDev > vdev);
+    static std::string logdev_vdev_name(logstore_family_id_t family, uint32_t shard_idx);
     void start_threads();
     void flush_if_needed();
     void send_flush_msg();
 
 private:
     std::array< std::unique_ptr< LogStoreFamily >, num_log_families > m_logstore_families;
-    std::unique_ptr< JournalVirtualDev > m_data_logdev_vdev;
-    std::unique_ptr< JournalVirtualDev > m_ctrl_logdev_vdev;
+    std::array< std::vector< std::unique_ptr< JournalVirtualDev > >, num_log_families > m_logdev_vdevs; // Per shard
     iomgr::io_thread_t m_truncate_thread;
-    iomgr::io_thread_t m_flush_thread;
+    std::vector< iomgr::io_thread_t > m_flush_threads;
+    std::vector< iomgr::io_thread_t > m_meta_threads;
     LogStoreServiceMetrics m_metrics;
 };
 
@@ -0,0 +1,159 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#pragma once
+#include <cstddef>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace homestore {
+
+template < typename Sig, size_t InlineSize = 48 >
+class small_function;
+
+/*
+ * A copyable callable wrapper like std::function, which stores callables of upto InlineSize bytes (a lambda capturing a
+ * few pointers, or a std::function itself) inline, without any heap allocation. Larger callables are put on heap.
+ *
+ * Wrapping an empty std::function or a null function pointer results in an empty small_function, so that callers can
+ * continue to test the callback before calling it.
+ */
+template < typename R, typename... Args, size_t InlineSize >
+class small_function< R(Args...), InlineSize > {
+public:
+    small_function() noexcept = default;
+    small_function(std::nullptr_t) noexcept {}
+
+    template < typename F, typename FD = std::decay_t< F >,
+               typename = std::enable_if_t< !std::is_same_v< FD, small_function > &&
+                                            std::is_invocable_r_v< R, FD&, Args... > > >
+    small_function(F&& f) {
+        if constexpr (std::is_constructible_v< bool, const FD& >) {
+            if (!static_cast< bool >(f)) { return; }
+        }
+        if constexpr (is_inline< FD >) {
+            new (&m_storage) FD(std::forward< F >(f));
+            m_ops = &s_inline_ops< FD >;
+        } else {
+            *r_cast_storage< FD* >() = new FD(std::forward< F >(f));
+            m_ops = &s_heap_ops< FD >;
+        }
+    }
+
+    small_function(const small_function& other) : m_ops{other.m_ops} {
+        if (m_ops) { m_ops->copy(&m_storage, &other.m_storage); }
+    }
+
+    small_function(small_function&& other) noexcept : m_ops{other.m_ops} {
+        if (m_ops) {
+            m_ops->move(&m_storage, &other.m_storage);
+            other.m_ops = nullptr;
+        }
+    }
+
+    small_function& operator=(const small_function& other) {
+        if (this != &other) {
+            small_function tmp{other};
+            *this = std::move(tmp);
+        }
+        return *this;
+    }
+
+    small_function& operator=(small_function&& other) noexcept {
+        if (this != &other) {
+            reset();
+            if (other.m_ops) {
+                other.m_ops->move(&m_storage, &other.m_storage);
+                m_ops = other.m_ops;
+                other.m_ops = nullptr;
+            }
+        }
+        return *this;
+    }
+
+    small_function& operator=(std::nullptr_t) noexcept {
+        reset();
+        return *this;
+    }
+
+    ~small_function() { reset(); }
+
+    explicit operator bool() const noexcept { return (m_ops != nullptr); }
+
+    R operator()(Args... args) const {
+        if (!m_ops) { throw std::bad_function_call(); }
+        return m_ops->invoke(&m_storage, std::forward< Args >(args)...);
+    }
+
+private:
+    struct ops_t {
+        R (*invoke)(void* storage, Args&&... args);
+        void (*copy)(void* dst, const void* src);
+        void (*move)(void* dst, void* src) noexcept; // Moves and destroys the source
+        void (*destroy)(void* storage) noexcept;
+    };
+
+    template < typename F >
+    static constexpr bool is_inline = (sizeof(F) <= InlineSize) && (alignof(F) <= alignof(std::max_align_t)) &&
+        std::is_nothrow_move_constructible_v< F >;
+
+    template < typename F >
+    static inline const ops_t s_inline_ops{
+        [](void* s, Args&&... args) -> R {
+            if constexpr (std::is_void_v< R >) {
+                std::invoke(*static_cast< F* >(s), std::forward< Args >(args)...);
+            } else {
+                return std::invoke(*static_cast< F* >(s), std::forward< Args >(args)...);
+            }
+        },
+        [](void* dst, const void* src) { new (dst) F(*static_cast< const F* >(src)); },
+        [](void* dst, void* src) noexcept {
+            new (dst) F(std::move(*static_cast< F* >(src)));
+            static_cast< F* >(src)->~F();
+        },
+        [](void* s) noexcept { static_cast< F* >(s)->~F(); }};
+
+    template < typename F >
+    static inline const ops_t s_heap_ops{
+        [](void* s, Args&&... args) -> R {
+            if constexpr (std::is_void_v< R >) {
+                std::invoke(**static_cast< F** >(s), std::forward< Args >(args)...);
+            } else {
+                return std::invoke(**static_cast< F** >(s), std::forward< Args >(args)...);
+            }
+        },
+        [](void* dst, const void* src) { *static_cast< F** >(dst) = new F(**static_cast< F* const* >(src)); },
+        [](void* dst, void* src) noexcept { *static_cast< F** >(dst) = *static_cast< F** >(src); },
+        [](void* s) noexcept { delete *static_cast< F** >(s); }};
+
+    template < typename T >
+    T* r_cast_storage() {
+        return reinterpret_cast< T* >(&m_storage);
+    }
+
+    void reset() noexcept {
+        if (m_ops) {
+            m_ops->destroy(&m_storage);
+            m_ops = nullptr;
+        }
+    }
+
+private:
+    mutable std::aligned_storage_t< InlineSize, alignof(std::max_align_t) > m_storage;
+    const ops_t* m_ops{nullptr};
+};
+
+} // namespace homestore
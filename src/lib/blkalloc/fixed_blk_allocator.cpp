@@ -15,6 +15,7 @@
  *********************************************************************************/
 #include <cassert>
 
+#include <homestore/homestore_probes.hpp>
 #include "common/homestore_assert.hpp"
 #include "common/homestore_flip.hpp"
 #include "blk_allocator.h"
@@ -67,6 +68,8 @@ BlkAllocStatus FixedBlkAllocator::alloc(blk_count_t nblks, const blk_alloc_hints
         out_blkid.push_back(bid);
         // no need to update real time bm as it is already updated in alloc of single blkid api;
     }
+    HS_PROBE(blkalloc_alloc, m_cfg.get_name().c_str(), nblks, (status == BlkAllocStatus::SUCCESS) ? 1 : 0,
+             s_cast< int >(status));
     return status;
 }
 
@@ -98,6 +101,7 @@ void FixedBlkAllocator::free(const BlkId& b) {
         const auto pushed = m_blk_q.write(b);
         HS_DBG_ASSERT_EQ(pushed, true, "Expected to be able to push the blk on fixed capacity Q");
     }
+    HS_PROBE(blkalloc_free, m_cfg.get_name().c_str(), b.get_blk_num(), b.get_nblks());
 }
 
 blk_cap_t FixedBlkAllocator::available_blks() const { return m_blk_q.sizeGuess(); }
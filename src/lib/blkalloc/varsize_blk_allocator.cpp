@@ -23,6 +23,7 @@
 #include <sisl/utility/thread_factory.hpp>
 #include <sisl/utility/thread_buffer.hpp>
 
+#include <homestore/homestore_probes.hpp>
 #include "blk_cache_queue.h"
 #include "common/homestore_flip.hpp"
 
@@ -297,6 +298,9 @@ void VarsizeBlkAllocator::fill_cache(BlkAllocSegment* in_seg, blk_cache_fill_ses
     }
 #endif
 
+    HS_PROBE(blkalloc_sweep_start, m_cfg.get_name().c_str(), fill_session.session_id);
+    [[maybe_unused]] auto const sweep_start_time = Clock::now();
+
     // Pick a segment if scan if not provided
     BlkAllocSegment* seg = in_seg;
     if (seg == nullptr) {
@@ -340,6 +344,8 @@ void VarsizeBlkAllocator::fill_cache(BlkAllocSegment* in_seg, blk_cache_fill_ses
         BLKALLOC_LOG(DEBUG, "Allocator sweep session={} failed to add any blocks to blk cache",
                      fill_session.session_id);
     }
+    HS_PROBE(blkalloc_sweep_done, m_cfg.get_name().c_str(), fill_session.session_id,
+             fill_session.overall_refilled_num_blks, get_elapsed_time_us(sweep_start_time));
     m_fb_cache->close_cache_fill_session(fill_session);
 }
 
@@ -558,6 +564,7 @@ BlkAllocStatus VarsizeBlkAllocator::alloc(blk_count_t nblks, const blk_alloc_hin
 #endif
     }
 
+    HS_PROBE(blkalloc_alloc, m_cfg.get_name().c_str(), nblks, total_allocated, s_cast< int >(status));
     return status;
 }
 
@@ -591,6 +598,7 @@ void VarsizeBlkAllocator::free(const BlkId& b) {
     }
 
     decr_alloced_blk_count(b.get_nblks());
+    HS_PROBE(blkalloc_free, m_cfg.get_name().c_str(), b.get_blk_num(), b.get_nblks());
     BLKALLOC_LOG(TRACE, "Freed blk_num={}", blkid_to_blk_cache_entry(b).to_string());
 }
 
@@ -13,23 +13,92 @@
  * specific language governing permissions and limitations under the License.
  *
  *********************************************************************************/
+#include <limits>
+#include <map>
+#include <random>
+
 #include <homestore/blkdata_service.hpp>
 #include <homestore/homestore.hpp>
+#include <homestore/checkpoint/cp_mgr.hpp>
+#include "checkpoint/cp.hpp"
+#include "device/device.h"
 #include "device/virtual_dev.hpp"
 #include "device/physical_dev.hpp"     // vdev_info_block
 #include "common/homestore_config.hpp" // is_data_drive_hdd
 #include "common/error.h"
+#include "common/reactor_obj_pool.hpp"
 #include "blk_read_tracker.hpp"
+#include "data_tier_mgr.hpp"
 
 namespace homestore {
 
 BlkDataService& data_service() { return hs()->data_service(); }
 
+// Blks freed in a cp, which are discarded once the cp is committed
+class DataSvcCPContext : public CPContext {
+public:
+    DataSvcCPContext(cp_id_t id) : CPContext{id} {}
+    std::map< chunk_num_t, std::vector< BlkId > > m_discard_blks;
+};
+
+// Data service does not have any dirty buffers to flush on cp. It only discards the blks freed in the cp, once the cp
+// is committed. Blks freed after the switchover belong to the next cp, which could still be referenced by recovery.
+class DataSvcCPCallbacks : public CPCallbacks {
+public:
+    DataSvcCPCallbacks(VirtualDev* vdev) : m_vdev{vdev} {}
+    virtual ~DataSvcCPCallbacks() = default;
+
+    std::unique_ptr< CPContext > on_switchover_cp(CP* cur_cp, CP* new_cp) override {
+        if (cur_cp != nullptr) {
+            auto* ctx = s_cast< DataSvcCPContext* >(cur_cp->context(cp_consumer_t::BLK_DATA_SVC));
+            if (ctx != nullptr) { ctx->m_discard_blks = m_vdev->take_pending_discards(); }
+        }
+        return std::make_unique< DataSvcCPContext >(new_cp->id());
+    }
+    void cp_flush(CP* cp, cp_flush_done_cb_t&& done_cb) override { done_cb(cp); }
+    void cp_cleanup(CP* cp) override {
+        auto* ctx = s_cast< DataSvcCPContext* >(cp->context(cp_consumer_t::BLK_DATA_SVC));
+        if (ctx != nullptr) { m_vdev->flush_discards(std::move(ctx->m_discard_blks)); }
+    }
+    int cp_progress_percent() override { return 100; }
+
+private:
+    VirtualDev* m_vdev;
+};
+
 BlkDataService::BlkDataService() { m_blk_read_tracker = std::make_unique< BlkReadTracker >(); }
 BlkDataService::~BlkDataService() = default;
 
+void BlkDataService::start() {
+    hs()->cp_mgr().register_consumer(cp_consumer_t::BLK_DATA_SVC, std::make_unique< DataSvcCPCallbacks >(m_vdev.get()));
+    if (m_fast_vdev) {
+        m_tier_mgr = std::make_unique< DataTierMgr >(m_vdev.get(), m_fast_vdev.get(), m_page_size);
+        if (!hs()->is_first_time_boot()) {
+            // Extents found on fast tier commit their blks, so fast vdev is marked recovered only after it
+            m_tier_mgr->recover();
+            m_fast_vdev->recovery_done();
+        }
+        m_tier_mgr->start();
+    }
+}
+
+void BlkDataService::stop() {
+    hs()->cp_mgr().register_consumer(cp_consumer_t::BLK_DATA_SVC, nullptr);
+    if (m_tier_mgr) { m_tier_mgr->stop(); }
+    m_vdev->drain_discards();
+}
+
 // recovery path
 void BlkDataService::open_vdev(vdev_info_block* vb) {
+    auto const* blob = r_cast< const blkstore_blob* >(vb->context_data);
+    if (blob->type == blkstore_type::DATA_FAST_TIER_STORE) {
+        // Its blks are recovered from the extent headers in its header region, once data service is started
+        m_fast_vdev = std::make_unique< VirtualDev >(hs()->device_mgr(), "DataFastTierVDev", vb,
+                                                     PhysicalDevGroup::FAST, blk_allocator_type_t::varsize,
+                                                     vb->is_failed(), true /* auto_recovery */);
+        return;
+    }
+
     m_vdev = std::make_unique< VirtualDev >(hs()->device_mgr(), "DataVDev", vb, PhysicalDevGroup::DATA,
                                             blk_allocator_type_t::varsize, vb->is_failed(), true /* auto_recovery */);
 
@@ -44,8 +113,17 @@ void BlkDataService::open_vdev(vdev_info_block* vb) {
 void BlkDataService::async_free_blk(const BlkId bid, const io_completion_cb_t& cb) {
     // create blk read waiter instance;
     m_blk_read_tracker->wait_on(bid, [this, bid, cb]() {
-        m_vdev->free_blk(bid);
-        cb(no_error);
+        if (!m_tier_mgr) {
+            m_vdev->free_blk_with_discard(bid);
+            cb(no_error);
+            return;
+        }
+
+        // Fast tier extents of the blk are dropped first, so that they are not recovered once the blk is reused
+        m_tier_mgr->async_free_blk(bid, [this, bid, cb]() {
+            m_vdev->free_blk_with_discard(bid);
+            cb(no_error);
+        });
     });
 }
 
@@ -57,60 +135,171 @@ void BlkDataService::create_vdev(uint64_t size) {
     m_vdev = std::make_unique< VirtualDev >(hs()->device_mgr(), "DataVDev", PhysicalDevGroup::DATA,
                                             blk_allocator_type_t::varsize, size, 0, true /* is_stripe */, m_page_size,
                                             (char*)&blob, sizeof(blkstore_blob), true /* auto_recovery */);
+
+    auto const fast_tier_pct = HS_DYNAMIC_CONFIG(data_tier->fast_tier_size_pct);
+    if (is_data_drive_hdd() && (fast_tier_pct > 0) && hs()->device_mgr()->has_devices(PhysicalDevGroup::FAST)) {
+        auto* dmgr = hs()->device_mgr();
+        auto const fast_size =
+            sisl::round_up(uint64_cast((fast_tier_pct * dmgr->total_cap(PhysicalDevGroup::FAST)) / 100),
+                           dmgr->phys_page_size(PhysicalDevGroup::FAST));
+
+        static std::random_device s_rd;
+        std::uniform_int_distribution< uint32_t > id_dist{1, std::numeric_limits< uint32_t >::max()};
+        data_tier_blkstore_blob fast_blob;
+        fast_blob.type = blkstore_type::DATA_FAST_TIER_STORE;
+        fast_blob.tier_id = id_dist(s_rd);
+        fast_blob.nhdr_runs = 0; // Header region is set aside once the tier is started
+        m_fast_vdev = std::make_unique< VirtualDev >(
+            dmgr, "DataFastTierVDev", PhysicalDevGroup::FAST, blk_allocator_type_t::varsize, fast_size, 0,
+            true /* is_stripe */, m_page_size /* blk_size, same as data so that extents map 1:1 */, (char*)&fast_blob,
+            sizeof(data_tier_blkstore_blob), true /* auto_recovery */);
+    }
+}
+
+// Context of a data IO on a single blkid, which embeds the vdev context of the IO, so that the most common IOs take just
+// one allocation from the reactor's pool, instead of one each for async_info and vdev context.
+struct data_io_req : public vdev_req_context {
+    async_info as_info;
+
+    data_io_req() = default;
+
+protected:
+    void free_self() override { ReactorObjPool< data_io_req >::deallocate(this); }
+};
+
+static void complete_data_io(std::error_condition ec, async_info* as_info) {
+    if (as_info->is_read) {
+        // this will trigger any pending free_blk on this read to complete;
+        hs()->data_service().read_blk_tracker()->remove(as_info->bid);
+    }
+
+    // send callback to caller;
+    as_info->cb(ec);
+}
+
+static data_io_req* make_data_io_req(const BlkId& bid, const io_completion_cb_t& cb, bool is_read) {
+    auto* req = ReactorObjPool< data_io_req >::make_object();
+    req->as_info.cb = cb;
+    req->as_info.is_read = is_read;
+    req->as_info.bid = bid;
+    req->cb = [](std::error_condition ec, void* cookie) { complete_data_io(ec, r_cast< async_info* >(cookie)); };
+    req->cookie = &req->as_info;
+    return req;
 }
 
 void BlkDataService::async_read(const BlkId& bid, sisl::sg_list& sgs, uint32_t size, const io_completion_cb_t& cb,
                                 bool part_of_batch) {
 
     m_blk_read_tracker->insert(bid);
+    HS_DBG_ASSERT_EQ(sgs.iovs.size(), 1, "Expecting iov size to be 1 since reading on one blk.");
 
-    auto as_info = sisl::ObjectAllocator< async_info >::make_object();
+    if (!m_tier_mgr) {
+        m_vdev->async_readv(sgs.iovs.data(), sgs.iovs.size(), size, bid, make_data_io_req(bid, cb, true /* is_read */),
+                            part_of_batch);
+        return;
+    }
+
+    auto as_info = ReactorObjPool< async_info >::make_object();
     as_info->cb = cb;
     as_info->is_read = true;
     as_info->bid = bid;
+    as_info->outstanding_io_cnt.increment(1);
 
-    HS_DBG_ASSERT_EQ(sgs.iovs.size(), 1, "Expecting iov size to be 1 since reading on one blk.");
+    issue_readv(sgs.iovs.data(), sgs.iovs.size(), size, bid, as_info, part_of_batch);
+}
 
-    as_info->outstanding_io_cnt.increment(1);
+void BlkDataService::async_read(const std::vector< BlkId >& in_blkids, sisl::sg_list& sgs,
+                                const io_completion_cb_t& cb, bool part_of_batch) {
+    if (in_blkids.size() == 1) {
+        async_read(in_blkids[0], sgs, s_cast< uint32_t >(sgs.size), cb, part_of_batch);
+        return;
+    }
+
+    // Each blkid is read and tracked in blk read tracker individually, caller is called back once all are read
+    struct multi_read_ctx {
+        io_completion_cb_t cb;
+        sisl::atomic_counter< int > outstanding_cnt{0};
+        std::atomic< bool > failed{false};
+        std::error_condition err{no_error};
+    };
+    auto mr_ctx = std::make_shared< multi_read_ctx >();
+    mr_ctx->cb = cb;
+    mr_ctx->outstanding_cnt.set(s_cast< int >(in_blkids.size()));
+
+    sisl::sg_iterator sg_it{sgs.iovs};
+    for (const auto& bid : in_blkids) {
+        m_blk_read_tracker->insert(bid);
+
+        auto as_info = ReactorObjPool< async_info >::make_object();
+        as_info->cb = [mr_ctx](std::error_condition ec) {
+            if (ec && !mr_ctx->failed.exchange(true)) { mr_ctx->err = ec; }
+            if (mr_ctx->outstanding_cnt.decrement_testz()) { mr_ctx->cb(mr_ctx->err); }
+        };
+        as_info->is_read = true;
+        as_info->bid = bid;
+        as_info->outstanding_io_cnt.increment(1);
+
+        const auto size = bid.get_nblks() * m_page_size;
+        auto iovs = sg_it.next_iovs(size);
+        issue_readv(iovs.data(), iovs.size(), size, bid, as_info, part_of_batch);
+    }
+}
+
+void BlkDataService::issue_readv(iovec* iovs, int iovcnt, uint32_t size, const BlkId& bid, async_info* as_info,
+                                 bool part_of_batch) {
+    if (m_tier_mgr) {
+        m_tier_mgr->async_readv(
+            iovs, iovcnt, bid, [as_info](std::error_condition ec) { process_data_completion(ec, as_info); },
+            part_of_batch);
+    } else {
+        m_vdev->async_readv(iovs, iovcnt, size, bid, BlkDataService::process_data_completion,
+                            reinterpret_cast< const void* >(as_info) /* cookie */, part_of_batch);
+    }
+}
 
-    m_vdev->async_readv(sgs.iovs.data(), sgs.iovs.size(), size, bid, BlkDataService::process_data_completion,
-                        reinterpret_cast< const void* >(as_info) /* cookie */, part_of_batch);
+void BlkDataService::issue_writev(const iovec* iovs, int iovcnt, const BlkId& bid, async_info* as_info,
+                                  bool part_of_batch) {
+    if (m_tier_mgr) {
+        m_tier_mgr->async_writev(
+            iovs, iovcnt, bid, [as_info](std::error_condition ec) { process_data_completion(ec, as_info); },
+            part_of_batch);
+    } else {
+        m_vdev->async_writev(iovs, iovcnt, bid, BlkDataService::process_data_completion,
+                             reinterpret_cast< const void* >(as_info) /* cookie */, part_of_batch);
+    }
 }
 
 void BlkDataService::process_data_completion(std::error_condition ec, void* cookie) {
     auto as_info = reinterpret_cast< async_info* >(cookie);
 
     if (as_info->outstanding_io_cnt.decrement_testz(1)) {
-
-        if (as_info->is_read) {
-            // this will trigger any pending free_blk on this read to complete;
-            hs()->data_service().read_blk_tracker()->remove(as_info->bid);
-        }
-
-        // send callback to caller;
-        as_info->cb(ec);
-        sisl::ObjectAllocator< async_info >::deallocate(as_info);
+        complete_data_io(ec, as_info);
+        ReactorObjPool< async_info >::deallocate(as_info);
     }
 }
 
 void BlkDataService::async_write(const sisl::sg_list& sgs, const blk_alloc_hints& hints,
                                  const std::vector< BlkId >& in_blkids, const io_completion_cb_t& cb,
                                  bool part_of_batch) {
-    auto as_info = sisl::ObjectAllocator< async_info >::make_object();
+    if ((in_blkids.size() == 1) && !m_tier_mgr) {
+        // Shortcut to most common case
+        m_vdev->async_writev(sgs.iovs.data(), sgs.iovs.size(), in_blkids[0],
+                             make_data_io_req(in_blkids[0], cb, false /* is_read */), part_of_batch);
+        return;
+    }
+
+    auto as_info = ReactorObjPool< async_info >::make_object();
     as_info->cb = cb;
 
     if (in_blkids.size() == 1) {
-        // Shortcut to most common case
         as_info->outstanding_io_cnt.increment(1);
-        m_vdev->async_writev(sgs.iovs.data(), sgs.iovs.size(), in_blkids[0], BlkDataService::process_data_completion,
-                             reinterpret_cast< const void* >(as_info) /* cookie */, part_of_batch);
+        issue_writev(sgs.iovs.data(), sgs.iovs.size(), in_blkids[0], as_info, part_of_batch);
     } else {
         sisl::sg_iterator sg_it{sgs.iovs};
         for (const auto& bid : in_blkids) {
             const auto iovs = sg_it.next_iovs(bid.get_nblks() * m_page_size);
             as_info->outstanding_io_cnt.increment(1);
-            m_vdev->async_writev(iovs.data(), iovs.size(), bid, BlkDataService::process_data_completion,
-                                 reinterpret_cast< const void* >(as_info) /* cookie */, part_of_batch);
+            issue_writev(iovs.data(), iovs.size(), bid, as_info, part_of_batch);
         }
     }
 }
@@ -0,0 +1,1154 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#include <algorithm>
+#include <cstring>
+
+#include <isa-l/crc.h>
+#include <sisl/utility/atomic_counter.hpp>
+
+#include <homestore/homestore.hpp>
+#include "common/error.h"
+#include "common/homestore_assert.hpp"
+#include "common/homestore_config.hpp"
+#include "common/homestore_flip.hpp"
+#include "common/homestore_utils.hpp"
+#include "device/physical_dev.hpp"
+#include "device/virtual_dev.hpp"
+#include "data_tier_mgr.hpp"
+
+namespace homestore {
+static_assert(sizeof(data_tier_blkstore_blob) <= MAX_CONTEXT_DATA_SZ, "Fast tier blob should fit in vdev context");
+
+struct DataTierMgr::tier_io_ctx {
+    io_completion_cb_t cb;
+    sisl::atomic_counter< int > outstanding{1}; // Held by the issuer till all the ranges of the IO are issued
+    std::atomic< bool > failed{false};
+    std::error_condition err{no_error};
+
+    void set_error(std::error_condition ec) {
+        if (ec && !failed.exchange(true)) { err = ec; }
+    }
+};
+
+// Returns the iovecs covering [offset, offset + size) of the given iovecs
+static std::vector< iovec > slice_iovs(const iovec* iov, int iovcnt, uint64_t offset, uint64_t size) {
+    std::vector< iovec > out;
+    for (int i{0}; (i < iovcnt) && (size > 0); ++i) {
+        if (offset >= iov[i].iov_len) {
+            offset -= iov[i].iov_len;
+            continue;
+        }
+        auto const len = std::min(iov[i].iov_len - offset, size);
+        out.push_back(iovec{static_cast< uint8_t* >(iov[i].iov_base) + offset, len});
+        size -= len;
+        offset = 0;
+    }
+    return out;
+}
+
+DataTierMgr::DataTierMgr(VirtualDev* home_vdev, VirtualDev* fast_vdev, uint32_t blk_size) :
+        m_home_vdev{home_vdev}, m_fast_vdev{fast_vdev}, m_blk_size{blk_size} {
+    HS_REL_ASSERT_EQ(m_fast_vdev->block_size(), m_blk_size, "Fast tier blk size should be same as data blk size");
+    HS_REL_ASSERT_GE(m_blk_size, sizeof(tier_extent_header), "Extent header should fit in a blk");
+    m_fast_total_blks = m_fast_vdev->size() / m_blk_size;
+
+    data_tier_blkstore_blob blob;
+    m_fast_vdev->get_vb_context(sisl::blob{r_cast< uint8_t* >(&blob), sizeof(data_tier_blkstore_blob)});
+    m_tier_id = blob.tier_id;
+    for (uint32_t i{0}; i < blob.nhdr_runs; ++i) {
+        m_hdr_runs.emplace_back(blob.hdr_runs[i]);
+        m_nhdr_blks += m_hdr_runs.back().get_nblks();
+    }
+    m_fast_total_blks -= m_nhdr_blks;
+
+    m_zero_blk = hs_utils::iobuf_alloc(m_blk_size, sisl::buftag::common, m_fast_vdev->align_size());
+    std::memset(m_zero_blk, 0, m_blk_size);
+}
+
+DataTierMgr::~DataTierMgr() {
+    stop();
+    hs_utils::iobuf_free(m_zero_blk, sisl::buftag::common);
+}
+
+void DataTierMgr::start() {
+    if (m_hdr_runs.empty()) { create_hdr_region(); }
+    LOGINFO("Starting data tiering with fast tier of size {} tier_id={}", in_bytes(m_fast_vdev->size()), m_tier_id);
+
+    // Mover runs on a reactor of its own, with its IOs issued async, woken up by a timer on it every interval
+    iomanager.create_reactor("data_tier_mover", INTERRUPT_LOOP, [this](bool is_started) {
+        if (is_started) {
+            std::unique_lock< std::mutex > lk{m_mover_mtx};
+            m_mover_thread = iomanager.iothread_self();
+            arm_mover_timer();
+            m_mover_cv.notify_all();
+        }
+    });
+    std::unique_lock< std::mutex > lk{m_mover_mtx};
+    m_mover_cv.wait(lk, [this]() { return (m_mover_thread != nullptr); });
+}
+
+void DataTierMgr::stop() {
+    iomgr::io_thread_t mover_thread;
+    {
+        std::unique_lock< std::mutex > lk{m_mover_mtx};
+        m_mover_stop = true;
+        m_mover_cv.wait(lk, [this]() { return !m_pass_running; });
+        mover_thread = std::move(m_mover_thread);
+        m_mover_thread = nullptr;
+    }
+    if (mover_thread == nullptr) { return; }
+
+    // Timer is cancelled on the mover reactor, where it fires, before the reactor is stopped
+    bool cancelled{false};
+    iomanager.run_on(mover_thread, [this, &cancelled]([[maybe_unused]] iomgr::io_thread_addr_t addr) {
+        std::unique_lock< std::mutex > lk{m_mover_mtx};
+        if (m_mover_timer_hdl != iomgr::null_timer_handle) {
+            iomanager.cancel_timer(m_mover_timer_hdl);
+            m_mover_timer_hdl = iomgr::null_timer_handle;
+        }
+        cancelled = true;
+        m_mover_cv.notify_all();
+    });
+    {
+        std::unique_lock< std::mutex > lk{m_mover_mtx};
+        m_mover_cv.wait(lk, [&cancelled]() { return cancelled; });
+    }
+    iomanager.run_on(mover_thread, []([[maybe_unused]] iomgr::io_thread_addr_t addr) { iomanager.stop_io_loop(); });
+}
+
+// Fast tier is as full as the more used of its data blks and header blks
+uint32_t DataTierMgr::fast_used_pct() const {
+    if ((m_fast_total_blks == 0) || (m_nhdr_blks == 0)) { return 100; }
+    auto const data_pct = (m_fast_used_blks.load() * 100) / m_fast_total_blks;
+    auto const hdr_pct = ((m_nhdr_blks - m_free_hdr_blks_count.load()) * 100) / m_nhdr_blks;
+    return s_cast< uint32_t >(std::max(data_pct, hdr_pct));
+}
+
+template < typename FnT >
+void DataTierMgr::for_each_shard_range(const BlkId& bid, FnT&& fn) {
+    auto addr = to_addr(bid);
+    auto const end = addr + bid.get_nblks();
+    uint32_t blk_offset{0};
+    while (addr < end) {
+        auto const range_end = std::min(end, ((addr / s_shard_range_blks) + 1) * s_shard_range_blks);
+        auto const nblks = s_cast< blk_count_t >(range_end - addr);
+        fn(addr, nblks, blk_offset);
+        blk_offset += nblks;
+        addr = range_end;
+    }
+}
+
+// Caller is expected to hold the shard lock
+void DataTierMgr::split_into_segments(map_shard& shard, uint64_t addr, blk_count_t nblks,
+                                      std::vector< tier_segment >& segs) {
+    auto const end = addr + nblks;
+    auto add_segment = [&](uint64_t from, uint64_t to, const tier_extent_ptr& ext) {
+        tier_segment seg;
+        seg.addr = from;
+        seg.nblks = s_cast< blk_count_t >(to - from);
+        seg.blk_offset = s_cast< uint32_t >(from - addr);
+        seg.ext = ext;
+        segs.push_back(std::move(seg));
+    };
+
+    auto it = shard.extents.upper_bound(addr);
+    if (it != shard.extents.begin()) {
+        auto prev = std::prev(it);
+        if (prev->second->end_addr() > addr) { it = prev; }
+    }
+
+    auto cur = addr;
+    for (; (cur < end) && (it != shard.extents.end()) && (it->first < end); ++it) {
+        const auto& ext = it->second;
+        if (ext->home_addr > cur) {
+            add_segment(cur, ext->home_addr, nullptr);
+            cur = ext->home_addr;
+        }
+        auto const seg_end = std::min(end, ext->end_addr());
+        add_segment(cur, seg_end, ext);
+        cur = seg_end;
+    }
+    if (cur < end) { add_segment(cur, end, nullptr); }
+}
+
+void DataTierMgr::create_hdr_region() {
+    // Each extent takes at least one data blk besides its header blk
+    auto const max_blks = uint64_cast(BlkId::max_blks_in_op());
+    auto nslots = std::min({uint64_cast(HS_DYNAMIC_CONFIG(data_tier->max_fast_extents)), m_fast_total_blks / 2,
+                            data_tier_blkstore_blob::max_hdr_runs * max_blks});
+
+    data_tier_blkstore_blob blob;
+    m_fast_vdev->get_vb_context(sisl::blob{r_cast< uint8_t* >(&blob), sizeof(data_tier_blkstore_blob)});
+    blob.nhdr_runs = 0;
+
+    blk_alloc_hints hints;
+    hints.is_contiguous = true;
+    while (nslots > 0) {
+        BlkId run;
+        auto const nblks = s_cast< blk_count_t >(std::min(nslots, max_blks));
+        if (m_fast_vdev->alloc_contiguous_blk(nblks, hints, &run) != BlkAllocStatus::SUCCESS) { break; }
+        blob.hdr_runs[blob.nhdr_runs++] = run.to_integer();
+        m_hdr_runs.push_back(run);
+        m_nhdr_blks += nblks;
+        nslots -= nblks;
+    }
+    HS_REL_ASSERT(!m_hdr_runs.empty(), "Could not set aside header blks on fast tier");
+
+    // Blks of the region could have stale headers of an earlier format, which are told apart by their tier id
+    m_fast_vdev->update_vb_context(sisl::blob{r_cast< uint8_t* >(&blob), sizeof(data_tier_blkstore_blob)});
+    m_fast_total_blks -= m_nhdr_blks;
+    {
+        std::unique_lock< std::mutex > lk{m_hdr_mtx};
+        for (const auto& run : m_hdr_runs) {
+            for (blk_count_t i{0}; i < run.get_nblks(); ++i) {
+                m_free_hdr_blks.emplace_back(run.get_blk_num() + i, 1, run.get_chunk_num());
+            }
+        }
+        m_free_hdr_blks_count.store(m_free_hdr_blks.size());
+    }
+    LOGINFO("Set aside {} header blks in {} runs on fast tier", m_nhdr_blks, m_hdr_runs.size());
+}
+
+bool DataTierMgr::alloc_fast_blks(blk_count_t nblks, fast_blks& out) {
+    {
+        std::unique_lock< std::mutex > lk{m_hdr_mtx};
+        if (m_free_hdr_blks.empty()) { return false; }
+        out.hdr_bid = m_free_hdr_blks.back();
+        m_free_hdr_blks.pop_back();
+        m_free_hdr_blks_count.store(m_free_hdr_blks.size());
+    }
+
+    blk_alloc_hints hints;
+    hints.is_contiguous = true;
+    if (m_fast_vdev->alloc_contiguous_blk(nblks, hints, &out.fast_bid) != BlkAllocStatus::SUCCESS) {
+        free_hdr_blk(out.hdr_bid);
+        return false;
+    }
+    m_fast_used_blks.fetch_add(nblks);
+    return true;
+}
+
+void DataTierMgr::free_hdr_blk(const BlkId& hdr_bid) {
+    std::unique_lock< std::mutex > lk{m_hdr_mtx};
+    m_free_hdr_blks.push_back(hdr_bid);
+    m_free_hdr_blks_count.store(m_free_hdr_blks.size());
+}
+
+void DataTierMgr::free_fast_blks(const BlkId& hdr_bid, const BlkId& fast_bid) {
+    free_hdr_blk(hdr_bid);
+    m_fast_vdev->free_blk(fast_bid);
+    m_fast_used_blks.fetch_sub(fast_bid.get_nblks());
+}
+
+uint8_t* DataTierMgr::make_header(const tier_extent& ext) {
+    auto* buf = hs_utils::iobuf_alloc(m_blk_size, sisl::buftag::common, m_fast_vdev->align_size());
+    std::memset(buf, 0, m_blk_size);
+
+    tier_extent_header hdr;
+    hdr.tier_id = m_tier_id;
+    hdr.seq = m_next_seq.fetch_add(1);
+    hdr.home_addr = ext.home_addr;
+    hdr.fast_bid = ext.fast_bid.to_integer();
+    hdr.nblks = ext.nblks;
+    hdr.crc = crc32_ieee(init_crc32, r_cast< const uint8_t* >(&hdr), sizeof(tier_extent_header));
+    std::memcpy(buf, &hdr, sizeof(tier_extent_header));
+    return buf;
+}
+
+// Caller is expected to hold the shard lock, so that the extent does not leave its state before the IO is parked
+void DataTierMgr::park(const tier_extent_ptr& ext, std::function< void() >&& fn) {
+    COUNTER_INCREMENT(m_metrics, tier_parked_ios, 1);
+    std::unique_lock< std::mutex > lk{ext->park_mtx};
+    ext->parked.push_back(std::move(fn));
+}
+
+// Called once the extent has left the state, with the shard lock released
+void DataTierMgr::unpark(const tier_extent_ptr& ext) {
+    std::vector< std::function< void() > > parked;
+    {
+        std::unique_lock< std::mutex > lk{ext->park_mtx};
+        parked.swap(ext->parked);
+    }
+    for (auto& fn : parked) {
+        fn();
+    }
+}
+
+////////////////////////////////////// Write section //////////////////////////////////////
+void DataTierMgr::async_writev(const iovec* iov, int iovcnt, const BlkId& bid, const io_completion_cb_t& cb,
+                               bool part_of_batch) {
+    auto ctx = std::make_shared< tier_io_ctx >();
+    ctx->cb = cb;
+    for_each_shard_range(bid, [&](uint64_t addr, blk_count_t nblks, uint32_t blk_offset) {
+        ctx->outstanding.increment(1);
+        write_range(ctx,
+                    slice_iovs(iov, iovcnt, uint64_cast(blk_offset) * m_blk_size, uint64_cast(nblks) * m_blk_size),
+                    addr, nblks, part_of_batch);
+    });
+    complete_io(ctx);
+}
+
+void DataTierMgr::write_range(const std::shared_ptr< tier_io_ctx >& ctx, std::vector< iovec > iovs, uint64_t addr,
+                              blk_count_t nblks, bool part_of_batch) {
+    auto& shard = shard_of(addr);
+
+    // Blks for the parts not on fast tier yet are allocated outside the lock. Parts which are found placed by a racing
+    // IO, once the lock is taken, leave their blks unused.
+    std::vector< fast_blks > allocs;
+    {
+        std::vector< tier_segment > segs;
+        {
+            std::shared_lock< std::shared_mutex > lg{shard.mtx};
+            split_into_segments(shard, addr, nblks, segs);
+        }
+        auto const has_room = (fast_used_pct() < HS_DYNAMIC_CONFIG(data_tier->demote_high_watermark_pct));
+        for (const auto& seg : segs) {
+            if (seg.ext) { continue; }
+            fast_blks fb;
+            if (!has_room || !alloc_fast_blks(seg.nblks, fb)) {
+                COUNTER_INCREMENT(m_metrics, tier_fast_write_skipped, 1);
+                break;
+            }
+            fb.addr = seg.addr;
+            fb.nblks = seg.nblks;
+            allocs.push_back(fb);
+        }
+    }
+
+    auto segs = std::make_shared< std::vector< tier_segment > >();
+    {
+        std::shared_lock< std::shared_mutex > shared_lg{shard.mtx, std::defer_lock};
+        std::unique_lock< std::shared_mutex > excl_lg{shard.mtx, std::defer_lock};
+        if (allocs.empty()) {
+            shared_lg.lock();
+        } else {
+            excl_lg.lock();
+        }
+
+        split_into_segments(shard, addr, nblks, *segs);
+        for (auto& seg : *segs) {
+            seg.iovs = slice_iovs(iovs.data(), s_cast< int >(iovs.size()), uint64_cast(seg.blk_offset) * m_blk_size,
+                                  uint64_cast(seg.nblks) * m_blk_size);
+            ctx->outstanding.increment(1);
+
+            if (!seg.ext) {
+                auto const fit = std::find_if(allocs.begin(), allocs.end(), [&seg](const fast_blks& fb) {
+                    return (fb.addr == seg.addr) && (fb.nblks == seg.nblks);
+                });
+                if (fit != allocs.end()) {
+                    seg.ext = std::make_shared< tier_extent >(seg.addr, seg.nblks, fit->hdr_bid, fit->fast_bid,
+                                                              extent_state::HDR_PENDING);
+                    seg.ext->write_gen.store(1);
+                    seg.ext->inflight_writes.fetch_add(1);
+                    seg.ext->last_access.store(m_cur_pass.load());
+                    shard.extents.emplace(seg.addr, seg.ext);
+                    allocs.erase(fit);
+                    seg.kind = seg_kind::PLACE;
+                } else {
+                    std::unique_lock< std::mutex > hlk{shard.home_writes_mtx};
+                    shard.home_writes.emplace(seg.addr, seg.addr + seg.nblks);
+                    seg.kind = seg_kind::HOME;
+                }
+                continue;
+            }
+
+            switch (seg.ext->state.load()) {
+            case extent_state::PROMOTING:
+                // Copy of the promotion could miss this write, bumping the gen aborts it
+                seg.ext->write_gen.fetch_add(1);
+                seg.kind = seg_kind::HOME;
+                break;
+            case extent_state::ON_FAST:
+                seg.ext->write_gen.fetch_add(1);
+                seg.ext->inflight_writes.fetch_add(1);
+                seg.ext->last_access.store(m_cur_pass.load());
+                seg.kind = seg_kind::FAST;
+                break;
+            default:
+                // Reissued once the header of the extent is written or zeroed, on whatever the range is on by then
+                seg.kind = seg_kind::PARK;
+                park(seg.ext, [this, ctx, seg_iovs = seg.iovs, seg_addr = seg.addr, seg_nblks = seg.nblks]() {
+                    write_range(ctx, seg_iovs, seg_addr, seg_nblks, false /* part_of_batch */);
+                });
+                break;
+            }
+        }
+    }
+    for (const auto& fb : allocs) {
+        free_fast_blks(fb.hdr_bid, fb.fast_bid);
+    }
+
+    for (size_t i{0}; i < segs->size(); ++i) {
+        auto& seg = (*segs)[i];
+        switch (seg.kind) {
+        case seg_kind::HOME:
+            m_home_vdev->async_writev(
+                seg.iovs.data(), s_cast< int >(seg.iovs.size()), to_home_bid(seg.addr, seg.nblks),
+                [this, ctx, segs, i, &shard](std::error_condition ec, void*) {
+                    const auto& seg = (*segs)[i];
+                    if (!seg.ext) {
+                        std::unique_lock< std::mutex > hlk{shard.home_writes_mtx};
+                        auto [b, e] = shard.home_writes.equal_range(seg.addr);
+                        auto const it = std::find_if(b, e, [&seg](const auto& w) {
+                            return w.second == seg.addr + seg.nblks;
+                        });
+                        if (it != e) { shard.home_writes.erase(it); }
+                    }
+                    ctx->set_error(ec);
+                    complete_io(ctx);
+                },
+                nullptr, part_of_batch);
+            break;
+
+        case seg_kind::FAST:
+            COUNTER_INCREMENT(m_metrics, tier_fast_writes, 1);
+            m_fast_vdev->async_writev(
+                seg.iovs.data(), s_cast< int >(seg.iovs.size()), fast_bid_of(*seg.ext, seg.addr, seg.nblks),
+                [this, ctx, ext = seg.ext](std::error_condition ec, void*) {
+                    // Fast tier has the only copy of a dirty extent, so a failed write is failed to the caller
+                    if (ec) { ext->failed.store(true); }
+                    ext->inflight_writes.fetch_sub(1);
+                    ctx->set_error(ec);
+                    complete_io(ctx);
+                },
+                nullptr, part_of_batch);
+            break;
+
+        case seg_kind::PLACE: {
+            COUNTER_INCREMENT(m_metrics, tier_fast_writes, 1);
+            // Data is written first and sealed with the header once it has landed, so that a header found on
+            // recovery always has its data on fast tier. A crash before the header leaves the range on home.
+            m_fast_vdev->async_writev(
+                seg.iovs.data(), s_cast< int >(seg.iovs.size()), seg.ext->fast_bid,
+                [this, ctx, ext = seg.ext, &shard](std::error_condition ec, void*) {
+                    if (ec) {
+                        ctx->set_error(ec);
+                        abort_placement(shard, ext);
+                        complete_io(ctx);
+                        return;
+                    }
+                    auto* hdr_buf = make_header(*ext);
+                    m_fast_vdev->async_write(
+                        r_cast< const char* >(hdr_buf), m_blk_size, ext->hdr_bid,
+                        [this, ctx, ext, hdr_buf, &shard](std::error_condition ec, void*) {
+                            hs_utils::iobuf_free(hdr_buf, sisl::buftag::common);
+                            ctx->set_error(ec);
+                            complete_placement(shard, ext, !ec);
+                            complete_io(ctx);
+                        },
+                        nullptr);
+                },
+                nullptr, part_of_batch);
+            break;
+        }
+
+        case seg_kind::PARK:
+        default:
+            break;
+        }
+    }
+    complete_io(ctx);
+}
+
+void DataTierMgr::abort_placement(map_shard& shard, const tier_extent_ptr& ext) {
+    // Header was not written, so nothing on fast tier has the range and it is left on home
+    {
+        std::unique_lock< std::shared_mutex > lg{shard.mtx};
+        auto it = shard.extents.find(ext->home_addr);
+        if ((it != shard.extents.end()) && (it->second == ext)) { shard.extents.erase(it); }
+    }
+    ext->inflight_writes.fetch_sub(1);
+    free_fast_blks(ext->hdr_bid, ext->fast_bid);
+    unpark(ext);
+}
+
+void DataTierMgr::complete_placement(map_shard& shard, const tier_extent_ptr& ext, bool success) {
+    // A header write which failed could still have landed, so the placement is the copy of the range which could be
+    // recovered. It is kept as the latest and dropped by the mover once it is written back.
+    if (!success) { ext->failed.store(true); }
+    ext->inflight_writes.fetch_sub(1);
+    {
+        std::unique_lock< std::shared_mutex > lg{shard.mtx};
+        ext->state.store(extent_state::ON_FAST);
+    }
+    unpark(ext);
+}
+
+////////////////////////////////////// Read section //////////////////////////////////////
+void DataTierMgr::async_readv(iovec* iov, int iovcnt, const BlkId& bid, const io_completion_cb_t& cb,
+                              bool part_of_batch) {
+    auto ctx = std::make_shared< tier_io_ctx >();
+    ctx->cb = cb;
+    for_each_shard_range(bid, [&](uint64_t addr, blk_count_t nblks, uint32_t blk_offset) {
+        ctx->outstanding.increment(1);
+        read_range(ctx,
+                   slice_iovs(iov, iovcnt, uint64_cast(blk_offset) * m_blk_size, uint64_cast(nblks) * m_blk_size),
+                   addr, nblks, part_of_batch);
+    });
+    complete_io(ctx);
+}
+
+void DataTierMgr::read_range(const std::shared_ptr< tier_io_ctx >& ctx, std::vector< iovec > iovs, uint64_t addr,
+                             blk_count_t nblks, bool part_of_batch) {
+    auto& shard = shard_of(addr);
+    auto segs = std::make_shared< std::vector< tier_segment > >();
+    {
+        std::shared_lock< std::shared_mutex > lg{shard.mtx};
+        split_into_segments(shard, addr, nblks, *segs);
+        for (auto& seg : *segs) {
+            if (seg.ext && (seg.ext->state.load() == extent_state::ON_FAST)) {
+                seg.ext->outstanding_ios.fetch_add(1);
+                seg.ext->last_access.store(m_cur_pass.load());
+                seg.kind = seg_kind::FAST;
+            } else {
+                seg.ext = nullptr; // Segment not on fast tier need not hold the extent
+                seg.kind = seg_kind::HOME;
+            }
+        }
+    }
+
+    if ((segs->size() == 1) && ((*segs)[0].kind == seg_kind::HOME)) { record_home_read(to_home_bid(addr, nblks)); }
+
+    for (auto& seg : *segs) {
+        seg.iovs = slice_iovs(iovs.data(), s_cast< int >(iovs.size()), uint64_cast(seg.blk_offset) * m_blk_size,
+                              uint64_cast(seg.nblks) * m_blk_size);
+    }
+    ctx->outstanding.increment(s_cast< int >(segs->size()));
+    for (size_t i{0}; i < segs->size(); ++i) {
+        issue_segment_read(ctx, segs, i, part_of_batch);
+    }
+    complete_io(ctx);
+}
+
+void DataTierMgr::issue_segment_read(const std::shared_ptr< tier_io_ctx >& ctx, const tier_segments_ptr& segs,
+                                     size_t idx, bool part_of_batch) {
+    auto& seg = (*segs)[idx];
+    auto const size = uint64_cast(seg.nblks) * m_blk_size;
+    if (seg.kind == seg_kind::FAST) {
+        COUNTER_INCREMENT(m_metrics, tier_fast_reads, 1);
+        m_fast_vdev->async_readv(
+            seg.iovs.data(), s_cast< int >(seg.iovs.size()), size, fast_bid_of(*seg.ext, seg.addr, seg.nblks),
+            [this, ctx, segs, idx](std::error_condition ec, void*) {
+                auto& seg = (*segs)[idx];
+                auto ext = std::move(seg.ext);
+                if (ec) {
+                    COUNTER_INCREMENT(m_metrics, tier_fast_read_errors, 1);
+                    ext->failed.store(true);
+                    if (!ext->is_dirty()) {
+                        // Home has the same data, the fast copy is dropped by mover
+                        seg.kind = seg_kind::HOME;
+                        ext->outstanding_ios.fetch_sub(1);
+                        issue_segment_read(ctx, segs, idx, false /* part_of_batch */);
+                        return;
+                    }
+                    ctx->set_error(ec);
+                }
+                ext->outstanding_ios.fetch_sub(1);
+                complete_io(ctx);
+            },
+            nullptr, part_of_batch);
+    } else {
+        COUNTER_INCREMENT(m_metrics, tier_home_reads, 1);
+        m_home_vdev->async_readv(
+            seg.iovs.data(), s_cast< int >(seg.iovs.size()), size, to_home_bid(seg.addr, seg.nblks),
+            [this, ctx](std::error_condition ec, void*) {
+                ctx->set_error(ec);
+                complete_io(ctx);
+            },
+            nullptr, part_of_batch);
+    }
+}
+
+void DataTierMgr::complete_io(const std::shared_ptr< tier_io_ctx >& ctx) {
+    if (ctx->outstanding.decrement_testz()) { ctx->cb(ctx->err); }
+}
+
+////////////////////////////////////// Free section //////////////////////////////////////
+void DataTierMgr::async_free_blk(const BlkId& bid, const std::function< void() >& cb) {
+    struct free_ctx {
+        sisl::atomic_counter< int > outstanding{1};
+        std::function< void() > cb;
+    };
+    auto fctx = std::make_shared< free_ctx >();
+    fctx->cb = cb;
+    auto const done = [fctx]() {
+        if (fctx->outstanding.decrement_testz()) { fctx->cb(); }
+    };
+
+    {
+        auto& shard = shard_of(to_addr(bid));
+        std::unique_lock< std::mutex > lk{shard.stats_mtx};
+        shard.home_read_counts.erase(bid.to_integer());
+    }
+    for_each_shard_range(bid, [&](uint64_t addr, blk_count_t nblks, uint32_t) {
+        {
+            auto& shard = shard_of(addr);
+            std::unique_lock< std::mutex > lk{shard.stats_mtx};
+            shard.home_read_counts.erase(to_home_bid(addr, nblks).to_integer());
+        }
+        fctx->outstanding.increment(1);
+        free_range(addr, nblks, done);
+    });
+    done();
+}
+
+void DataTierMgr::free_range(uint64_t addr, blk_count_t nblks, const std::function< void() >& done) {
+    auto& shard = shard_of(addr);
+    auto const end = addr + nblks;
+
+    std::vector< tier_extent_ptr > to_drop;
+    {
+        std::unique_lock< std::shared_mutex > lg{shard.mtx};
+        std::vector< tier_extent_ptr > freed;
+        auto it = shard.extents.upper_bound(addr);
+        if (it != shard.extents.begin()) { it = std::prev(it); }
+        for (; (it != shard.extents.end()) && (it->first < end); ++it) {
+            if ((it->first >= addr) && (it->second->end_addr() <= end)) { freed.push_back(it->second); }
+        }
+
+        for (const auto& ext : freed) {
+            if (ext->is_transient()) {
+                park(ext, [this, addr, nblks, done]() { free_range(addr, nblks, done); });
+                return;
+            }
+        }
+        for (const auto& ext : freed) {
+            if (ext->state.load() == extent_state::PROMOTING) {
+                // Promotion has not written its header yet. Mover frees its blks once it finds it removed.
+                shard.extents.erase(ext->home_addr);
+            } else {
+                ext->state.store(extent_state::DROPPING);
+                to_drop.push_back(ext);
+            }
+        }
+    }
+    if (to_drop.empty()) {
+        done();
+        return;
+    }
+
+    auto remaining = std::make_shared< sisl::atomic_counter< int > >(s_cast< int >(to_drop.size()));
+    for (const auto& ext : to_drop) {
+        m_fast_vdev->async_write(
+            r_cast< const char* >(m_zero_blk), m_blk_size, ext->hdr_bid,
+            [this, &shard, ext, remaining, done](std::error_condition ec, void*) {
+                finish_drop(shard, ext, !ec);
+                if (remaining->decrement_testz()) { done(); }
+            },
+            nullptr);
+    }
+}
+
+void DataTierMgr::finish_drop(map_shard& shard, const tier_extent_ptr& ext, bool invalidated) {
+    if (!invalidated) {
+        // Its header could still be valid and recovered, so it stays the copy of the range till the mover drops it
+        LOGERROR("Zeroing the header of fast tier extent at home blkid={} failed",
+                 to_home_bid(ext->home_addr, ext->nblks).to_string());
+        ext->failed.store(true);
+        {
+            std::unique_lock< std::shared_mutex > lg{shard.mtx};
+            ext->state.store(extent_state::ON_FAST);
+        }
+        unpark(ext);
+        return;
+    }
+
+    {
+        std::unique_lock< std::shared_mutex > lg{shard.mtx};
+        auto it = shard.extents.find(ext->home_addr);
+        if ((it != shard.extents.end()) && (it->second == ext)) { shard.extents.erase(it); }
+    }
+    free_fast_blks(ext->hdr_bid, ext->fast_bid);
+    unpark(ext);
+}
+
+void DataTierMgr::record_home_read(const BlkId& bid) {
+    // Counts are kept in the shard of the blkid, so that reads on different ranges do not contend on one lock
+    auto& shard = shard_of(to_addr(bid));
+    std::unique_lock< std::mutex > lk{shard.stats_mtx};
+    auto it = shard.home_read_counts.find(bid.to_integer());
+    if (it != shard.home_read_counts.end()) {
+        ++it->second;
+    } else if (shard.home_read_counts.size() < (HS_DYNAMIC_CONFIG(data_tier->max_tracked_extents) / s_num_shards)) {
+        shard.home_read_counts.emplace(bid.to_integer(), 1);
+    }
+}
+
+////////////////////////////////////// Recovery section //////////////////////////////////////
+void DataTierMgr::recover() {
+    struct found_extent {
+        tier_extent_header hdr;
+        BlkId hdr_bid;
+    };
+    std::vector< found_extent > found;
+    std::vector< BlkId > unused;
+
+    // Only the header region is read, every blk in it which has a valid header of this tier is an extent header
+    auto* buf = hs_utils::iobuf_alloc(uint32_cast(BlkId::max_blks_in_op()) * m_blk_size, sisl::buftag::common,
+                                      m_fast_vdev->align_size());
+    for (const auto& run : m_hdr_runs) {
+        m_fast_vdev->commit_blk(run);
+        auto const size = uint32_cast(run.get_nblks()) * m_blk_size;
+        auto const ret = m_fast_vdev->sync_read(r_cast< char* >(buf), size, run);
+        HS_REL_ASSERT_EQ(ret, s_cast< ssize_t >(size), "Read of fast tier header region failed during recovery");
+
+        for (blk_count_t i{0}; i < run.get_nblks(); ++i) {
+            BlkId const hdr_bid{run.get_blk_num() + i, 1, run.get_chunk_num()};
+            tier_extent_header hdr;
+            std::memcpy(&hdr, buf + (uint64_cast(i) * m_blk_size), sizeof(tier_extent_header));
+            auto const crc = hdr.crc;
+            hdr.crc = 0;
+            if ((hdr.magic != tier_extent_header::s_magic) || (hdr.version != tier_extent_header::s_version) ||
+                (hdr.tier_id != m_tier_id) ||
+                (crc32_ieee(init_crc32, r_cast< const uint8_t* >(&hdr), sizeof(tier_extent_header)) != crc)) {
+                unused.push_back(hdr_bid);
+                continue;
+            }
+            found.push_back(found_extent{hdr, hdr_bid});
+        }
+    }
+    hs_utils::iobuf_free(buf, sisl::buftag::common);
+
+    // Newer extent wins over an older one overlapping it, whose header is zeroed so that it is not found again
+    std::sort(found.begin(), found.end(), [](const auto& a, const auto& b) { return a.hdr.seq > b.hdr.seq; });
+    uint64_t max_seq{0};
+    uint64_t nrecovered{0};
+    for (const auto& f : found) {
+        max_seq = std::max(max_seq, f.hdr.seq);
+        auto const addr = f.hdr.home_addr;
+        auto& shard = shard_of(addr);
+
+        auto it = shard.extents.lower_bound(addr);
+        auto const overlaps = ((it != shard.extents.end()) && (it->first < addr + f.hdr.nblks)) ||
+            ((it != shard.extents.begin()) && (std::prev(it)->second->end_addr() > addr));
+        if (overlaps) {
+            m_fast_vdev->sync_write(r_cast< const char* >(m_zero_blk), m_blk_size, f.hdr_bid);
+            unused.push_back(f.hdr_bid);
+            continue;
+        }
+
+        // It is not known if it was written back before the crash, so it is dirty
+        auto ext = std::make_shared< tier_extent >(addr, f.hdr.nblks, f.hdr_bid, BlkId{f.hdr.fast_bid},
+                                                   extent_state::ON_FAST);
+        ext->write_gen.store(1);
+        shard.extents.emplace(addr, ext);
+        m_fast_vdev->commit_blk(ext->fast_bid);
+        m_fast_used_blks.fetch_add(ext->nblks);
+        ++nrecovered;
+    }
+    m_next_seq.store(max_seq + 1);
+    {
+        std::unique_lock< std::mutex > lk{m_hdr_mtx};
+        m_free_hdr_blks = std::move(unused);
+        m_free_hdr_blks_count.store(m_free_hdr_blks.size());
+    }
+
+    COUNTER_INCREMENT(m_metrics, tier_recovered_extents, nrecovered);
+    LOGINFO("Recovered {} extents on fast tier, {} stale headers dropped", nrecovered, found.size() - nrecovered);
+    update_gauges();
+}
+
+////////////////////////////////////// Mover section //////////////////////////////////////
+struct DataTierMgr::mover_pass {
+    std::vector< std::pair< uint64_t, tier_extent_ptr > > extents; // Extents of the current step, with their order
+    std::vector< std::pair< uint32_t, uint64_t > > hot;            // Read count -> home blkid to promote
+    size_t idx{0};                                                 // Next one of the current step to move
+    size_t max{0};                                                 // Max of them moved in this step
+    std::function< void() > done;                                  // Called with mover lock held once the pass is done
+};
+
+// Called on the mover reactor, since the timer fires on the reactor which armed it
+void DataTierMgr::arm_mover_timer() {
+    m_mover_timer_hdl = iomanager.schedule_thread_timer(HS_DYNAMIC_CONFIG(data_tier->mover_interval_ms) * 1000 * 1000,
+                                                        false /* recurring */, nullptr /* cookie */,
+                                                        [this](void*) { on_mover_timer(); });
+}
+
+void DataTierMgr::on_mover_timer() {
+    std::unique_lock< std::mutex > lk{m_mover_mtx};
+    m_mover_timer_hdl = iomgr::null_timer_handle;
+    if (m_mover_stop) { return; }
+    if (m_pass_running) {
+        // A pass run by tests is in progress, this one waits for the next interval
+        arm_mover_timer();
+        return;
+    }
+    m_pass_running = true;
+    lk.unlock();
+    start_mover_pass([this]() {
+        if (!m_mover_stop) { arm_mover_timer(); }
+    });
+}
+
+void DataTierMgr::run_mover_pass() {
+    std::unique_lock< std::mutex > lk{m_mover_mtx};
+    m_mover_cv.wait(lk, [this]() { return !m_pass_running; });
+    m_pass_running = true;
+    bool done{false};
+    iomanager.run_on(m_mover_thread, [this, &done]([[maybe_unused]] iomgr::io_thread_addr_t addr) {
+        start_mover_pass([&done]() { done = true; });
+    });
+    m_mover_cv.wait(lk, [&done]() { return done; });
+}
+
+// Steps of a pass run one after another and extents are moved one at a time, each issued once the IOs of the previous
+// one are done
+void DataTierMgr::start_mover_pass(std::function< void() >&& done) {
+    auto pass = std::make_shared< mover_pass >();
+    pass->done = std::move(done);
+    m_cur_pass.fetch_add(1);
+    destage_dirty_extents(pass);
+}
+
+void DataTierMgr::finish_mover_pass(const mover_pass_ptr& pass) {
+    // Finished on the mover reactor, as the last IO of the pass could have completed on any reactor
+    iomanager.run_on(m_mover_thread, [this, pass]([[maybe_unused]] iomgr::io_thread_addr_t addr) {
+        update_gauges();
+        std::unique_lock< std::mutex > lk{m_mover_mtx};
+        m_pass_running = false;
+        pass->done();
+        m_mover_cv.notify_all();
+    });
+}
+
+void DataTierMgr::update_gauges() {
+    size_t nextents{0};
+    size_t ndirty{0};
+    for (auto& shard : m_shards) {
+        std::shared_lock< std::shared_mutex > lg{shard.mtx};
+        nextents += shard.extents.size();
+        for (const auto& [addr, ext] : shard.extents) {
+            if (ext->is_dirty()) { ++ndirty; }
+        }
+    }
+    GAUGE_UPDATE(m_metrics, tier_fast_extents, nextents);
+    GAUGE_UPDATE(m_metrics, tier_dirty_extents, ndirty);
+    GAUGE_UPDATE(m_metrics, tier_fast_used_pct, fast_used_pct());
+}
+
+void DataTierMgr::destage_dirty_extents(const mover_pass_ptr& pass) {
+    // Extents written in the last pass are likely to be written again, they are left for a later pass
+    auto const cur_pass = m_cur_pass.load();
+    pass->extents.clear();
+    for (auto& shard : m_shards) {
+        std::shared_lock< std::shared_mutex > lg{shard.mtx};
+        for (const auto& [addr, ext] : shard.extents) {
+            if ((ext->state.load() != extent_state::ON_FAST) || !ext->is_dirty()) { continue; }
+            if (ext->failed.load()) {
+                pass->extents.emplace_back(0, ext);
+            } else if (ext->last_access.load() + 1 < cur_pass) {
+                pass->extents.emplace_back(ext->last_access.load() + 1, ext);
+            }
+        }
+    }
+    std::sort(pass->extents.begin(), pass->extents.end(),
+              [](const auto& a, const auto& b) { return a.first < b.first; });
+
+    pass->idx = 0;
+    pass->max = std::min(pass->extents.size(), size_t{HS_DYNAMIC_CONFIG(data_tier->max_destages_per_pass)});
+    destage_next(pass);
+}
+
+void DataTierMgr::destage_next(const mover_pass_ptr& pass) {
+    while (pass->idx < pass->max) {
+        const auto& ext = pass->extents[pass->idx++].second;
+        if (destage_extent(ext, [this, pass](bool) { destage_next(pass); })) { return; }
+    }
+    demote_cold_extents(pass);
+}
+
+bool DataTierMgr::destage_extent(const tier_extent_ptr& ext, const mover_cb_t& cb) {
+    auto& shard = shard_of(ext->home_addr);
+    uint64_t gen;
+    {
+        // Writes on the fast copy are started with the lock held, so none starts till the gen is taken. One already
+        // in flight could be partly on the fast copy, the extent is written back in a later pass.
+        std::unique_lock< std::shared_mutex > lg{shard.mtx};
+        if ((ext->state.load() != extent_state::ON_FAST) || (ext->inflight_writes.load() != 0)) { return false; }
+        gen = ext->write_gen.load();
+        ext->outstanding_ios.fetch_add(1);
+    }
+
+    auto const size = uint32_cast(ext->nblks) * m_blk_size;
+    auto* buf = hs_utils::iobuf_alloc(size, sisl::buftag::common, m_fast_vdev->align_size());
+    auto const written = [this, ext, gen, buf, cb](std::error_condition ec) {
+        hs_utils::iobuf_free(buf, sisl::buftag::common);
+        ext->outstanding_ios.fetch_sub(1);
+        if (ec) {
+            LOGERROR("Write back of fast tier extent at home blkid={} failed: {}",
+                     to_home_bid(ext->home_addr, ext->nblks).to_string(), ec.message());
+            cb(false);
+            return;
+        }
+
+        // A write started since the gen was taken keeps it dirty
+        if (ext->write_gen.load() == gen) { ext->clean_gen.store(gen); }
+        COUNTER_INCREMENT(m_metrics, tier_destages, 1);
+        cb(true);
+    };
+    m_fast_vdev->async_read(
+        r_cast< char* >(buf), size, ext->fast_bid, [this, ext, buf, size, written](std::error_condition ec, void*) {
+            if (ec) {
+                written(ec);
+                return;
+            }
+            m_home_vdev->async_write(r_cast< const char* >(buf), size, to_home_bid(ext->home_addr, ext->nblks),
+                                     [written](std::error_condition ec, void*) { written(ec); });
+        });
+    return true;
+}
+
+void DataTierMgr::demote_cold_extents(const mover_pass_ptr& pass) {
+    auto const over_high_wm = (fast_used_pct() >= HS_DYNAMIC_CONFIG(data_tier->demote_high_watermark_pct));
+
+    // Extents whose fast copy has failed are dropped irrespective of the usage, ahead of others
+    pass->extents.clear();
+    for (auto& shard : m_shards) {
+        std::shared_lock< std::shared_mutex > lg{shard.mtx};
+        for (const auto& [addr, ext] : shard.extents) {
+            if (ext->state.load() != extent_state::ON_FAST) { continue; }
+            if (ext->failed.load()) {
+                pass->extents.emplace_back(0, ext);
+            } else if (over_high_wm) {
+                pass->extents.emplace_back(ext->last_access.load() + 1, ext);
+            }
+        }
+    }
+    std::sort(pass->extents.begin(), pass->extents.end(),
+              [](const auto& a, const auto& b) { return a.first < b.first; });
+
+    pass->idx = 0;
+    pass->max = pass->extents.size();
+    demote_next(pass);
+}
+
+void DataTierMgr::demote_next(const mover_pass_ptr& pass) {
+    auto const low_wm = HS_DYNAMIC_CONFIG(data_tier->demote_low_watermark_pct);
+    auto const dropped = [this, pass](bool success) {
+        if (success) { COUNTER_INCREMENT(m_metrics, tier_demotions, 1); }
+        demote_next(pass);
+    };
+
+    while (pass->idx < pass->max) {
+        auto const access = pass->extents[pass->idx].first;
+        auto const ext = pass->extents[pass->idx++].second;
+        if ((access != 0) && (fast_used_pct() < low_wm)) { break; }
+        if (!ext->is_dirty()) {
+            if (drop_extent(ext, dropped)) { return; }
+            continue;
+        }
+        auto const issued = destage_extent(ext, [this, ext, pass, dropped](bool written) {
+            if (!written || !drop_extent(ext, dropped)) { demote_next(pass); }
+        });
+        if (issued) { return; }
+    }
+    promote_hot_extents(pass);
+}
+
+bool DataTierMgr::drop_extent(const tier_extent_ptr& ext, const mover_cb_t& cb) {
+    auto& shard = shard_of(ext->home_addr);
+    {
+        std::unique_lock< std::shared_mutex > lg{shard.mtx};
+        auto it = shard.extents.find(ext->home_addr);
+        if ((it == shard.extents.end()) || (it->second != ext) || (ext->state.load() != extent_state::ON_FAST) ||
+            ext->is_dirty() || (ext->outstanding_ios.load() != 0) || (ext->inflight_writes.load() != 0)) {
+            return false;
+        }
+        ext->state.store(extent_state::DROPPING);
+    }
+
+#ifdef _PRERELEASE
+    if (homestore_flip->test_flip("data_tier_crash_before_drop")) {
+        // Left half dropped, as a crash would, with its header still valid on fast tier
+        LOGINFO("Simulating crash before dropping extent at home blkid={}",
+                to_home_bid(ext->home_addr, ext->nblks).to_string());
+        return false;
+    }
+#endif
+
+    m_fast_vdev->async_write(r_cast< const char* >(m_zero_blk), m_blk_size, ext->hdr_bid,
+                             [this, &shard, ext, cb](std::error_condition ec, void*) {
+                                 finish_drop(shard, ext, !ec);
+                                 cb(!ec);
+                             });
+    return true;
+}
+
+void DataTierMgr::promote_hot_extents(const mover_pass_ptr& pass) {
+    pass->hot.clear();
+    auto const low_wm = HS_DYNAMIC_CONFIG(data_tier->demote_low_watermark_pct);
+    if (fast_used_pct() < low_wm) {
+        auto const threshold = HS_DYNAMIC_CONFIG(data_tier->promote_read_threshold);
+        for (auto& shard : m_shards) {
+            std::unique_lock< std::mutex > lk{shard.stats_mtx};
+            for (const auto& [bid_int, count] : shard.home_read_counts) {
+                if (count >= threshold) { pass->hot.emplace_back(count, bid_int); }
+            }
+        }
+    }
+    std::sort(pass->hot.begin(), pass->hot.end(), [](const auto& a, const auto& b) { return a.first > b.first; });
+
+    pass->idx = 0;
+    pass->max = std::min(pass->hot.size(), size_t{HS_DYNAMIC_CONFIG(data_tier->max_promotions_per_pass)});
+    promote_next(pass);
+}
+
+void DataTierMgr::promote_next(const mover_pass_ptr& pass) {
+    auto const low_wm = HS_DYNAMIC_CONFIG(data_tier->demote_low_watermark_pct);
+    while ((pass->idx < pass->max) && (fast_used_pct() < low_wm)) {
+        BlkId const home_bid{pass->hot[pass->idx++].second};
+        {
+            auto& shard = shard_of(to_addr(home_bid));
+            std::unique_lock< std::mutex > lk{shard.stats_mtx};
+            shard.home_read_counts.erase(home_bid.to_integer());
+        }
+        if (promote_extent(home_bid, [this, pass](bool) { promote_next(pass); })) { return; }
+    }
+
+    // Decay the counts, so that only the extents read often recently are promoted
+    for (auto& shard : m_shards) {
+        std::unique_lock< std::mutex > lk{shard.stats_mtx};
+        for (auto it = shard.home_read_counts.begin(); it != shard.home_read_counts.end();) {
+            it->second >>= 1;
+            it = (it->second == 0) ? shard.home_read_counts.erase(it) : std::next(it);
+        }
+    }
+    finish_mover_pass(pass);
+}
+
+void DataTierMgr::abort_promotion(const tier_extent_ptr& ext) {
+    free_fast_blks(ext->hdr_bid, ext->fast_bid);
+    COUNTER_INCREMENT(m_metrics, tier_promotions_aborted, 1);
+}
+
+bool DataTierMgr::promote_extent(const BlkId& home_bid, const mover_cb_t& cb) {
+    auto const addr = to_addr(home_bid);
+    auto const nblks = home_bid.get_nblks();
+    if ((addr / s_shard_range_blks) != ((addr + nblks - 1) / s_shard_range_blks)) { return false; }
+    auto& shard = shard_of(addr);
+
+    fast_blks fb;
+    if (!alloc_fast_blks(nblks, fb)) { return false; }
+    auto ext = std::make_shared< tier_extent >(addr, nblks, fb.hdr_bid, fb.fast_bid, extent_state::PROMOTING);
+    ext->last_access.store(m_cur_pass.load());
+
+    {
+        std::unique_lock< std::shared_mutex > lg{shard.mtx};
+        auto it = shard.extents.lower_bound(addr);
+        auto overlaps = ((it != shard.extents.end()) && (it->first < addr + nblks)) ||
+            ((it != shard.extents.begin()) && (std::prev(it)->second->end_addr() > addr));
+
+        // A write on the range issued before the extent is inserted could be in flight and the copy could miss it.
+        // Writes issued after are caught by the write gen. Writes on other ranges do not hold off this promotion.
+        if (!overlaps) {
+            std::unique_lock< std::mutex > hlk{shard.home_writes_mtx};
+            auto const from = (addr > BlkId::max_blks_in_op()) ? (addr - BlkId::max_blks_in_op()) : 0;
+            for (auto wit = shard.home_writes.lower_bound(from);
+                 (wit != shard.home_writes.end()) && (wit->first < addr + nblks); ++wit) {
+                if (wit->second > addr) {
+                    overlaps = true;
+                    break;
+                }
+            }
+        }
+        if (overlaps) {
+            lg.unlock();
+            abort_promotion(ext);
+            return false;
+        }
+        shard.extents.emplace(addr, ext);
+    }
+
+    auto const size = uint32_cast(nblks) * m_blk_size;
+    auto* buf = hs_utils::iobuf_alloc(size, sisl::buftag::common, m_home_vdev->align_size());
+    auto const copied = [this, &shard, ext, home_bid, buf, cb](std::error_condition ec) {
+        hs_utils::iobuf_free(buf, sisl::buftag::common);
+        if (ec) { LOGERROR("Promotion of blkid={} failed: {}", home_bid.to_string(), ec.message()); }
+
+#ifdef _PRERELEASE
+        if (homestore_flip->test_flip("data_tier_crash_after_promote_copy")) {
+            // Left as a crash would, with the data copied but no header, so the copy is not recovered
+            LOGINFO("Simulating crash after the copy of promotion of blkid={}", home_bid.to_string());
+            cb(false);
+            return;
+        }
+#endif
+
+        {
+            std::unique_lock< std::shared_mutex > lg{shard.mtx};
+            auto it = shard.extents.find(ext->home_addr);
+            auto const present = (it != shard.extents.end()) && (it->second == ext);
+            if (!present || ec || (ext->write_gen.load() != 0)) {
+                if (present) { shard.extents.erase(it); }
+                lg.unlock();
+                abort_promotion(ext);
+                cb(false);
+                return;
+            }
+            // Writes are parked till the header is written, so that none is completed on a copy not recovered yet
+            ext->state.store(extent_state::HDR_PENDING);
+        }
+        seal_promotion(shard, ext, home_bid, cb);
+    };
+    m_home_vdev->async_read(
+        r_cast< char* >(buf), size, home_bid, [this, ext, buf, size, copied](std::error_condition ec, void*) {
+            if (ec) {
+                copied(ec);
+                return;
+            }
+            m_fast_vdev->async_write(r_cast< const char* >(buf), size, ext->fast_bid,
+                                     [copied](std::error_condition ec, void*) { copied(ec); });
+        });
+    return true;
+}
+
+void DataTierMgr::seal_promotion(map_shard& shard, const tier_extent_ptr& ext, const BlkId& home_bid,
+                                 const mover_cb_t& cb) {
+    auto* hdr_buf = make_header(*ext);
+    m_fast_vdev->async_write(
+        r_cast< const char* >(hdr_buf), m_blk_size, ext->hdr_bid,
+        [this, &shard, ext, home_bid, hdr_buf, cb](std::error_condition ec, void*) {
+            hs_utils::iobuf_free(hdr_buf, sisl::buftag::common);
+            if (ec) {
+                LOGERROR("Header write of promotion of blkid={} failed: {}", home_bid.to_string(), ec.message());
+            }
+
+#ifdef _PRERELEASE
+            if (homestore_flip->test_flip("data_tier_crash_after_promote_seal")) {
+                LOGINFO("Simulating crash after the header write of promotion of blkid={}", home_bid.to_string());
+                cb(false);
+                return;
+            }
+#endif
+
+            {
+                std::unique_lock< std::shared_mutex > lg{shard.mtx};
+                if (!ec) {
+                    ext->state.store(extent_state::ON_FAST);
+                } else {
+                    shard.extents.erase(ext->home_addr);
+                }
+            }
+            unpark(ext);
+            if (ec) {
+                abort_promotion(ext);
+                cb(false);
+                return;
+            }
+            COUNTER_INCREMENT(m_metrics, tier_promotions, 1);
+            cb(true);
+        });
+}
+} // namespace homestore
@@ -0,0 +1,343 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#pragma once
+#include <sys/uio.h>
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+#include <vector>
+
+#include <iomgr/iomgr.hpp>
+#include <sisl/metrics/metrics.hpp>
+#include <homestore/blk.h>
+#include <homestore/blkdata_service.hpp>
+
+namespace homestore {
+class VirtualDev;
+
+class DataTierMetrics : public sisl::MetricsGroupWrapper {
+public:
+    explicit DataTierMetrics() : sisl::MetricsGroupWrapper("DataTier", "DataTier") {
+        REGISTER_COUNTER(tier_fast_reads, "Number of reads served from fast tier");
+        REGISTER_COUNTER(tier_home_reads, "Number of reads served from hdd tier");
+        REGISTER_COUNTER(tier_fast_read_errors, "Number of reads on fast tier failed");
+        REGISTER_COUNTER(tier_fast_writes, "Number of writes which landed on fast tier");
+        REGISTER_COUNTER(tier_fast_write_skipped, "Number of writes not placed on fast tier as it is full");
+        REGISTER_COUNTER(tier_parked_ios, "Number of writes and frees parked on an extent being sealed or dropped");
+        REGISTER_COUNTER(tier_promotions, "Number of extents promoted to fast tier");
+        REGISTER_COUNTER(tier_promotions_aborted, "Number of promotions aborted due to a racing write or free");
+        REGISTER_COUNTER(tier_destages, "Number of dirty extents written back to hdd tier");
+        REGISTER_COUNTER(tier_demotions, "Number of extents demoted from fast tier");
+        REGISTER_COUNTER(tier_recovered_extents, "Number of extents found on fast tier on recovery");
+        REGISTER_GAUGE(tier_fast_extents, "Number of extents on fast tier");
+        REGISTER_GAUGE(tier_dirty_extents, "Number of extents on fast tier not written back to hdd tier yet");
+        REGISTER_GAUGE(tier_fast_used_pct, "Percentage of fast tier used");
+
+        register_me_to_farm();
+    }
+
+    DataTierMetrics(const DataTierMetrics&) = delete;
+    DataTierMetrics(DataTierMetrics&&) noexcept = delete;
+    DataTierMetrics& operator=(const DataTierMetrics&) = delete;
+    DataTierMetrics& operator=(DataTierMetrics&&) noexcept = delete;
+
+    ~DataTierMetrics() { deregister_me_from_farm(); }
+};
+
+//
+// clang-format off
+//
+//  DataTierMgr places the data of data service (on hdd vdev) on a fast (ssd) vdev for the working set.
+//
+//  BlkIds handed out by data service are always allocated from the hdd vdev (home) and never change. An extent which
+//  is on fast tier is found through an indirection map from its home address to its blks on the fast vdev.
+//
+//  Fast tier is write-back: a write on a range on fast tier, or newly placed on it, is completed once it is on fast
+//  tier. Home is updated later by the background mover. Every extent on fast tier has a header blk of its own on fast
+//  tier, which records its home address and data blks. It is written once the data of a placed extent has landed
+//  and is zeroed before the extent is dropped, so the headers on fast tier are the persisted form of the map.
+//  Header blks are taken from a region of the fast tier set aside when it is first started, whose runs are recorded
+//  in the context of the fast vdev: recovery reads only the region and rebuilds the map from the valid headers.
+//  Recovered extents are treated as dirty, since it is not known which of them were written back.
+//
+//  Extent states:
+//  PROMOTING   : Being copied from home by the mover, no header yet. IOs go to home, writes abort the promotion.
+//  HDR_PENDING : Placed data or header in flight. Reads go to home, writes and frees are parked.
+//  ON_FAST     : Reads and writes go to fast tier.
+//  DROPPING    : Header being zeroed (demotion or free). Reads go to home, writes and frees are parked.
+//  Parked IOs are reissued once the extent leaves the state, on whatever the range is on by then.
+//
+//  Background mover runs on a reactor of its own, woken up by a timer every mover_interval_ms, and issues its IOs async
+//  so that it does not hold a thread while they are in flight. On every pass it:
+//  1. writes back the dirty extents not written in the last pass, a write racing with it keeps the extent dirty;
+//  2. demotes least recently accessed extents once the fast tier is used beyond its high watermark, writing them
+//     back first if they are dirty;
+//  3. promotes extents which are read often from home, while the fast tier is below its low watermark.
+//
+//  The map is sharded by ranges of home address, so that IOs on different ranges do not contend on one lock. An IO
+//  which spans ranges is split per range and extents never span ranges. Blks on fast tier are allocated outside the
+//  shard lock and the range is checked again before they are used.
+//
+// clang-format on
+//
+class DataTierMgr {
+public:
+    DataTierMgr(VirtualDev* home_vdev, VirtualDev* fast_vdev, uint32_t blk_size);
+    DataTierMgr(const DataTierMgr&) = delete;
+    DataTierMgr& operator=(const DataTierMgr&) = delete;
+    DataTierMgr(DataTierMgr&&) noexcept = delete;
+    DataTierMgr& operator=(DataTierMgr&&) noexcept = delete;
+    ~DataTierMgr();
+
+    /**
+     * @brief : rebuild the map from the extent headers on fast tier. Called on recovery before start and before the
+     * fast vdev is marked recovered, since it commits the blks of the extents found on the fast vdev.
+     */
+    void recover();
+
+    /**
+     * @brief : start the background mover. Sets aside the header region on fast tier, if it is started first time.
+     */
+    void start();
+
+    /**
+     * @brief : stop the background mover, once the pass it is in is done. Dirty extents stay on fast tier and are
+     * recovered on next boot.
+     */
+    void stop();
+
+    /**
+     * @brief : write the home blkid. Ranges on fast tier, or placed on it if fast tier has room, are written only on
+     * fast tier and the rest on home.
+     *
+     * @param iov : iovecs of the data to write, of total size of bid
+     * @param iovcnt : number of iovecs
+     * @param bid : home blkid to write
+     * @param cb : callback called once all the writes are completed, with the error of any failed write
+     * @param part_of_batch : is this write part of a batch;
+     */
+    void async_writev(const iovec* iov, int iovcnt, const BlkId& bid, const io_completion_cb_t& cb,
+                      bool part_of_batch);
+
+    /**
+     * @brief : read the home blkid, each of its ranges from the tier it is on. A failed read on fast tier is retried
+     * on home if the extent is written back.
+     *
+     * @param iov : iovecs to read into, of total size of bid
+     * @param iovcnt : number of iovecs
+     * @param bid : home blkid to read
+     * @param cb : callback called once all the reads are completed
+     * @param part_of_batch : is this read part of a batch;
+     */
+    void async_readv(iovec* iov, int iovcnt, const BlkId& bid, const io_completion_cb_t& cb, bool part_of_batch);
+
+    /**
+     * @brief : drop the fast tier extents within the home blkid which is being freed. Headers of the extents are
+     * zeroed before the callback, so that they are not recovered once the home blkid is reused.
+     *
+     * @param bid : home blkid freed
+     * @param cb : callback called once the extents are dropped, after which home blkid can be freed
+     */
+    void async_free_blk(const BlkId& bid, const std::function< void() >& cb);
+
+    /**
+     * @brief : run one pass of the mover on the mover reactor and wait for it to be done. Mover runs it every
+     * mover_interval_ms, tests call it to move extents at a point of their choice.
+     */
+    void run_mover_pass();
+
+private:
+    enum class extent_state : uint8_t { PROMOTING, HDR_PENDING, ON_FAST, DROPPING };
+
+    struct tier_extent {
+        uint64_t home_addr;
+        blk_count_t nblks;
+        BlkId hdr_bid;  // Header blk on fast tier
+        BlkId fast_bid; // Data blks on fast tier
+        std::atomic< extent_state > state;
+        std::atomic< uint32_t > outstanding_ios{0}; // Reads and write back on its fast copy, holds off its demotion
+        std::atomic< uint32_t > inflight_writes{0}; // Writes on its fast copy, holds off its write back
+        std::atomic< uint64_t > write_gen{0};       // Bumped by every write on it
+        std::atomic< uint64_t > clean_gen{0};       // write_gen as of the last write back, dirty if not same
+        std::atomic< uint64_t > last_access{0};     // Mover pass in which it was last accessed
+        std::atomic< bool > failed{false};          // An IO on its fast copy failed, it is dropped by the mover
+
+        std::mutex park_mtx;
+        std::vector< std::function< void() > > parked; // IOs waiting for it to leave HDR_PENDING or DROPPING
+
+        tier_extent(uint64_t addr, blk_count_t n, const BlkId& hbid, const BlkId& fbid, extent_state st) :
+                home_addr{addr}, nblks{n}, hdr_bid{hbid}, fast_bid{fbid}, state{st} {}
+        uint64_t end_addr() const { return home_addr + nblks; }
+        bool is_dirty() const { return write_gen.load() != clean_gen.load(); }
+        bool is_transient() const {
+            auto const st = state.load();
+            return (st == extent_state::HDR_PENDING) || (st == extent_state::DROPPING);
+        }
+    };
+    using tier_extent_ptr = std::shared_ptr< tier_extent >;
+
+    // Persisted header of an extent, in the first bytes of its header blk on fast tier
+#pragma pack(1)
+    struct tier_extent_header {
+        static constexpr uint64_t s_magic{0x5449455245585431}; // "TIEREXT1"
+        static constexpr uint32_t s_version{1};
+
+        uint64_t magic{s_magic};
+        uint32_t version{s_version};
+        uint32_t tier_id{0};     // Of the fast vdev, so that headers of an earlier format are not picked up
+        uint64_t seq{0};         // Newer extent wins, if headers of overlapping extents are found on recovery
+        uint64_t home_addr{0};
+        uint64_t fast_bid{0};    // Data blks on fast tier
+        blk_count_t nblks{0};
+        crc32_t crc{0};          // Of the header with crc as 0
+    };
+#pragma pack()
+
+    // Home address ranges of this many blks are in one shard of the map
+    static constexpr uint64_t s_shard_range_blks{1ul << 16};
+    static constexpr uint32_t s_num_shards{64};
+
+    struct map_shard {
+        mutable std::shared_mutex mtx;
+        std::map< uint64_t, tier_extent_ptr > extents; // home address -> extent on fast tier
+
+        // Writes in flight on home for ranges with no extent, taken with mtx held (shared or exclusive). A promotion
+        // is not started on a range with a home write in flight, since its copy could miss the write.
+        std::mutex home_writes_mtx;
+        std::multimap< uint64_t, uint64_t > home_writes; // start -> end address
+
+        // Reads served from home, of the blkids starting in this shard, to find the extents to promote
+        std::mutex stats_mtx;
+        std::unordered_map< uint64_t, uint32_t > home_read_counts; // home blkid -> reads since its last decay
+    };
+
+    enum class seg_kind : uint8_t { HOME, FAST, PLACE, PARK };
+
+    // A part of an IO which is entirely on one of the tiers
+    struct tier_segment {
+        uint64_t addr{0}; // Home address of the segment
+        blk_count_t nblks{0};
+        uint32_t blk_offset{0}; // Offset in blks from the start of IO
+        seg_kind kind{seg_kind::HOME};
+        tier_extent_ptr ext; // nullptr if the segment is only on home
+        std::vector< iovec > iovs;
+    };
+    using tier_segments_ptr = std::shared_ptr< std::vector< tier_segment > >;
+    struct tier_io_ctx;
+
+    struct fast_blks {
+        uint64_t addr{0};
+        blk_count_t nblks{0};
+        BlkId hdr_bid;
+        BlkId fast_bid;
+    };
+
+    static uint64_t to_addr(const BlkId& bid) {
+        return (uint64_cast(bid.get_chunk_num()) << 32) | uint64_cast(bid.get_blk_num());
+    }
+    static BlkId to_home_bid(uint64_t addr, blk_count_t nblks) {
+        return BlkId{s_cast< blk_num_t >(addr & 0xFFFFFFFF), nblks, s_cast< chunk_num_t >(addr >> 32)};
+    }
+    static BlkId fast_bid_of(const tier_extent& ext, uint64_t addr, blk_count_t nblks) {
+        return BlkId{s_cast< blk_num_t >(ext.fast_bid.get_blk_num() + (addr - ext.home_addr)), nblks,
+                     ext.fast_bid.get_chunk_num()};
+    }
+    map_shard& shard_of(uint64_t addr) { return m_shards[(addr / s_shard_range_blks) % s_num_shards]; }
+    template < typename FnT >
+    static void for_each_shard_range(const BlkId& bid, FnT&& fn);
+
+    void split_into_segments(map_shard& shard, uint64_t addr, blk_count_t nblks, std::vector< tier_segment >& segs);
+    void create_hdr_region();
+    bool alloc_fast_blks(blk_count_t nblks, fast_blks& out);
+    void free_hdr_blk(const BlkId& hdr_bid);
+    void free_fast_blks(const BlkId& hdr_bid, const BlkId& fast_bid);
+    uint8_t* make_header(const tier_extent& ext);
+    void park(const tier_extent_ptr& ext, std::function< void() >&& fn);
+    void unpark(const tier_extent_ptr& ext);
+
+    void write_range(const std::shared_ptr< tier_io_ctx >& ctx, std::vector< iovec > iovs, uint64_t addr,
+                     blk_count_t nblks, bool part_of_batch);
+    void abort_placement(map_shard& shard, const tier_extent_ptr& ext);
+    void complete_placement(map_shard& shard, const tier_extent_ptr& ext, bool success);
+    void read_range(const std::shared_ptr< tier_io_ctx >& ctx, std::vector< iovec > iovs, uint64_t addr,
+                    blk_count_t nblks, bool part_of_batch);
+    void issue_segment_read(const std::shared_ptr< tier_io_ctx >& ctx, const tier_segments_ptr& segs, size_t idx,
+                            bool part_of_batch);
+    void complete_io(const std::shared_ptr< tier_io_ctx >& ctx);
+    void free_range(uint64_t addr, blk_count_t nblks, const std::function< void() >& done);
+    void finish_drop(map_shard& shard, const tier_extent_ptr& ext, bool invalidated);
+    void record_home_read(const BlkId& bid);
+    uint32_t fast_used_pct() const;
+
+    // Steps of the mover issue their IOs async and call the callback with the outcome once they are done. They return
+    // false, without calling it, if there was nothing to issue.
+    using mover_cb_t = std::function< void(bool /* success */) >;
+    struct mover_pass;
+    using mover_pass_ptr = std::shared_ptr< mover_pass >;
+
+    void arm_mover_timer();
+    void on_mover_timer();
+    void start_mover_pass(std::function< void() >&& done);
+    void finish_mover_pass(const mover_pass_ptr& pass);
+    void destage_dirty_extents(const mover_pass_ptr& pass);
+    void destage_next(const mover_pass_ptr& pass);
+    bool destage_extent(const tier_extent_ptr& ext, const mover_cb_t& cb);
+    void demote_cold_extents(const mover_pass_ptr& pass);
+    void demote_next(const mover_pass_ptr& pass);
+    bool drop_extent(const tier_extent_ptr& ext, const mover_cb_t& cb);
+    void promote_hot_extents(const mover_pass_ptr& pass);
+    void promote_next(const mover_pass_ptr& pass);
+    bool promote_extent(const BlkId& home_bid, const mover_cb_t& cb);
+    void seal_promotion(map_shard& shard, const tier_extent_ptr& ext, const BlkId& home_bid, const mover_cb_t& cb);
+    void abort_promotion(const tier_extent_ptr& ext);
+    void update_gauges();
+
+private:
+    VirtualDev* m_home_vdev;
+    VirtualDev* m_fast_vdev;
+    uint32_t m_blk_size;
+    uint32_t m_tier_id{0};
+
+    std::array< map_shard, s_num_shards > m_shards;
+    std::atomic< uint64_t > m_next_seq{1};
+    std::atomic< uint64_t > m_fast_used_blks{0};
+    uint64_t m_fast_total_blks{0}; // Data blks on fast tier, outside the header region
+
+    std::vector< BlkId > m_hdr_runs; // Runs of blks of the header region
+    uint64_t m_nhdr_blks{0};
+    std::mutex m_hdr_mtx;
+    std::vector< BlkId > m_free_hdr_blks; // Header blks not used by any extent
+    std::atomic< uint64_t > m_free_hdr_blks_count{0};
+    uint8_t* m_zero_blk{nullptr}; // Written on the header blk of an extent being dropped
+
+    std::atomic< uint64_t > m_cur_pass{0};
+    std::mutex m_mover_mtx;
+    std::condition_variable m_mover_cv;
+    bool m_mover_stop{false};
+    bool m_pass_running{false}; // Serializes the passes run on timer with the ones run by tests
+    iomgr::io_thread_t m_mover_thread{nullptr};
+    iomgr::timer_handle_t m_mover_timer_hdl{iomgr::null_timer_handle};
+
+    DataTierMetrics m_metrics;
+};
+} // namespace homestore
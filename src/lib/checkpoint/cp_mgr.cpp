@@ -18,9 +18,11 @@
 #include <homestore/homestore.hpp>
 #include <homestore/meta_service.hpp>
 #include <homestore/checkpoint/cp_mgr.hpp>
+#include <homestore/homestore_probes.hpp>
 
 #include "common/homestore_assert.hpp"
 #include "common/homestore_config.hpp"
+#include "common/io_trace.hpp"
 #include "cp.hpp"
 
 namespace homestore {
@@ -133,6 +135,7 @@ void CPManager::trigger_cp_flush(cp_done_cb_t&& cb, bool force) {
         HS_PERIODIC_LOG(INFO, cp, "<<<<<<<<<<< Triggering flush of the CP {}", cur_cp->to_string());
         COUNTER_INCREMENT(*m_metrics, cp_cnt, 1);
         m_cp_start_time = Clock::now();
+        HS_PROBE(cp_phase, cur_cp->id(), s_cast< uint8_t >(cur_cp->m_cp_status), 0);
 
         /* allocate a new cp */
         auto new_cp = new CP(this);
@@ -150,10 +153,13 @@ void CPManager::trigger_cp_flush(cp_done_cb_t&& cb, bool force) {
             HS_PERIODIC_LOG(DEBUG, cp, "CP Attached completed, proceed to exit cp critical section");
             cur_cp->m_done_cb = cb;
             cur_cp->m_cp_status = cp_status_t::cp_flush_prepare;
+            HS_PROBE(cp_phase, cur_cp->id(), s_cast< uint8_t >(cur_cp->m_cp_status),
+                     get_elapsed_time_us(m_cp_start_time));
             new_cp->m_cp_status = cp_status_t::cp_io_ready;
             rcu_xchg_pointer(&m_cur_cp, new_cp);
             synchronize_rcu();
         }
+        IOTrace::record(io_trace_event_t::cp_switchover, cur_cp->id());
         // At this point we are sure that there is no thread working on prev_cp without incrementing the cp_enter cnt
     }
     HS_PERIODIC_LOG(DEBUG, cp, "CP critical section done, doing cp_io_exit");
@@ -162,6 +168,8 @@ void CPManager::trigger_cp_flush(cp_done_cb_t&& cb, bool force) {
 void CPManager::cp_start_flush(CP* cp) {
     HS_PERIODIC_LOG(INFO, cp, "Starting CP {} flush", cp->id());
     cp->m_cp_status = cp_status_t::cp_flushing;
+    HS_PROBE(cp_phase, cp->id(), s_cast< uint8_t >(cp->m_cp_status), get_elapsed_time_us(m_cp_start_time));
+    IOTrace::record(io_trace_event_t::cp_flush_start, cp->id());
     m_cp_flush_waiters.increment();
     for (auto& consumer : m_cp_cb_table) {
         if (consumer) {
@@ -184,6 +192,8 @@ void CPManager::cp_start_flush(CP* cp) {
 void CPManager::on_cp_flush_done(CP* cp) {
     HS_DBG_ASSERT_EQ(cp->m_cp_status, cp_status_t::cp_flushing);
     cp->m_cp_status = cp_status_t::cp_flush_done;
+    HS_PROBE(cp_phase, cp->id(), s_cast< uint8_t >(cp->m_cp_status), get_elapsed_time_us(m_cp_start_time));
+    IOTrace::record(io_trace_event_t::cp_flush_done, cp->id());
 
     // Persist the superblock with this flushed cp information
     ++(m_sb->m_last_flushed_cp);
@@ -212,6 +222,7 @@ void CPManager::on_cp_flush_done(CP* cp) {
 
 void CPManager::cleanup_cp(CP* cp) {
     cp->m_cp_status = cp_status_t::cp_cleaning;
+    HS_PROBE(cp_phase, cp->id(), s_cast< uint8_t >(cp->m_cp_status), get_elapsed_time_us(m_cp_start_time));
     for (auto& consumer : m_cp_cb_table) {
         if (consumer) { consumer->cp_cleanup(cp); }
     }
@@ -26,6 +26,8 @@ std::string homstore_err_category::message(int ev) const {
         return "lba not exist in mapping table";
     case homestore_error::cache_full:
         return "cache full";
+    case homestore_error::log_group_corrupted:
+        return "log group corrupted";
     }
     return "unknown error";
 }
@@ -41,7 +41,8 @@ enum homestore_error {
     flip_comp_error = 16,
     invalid_chunk_size = 17,
     cache_full = 18,
-    btree_crc_mismatch = 19
+    btree_crc_mismatch = 19,
+    log_group_corrupted = 20
 };
 
 class homstore_err_category : public std::error_category {
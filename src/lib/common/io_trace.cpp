@@ -0,0 +1,140 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#include "io_trace.hpp"
+
+#include <pthread.h>
+
+#include <algorithm>
+
+namespace homestore {
+
+std::atomic< bool > IOTrace::s_enabled{false};
+std::atomic< uint32_t > IOTrace::s_ring_size{16384};
+std::mutex IOTrace::s_rings_mtx;
+std::vector< std::shared_ptr< IOTraceRing > > IOTrace::s_rings;
+uint32_t IOTrace::s_retired_count{0};
+
+static uint32_t round_up_pow2(uint32_t n) {
+    uint32_t p{1};
+    while (p < n) {
+        p <<= 1;
+    }
+    return p;
+}
+
+IOTraceRing::IOTraceRing(uint32_t size, std::string thread_name) :
+        m_slots{new slot_t[round_up_pow2(std::max(size, 2u))]},
+        m_mask{round_up_pow2(std::max(size, 2u)) - 1},
+        m_thread_name{std::move(thread_name)} {}
+
+uint64_t IOTraceRing::snapshot(std::vector< io_trace_record >& out) const {
+    auto const cap = uint64_t{m_mask} + 1;
+    auto const head = m_head.load(std::memory_order_acquire);
+    auto const start = (head > cap) ? (head - cap) : 0;
+
+    std::vector< io_trace_record > copy;
+    copy.reserve(head - start);
+    for (auto i = start; i < head; ++i) {
+        const auto& slot = m_slots[i & m_mask];
+        auto const expected_seq = 2 * (i + 1);
+        uint64_t words[slot_words];
+        if (slot.seq.load(std::memory_order_acquire) != expected_seq) {
+            // Writer has moved on to a later record in this slot; records before it are overwritten as well
+            copy.clear();
+            continue;
+        }
+        for (uint32_t w{0}; w < slot_words; ++w) {
+            words[w] = slot.words[w].load(std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.seq.load(std::memory_order_relaxed) != expected_seq) {
+            copy.clear();
+            continue;
+        }
+        std::memcpy(&copy.emplace_back(), words, sizeof(words));
+    }
+    out.insert(out.end(), copy.begin(), copy.end());
+    return head;
+}
+
+// Retires the ring of the thread when it exits
+struct io_trace_ring_holder {
+    std::shared_ptr< IOTraceRing > ring;
+    ~io_trace_ring_holder() {
+        if (ring) { IOTrace::retire_ring(ring); }
+    }
+};
+
+IOTraceRing& IOTrace::thread_ring() {
+    static thread_local io_trace_ring_holder t_holder;
+    if (!t_holder.ring) {
+        char name[64]{};
+        if (pthread_getname_np(pthread_self(), name, sizeof(name)) != 0) { name[0] = '\0'; }
+        t_holder.ring = std::make_shared< IOTraceRing >(s_ring_size.load(std::memory_order_relaxed), name);
+
+        std::unique_lock lg{s_rings_mtx};
+        s_rings.push_back(t_holder.ring);
+    }
+    return *t_holder.ring;
+}
+
+void IOTrace::retire_ring(const std::shared_ptr< IOTraceRing >& ring) {
+    std::unique_lock lg{s_rings_mtx};
+    ring->set_exited();
+    if (++s_retired_count <= max_retired_rings) { return; }
+
+    // Free the oldest retired ring. A dump in progress holds its own reference and frees it once done.
+    auto it = std::find_if(s_rings.begin(), s_rings.end(), [](const auto& r) { return r->is_exited(); });
+    s_rings.erase(it);
+    --s_retired_count;
+}
+
+nlohmann::json IOTrace::dump(int verbosity_level) {
+    std::vector< std::shared_ptr< IOTraceRing > > rings;
+    {
+        std::unique_lock lg{s_rings_mtx};
+        rings = s_rings;
+    }
+
+    nlohmann::json js;
+    js["enabled"] = is_enabled();
+    js["clock"] = "steady_ns";
+    js["threads"] = nlohmann::json::array();
+
+    std::vector< io_trace_record > recs;
+    for (size_t t{0}; t < rings.size(); ++t) {
+        recs.clear();
+        auto const total = rings[t]->snapshot(recs);
+
+        nlohmann::json tjs;
+        tjs["thread_idx"] = t;
+        tjs["thread_name"] = rings[t]->thread_name();
+        tjs["exited"] = rings[t]->is_exited();
+        tjs["total_recorded"] = total;
+        tjs["records_present"] = recs.size();
+        if (verbosity_level > 0) {
+            // Each record as [ts_ns, event, id, arg, op] to keep the dump compact
+            auto events = nlohmann::json::array();
+            for (const auto& r : recs) {
+                events.push_back(nlohmann::json::array({r.ts_ns, enum_name(r.event), r.id, r.arg, r.op}));
+            }
+            tjs["events"] = std::move(events);
+        }
+        js["threads"].push_back(std::move(tjs));
+    }
+    return js;
+}
+
+} // namespace homestore
@@ -0,0 +1,155 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+#include <sisl/utility/enum.hpp>
+
+namespace homestore {
+
+ENUM(io_trace_event_t, uint8_t,
+     vdev_queued,           // IO is queued as the pdev is at its queue depth limit; id = request id
+     vdev_submit,           // IO issued to the drive (after admission on the pdev queue depth); id = request id
+     vdev_device_complete,  // Drive completed the IO; id = request id
+     vdev_callback_done,    // Caller callback of the IO returned; id = request id
+     logdev_flush_start,    // Log group write issued; id = first log idx of the group
+     logdev_flush_done,     // Log group write completed and appends are called back; id = first log idx
+     cp_switchover,         // New cp is attached; id = cp id being flushed
+     cp_flush_start,        // Consumers are asked to flush the cp; id = cp id
+     cp_flush_done,         // All consumers flushed the cp; id = cp id
+     btree_node_read_start, // Btree node is read from the drive on cache miss; id = node id
+     btree_node_read_done   // Btree node read completed; id = node id
+);
+
+struct io_trace_record {
+    uint64_t ts_ns{0};  // steady clock time in ns, comparable across threads
+    uint64_t id{0};     // id of the IO/request the event is about, see io_trace_event_t
+    uint32_t arg{0};    // size of the IO in bytes where it applies
+    io_trace_event_t event{io_trace_event_t::vdev_submit};
+    uint8_t op{0};      // vdev_op_type_t for vdev events
+    uint16_t pad{0};
+};
+
+/*
+ * Ring of trace records of a thread. It has a single writer (the owning thread), which never blocks nor waits on the
+ * reader. Each slot carries the sequence of the record in it, which the writer makes odd while it is writing the slot
+ * and sets to 2 * (index + 1) once done. A reader copies the ring without any lock and keeps a slot only if its
+ * sequence is that of the expected record, before and after the copy.
+ */
+class IOTraceRing {
+public:
+    IOTraceRing(uint32_t size, std::string thread_name);
+
+    void record(const io_trace_record& rec) {
+        auto const h = m_head.load(std::memory_order_relaxed);
+        auto& slot = m_slots[h & m_mask];
+        uint64_t words[slot_words];
+        std::memcpy(words, &rec, sizeof(words));
+
+        slot.seq.store((2 * h) + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for (uint32_t w{0}; w < slot_words; ++w) {
+            slot.words[w].store(words[w], std::memory_order_relaxed);
+        }
+        slot.seq.store(2 * (h + 1), std::memory_order_release);
+        m_head.store(h + 1, std::memory_order_release);
+    }
+
+    /// @brief Copies the records present in the ring in the order they were recorded and returns the total number of
+    /// records recorded so far (including those overwritten)
+    uint64_t snapshot(std::vector< io_trace_record >& out) const;
+
+    const std::string& thread_name() const { return m_thread_name; }
+    uint32_t capacity() const { return m_mask + 1; }
+
+    void set_exited() { m_exited.store(true, std::memory_order_relaxed); }
+    bool is_exited() const { return m_exited.load(std::memory_order_relaxed); }
+
+private:
+    static constexpr uint32_t slot_words{sizeof(io_trace_record) / sizeof(uint64_t)};
+    static_assert(sizeof(io_trace_record) == slot_words * sizeof(uint64_t), "Record should be whole 64 bit words");
+
+    struct slot_t {
+        std::atomic< uint64_t > seq{0};
+        std::atomic< uint64_t > words[slot_words]{};
+    };
+
+    std::unique_ptr< slot_t[] > m_slots;
+    uint32_t m_mask;
+    std::atomic< uint64_t > m_head{0};
+    std::atomic< bool > m_exited{false};
+    std::string m_thread_name;
+};
+
+struct io_trace_ring_holder;
+
+/*
+ * IOTrace: low overhead tracing of the IO path, to break down the latency of IOs into the time spent in
+ * allocation/queueing, on the drive and in the completion handling, along with the timeline of logdev flushes, cp
+ * phases and btree node reads. It is off by default (generic.io_trace_enabled).
+ *
+ * Every thread records into its own ring (created on its first event), so recording is a few stores without any
+ * atomic RMW or lock. Ring of a thread is retired when it exits; the latest max_retired_rings retired rings are kept,
+ * so that the events of short lived threads are still dumped, and older ones are freed. Dump is exposed as the
+ * "IOTrace" module of HomeStoreStatusMgr, which can be fed to the io_trace_analyzer tool.
+ */
+class IOTrace {
+public:
+    static void record(io_trace_event_t event, uint64_t id, uint32_t arg = 0, uint8_t op = 0) {
+        if (!s_enabled.load(std::memory_order_relaxed)) { return; }
+        thread_ring().record(io_trace_record{now_ns(), id, arg, event, op, 0});
+    }
+
+    static void set_enabled(bool enabled) { s_enabled.store(enabled, std::memory_order_relaxed); }
+    static bool is_enabled() { return s_enabled.load(std::memory_order_relaxed); }
+
+    /// @brief Sets the number of records each thread ring holds (rounded up to power of 2). It only applies to the
+    /// rings created after this call.
+    static void set_ring_size(uint32_t size) { s_ring_size.store(size, std::memory_order_relaxed); }
+
+    /// @brief Dump of all the rings. verbosity_level 0 dumps only the number of records per thread, higher levels dump
+    /// the records as well
+    static nlohmann::json dump(int verbosity_level);
+
+private:
+    friend struct io_trace_ring_holder;
+
+    static uint64_t now_ns() {
+        return std::chrono::duration_cast< std::chrono::nanoseconds >(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+    }
+    static IOTraceRing& thread_ring();
+    static void retire_ring(const std::shared_ptr< IOTraceRing >& ring);
+
+private:
+    static constexpr uint32_t max_retired_rings{16};
+
+    static std::atomic< bool > s_enabled;
+    static std::atomic< uint32_t > s_ring_size;
+    static std::mutex s_rings_mtx;
+    static std::vector< std::shared_ptr< IOTraceRing > > s_rings; // In the order of creation
+    static uint32_t s_retired_count;
+};
+
+} // namespace homestore
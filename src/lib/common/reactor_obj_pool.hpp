@@ -0,0 +1,87 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#pragma once
+#include <cstddef>
+#include <new>
+#include <utility>
+
+namespace homestore {
+
+/*
+ * Pool of objects of type T for the per IO contexts, kept per reactor (thread), so that neither allocation nor free
+ * takes any lock or atomic. Memory of each object is aligned to alignof(T), which per IO contexts declare as the cache
+ * line size, so that contexts of different reactors never share a cache line.
+ *
+ * An object freed on a reactor other than the one it was allocated on is cached on the freeing reactor. Each reactor
+ * caches upto MaxCached objects and frees the rest to the heap.
+ */
+template < typename T, size_t MaxCached = 4096 >
+class ReactorObjPool {
+public:
+    template < typename... Args >
+    static T* make_object(Args&&... args) {
+        auto& fl = free_list();
+        void* mem;
+        if (fl.head) {
+            mem = fl.head;
+            fl.head = fl.head->next;
+            --fl.count;
+        } else {
+            mem = ::operator new(sizeof(T), std::align_val_t{alignof(T)});
+        }
+        return new (mem) T(std::forward< Args >(args)...);
+    }
+
+    static void deallocate(T* obj) {
+        obj->~T();
+        auto& fl = free_list();
+        if (fl.count >= MaxCached) {
+            ::operator delete(static_cast< void* >(obj), std::align_val_t{alignof(T)});
+            return;
+        }
+        auto* n = reinterpret_cast< free_node* >(obj);
+        n->next = fl.head;
+        fl.head = n;
+        ++fl.count;
+    }
+
+    static size_t cached_count() { return free_list().count; }
+
+private:
+    struct free_node {
+        free_node* next;
+    };
+    static_assert(sizeof(T) >= sizeof(free_node), "Pooled object should be big enough to hold the free list link");
+
+    struct reactor_free_list {
+        free_node* head{nullptr};
+        size_t count{0};
+
+        ~reactor_free_list() {
+            while (head) {
+                auto* n = head;
+                head = head->next;
+                ::operator delete(static_cast< void* >(n), std::align_val_t{alignof(T)});
+            }
+        }
+    };
+
+    static reactor_free_list& free_list() {
+        static thread_local reactor_free_list s_free_list;
+        return s_free_list;
+    }
+};
+
+} // namespace homestore
@@ -33,6 +33,7 @@
 #include <boost/uuid/uuid_io.hpp>         // streaming operators etc.
 #include <iomgr/iomgr.hpp>
 #include <sisl/logging/logging.h>
+#include <sisl/metrics/metrics.hpp>
 #include <sisl/fds/sparse_vector.hpp>
 #include <sisl/fds/utils.hpp>
 
@@ -57,6 +58,28 @@ class PhysicalDevChunk;
 class PhysicalDev;
 struct meta_blk;
 
+/* Time taken by each phase of the device startup, to find out which of them dominates the restart time */
+class DeviceManagerMetrics : public sisl::MetricsGroupWrapper {
+public:
+    explicit DeviceManagerMetrics() : sisl::MetricsGroupWrapper{"DeviceManager", "DeviceManager"} {
+        REGISTER_GAUGE(dm_probe_devices_ms, "Time to probe the superblocks of all devices in ms");
+        REGISTER_GAUGE(dm_format_devices_ms, "Time to format all devices on first boot in ms");
+        REGISTER_GAUGE(dm_load_devices_ms, "Time to open and validate the superblocks of all devices in ms");
+        REGISTER_GAUGE(dm_read_info_blocks_ms, "Time to read the device manager info blocks in ms");
+        REGISTER_GAUGE(dm_scan_chunks_ms, "Time to scan the chunks of all devices in ms");
+        REGISTER_GAUGE(dm_load_vdevs_ms, "Time to load all vdevs in ms");
+
+        register_me_to_farm();
+    }
+
+    DeviceManagerMetrics(const DeviceManagerMetrics&) = delete;
+    DeviceManagerMetrics(DeviceManagerMetrics&&) noexcept = delete;
+    DeviceManagerMetrics& operator=(const DeviceManagerMetrics&) = delete;
+    DeviceManagerMetrics& operator=(DeviceManagerMetrics&&) noexcept = delete;
+
+    ~DeviceManagerMetrics() { deregister_me_from_farm(); }
+};
+
 class DeviceManager {
     // forward declarations
     struct dm_derived_type;
@@ -102,7 +125,6 @@ public:
         std::vector< PhysicalDev* > vec;
         {
             std::lock_guard< decltype(m_dev_mutex) > lock{m_dev_mutex};
-            vec.reserve(m_data_pdevs.size());
             for (auto& pdev : m_data_pdevs) {
                 if (pdev) { vec.push_back(pdev.get()); }
             }
@@ -124,6 +146,14 @@ public:
     /* Free up the vdev_id */
     void free_vdev(vdev_info_block* vb);
 
+    /* Grow the vdev by the given number of primary chunks and size and persist its info block */
+    void expand_vdev(vdev_info_block* vb, uint32_t addln_primary_chunks, uint64_t addln_size);
+
+    /* Add a new device to a running homestore. The device is formatted with the system uuid of the existing devices
+     * and is available to the vdevs to expand on. Caller is expected to serialize it with other management operations
+     * and to pass the device in data devices on the subsequent boots. */
+    PhysicalDev* add_device(const dev_info& dinfo);
+
     /* Given an ID, get the chunk */
     const PhysicalDevChunk* get_chunk(uint32_t chunk_id) const;
     PhysicalDevChunk* get_chunk_mutable(uint32_t chunk_id);
@@ -142,6 +172,7 @@ public:
     void close_devices();
     bool is_first_time_boot() const { return m_first_time_boot; }
     std::vector< PhysicalDev* > get_devices(PhysicalDevGroup pdev_group) const;
+    bool has_devices(PhysicalDevGroup pdev_group) const;
     // void zero_pdev_sbs();
 
     bool is_hdd(const std::string& devname) const;
@@ -212,8 +243,10 @@ private:
     bool m_scan_cmpltd{false};
     vdev_error_callback m_vdev_error_cb;
     bool m_first_time_boot{true};
+    uint64_t m_probe_ms{0}; // Time taken to probe the devices at construction, logged with the startup timeline
     hs_uuid_t m_data_system_uuid{INVALID_SYSTEM_UUID};
     uint32_t m_num_sys_chunks{0};
+    DeviceManagerMetrics m_metrics;
 }; // class DeviceManager
 
 } // namespace homestore
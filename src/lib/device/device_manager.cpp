@@ -13,9 +13,11 @@
  * specific language governing permissions and limitations under the License.
  *
  *********************************************************************************/
+#include <algorithm>
 #include <cassert>
 #include <cstring>
 #include <ctime>
+#include <future>
 
 #ifdef __linux__
 #include <sys/stat.h>
@@ -41,6 +43,46 @@ namespace homestore {
 
 std::atomic< uint64_t > vdev_req_context::s_req_id{0};
 
+// Each reactor takes a range of request ids at a time from the global counter, so that issuing an IO does not need an
+// atomic on a cache line shared by all the reactors.
+uint64_t vdev_req_context::next_request_id() {
+    static constexpr uint64_t req_ids_per_range{1ul << 16};
+    static thread_local uint64_t t_next_id{0};
+    static thread_local uint64_t t_range_end{0};
+
+    if (t_next_id == t_range_end) {
+        t_next_id = s_req_id.fetch_add(req_ids_per_range, std::memory_order_relaxed);
+        t_range_end = t_next_id + req_ids_per_range;
+    }
+    return t_next_id++;
+}
+
+// Runs fn on each of the devices in parallel, each on its own thread, since opening a device and reading its blocks
+// are blocking calls. Returns the results in the order of devices. Exception thrown by any of them is rethrown, after
+// all of them are done.
+template < typename Fn >
+static auto run_on_devices_parallel(const std::vector< dev_info >& devices, Fn&& fn) {
+    using result_t = decltype(fn(devices.front()));
+    std::vector< std::future< result_t > > futs;
+    futs.reserve(devices.size());
+    for (const auto& d : devices) {
+        futs.emplace_back(std::async(std::launch::async, [&fn, &d]() { return fn(d); }));
+    }
+
+    std::vector< result_t > results;
+    results.reserve(devices.size());
+    std::exception_ptr eptr;
+    for (auto& f : futs) {
+        try {
+            results.emplace_back(f.get());
+        } catch (...) {
+            if (!eptr) { eptr = std::current_exception(); }
+        }
+    }
+    if (eptr) { std::rethrow_exception(eptr); }
+    return results;
+}
+
 DeviceManager::DeviceManager(const std::vector< dev_info >& data_devices, NewVDevCallback vcb,
                              uint32_t vdev_metadata_size, iomgr::io_interface_comp_cb_t io_comp_cb,
                              vdev_error_callback vdev_error_cb) :
@@ -106,17 +148,40 @@ DeviceManager::DeviceManager(const std::vector< dev_info >& data_devices, NewVDe
         dm_derived.vdev_hdr = &dm_derived.info->vdev_hdr;
     };
 
-    uint32_t max_phys_page_size{0}, max_align_size{0};
-    for (const auto& d : m_data_devices) {
+    struct probe_result {
+        bool valid_sb{false};
+        hs_uuid_t system_uuid{INVALID_SYSTEM_UUID};
+        uint32_t page_size{0};
+        uint32_t align_size{0};
+    };
+    auto const probe_start_time = Clock::now();
+    auto const probe_results = run_on_devices_parallel(m_data_devices, [this](const dev_info& d) {
+        probe_result res;
         auto pdev = std::make_unique< PhysicalDev >(d.dev_names, get_device_open_flags(d.dev_names));
-        if (pdev->has_valid_superblock(m_data_system_uuid)) { m_first_time_boot = false; }
-        auto const page_size = pdev->page_size();
-        auto const align_size = pdev->align_size();
-        max_align_size = std::max(max_align_size, align_size);
-        max_phys_page_size = std::max(max_phys_page_size, page_size);
+        res.valid_sb = pdev->has_valid_superblock(res.system_uuid);
+        res.page_size = pdev->page_size();
+        res.align_size = pdev->align_size();
+        return res;
+    });
+
+    uint32_t max_phys_page_size{0}, max_align_size{0};
+    for (const auto& res : probe_results) {
+        if (res.valid_sb) {
+            m_first_time_boot = false;
+            m_data_system_uuid = res.system_uuid;
+        }
+        max_align_size = std::max(max_align_size, res.align_size);
+        max_phys_page_size = std::max(max_phys_page_size, res.page_size);
     }
+    m_probe_ms = get_elapsed_time_ms(probe_start_time);
+    GAUGE_UPDATE(m_metrics, dm_probe_devices_ms, m_probe_ms);
 
     initialize_memory_structures(&m_data_chunk_memory, m_data_dm_derived, max_phys_page_size, max_align_size);
+
+    // Size upto the max, so that adding a device or chunk online only fills its slot. The vectors are never resized
+    // after this and the IO path can look up the slots of published chunks and devices without any lock.
+    m_data_pdevs.resize(HS_STATIC_CONFIG(engine.max_pdevs));
+    m_data_chunks.resize(HS_STATIC_CONFIG(engine.max_chunks));
     m_scan_cmpltd = false;
 
     HS_LOG_ASSERT_LE(m_vdev_metadata_size, MAX_CONTEXT_DATA_SZ);
@@ -178,6 +243,8 @@ void DeviceManager::init_devices() {
     dm_derived.pdev_hdr->info_offset = static_cast< uint64_t >(reinterpret_cast< uint8_t* >(dm_derived.pdev_info) -
                                                                reinterpret_cast< uint8_t* >(dm_derived.info));
 
+    // Formatting allocates chunks on each device, which are not thread safe. So devices are formatted one by one.
+    auto const format_start_time = Clock::now();
     uint64_t max_dev_offset{0};
     for (const auto& d : m_data_devices) {
         bool is_inited;
@@ -198,6 +265,11 @@ void DeviceManager::init_devices() {
     m_last_data_pdev_id = m_pdev_id - 1;
     m_scan_cmpltd = true;
     write_info_blocks();
+    auto const format_ms = get_elapsed_time_ms(format_start_time);
+    GAUGE_UPDATE(m_metrics, dm_format_devices_ms, format_ms);
+
+    LOGINFO("Device startup timeline for {} devices: probe={} ms, format={} ms", m_data_devices.size(), m_probe_ms,
+            format_ms);
 }
 
 DeviceManager::~DeviceManager() {
@@ -247,12 +319,27 @@ void DeviceManager::load_and_repair_devices(const hs_uuid_t& sys_uuid) {
     auto* chunk_memory = get_chunk_memory();
     auto& dm_derived = get_dm_derived();
     auto& gen_count = get_gen_count();
-    for (const auto& d : m_data_devices) {
-        bool is_inited;
-        std::unique_ptr< PhysicalDev > pdev =
-            std::make_unique< PhysicalDev >(this, d.dev_names, get_device_open_flags(d.dev_names), sys_uuid,
-                                            INVALID_DEV_ID, 0, false, dm_derived.info_size, m_io_comp_cb, &is_inited);
-        if (!is_inited) {
+
+    // Open all the devices and load and validate their superblocks in parallel and then merge them in device order
+    struct loaded_dev {
+        std::unique_ptr< PhysicalDev > pdev;
+        bool is_inited{false};
+    };
+    auto const load_start_time = Clock::now();
+    auto loaded_devs = run_on_devices_parallel(m_data_devices, [this, &sys_uuid, &dm_derived](const dev_info& d) {
+        loaded_dev ld;
+        ld.pdev = std::make_unique< PhysicalDev >(this, d.dev_names, get_device_open_flags(d.dev_names), sys_uuid,
+                                                  INVALID_DEV_ID, 0, false, dm_derived.info_size, m_io_comp_cb,
+                                                  &ld.is_inited);
+        return ld;
+    });
+    auto const load_ms = get_elapsed_time_ms(load_start_time);
+    GAUGE_UPDATE(m_metrics, dm_load_devices_ms, load_ms);
+
+    for (size_t i{0}; i < m_data_devices.size(); ++i) {
+        const auto& d = m_data_devices[i];
+        auto& pdev = loaded_devs[i].pdev;
+        if (!loaded_devs[i].is_inited) {
             // Super block is not present, possibly a new device, will format the device later
             HS_LOG(CRITICAL, device,
                    "{} device {} appears to be not formatted. Will format it and replace it with the "
@@ -290,8 +377,11 @@ void DeviceManager::load_and_repair_devices(const hs_uuid_t& sys_uuid) {
 
     if (gen_count.load() == 0) { HS_REL_ASSERT(false, "no valid device found"); }
 
-    // load the info blocks
+    // load the info blocks. They are read only from the device which has the latest generation of them.
+    auto const read_info_start_time = Clock::now();
     read_info_blocks(device_id);
+    auto const read_info_ms = get_elapsed_time_ms(read_info_start_time);
+    GAUGE_UPDATE(m_metrics, dm_read_info_blocks_ms, read_info_ms);
 
     // TODO : If it is different then existing chunk in pdev superblock has to be deleted and new
     // has to be created
@@ -299,6 +389,7 @@ void DeviceManager::load_and_repair_devices(const hs_uuid_t& sys_uuid) {
     HS_LOG_ASSERT_EQ(dm_derived.info->get_version(), CURRENT_DM_INFO_VERSION);
 
     // scan and create all the chunks for all physical devices
+    auto const scan_start_time = Clock::now();
     uint32_t nchunks{0};
     for (uint32_t dev_id{0}; dev_id < dm_derived.pdev_hdr->num_phys_devs; ++dev_id) {
         auto* pdev = get_pdev(dev_id);
@@ -319,6 +410,8 @@ void DeviceManager::load_and_repair_devices(const hs_uuid_t& sys_uuid) {
     }
 
     HS_LOG_ASSERT_EQ(nchunks, dm_derived.chunk_hdr->get_num_chunks());
+    auto const scan_ms = get_elapsed_time_ms(scan_start_time);
+    GAUGE_UPDATE(m_metrics, dm_scan_chunks_ms, scan_ms);
 
     m_scan_cmpltd = true;
 
@@ -345,7 +438,14 @@ void DeviceManager::load_and_repair_devices(const hs_uuid_t& sys_uuid) {
     }};
 
     // create data vdevs
+    auto const vdevs_start_time = Clock::now();
     create_vdevs(data_rewrite);
+    auto const vdevs_ms = get_elapsed_time_ms(vdevs_start_time);
+    GAUGE_UPDATE(m_metrics, dm_load_vdevs_ms, vdevs_ms);
+
+    LOGINFO("Device startup timeline for {} devices: probe={} ms, load_devices={} ms, read_info_blocks={} ms, "
+            "scan_chunks={} ms, load_vdevs={} ms",
+            m_data_devices.size(), m_probe_ms, load_ms, read_info_ms, scan_ms, vdevs_ms);
 }
 
 void DeviceManager::handle_error(PhysicalDev* pdev) {
@@ -634,6 +734,66 @@ void DeviceManager::free_vdev(vdev_info_block* vb) {
     write_info_blocks();
 }
 
+void DeviceManager::expand_vdev(vdev_info_block* vb, uint32_t addln_primary_chunks, uint64_t addln_size) {
+    std::lock_guard< decltype(m_dev_mutex) > lock{m_dev_mutex};
+    vb->num_primary_chunks += addln_primary_chunks;
+    vb->size += addln_size;
+
+    HS_LOG(INFO, device, "Expanding vdev id = {} by {} chunks, new size = {}", vb->get_vdev_id(), addln_primary_chunks,
+           in_bytes(vb->get_size()));
+    write_info_blocks();
+}
+
+PhysicalDev* DeviceManager::add_device(const dev_info& dinfo) {
+    HS_REL_ASSERT_LT(m_pdev_id, HS_STATIC_CONFIG(engine.max_pdevs), "No free slot available to add device {}",
+                     dinfo.dev_names);
+    HS_REL_ASSERT_EQ(is_hdd(dinfo.dev_names), is_data_drive_hdd(), "Device {} is not of same type as other devices",
+                     dinfo.dev_names);
+
+    // New device is placed after all the existing devices and inherits their system uuid
+    uint64_t dev_offset{0};
+    hs_uuid_t sys_uuid{INVALID_SYSTEM_UUID};
+    for (auto* pdev : get_all_devices()) {
+        dev_offset = std::max(dev_offset, pdev->dev_offset() + pdev->size());
+        sys_uuid = pdev->sys_uuid();
+    }
+    HS_REL_ASSERT_NE(sys_uuid, INVALID_SYSTEM_UUID, "Device can be added only after homestore is initialized");
+
+    // Formatting the device allocates its superblock chunks. Defer writing the info blocks until the device is added
+    // to the pdev list, so that no info block refers to chunks of a device which is not in it.
+    m_scan_cmpltd = false;
+    auto& dm_derived = get_dm_derived();
+    bool is_inited;
+    std::unique_ptr< PhysicalDev > pdev;
+    try {
+        pdev = std::make_unique< PhysicalDev >(this, dinfo.dev_names, get_device_open_flags(dinfo.dev_names), sys_uuid,
+                                               m_pdev_id, dev_offset, true /* is_init */, dm_derived.info_size,
+                                               m_io_comp_cb, &is_inited);
+    } catch (const std::exception& e) {
+        LOGERROR("Failed to add device {}, error: {}", dinfo.dev_names, e.what());
+        m_scan_cmpltd = true;
+        throw;
+    }
+    LOGINFO("Adding device name: {}, dev_id: {} with system uuid: {} size {}", dinfo.dev_names, pdev->dev_id(),
+            std::ctime(&sys_uuid), in_bytes(pdev->size()));
+
+    auto* raw_pdev = pdev.get();
+    {
+        std::lock_guard< decltype(m_dev_mutex) > lock{m_dev_mutex};
+        auto const id = m_pdev_id++;
+        m_data_pdevs[id] = std::move(pdev);
+        dm_derived.pdev_info[id] = raw_pdev->get_info_blk();
+        ++(dm_derived.pdev_hdr->num_phys_devs);
+        m_last_data_pdev_id = id;
+
+        // Writes the info blocks on all devices including the new one, which also writes its superblock
+        m_scan_cmpltd = true;
+        write_info_blocks();
+    }
+    raw_pdev->init_done();
+    return raw_pdev;
+}
+
 const PhysicalDevChunk* DeviceManager::get_chunk(uint32_t chunk_id) const {
     return (chunk_id == INVALID_CHUNK_ID) ? nullptr : m_data_chunks[chunk_id].get();
 }
@@ -732,9 +892,9 @@ bool DeviceManager::is_hdd(const std::string& devname) const {
 std::vector< PhysicalDev* > DeviceManager::get_devices(const PhysicalDevGroup pdev_group) const {
     // go through all the devices
     std::vector< PhysicalDev* > vec;
-    vec.reserve(m_data_pdevs.size());
-
+    std::lock_guard< decltype(m_dev_mutex) > lock{m_dev_mutex};
     for (const auto& pdev : m_data_pdevs) {
+        if (!pdev) { continue; }
         if (is_data_drive_hdd()) {
             if (pdev_group == PhysicalDevGroup::DATA && pdev->is_hdd()) {
                 vec.push_back(pdev.get());
@@ -751,6 +911,15 @@ std::vector< PhysicalDev* > DeviceManager::get_devices(const PhysicalDevGroup pd
     return vec;
 }
 
+bool DeviceManager::has_devices(const PhysicalDevGroup pdev_group) const {
+    auto const any_dev = !is_data_drive_hdd();
+    auto const want_hdd = (pdev_group != PhysicalDevGroup::FAST);
+    std::lock_guard< decltype(m_dev_mutex) > lock{m_dev_mutex};
+    return std::any_of(m_data_pdevs.cbegin(), m_data_pdevs.cend(), [any_dev, want_hdd](const auto& pdev) {
+        return pdev && (any_dev || (pdev->is_hdd() == want_hdd));
+    });
+}
+
 size_t DeviceManager::total_cap(const PhysicalDevGroup pdev_group) const {
     auto const list = get_devices(pdev_group);
     uint64_t sz = 0;
@@ -762,8 +931,9 @@ size_t DeviceManager::total_cap(const PhysicalDevGroup pdev_group) const {
 
 size_t DeviceManager::total_cap() const {
     uint64_t sz = 0;
+    std::lock_guard< decltype(m_dev_mutex) > lock{m_dev_mutex};
     for (const auto& pdev : m_data_pdevs) {
-        sz += pdev->size();
+        if (pdev) { sz += pdev->size(); }
     }
     return sz;
 }
@@ -782,8 +952,9 @@ uint32_t DeviceManager::atomic_page_size(PhysicalDevGroup pdev_group) const {
 
 uint32_t DeviceManager::get_common_phys_page_sz() const {
     uint32_t max_page_size{0};
-
+    std::lock_guard< decltype(m_dev_mutex) > lock{m_dev_mutex};
     for (const auto& pdev : m_data_pdevs) {
+        if (!pdev) { continue; }
         auto const page_size = pdev->page_size();
         if (page_size == 0 || (page_size & (page_size - 1)) != 0) {
             HS_REL_ASSERT(0, "very odd page size {}", page_size);
@@ -796,7 +967,9 @@ uint32_t DeviceManager::get_common_phys_page_sz() const {
 
 uint32_t DeviceManager::get_common_align_sz() const {
     uint32_t max_align_size{0};
+    std::lock_guard< decltype(m_dev_mutex) > lock{m_dev_mutex};
     for (const auto& pdev : m_data_pdevs) {
+        if (!pdev) { continue; }
         auto const align_size = pdev->align_size();
         if (align_size == 0 || (align_size & (align_size - 1)) != 0) {
             HS_REL_ASSERT(0, "very odd align size {}", align_size);
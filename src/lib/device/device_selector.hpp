@@ -15,6 +15,9 @@
  *********************************************************************************/
 #pragma once
 
+#include <array>
+#include <atomic>
+#include <cstdint>
 #include <vector>
 #include <folly/ThreadLocal.h>
 #include "blkalloc/blk_allocator.h"
@@ -22,9 +25,21 @@
 namespace homestore {
 class PhysicalDev;
 
+/* Selects the device to allocate from, round robin across the devices by default. If weights are set, devices are
+ * selected in proportion to their weights instead, using a precomputed schedule in which the selections of a device
+ * are spread apart (smooth weighted round robin).
+ *
+ * select() can run concurrently with add_pdev() and set_weights(), which are expected to be serialized by caller. A
+ * select racing with them could pick from the old or new set of devices, both of which are valid.
+ */
 class RoundRobinDeviceSelector {
 public:
-    explicit RoundRobinDeviceSelector() { *m_last_dev_ind = 0; }
+    static constexpr uint32_t max_schedule_slots{1024};
+
+    explicit RoundRobinDeviceSelector() {
+        *m_last_dev_ind = 0;
+        *m_last_slot_ind = 0;
+    }
 
     RoundRobinDeviceSelector(const RoundRobinDeviceSelector&) = delete;
     RoundRobinDeviceSelector(RoundRobinDeviceSelector&&) noexcept = delete;
@@ -33,10 +48,55 @@ public:
 
     ~RoundRobinDeviceSelector() = default;
 
-    void add_pdev(const PhysicalDev* const pdev) { m_pdevs.push_back(pdev); }
+    void add_pdev(const PhysicalDev* const pdev) {
+        m_pdevs.push_back(pdev);
+        m_num_pdevs.store(static_cast< uint32_t >(m_pdevs.size()), std::memory_order_release);
+    }
+
+    /* Weight for each of the added pdevs in the order they are added. Empty weights resets to plain round robin */
+    void set_weights(const std::vector< uint64_t >& weights) {
+        if (weights.empty()) {
+            m_num_slots.store(0, std::memory_order_release);
+            return;
+        }
+
+        // Scale the weights to the schedule slots, so that every device gets at least one slot
+        const auto ndevs = static_cast< uint32_t >(weights.size());
+        uint64_t total_weight{0};
+        for (const auto w : weights) {
+            total_weight += w;
+        }
+        const uint64_t scale_slots = max_schedule_slots - ndevs;
+        std::vector< int64_t > slot_weights(ndevs);
+        int64_t nslots{0};
+        for (uint32_t i{0}; i < ndevs; ++i) {
+            slot_weights[i] = (total_weight == 0) ? 1 : static_cast< int64_t >(weights[i] * scale_slots / total_weight);
+            if (slot_weights[i] == 0) { slot_weights[i] = 1; }
+            nslots += slot_weights[i];
+        }
+
+        std::vector< int64_t > current(ndevs, 0);
+        for (int64_t slot{0}; slot < nslots; ++slot) {
+            uint32_t best{0};
+            for (uint32_t i{0}; i < ndevs; ++i) {
+                current[i] += slot_weights[i];
+                if (current[i] > current[best]) { best = i; }
+            }
+            current[best] -= nslots;
+            m_schedule[slot].store(best, std::memory_order_relaxed);
+        }
+        m_num_slots.store(static_cast< uint32_t >(nslots), std::memory_order_release);
+    }
 
     uint32_t select(const blk_alloc_hints& hints) {
-        if (*m_last_dev_ind == (m_pdevs.size() - 1)) {
+        const auto nslots = m_num_slots.load(std::memory_order_acquire);
+        if (nslots != 0) {
+            *m_last_slot_ind = (*m_last_slot_ind + 1) % nslots;
+            return m_schedule[*m_last_slot_ind].load(std::memory_order_relaxed);
+        }
+
+        const auto npdevs = m_num_pdevs.load(std::memory_order_acquire);
+        if (*m_last_dev_ind >= (npdevs - 1)) {
             *m_last_dev_ind = 0;
         } else {
             ++(*m_last_dev_ind);
@@ -47,7 +107,12 @@ public:
 
 private:
     std::vector< const PhysicalDev* > m_pdevs;
+    std::atomic< uint32_t > m_num_pdevs{0};
     folly::ThreadLocal< uint32_t > m_last_dev_ind;
+
+    std::array< std::atomic< uint32_t >, max_schedule_slots > m_schedule{};
+    std::atomic< uint32_t > m_num_slots{0};
+    folly::ThreadLocal< uint32_t > m_last_slot_ind;
 };
 
 } // namespace homestore
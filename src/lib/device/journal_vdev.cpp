@@ -289,6 +289,21 @@ ssize_t JournalVirtualDev::sync_pread(uint8_t* buf, size_t size, off_t offset) {
     return sync_read_internal(r_cast< char* >(buf), size, pdev, pchunk, offset_in_dev);
 }
 
+void JournalVirtualDev::async_pread(uint8_t* buf, size_t size, off_t offset, vdev_io_comp_cb_t cb) {
+    uint32_t dev_id{0}, chunk_id{0};
+    off_t offset_in_chunk{0};
+
+    const uint64_t offset_in_dev = logical_to_dev_offset(offset, dev_id, chunk_id, offset_in_chunk);
+
+    // if the read count is acrossing chunk, only read what's left in this chunk
+    if (m_chunk_size - offset_in_chunk < size) { size = m_chunk_size - offset_in_chunk; }
+
+    auto* pdev = m_primary_pdev_chunks_list[dev_id].pdev;
+    auto* pchunk = m_primary_pdev_chunks_list[dev_id].chunks_in_pdev[chunk_id];
+
+    async_read_internal(r_cast< char* >(buf), size, pdev, pchunk, offset_in_dev, std::move(cb));
+}
+
 ssize_t JournalVirtualDev::sync_preadv(iovec* iov, int iovcnt, off_t offset) {
     uint32_t dev_id{0}, chunk_id{0};
     off_t offset_in_chunk{0};
@@ -161,6 +161,17 @@ public:
      */
     ssize_t sync_pread(uint8_t* buf, const size_t count_in, const off_t offset);
 
+    /**
+     * @brief : reads up to count bytes at offset into the buffer starting at buf asynchronously.
+     * The curosr is not updated. Same as sync_pread, read does not go across the chunk boundary.
+     *
+     * @param buf : the buffer that points to the read out data, which is expected to be valid till callback is called.
+     * @param count : size of buffer
+     * @param offset : the start offset to do read
+     * @param cb : callback upon completion of read, with error condition if any.
+     */
+    void async_pread(uint8_t* buf, size_t count, off_t offset, vdev_io_comp_cb_t cb);
+
     /**
      * @brief : read at offset and save output to iov.
      * We don't have a use case for external caller of preadv now, meaning iov will always have only 1 element;
@@ -296,6 +307,12 @@ public:
         return BlkAllocStatus::BLK_ALLOC_NONE;
     }
 
+    // Journal offsets are laid out across the chunks in pdev order, so adding chunks would move the existing offsets
+    uint64_t expand(uint64_t addln_size, bool rebalance = true) override {
+        HS_DBG_ASSERT(false, "Unsupported API for journalvdev");
+        return 0;
+    }
+
     BlkAllocStatus alloc_blk(uint32_t nblks, const blk_alloc_hints& hints, std::vector< BlkId >& out_blkid) override {
         HS_DBG_ASSERT(false, "Unsupported API for journalvdev");
         return BlkAllocStatus::BLK_ALLOC_NONE;
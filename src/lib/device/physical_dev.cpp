@@ -13,13 +13,17 @@
  * specific language governing permissions and limitations under the License.
  *
  *********************************************************************************/
+#include <algorithm>
 #include <cstring>
 #include <exception>
 #include <iostream>
+#include <mutex>
 #include <stdexcept>
 #include <system_error>
 
 #ifdef __linux__
+#include <fcntl.h>
+#include <linux/falloc.h>
 #include <linux/fs.h>
 #include <sys/ioctl.h>
 #include <sys/stat.h>
@@ -34,6 +38,7 @@
 #include "physical_dev.hpp"
 #include "device.h"
 #include "blkalloc/blk_allocator.h"
+#include "common/homestore_config.hpp"
 #include "common/homestore_flip.hpp"
 #include "common/homestore_utils.hpp"
 
@@ -42,6 +47,16 @@ namespace homestore {
 static std::atomic< uint64_t > glob_phys_dev_offset{0};
 static std::atomic< uint32_t > glob_phys_dev_ids{0};
 
+// Devices are opened in parallel at startup, but iomgr does not document opening a device (which registers it) or
+// attaching a completion callback to the drive interface shared by all the devices as thread safe. So only those
+// calls are serialized, the superblock reads and validation of the devices still run in parallel.
+static std::mutex s_iomgr_dev_mtx;
+
+static iomgr::io_device_ptr open_iodev(const std::string& devname, int oflags) {
+    std::lock_guard< std::mutex > lk{s_iomgr_dev_mtx};
+    return iomgr::DriveInterface::open_dev(devname, oflags);
+}
+
 const size_t dm_info::s_pdev_info_blocks_size = sizeof(pdev_info_block) * HS_STATIC_CONFIG(engine.max_pdevs);
 const size_t dm_info::s_vdev_info_blocks_size = sizeof(vdev_info_block) * HS_STATIC_CONFIG(engine.max_vdevs);
 size_t dm_info::s_chunk_info_blocks_size = sizeof(chunk_info_block) * HS_STATIC_CONFIG(engine.max_chunks);
@@ -78,7 +93,7 @@ PhysicalDev::PhysicalDev(DeviceManager* mgr, const std::string& devname, int ofl
 
     LOGINFO("Opening device {} with {} mode.", devname, oflags_used & O_DIRECT ? "DIRECT_IO" : "BUFFERED_IO");
 
-    m_iodev = iomgr::DriveInterface::open_dev(devname, oflags_used);
+    m_iodev = open_iodev(devname, oflags_used);
     if (m_iodev == nullptr
 #ifdef _PRERELEASE
         || (homestore_flip->test_flip("device_boot_fail", devname.c_str()))
@@ -90,7 +105,10 @@ PhysicalDev::PhysicalDev(DeviceManager* mgr, const std::string& devname, int ofl
         throw std::system_error(errno, std::system_category(), "error while opening the device");
     }
     m_drive_iface = m_iodev->drive_interface();
-    m_drive_iface->attach_completion_cb(io_comp_cb);
+    {
+        std::lock_guard< std::mutex > lk{s_iomgr_dev_mtx};
+        m_drive_iface->attach_completion_cb(io_comp_cb);
+    }
 
     // Get the device size
     try {
@@ -112,6 +130,8 @@ PhysicalDev::PhysicalDev(DeviceManager* mgr, const std::string& devname, int ofl
         LOGWARN("device size is not the multiple of physical page size old size {}", current_size);
     }
     LOGINFO("Device {} opened with dev_id={} size={}", m_devname, m_iodev->dev_id(), in_bytes(m_devsize));
+    m_qd_limit = HS_DYNAMIC_CONFIG(device->qdepth_max);
+    GAUGE_UPDATE(m_metrics, drive_qdepth_limit, m_qd_limit.load());
     m_dm_chunk[0] = m_dm_chunk[1] = nullptr;
     if (is_init) {
         /* create a chunk */
@@ -215,7 +235,7 @@ void PhysicalDev::read_and_fill_superblock(int oflags) {
     auto const minimal_sb_size = super_block::s_min_sb_size;
     alloc_superblock(minimal_sb_size, 512);
 
-    m_iodev = iomgr::DriveInterface::open_dev(m_devname, oflags);
+    m_iodev = open_iodev(m_devname, oflags);
     m_drive_iface = m_iodev->drive_interface();
 
     auto const bytes_read = m_drive_iface->sync_read(m_iodev.get(), reinterpret_cast< char* >(m_super_blk),
@@ -348,7 +368,7 @@ void PhysicalDev::zero_boot_sbs(const std::vector< dev_info >& devices, int ofla
         HS_LOG_ASSERT_LE(sizeof(super_block), superblock_size,
                          "Device {} Ondisk Superblock size not enough to hold in-mem", dev_str);
         // open device
-        auto iodev = iomgr::DriveInterface::open_dev(dev_str, oflags);
+        auto iodev = open_iodev(dev_str, oflags);
 
         // write zeroed sb to disk
         auto const bytes =
@@ -511,6 +531,124 @@ ssize_t PhysicalDev::sync_readv(iovec* iov, int iovcnt, uint32_t size, uint64_t
     }
 }
 
+bool PhysicalDev::sync_discard(uint64_t size, uint64_t offset) {
+    if (!is_discard_supported() || (size == 0)) { return false; }
+
+    auto const start_time = Clock::now();
+    int ret{-1};
+#ifdef __linux__
+    auto const dtype = iomgr::DriveInterface::get_drive_type(m_devname);
+    if ((dtype == iomgr::drive_type::block_nvme) || (dtype == iomgr::drive_type::block_hdd)) {
+        uint64_t range[2]{offset, size};
+        ret = ::ioctl(m_iodev->fd(), BLKDISCARD, &range);
+    } else {
+        ret = ::fallocate(m_iodev->fd(), FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, s_cast< off_t >(offset),
+                          s_cast< off_t >(size));
+    }
+#else
+    errno = EOPNOTSUPP;
+#endif
+
+    if (sisl_unlikely(ret != 0)) {
+        if ((errno == EOPNOTSUPP) || (errno == ENOTTY) || (errno == EINVAL)) {
+            LOGWARN("Device {} does not support discard errno {}, skipping all subsequent discards on it", m_devname,
+                    errno);
+            m_discard_supported.store(false, std::memory_order_relaxed);
+        } else {
+            HS_LOG(ERROR, device, "discard failed on device {} offset {} size {} errno {}", m_devname, offset, size,
+                   errno);
+            COUNTER_INCREMENT(m_metrics, drive_discard_errors, 1);
+        }
+        return false;
+    }
+
+    COUNTER_INCREMENT(m_metrics, drive_discard_count, 1);
+    COUNTER_INCREMENT(m_metrics, drive_discard_bytes, size);
+    HISTOGRAM_OBSERVE(m_metrics, drive_discard_latency, get_elapsed_time_us(start_time));
+    return true;
+}
+
+bool PhysicalDev::sync_zero(uint64_t size, uint64_t offset) {
+    if (size == 0) { return true; }
+
+    int ret{-1};
+#ifdef __linux__
+    auto const dtype = iomgr::DriveInterface::get_drive_type(m_devname);
+    if ((dtype == iomgr::drive_type::block_nvme) || (dtype == iomgr::drive_type::block_hdd)) {
+        uint64_t range[2]{offset, size};
+        ret = ::ioctl(m_iodev->fd(), BLKZEROOUT, &range);
+    } else if ((dtype == iomgr::drive_type::file_on_nvme) || (dtype == iomgr::drive_type::file_on_hdd)) {
+        ret = ::fallocate(m_iodev->fd(), FALLOC_FL_ZERO_RANGE | FALLOC_FL_KEEP_SIZE, s_cast< off_t >(offset),
+                          s_cast< off_t >(size));
+        if (ret != 0) {
+            // Not all filesystems support zero range, but a punched hole reads back as zeros as well
+            ret = ::fallocate(m_iodev->fd(), FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, s_cast< off_t >(offset),
+                              s_cast< off_t >(size));
+        }
+    } else {
+        errno = EOPNOTSUPP;
+    }
+#else
+    errno = EOPNOTSUPP;
+#endif
+
+    if (ret != 0) {
+        HS_LOG(INFO, device, "zero offload not done on device {} offset {} size {} errno {}, will write zeros",
+               m_devname, offset, size, errno);
+        return false;
+    }
+    COUNTER_INCREMENT(m_metrics, drive_zero_offload_bytes, size);
+    return true;
+}
+
+void PhysicalDev::qd_on_completion(uint64_t latency_us, bool adjust_limit) {
+    m_qd_outstanding.fetch_sub(1);
+
+    bool window_done{false};
+    if (adjust_limit && (HS_DYNAMIC_CONFIG(device->qdepth_target_latency_us) != 0)) {
+        m_qd_window_latency_us.fetch_add(latency_us, std::memory_order_relaxed);
+        // Adjust once per window of limit completions, so that a decrease is not repeated for the IOs which were
+        // already outstanding when the latency crossed the target
+        window_done = ((m_qd_window_ios.fetch_add(1, std::memory_order_relaxed) + 1) >=
+                       m_qd_limit.load(std::memory_order_relaxed));
+    }
+    if (!window_done && (m_qd_nwaiters.load() == 0)) { return; }
+
+    std::vector< qd_waiter > ready;
+    {
+        std::unique_lock< std::mutex > lk{m_qd_mtx};
+        if (window_done) { qd_adjust_limit(); }
+        while (!m_qd_waiters.empty() && qd_try_admit()) {
+            ready.push_back(std::move(m_qd_waiters.front()));
+            m_qd_waiters.pop_front();
+            m_qd_nwaiters.fetch_sub(1);
+        }
+    }
+
+    for (auto& w : ready) {
+        HISTOGRAM_OBSERVE(m_metrics, drive_qdepth_queue_delay, get_elapsed_time_us(w.queued_time));
+        w.dispatch();
+    }
+}
+
+void PhysicalDev::qd_adjust_limit() {
+    // Completions which raced to end the same window find it already reset
+    auto const limit = m_qd_limit.load(std::memory_order_relaxed);
+    if (m_qd_window_ios.load(std::memory_order_relaxed) < limit) { return; }
+    auto const window_ios = m_qd_window_ios.exchange(0, std::memory_order_relaxed);
+    auto const window_latency_us = m_qd_window_latency_us.exchange(0, std::memory_order_relaxed);
+
+    auto const target_us = HS_DYNAMIC_CONFIG(device->qdepth_target_latency_us);
+    auto const min_qd = std::max(HS_DYNAMIC_CONFIG(device->qdepth_min), 1u);
+    auto const max_qd = std::max(HS_DYNAMIC_CONFIG(device->qdepth_max), min_qd);
+    auto const avg_latency_us = window_latency_us / window_ios;
+    auto const new_limit = (avg_latency_us > target_us) ? (limit / 2) : (limit + 1);
+    m_qd_limit.store(std::clamp(new_limit, min_qd, max_qd), std::memory_order_relaxed);
+    GAUGE_UPDATE(m_metrics, drive_qdepth_limit, m_qd_limit.load(std::memory_order_relaxed));
+}
+
+uint32_t PhysicalDev::qd_limit() const { return m_qd_limit.load(std::memory_order_relaxed); }
+
 void PhysicalDev::attach_chunk(PhysicalDevChunk* chunk, PhysicalDevChunk* after) {
     if (after) {
         chunk->set_next_chunk(after->next_chunk_mutable());
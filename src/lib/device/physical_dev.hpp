@@ -14,6 +14,11 @@
  *
  *********************************************************************************/
 #pragma once
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <limits>
+#include <mutex>
 #include <vector>
 #include <string>
 
@@ -307,9 +312,17 @@ public:
         REGISTER_COUNTER(drive_write_errors, "Total drive write errors");
         REGISTER_COUNTER(drive_spurios_events, "Total number of spurious events per drive");
         REGISTER_COUNTER(drive_skipped_chunk_bm_writes, "Total number of skipped writes for chunk bitmap");
+        REGISTER_COUNTER(drive_discard_count, "Total number of discards issued to the drive");
+        REGISTER_COUNTER(drive_discard_bytes, "Total bytes discarded on the drive");
+        REGISTER_COUNTER(drive_discard_errors, "Total drive discard errors");
+        REGISTER_COUNTER(drive_zero_offload_bytes, "Total bytes zeroed on the drive with zero offload");
+        REGISTER_COUNTER(drive_qdepth_queued_ios, "Total IOs queued because drive queue depth limit is reached");
+        REGISTER_GAUGE(drive_qdepth_limit, "Current outstanding IOs limit of the drive by adaptive queue depth");
 
         REGISTER_HISTOGRAM(drive_write_latency, "BlkStore drive write latency in us");
         REGISTER_HISTOGRAM(drive_read_latency, "BlkStore drive read latency in us");
+        REGISTER_HISTOGRAM(drive_discard_latency, "BlkStore drive discard latency in us");
+        REGISTER_HISTOGRAM(drive_qdepth_queue_delay, "Time IOs waited for drive queue depth limit in us");
 
         REGISTER_HISTOGRAM(write_io_sizes, "Write IO Sizes", "io_sizes", {"io_direction", "write"},
                            HistogramBucketsType(ExponentialOfTwoBuckets));
@@ -469,6 +482,38 @@ public:
     PhysicalDevMetrics& metrics() { return m_metrics; }
     iomgr::DriveInterface* drive_iface() const { return m_drive_iface; }
 
+    /* Reads issued through vdev which are not completed yet on this device. Used to balance reads across copies */
+    uint32_t outstanding_reads() const { return m_outstanding_reads.load(std::memory_order_relaxed); }
+    void inc_outstanding_reads() { m_outstanding_reads.fetch_add(1, std::memory_order_relaxed); }
+    void dec_outstanding_reads() { m_outstanding_reads.fetch_sub(1, std::memory_order_relaxed); }
+
+    /* Adaptive queue depth of the device. An IO issued through vdev is admitted only if outstanding admitted IOs are
+     * below the current limit. Otherwise the waiter created by make_waiter is queued and called once an admitted IO
+     * completes. Returns true if the IO is admitted and caller should issue it right away. Admission within the limit
+     * is lock free, the lock is taken only to queue the waiter. */
+    template < typename WaiterFactory >
+    bool qd_admit(WaiterFactory&& make_waiter) {
+        if (qd_try_admit()) { return true; }
+
+        qd_waiter w{make_waiter(), Clock::now()};
+        std::unique_lock< std::mutex > lk{m_qd_mtx};
+        // Waiter is counted before trying again, so that either this try sees the slot freed by a completion or that
+        // completion sees the waiter and drains it.
+        m_qd_nwaiters.fetch_add(1);
+        if (qd_try_admit()) {
+            m_qd_nwaiters.fetch_sub(1);
+            return true;
+        }
+        m_qd_waiters.push_back(std::move(w));
+        COUNTER_INCREMENT(m_metrics, drive_qdepth_queued_ios, 1);
+        return false;
+    }
+
+    /* Completion of an admitted IO. Adjusts the limit with the completion latency if adjust_limit is set and issues
+     * the queued IOs which fit within the limit */
+    void qd_on_completion(uint64_t latency_us, bool adjust_limit);
+    uint32_t qd_limit() const;
+
     void set_dev_offset(uint64_t offset) { m_info_blk.dev_offset = offset; }
     void set_dev_id(uint32_t id) { m_info_blk.dev_num = id; }
 
@@ -498,6 +543,17 @@ public:
 
     ssize_t sync_read(char* data, uint32_t size, uint64_t offset);
     ssize_t sync_readv(iovec* iov, int iovcnt, uint32_t size, uint64_t offset);
+
+    /* Synchronously discard the range on the drive (BLKDISCARD on block devices, punch hole on files). Returns false
+     * if the discard is not done. If drive reports discard is not supported, all subsequent discards are skipped */
+    bool sync_discard(uint64_t size, uint64_t offset);
+    bool is_discard_supported() const { return m_discard_supported.load(std::memory_order_relaxed); }
+
+    /* Synchronously zero the range using the drive offload (BLKZEROOUT on block devices, zero range or punch hole on
+     * files), without writing any zero buffers. Returns false if the offload is not supported or failed, in which
+     * case caller is expected to write zeros */
+    bool sync_zero(uint64_t size, uint64_t offset);
+
     pdev_info_block get_info_blk();
     void read_dm_chunk(char* mem, uint64_t size);
     void write_dm_chunk(uint64_t gen_cnt, const char* mem, uint64_t size);
@@ -586,5 +642,28 @@ private:
     int32_t m_cur_indx{0};
     bool m_superblock_valid{false};
     sisl::atomic_counter< uint64_t > m_error_cnt{0};
+    std::atomic< bool > m_discard_supported{true};
+    std::atomic< uint32_t > m_outstanding_reads{0};
+
+    struct qd_waiter {
+        std::function< void(void) > dispatch;
+        Clock::time_point queued_time;
+    };
+    bool qd_try_admit() {
+        auto outstanding = m_qd_outstanding.load();
+        while (outstanding < m_qd_limit.load(std::memory_order_relaxed)) {
+            if (m_qd_outstanding.compare_exchange_weak(outstanding, outstanding + 1)) { return true; }
+        }
+        return false;
+    }
+    void qd_adjust_limit();
+
+    std::mutex m_qd_mtx; // Protects the waiters and the limit adjustment
+    std::atomic< uint32_t > m_qd_limit{std::numeric_limits< uint32_t >::max()}; // Allowed outstanding IOs
+    std::atomic< uint32_t > m_qd_outstanding{0};                               // Admitted IOs not completed yet
+    std::atomic< uint32_t > m_qd_nwaiters{0};                                  // Size of m_qd_waiters
+    std::atomic< uint32_t > m_qd_window_ios{0};            // IOs completed in the current window
+    std::atomic< uint64_t > m_qd_window_latency_us{0};     // Sum of their latencies
+    std::deque< qd_waiter > m_qd_waiters;                  // IOs waiting for the limit
 };
 } // namespace homestore
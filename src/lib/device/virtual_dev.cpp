@@ -13,10 +13,12 @@
  * specific language governing permissions and limitations under the License.
  *
  *********************************************************************************/
+#include <algorithm>
 #include <array>
 #include <atomic>
 #include <chrono>
 #include <cstdint>
+#include <cstring>
 #include <functional>
 #include <iterator>
 #include <limits>
@@ -25,6 +27,7 @@
 #include <mutex>
 #include <string>
 #include <system_error>
+#include <thread>
 #include <type_traits>
 #include <vector>
 
@@ -36,6 +39,7 @@
 #include <iomgr/drive_interface.hpp>
 
 #include <homestore/homestore.hpp>
+#include <homestore/homestore_probes.hpp>
 #include "physical_dev.hpp"
 #include "device.h"
 #include "virtual_dev.hpp"
@@ -43,7 +47,10 @@
 #include "blkalloc/varsize_blk_allocator.h"
 #include "common/error.h"
 #include "common/homestore_assert.hpp"
+#include "common/homestore_config.hpp"
 #include "common/homestore_flip.hpp"
+#include "common/homestore_utils.hpp"
+#include "common/io_trace.hpp"
 
 SISL_LOGGING_DECL(device)
 
@@ -70,9 +77,85 @@ static bool inject_delay_if_needed(PhysicalDev* pdev, const boost::intrusive_ptr
 #endif
 // clang-format on
 
+// Admits the IO on the pdev's adaptive queue depth, if enabled. If the pdev is at its limit, the waiter created by
+// make_waiter is queued on the pdev and issues the IO once an earlier IO completes.
+template < typename WaiterFactory >
+static bool admit_io(PhysicalDev* pdev, vdev_req_context* req, WaiterFactory&& make_waiter) {
+    if (HS_DYNAMIC_CONFIG(device->qdepth_target_latency_us) == 0) { return true; }
+    req->qd_admitted = true;
+    if (pdev->qd_admit(std::forward< WaiterFactory >(make_waiter))) { return true; }
+    IOTrace::record(io_trace_event_t::vdev_queued, req->request_id, 0, s_cast< uint8_t >(req->op_type));
+    return false;
+}
+
+static void trace_submit(const vdev_req_context* req, uint64_t size, uint64_t offset) {
+    IOTrace::record(io_trace_event_t::vdev_submit, req->request_id, s_cast< uint32_t >(size),
+                    s_cast< uint8_t >(req->op_type));
+    HS_PROBE(vdev_submit, req->request_id, s_cast< uint8_t >(req->op_type), size, offset);
+}
+
+// Queued IOs are issued outside the batch they were part of and their latency is measured from the time they are
+// issued. Iovs are copied when queued, since caller's iov array need not outlive the call.
+static void issue_write(PhysicalDev* pdev, const char* buf, uint32_t size, uint64_t offset, vdev_req_context* req,
+                        bool part_of_batch) {
+    if (admit_io(pdev, req, [=]() {
+            return [=]() {
+                req->io_start_time = Clock::now();
+                trace_submit(req, size, offset);
+                pdev->write(buf, size, offset, uintptr_cast(req), false);
+            };
+        })) {
+        trace_submit(req, size, offset);
+        pdev->write(buf, size, offset, uintptr_cast(req), part_of_batch);
+    }
+}
+
+static void issue_writev(PhysicalDev* pdev, const iovec* iov, int iovcnt, uint64_t size, uint64_t offset,
+                         vdev_req_context* req, bool part_of_batch) {
+    if (admit_io(pdev, req, [=]() {
+            return [=, iovs = std::vector< iovec >(iov, iov + iovcnt)]() {
+                req->io_start_time = Clock::now();
+                trace_submit(req, size, offset);
+                pdev->writev(iovs.data(), s_cast< int >(iovs.size()), size, offset, uintptr_cast(req), false);
+            };
+        })) {
+        trace_submit(req, size, offset);
+        pdev->writev(iov, iovcnt, size, offset, uintptr_cast(req), part_of_batch);
+    }
+}
+
+static void issue_read(PhysicalDev* pdev, char* buf, uint64_t size, uint64_t offset, vdev_req_context* req,
+                       bool part_of_batch) {
+    if (admit_io(pdev, req, [=]() {
+            return [=]() {
+                req->io_start_time = Clock::now();
+                trace_submit(req, size, offset);
+                pdev->read(buf, size, offset, uintptr_cast(req), false);
+            };
+        })) {
+        trace_submit(req, size, offset);
+        pdev->read(buf, size, offset, uintptr_cast(req), part_of_batch);
+    }
+}
+
+static void issue_readv(PhysicalDev* pdev, iovec* iov, int iovcnt, uint64_t size, uint64_t offset,
+                        vdev_req_context* req, bool part_of_batch) {
+    if (admit_io(pdev, req, [=]() {
+            return [=, iovs = std::vector< iovec >(iov, iov + iovcnt)]() mutable {
+                req->io_start_time = Clock::now();
+                trace_submit(req, size, offset);
+                pdev->readv(iovs.data(), s_cast< int >(iovs.size()), size, offset, uintptr_cast(req), false);
+            };
+        })) {
+        trace_submit(req, size, offset);
+        pdev->readv(iov, iovcnt, size, offset, uintptr_cast(req), part_of_batch);
+    }
+}
+
 void VirtualDev::static_process_completions(int64_t res, uint8_t* cookie) {
     boost::intrusive_ptr< vdev_req_context > vd_req{r_cast< vdev_req_context* >(cookie), false};
     HS_DBG_ASSERT_EQ(vd_req->version, 0xDEAD);
+    IOTrace::record(io_trace_event_t::vdev_device_complete, vd_req->request_id, 0, s_cast< uint8_t >(vd_req->op_type));
 
     if ((vd_req->err == no_error) && (res != 0)) {
         LOGERROR("Error on Vdev request id={} error={}", vd_req->request_id, res);
@@ -88,10 +171,13 @@ void VirtualDev::static_process_completions(int64_t res, uint8_t* cookie) {
     if (homestore_flip->test_flip("io_write_comp_error_flip")) { vd_req->err = write_failed; }
     if (homestore_flip->test_flip("io_read_comp_error_flip")) { vd_req->err = read_failed; }
 #endif
+    HS_PROBE(vdev_complete, vd_req->request_id, s_cast< uint8_t >(vd_req->op_type), vd_req->err.value(),
+             get_elapsed_time_us(vd_req->io_start_time));
 
     PhysicalDev* pdev{nullptr};
     if (vd_req->chunk) {
         pdev = vd_req->chunk->physical_dev_mutable();
+        if (vd_req->op_type == vdev_op_type_t::read) { pdev->dec_outstanding_reads(); }
         if (vd_req->err) {
             COUNTER_INCREMENT_IF_ELSE(pdev->metrics(), (vd_req->op_type == vdev_op_type_t::read), drive_read_errors,
                                       drive_write_errors, 1);
@@ -100,6 +186,33 @@ void VirtualDev::static_process_completions(int64_t res, uint8_t* cookie) {
             HISTOGRAM_OBSERVE_IF_ELSE(pdev->metrics(), (vd_req->op_type == vdev_op_type_t::read), drive_read_latency,
                                       drive_write_latency, get_elapsed_time_us(vd_req->io_start_time));
         }
+        if (vd_req->qd_admitted) {
+            pdev->qd_on_completion(get_elapsed_time_us(vd_req->io_start_time), !vd_req->err /* adjust_limit */);
+        }
+    }
+
+    if (vd_req->parent_req) {
+        // This is one copy of a mirrored write. Account its error on the parent and complete the parent only after
+        // all of its copies are completed.
+        auto parent = std::move(vd_req->parent_req);
+        if (vd_req->err) {
+            LOGERROR("Mirrored write copy failed on pdev={} parent request id={} error={}",
+                     pdev ? pdev->get_devname() : std::string{}, parent->request_id, vd_req->err.message());
+            if (parent->failed_ios.increment_test_eq(1)) { parent->err = vd_req->err; }
+        }
+        vd_req->dec_ref();
+
+        if (parent->outstanding_ios.decrement_testz()) {
+            if (parent->failed_ios.get() != 0) {
+                LOGERROR("Mirrored write request id={} failed on {} copies", parent->request_id,
+                         parent->failed_ios.get());
+            }
+            if (parent->cb) { parent->cb(parent->err, parent->cookie); }
+            IOTrace::record(io_trace_event_t::vdev_callback_done, parent->request_id, 0,
+                            s_cast< uint8_t >(parent->op_type));
+            parent->dec_ref();
+        }
+        return;
     }
 
     if (!vd_req->io_on_multi_pdevs || vd_req->outstanding_ios.decrement_testz()) {
@@ -109,6 +222,8 @@ void VirtualDev::static_process_completions(int64_t res, uint8_t* cookie) {
 #endif
             vd_req->cb(vd_req->err, vd_req->cookie);
         }
+        IOTrace::record(io_trace_event_t::vdev_callback_done, vd_req->request_id, 0,
+                        s_cast< uint8_t >(vd_req->op_type));
     }
 
     vd_req->dec_ref();
@@ -159,6 +274,8 @@ void VirtualDev::init(DeviceManager* mgr, vdev_info_block* vb, uint32_t blk_size
     m_num_chunks = 0;
     m_blk_size = blk_size;
     m_selector = std::make_unique< RoundRobinDeviceSelector >();
+    // Reserve for all possible pdevs, so that pdevs added by expand don't move the list which is read in IO path
+    m_primary_pdev_chunks_list.reserve(HS_STATIC_CONFIG(engine.max_pdevs));
     m_recovery_init = false;
     m_auto_recovery = auto_recovery;
     m_hwm_cb = std::move(hwm_cb);
@@ -177,7 +294,6 @@ VirtualDev::VirtualDev(DeviceManager* mgr, const char* name, PhysicalDevGroup pd
 
     auto const pdev_list = m_mgr->get_devices(pdev_group);
     // Prepare primary chunks in a physical device for future inserts.
-    m_primary_pdev_chunks_list.reserve(pdev_list.size());
     uint64_t mapped_stream_size = 0;
     const bool is_hdd = pdev_list.front()->is_hdd();
     m_drive_iface = pdev_list.front()->drive_iface();
@@ -185,7 +301,7 @@ VirtualDev::VirtualDev(DeviceManager* mgr, const char* name, PhysicalDevGroup pd
         pdev_chunk_map mp;
         mp.pdev = pdev;
         mp.chunks_in_pdev.reserve(1);
-        m_primary_pdev_chunks_list.push_back(std::move(mp));
+        add_pdev_chunk_map(std::move(mp));
         // homestore doesn't support heterogeneous devices in same device group;
         HS_REL_ASSERT((mapped_stream_size == 0 || mapped_stream_size == pdev->raw_stream_size()), "stream size {}",
                       pdev->raw_stream_size());
@@ -328,6 +444,11 @@ VirtualDev::VirtualDev(DeviceManager* mgr, const char* name, vdev_info_block* vb
     reserve_stream(m_default_chunk->chunk_id());
 }
 
+VirtualDev::~VirtualDev() {
+    // Whatever is not discarded yet, is left to be freed (without discard) on next boot by the allocator recovery
+    stop_discard_reactor();
+}
+
 void VirtualDev::reset_failed_state() {
     m_vb->set_failed(false);
     m_mgr->write_info_blocks();
@@ -358,28 +479,85 @@ PhysicalDevChunk* VirtualDev::get_next_chunk(uint32_t dev_id, uint32_t chunk_id)
     return m_primary_pdev_chunks_list[dev_id].chunks_in_pdev[chunk_id];
 }
 
-void VirtualDev::async_format(vdev_io_comp_cb_t cb) {
-    auto req = vdev_req_context::make_req_context();
-    req->outstanding_ios.set(num_chunks() * (num_mirrors() + 1));
-    req->io_on_multi_pdevs = true;
-    req->cb = std::move(cb);
+void VirtualDev::async_format(vdev_io_comp_cb_t cb, uint64_t zero_size_per_chunk) {
+    struct zero_region {
+        PhysicalDevChunk* chunk;
+        uint64_t size;
+        bool offloaded{false};
+    };
+    struct format_ctx {
+        std::map< PhysicalDev*, std::vector< zero_region > > pdev_regions;
+        std::atomic< uint32_t > pending_pdevs{0};
+        iomgr::io_thread_t issuer{nullptr};
+        boost::intrusive_ptr< vdev_req_context > req;
+    };
+
+    // Collect the regions to zero (primary and mirror chunks) per pdev
+    auto ctx = std::make_shared< format_ctx >();
+    uint32_t nregions{0};
+    auto const add_region = [&](PhysicalDevChunk* chunk) {
+        auto const size = (zero_size_per_chunk == 0) ? chunk->size() : std::min(zero_size_per_chunk, chunk->size());
+        ctx->pdev_regions[chunk->physical_dev_mutable()].push_back(zero_region{chunk, size});
+        ++nregions;
+    };
+    for (auto& pdev_chunks : m_primary_pdev_chunks_list) {
+        for (auto* pchunk : pdev_chunks.chunks_in_pdev) {
+            add_region(pchunk);
+            for (auto* mchunk : m_mirror_chunks[pchunk]) {
+                add_region(mchunk);
+            }
+        }
+    }
+    if (nregions == 0) {
+        // No completion is ever going to come for an empty request
+        cb(no_error, nullptr);
+        return;
+    }
 
-    for (size_t dev_ind{0}; dev_ind < m_primary_pdev_chunks_list.size(); ++dev_ind) {
-        for (auto* pchunk : m_primary_pdev_chunks_list[dev_ind].chunks_in_pdev) {
-            auto* pdev = pchunk->physical_dev_mutable();
-            req->inc_ref();
-            LOGINFO("writing zero for chunk: {}, size: {}, offset: {}", pchunk->chunk_id(), in_bytes(pchunk->size()),
-                    pchunk->start_offset());
-            pdev->write_zero(pchunk->size(), pchunk->start_offset(), uintptr_cast(req.get()));
-            auto mchunks_list = m_mirror_chunks[pchunk];
-            for (auto& mchunk : mchunks_list) {
-                auto* m_pdev = mchunk->physical_dev_mutable();
-                req->inc_ref();
-                LOGINFO("writing zero for mirror chunk: {}, size: {}, offset: {}", mchunk->chunk_id(),
-                        in_bytes(mchunk->size()), mchunk->start_offset());
-                m_pdev->write_zero(mchunk->size(), mchunk->start_offset(), uintptr_cast(req.get()));
+    ctx->req = vdev_req_context::make_req_context();
+    ctx->req->outstanding_ios.set(nregions);
+    ctx->req->io_on_multi_pdevs = true;
+    ctx->req->op_type = vdev_op_type_t::format;
+    ctx->req->cb = std::move(cb);
+    if (iomanager.am_i_io_reactor()) { ctx->issuer = iomanager.iothread_self(); }
+
+    // Regions which are not zeroed by offload are zeroed by writing zeros asynchronously, all at once, from the thread
+    // which issued the format.
+    auto const issue_zero_writes = [ctx]() {
+        for (auto& [pdev, regions] : ctx->pdev_regions) {
+            for (auto& r : regions) {
+                LOGINFO("{} chunk: {}, size: {}, offset: {}", r.offloaded ? "zeroed with offload" : "writing zero for",
+                        r.chunk->chunk_id(), in_bytes(r.size), r.chunk->start_offset());
+                ctx->req->inc_ref();
+                if (r.offloaded) {
+                    static_process_completions(0, uintptr_cast(ctx->req.get()));
+                } else {
+                    pdev->write_zero(r.size, r.chunk->start_offset(), uintptr_cast(ctx->req.get()));
+                }
             }
         }
+    };
+
+    // Zero with the drive offload on all pdevs in parallel, each pdev in its own thread since the offload is a
+    // blocking call, so that the issuing reactor is never blocked by it. Last pdev to finish its offload issues the
+    // zero writes for the rest back on the issuer.
+    ctx->pending_pdevs.store(s_cast< uint32_t >(ctx->pdev_regions.size()));
+    for (auto& [pdev, regions] : ctx->pdev_regions) {
+        std::thread([ctx, issue_zero_writes, pdev = pdev, &regions = regions]() {
+            for (auto& r : regions) {
+                r.offloaded = pdev->sync_zero(r.size, r.chunk->start_offset());
+            }
+            if (ctx->pending_pdevs.fetch_sub(1, std::memory_order_acq_rel) != 1) { return; }
+
+            if (ctx->issuer) {
+                iomanager.run_on(ctx->issuer,
+                                 [issue_zero_writes]([[maybe_unused]] iomgr::io_thread_addr_t addr) {
+                                     issue_zero_writes();
+                                 });
+            } else {
+                issue_zero_writes();
+            }
+        }).detach();
     }
 }
 
@@ -481,17 +659,34 @@ BlkAllocStatus VirtualDev::alloc_contiguous_blk(const blk_count_t nblks, const b
 
 BlkAllocStatus VirtualDev::alloc_blk(uint32_t nblks, const blk_alloc_hints& hints, std::vector< BlkId >& out_blkid) {
     size_t start_idx = out_blkid.size();
+    uint32_t nblks_per_op = BlkId::max_blks_in_op();
+
+    // Split a large allocation into stripe units on consecutive pdevs, so that the IOs on them go in parallel. Its
+    // skipped if caller has asked for a contiguous allocation or a specific device or stream.
+    blk_alloc_hints stripe_hints{hints};
+    const uint32_t num_pdevs = this->num_pdevs();
+    const uint32_t stripe_unit_blks = sisl::round_down(
+        s_cast< uint32_t >(HS_DYNAMIC_CONFIG(device->stripe_unit_size) / block_size()), hints.multiplier);
+    const bool is_striped = (num_pdevs > 1) && (stripe_unit_blks != 0) && (nblks > stripe_unit_blks) &&
+        !hints.is_contiguous && (hints.dev_id_hint == INVALID_DEV_ID) && !hints.stream_info;
+    if (is_striped) {
+        nblks_per_op = std::min(nblks_per_op, stripe_unit_blks);
+        stripe_hints.dev_id_hint = m_selector->select(hints);
+        COUNTER_INCREMENT(m_metrics, vdev_striped_alloc_count, 1);
+    }
+
     while (nblks != 0) {
-        const blk_count_t nblks_op = std::min(BlkId::max_blks_in_op(), s_cast< blk_count_t >(nblks));
-        const auto ret = do_alloc_blk(nblks_op, hints, out_blkid);
+        const blk_count_t nblks_op = s_cast< blk_count_t >(std::min(nblks_per_op, nblks));
+        const auto ret = do_alloc_blk(nblks_op, stripe_hints, out_blkid);
         if (ret != BlkAllocStatus::SUCCESS) {
             for (auto i = start_idx; i < out_blkid.size(); ++i) {
                 free_blk(out_blkid[i]);
-                out_blkid.erase(out_blkid.begin() + start_idx, out_blkid.end());
             }
+            out_blkid.erase(out_blkid.begin() + start_idx, out_blkid.end());
             return ret;
         }
         nblks -= nblks_op;
+        if (is_striped) { stripe_hints.dev_id_hint = (stripe_hints.dev_id_hint + 1) % num_pdevs; }
     }
     return BlkAllocStatus::SUCCESS;
 }
@@ -538,6 +733,7 @@ BlkAllocStatus VirtualDev::do_alloc_blk(blk_count_t nblks, const blk_alloc_hints
         // TODO: Right now there is only one primary chunk per device in a virtualdev. Need to support multiple
         // chunks. In that case just using physDevId as chunk number is not right strategy.
         uint32_t start_dev_ind = dev_ind;
+        auto const npdevs = num_pdevs();
         do {
             for (auto& chunk : m_primary_pdev_chunks_list[dev_ind].chunks_in_pdev) {
                 status = alloc_blk_from_chunk(nblks, hints, out_blkid, chunk);
@@ -545,7 +741,7 @@ BlkAllocStatus VirtualDev::do_alloc_blk(blk_count_t nblks, const blk_alloc_hints
             }
 
             if (status == BlkAllocStatus::SUCCESS || !hints.can_look_for_other_chunk) { break; }
-            dev_ind = uint32_cast((dev_ind + 1) % m_primary_pdev_chunks_list.size());
+            dev_ind = uint32_cast((dev_ind + 1) % npdevs);
         } while (dev_ind != start_dev_ind);
 
         if (status != BlkAllocStatus::SUCCESS) {
@@ -598,6 +794,178 @@ void VirtualDev::free_blk(const BlkId& b) {
     chunk->blk_allocator_mutable()->free(b);
 }
 
+void VirtualDev::free_blk_with_discard(const BlkId& b) {
+    if (!HS_DYNAMIC_CONFIG(device->discard_enabled)) {
+        free_blk(b);
+        return;
+    }
+
+    std::unique_lock< std::mutex > lk{m_pending_discard_mtx};
+    m_pending_discard_blks[b.get_chunk_num()].push_back(b);
+}
+
+void VirtualDev::flush_discards() { flush_discards(take_pending_discards()); }
+
+std::map< chunk_num_t, std::vector< BlkId > > VirtualDev::take_pending_discards() {
+    std::map< chunk_num_t, std::vector< BlkId > > blks;
+    std::unique_lock< std::mutex > lk{m_pending_discard_mtx};
+    blks.swap(m_pending_discard_blks);
+    return blks;
+}
+
+void VirtualDev::flush_discards(std::map< chunk_num_t, std::vector< BlkId > > blks) {
+    {
+        std::unique_lock< std::mutex > lk{m_pending_discard_mtx};
+        for (auto& [chunk_num, blkids] : blks) {
+            auto& ready_blkids = m_ready_discard_blks[chunk_num];
+            ready_blkids.insert(ready_blkids.end(), blkids.cbegin(), blkids.cend());
+        }
+        if (m_ready_discard_blks.empty() || m_discard_stop) { return; }
+
+        m_discard_requested = true;
+        if (m_discard_running) { return; } // Batch running now picks up this request once it is done
+        m_discard_running = true;
+
+        if (m_discard_thread == nullptr) {
+            lk.unlock();
+            iomanager.create_reactor("vdev_discard_" + m_name, INTERRUPT_LOOP, [this](bool is_started) {
+                if (is_started) {
+                    {
+                        std::unique_lock< std::mutex > lk{m_pending_discard_mtx};
+                        m_discard_thread = iomanager.iothread_self();
+                    }
+                    m_discard_cv.notify_all();
+                }
+            });
+            lk.lock();
+            m_discard_cv.wait(lk, [this] { return (m_discard_thread != nullptr); });
+        }
+    }
+    iomanager.run_on(m_discard_thread,
+                     [this]([[maybe_unused]] iomgr::io_thread_addr_t addr) { run_discard_batches(); });
+}
+
+void VirtualDev::run_discard_batches() {
+    std::unique_lock< std::mutex > lk{m_pending_discard_mtx};
+    while (m_discard_requested && !m_discard_stop) {
+        // Requests which came in while previous batch was running are served by one batch, so that the drive does not
+        // see more than the configured limit per batch.
+        m_discard_requested = false;
+        std::map< chunk_num_t, std::vector< BlkId > > blks;
+        blks.swap(m_ready_discard_blks);
+        for (const auto& [chunk_num, blkids] : blks) {
+            for (const auto& b : blkids) {
+                m_discard_inflight_nblks += b.get_nblks();
+            }
+        }
+
+        lk.unlock();
+        auto deferred_blks = discard_batch(blks, HS_DYNAMIC_CONFIG(device->max_discard_bytes_per_batch));
+        lk.lock();
+
+        for (auto& [chunk_num, blkids] : deferred_blks) {
+            auto& ready_blkids = m_ready_discard_blks[chunk_num];
+            ready_blkids.insert(ready_blkids.end(), blkids.cbegin(), blkids.cend());
+        }
+        m_discard_inflight_nblks = 0;
+    }
+    m_discard_running = false;
+    m_discard_cv.notify_all();
+}
+
+void VirtualDev::stop_discard_reactor() {
+    iomgr::io_thread_t discard_thread;
+    {
+        std::unique_lock< std::mutex > lk{m_pending_discard_mtx};
+        m_discard_stop = true;
+        m_discard_cv.wait(lk, [this] { return !m_discard_running; });
+        discard_thread = std::move(m_discard_thread);
+        m_discard_thread = nullptr;
+    }
+    if (discard_thread != nullptr) {
+        iomanager.run_on(discard_thread,
+                         []([[maybe_unused]] iomgr::io_thread_addr_t addr) { iomanager.stop_io_loop(); });
+    }
+}
+
+void VirtualDev::drain_discards() {
+    stop_discard_reactor();
+
+    std::map< chunk_num_t, std::vector< BlkId > > blks;
+    {
+        std::unique_lock< std::mutex > lk{m_pending_discard_mtx};
+        blks.swap(m_ready_discard_blks);
+        m_discard_requested = false;
+    }
+    discard_batch(blks, std::numeric_limits< uint64_t >::max());
+}
+
+uint64_t VirtualDev::discard_backlog_blks() {
+    std::unique_lock< std::mutex > lk{m_pending_discard_mtx};
+    uint64_t nblks{m_discard_inflight_nblks};
+    for (const auto* blks : {&m_pending_discard_blks, &m_ready_discard_blks}) {
+        for (const auto& [chunk_num, blkids] : *blks) {
+            for (const auto& b : blkids) {
+                nblks += b.get_nblks();
+            }
+        }
+    }
+    return nblks;
+}
+
+std::map< chunk_num_t, std::vector< BlkId > >
+VirtualDev::discard_batch(std::map< chunk_num_t, std::vector< BlkId > >& blks, uint64_t max_bytes) {
+    std::map< chunk_num_t, std::vector< BlkId > > deferred_blks;
+    auto const min_discard_size = HS_DYNAMIC_CONFIG(device->min_discard_size);
+    uint64_t discarded_bytes{0};
+
+    for (auto& [chunk_num, blkids] : blks) {
+        PhysicalDevChunk* chunk = m_mgr->get_chunk_mutable(chunk_num);
+        std::sort(blkids.begin(), blkids.end(),
+                  [](const BlkId& a, const BlkId& b) { return a.get_blk_num() < b.get_blk_num(); });
+
+        // Coalesce the adjacent blkids into one extent and discard it on primary and all of its mirror chunks
+        auto it = blkids.cbegin();
+        while (it != blkids.cend()) {
+            auto const extent_start = it;
+            blk_num_t const start_blk = it->get_blk_num();
+            blk_num_t end_blk = it->get_last_blk_num();
+            while ((++it != blkids.cend()) && (it->get_blk_num() <= end_blk + 1)) {
+                end_blk = std::max(end_blk, it->get_last_blk_num());
+            }
+
+            uint64_t const size = uint64_cast(end_blk - start_blk + 1) * block_size();
+            if (size < min_discard_size) {
+                COUNTER_INCREMENT(m_metrics, vdev_discard_skipped_bytes, size);
+            } else if ((discarded_bytes != 0) && (size > max_bytes - discarded_bytes)) {
+                // Over the limit of this batch, retain them (without freeing) for the next batch
+                COUNTER_INCREMENT(m_metrics, vdev_discard_deferred_bytes, size);
+                deferred_blks[chunk_num].insert(deferred_blks[chunk_num].end(), extent_start, it);
+                continue;
+            } else {
+                discarded_bytes += size;
+                uint64_t const offset_in_chunk = uint64_cast(start_blk) * block_size();
+                HS_LOG(DEBUG, device, "Discarding chunk={} blks=[{}-{}] size={}", chunk->chunk_id(), start_blk,
+                       end_blk, size);
+                chunk->physical_dev_mutable()->sync_discard(size, chunk->start_offset() + offset_in_chunk);
+
+                auto const mit = m_mirror_chunks.find(chunk);
+                if (mit != m_mirror_chunks.end()) {
+                    for (auto* mchunk : mit->second) {
+                        mchunk->physical_dev_mutable()->sync_discard(size, mchunk->start_offset() + offset_in_chunk);
+                    }
+                }
+            }
+
+            // Discard is done (or not needed) on these blks, now they can be reallocated
+            for (auto fit = extent_start; fit != it; ++fit) {
+                free_blk(*fit);
+            }
+        }
+    }
+    return deferred_blks;
+}
+
 void VirtualDev::recovery_done() {
     for (auto& pcm : m_primary_pdev_chunks_list) {
         for (auto& pchunk : pcm.chunks_in_pdev) {
@@ -642,7 +1010,21 @@ void VirtualDev::async_write_internal(const char* buf, uint32_t size, PhysicalDe
     if (sisl_unlikely(!hs_utils::mod_aligned_sz(dev_offset, pdev->align_size()))) {
         COUNTER_INCREMENT(m_metrics, unalign_writes, 1);
     }
-    pdev->write(buf, size, dev_offset, uintptr_cast(req.get()), part_of_batch);
+
+    if (num_mirrors()) {
+        write_nmirror(buf, size, pchunk, dev_offset, req, part_of_batch);
+    } else {
+        issue_write(pdev, buf, size, dev_offset, req.get(), part_of_batch);
+    }
+}
+
+void VirtualDev::async_writev(const iovec* iov, int iovcnt, const BlkId& bid, vdev_req_context* req,
+                              bool part_of_batch) {
+    PhysicalDevChunk* chunk;
+    uint64_t const dev_offset = to_dev_offset(bid, &chunk);
+    auto const size = get_len(iov, iovcnt);
+    writev_with_req(iov, iovcnt, size, chunk->physical_dev_mutable(), chunk, dev_offset,
+                    boost::intrusive_ptr< vdev_req_context >{req}, part_of_batch);
 }
 
 void VirtualDev::async_writev_internal(const iovec* iov, int iovcnt, uint64_t size, PhysicalDev* pdev,
@@ -650,16 +1032,26 @@ void VirtualDev::async_writev_internal(const iovec* iov, int iovcnt, uint64_t si
                                        const void* cookie, bool part_of_batch) {
     auto req = vdev_req_context::make_req_context();
     req->cb = std::move(cb);
+    req->cookie = const_cast< void* >(cookie);
+    writev_with_req(iov, iovcnt, size, pdev, pchunk, dev_offset, req, part_of_batch);
+}
+
+void VirtualDev::writev_with_req(const iovec* iov, int iovcnt, uint64_t size, PhysicalDev* pdev,
+                                 PhysicalDevChunk* pchunk, uint64_t dev_offset,
+                                 const boost::intrusive_ptr< vdev_req_context >& req, bool part_of_batch) {
     req->op_type = vdev_op_type_t::write;
     req->chunk = pchunk;
-    req->cookie = const_cast< void* >(cookie);
 
     HS_LOG(TRACE, device, "Writing in device: {}, offset = {}", pdev->dev_id(), dev_offset);
     COUNTER_INCREMENT(m_metrics, vdev_write_count, 1);
     if (sisl_unlikely(!hs_utils::mod_aligned_sz(dev_offset, pdev->align_size()))) {
         COUNTER_INCREMENT(m_metrics, unalign_writes, 1);
     }
-    pdev->writev(iov, iovcnt, size, dev_offset, uintptr_cast(req.get()), part_of_batch);
+    if (num_mirrors()) {
+        writev_nmirror(iov, iovcnt, size, pchunk, dev_offset, req, part_of_batch);
+    } else {
+        issue_writev(pdev, iov, iovcnt, size, dev_offset, req.get(), part_of_batch);
+    }
 }
 
 ////////////////////////// sync write section //////////////////////////////////
@@ -667,7 +1059,7 @@ ssize_t VirtualDev::sync_write(const char* buf, uint32_t size, const BlkId& bid)
     PhysicalDevChunk* chunk;
     uint64_t const dev_offset = to_dev_offset(bid, &chunk);
     auto bytes_written = chunk->physical_dev_mutable()->sync_write(buf, size, dev_offset);
-    if (num_mirrors()) { write_nmirror(buf, size, chunk, dev_offset); }
+    if (num_mirrors()) { sync_write_nmirror(buf, size, chunk, dev_offset); }
     return bytes_written;
 }
 
@@ -683,14 +1075,14 @@ ssize_t VirtualDev::sync_writev(const iovec* iov, int iovcnt, const BlkId& bid)
     }
 
     auto const bytes_written = pdev->sync_writev(iov, iovcnt, size, dev_offset);
-    if (num_mirrors()) { writev_nmirror(iov, iovcnt, size, chunk, dev_offset); }
+    if (num_mirrors()) { sync_writev_nmirror(iov, iovcnt, size, chunk, dev_offset); }
     return bytes_written;
 }
 
 ssize_t VirtualDev::sync_write_internal(const char* buf, uint32_t size, PhysicalDev* pdev, PhysicalDevChunk* pchunk,
                                         uint64_t dev_offset) {
     auto bytes_written = pdev->sync_write(buf, size, dev_offset);
-    if (num_mirrors()) { write_nmirror(buf, size, pchunk, dev_offset); }
+    if (num_mirrors()) { sync_write_nmirror(buf, size, pchunk, dev_offset); }
     return bytes_written;
 }
 
@@ -698,7 +1090,7 @@ ssize_t VirtualDev::sync_writev_internal(const iovec* iov, int iovcnt, PhysicalD
                                          uint64_t dev_offset) {
     auto const size = get_len(iov, iovcnt);
     auto bytes_written = pdev->sync_writev(iov, iovcnt, size, dev_offset);
-    if (num_mirrors()) { writev_nmirror(iov, iovcnt, size, pchunk, dev_offset); }
+    if (num_mirrors()) { sync_writev_nmirror(iov, iovcnt, size, pchunk, dev_offset); }
     return bytes_written;
 }
 ////////////////////////////////// async read section ///////////////////////////////////////////////
@@ -706,7 +1098,15 @@ void VirtualDev::async_read(char* buf, uint64_t size, const BlkId& bid, vdev_io_
                             bool part_of_batch) {
     PhysicalDevChunk* pchunk;
     uint64_t const dev_offset = to_dev_offset(bid, &pchunk);
-    async_read_internal(buf, size, pchunk->physical_dev_mutable(), pchunk, dev_offset, std::move(cb), cookie,
+    if (use_hedged_read()) {
+        const iovec iov{buf, size};
+        hedged_read(&iov, 1, size, pchunk, dev_offset, std::move(cb), cookie);
+        return;
+    }
+
+    auto* rchunk = pick_read_chunk(pchunk);
+    async_read_internal(buf, size, rchunk->physical_dev_mutable(), rchunk,
+                        rchunk->start_offset() + (dev_offset - pchunk->start_offset()), std::move(cb), cookie,
                         part_of_batch);
 }
 
@@ -714,10 +1114,38 @@ void VirtualDev::async_readv(iovec* iovs, int iovcnt, uint64_t size, const BlkId
                              const void* cookie, bool part_of_batch) {
     PhysicalDevChunk* pchunk;
     uint64_t const dev_offset = to_dev_offset(bid, &pchunk);
-    async_readv_internal(iovs, iovcnt, size, pchunk->physical_dev_mutable(), pchunk, dev_offset, std::move(cb), cookie,
+    if (use_hedged_read()) {
+        hedged_read(iovs, iovcnt, size, pchunk, dev_offset, std::move(cb), cookie);
+        return;
+    }
+
+    auto* rchunk = pick_read_chunk(pchunk);
+    async_readv_internal(iovs, iovcnt, size, rchunk->physical_dev_mutable(), rchunk,
+                         rchunk->start_offset() + (dev_offset - pchunk->start_offset()), std::move(cb), cookie,
                          part_of_batch);
 }
 
+void VirtualDev::async_readv(iovec* iovs, int iovcnt, uint64_t size, const BlkId& bid, vdev_req_context* req,
+                             bool part_of_batch) {
+    PhysicalDevChunk* pchunk;
+    uint64_t const dev_offset = to_dev_offset(bid, &pchunk);
+    if (use_hedged_read()) {
+        // Hedged reads issue their own contexts per copy, the caller context is only completed at the end.
+        hedged_read(iovs, iovcnt, size, pchunk, dev_offset,
+                    [req](std::error_condition err, void*) {
+                        if (req->cb) { req->cb(err, req->cookie); }
+                        req->dec_ref();
+                    },
+                    nullptr);
+        return;
+    }
+
+    auto* rchunk = pick_read_chunk(pchunk);
+    readv_with_req(iovs, iovcnt, size, rchunk->physical_dev_mutable(), rchunk,
+                   rchunk->start_offset() + (dev_offset - pchunk->start_offset()),
+                   boost::intrusive_ptr< vdev_req_context >{req}, part_of_batch);
+}
+
 void VirtualDev::async_read_internal(char* buf, uint64_t size, PhysicalDev* pdev, PhysicalDevChunk* pchunk,
                                      uint64_t dev_offset, vdev_io_comp_cb_t cb, const void* cookie,
                                      bool part_of_batch) {
@@ -727,7 +1155,8 @@ void VirtualDev::async_read_internal(char* buf, uint64_t size, PhysicalDev* pdev
     req->chunk = pchunk;
     req->cookie = const_cast< void* >(cookie);
 
-    pdev->read(buf, size, dev_offset, uintptr_cast(req.get()), part_of_batch);
+    pdev->inc_outstanding_reads();
+    issue_read(pdev, buf, size, dev_offset, req.get(), part_of_batch);
 }
 
 void VirtualDev::async_readv_internal(iovec* iovs, int iovcnt, uint64_t size, PhysicalDev* pdev,
@@ -735,17 +1164,35 @@ void VirtualDev::async_readv_internal(iovec* iovs, int iovcnt, uint64_t size, Ph
                                       const void* cookie, bool part_of_batch) {
     auto req = vdev_req_context::make_req_context();
     req->cb = std::move(cb);
+    req->cookie = const_cast< void* >(cookie);
+    readv_with_req(iovs, iovcnt, size, pdev, pchunk, dev_offset, req, part_of_batch);
+}
+
+void VirtualDev::readv_with_req(iovec* iovs, int iovcnt, uint64_t size, PhysicalDev* pdev, PhysicalDevChunk* pchunk,
+                                uint64_t dev_offset, const boost::intrusive_ptr< vdev_req_context >& req,
+                                bool part_of_batch) {
     req->op_type = vdev_op_type_t::read;
     req->chunk = pchunk;
-    req->cookie = const_cast< void* >(cookie);
 
-    pdev->readv(iovs, iovcnt, size, dev_offset, uintptr_cast(req.get()), part_of_batch);
+    pdev->inc_outstanding_reads();
+    issue_readv(pdev, iovs, iovcnt, size, dev_offset, req.get(), part_of_batch);
 }
 
 ////////////////////////////////////////// sync read section ////////////////////////////////////////////
 ssize_t VirtualDev::sync_read(char* buf, uint32_t size, const BlkId& bid) {
     PhysicalDevChunk* pchunk;
     uint64_t const dev_offset = to_dev_offset(bid, &pchunk);
+
+    auto* rchunk = pick_read_chunk(pchunk);
+    if (rchunk != pchunk) {
+        auto* pdev = rchunk->physical_dev_mutable();
+        pdev->inc_outstanding_reads();
+        auto const bytes_read =
+            pdev->sync_read(buf, size, rchunk->start_offset() + (dev_offset - pchunk->start_offset()));
+        pdev->dec_outstanding_reads();
+        if (bytes_read == size) { return bytes_read; }
+        // Failed on the mirror, fall back to read from the primary and rest of the mirrors
+    }
     return sync_read_internal(buf, size, pchunk->physical_dev_mutable(), pchunk, dev_offset);
 }
 
@@ -803,11 +1250,12 @@ void VirtualDev::fsync_pdevs(vdev_io_comp_cb_t cb) {
     req->cb = std::move(cb);
     req->op_type = vdev_op_type_t::fsync;
     req->io_on_multi_pdevs = true;
-    req->outstanding_ios.set((uint32_t)m_primary_pdev_chunks_list.size());
+    auto const npdevs = num_pdevs();
+    req->outstanding_ios.set(npdevs);
 
-    assert(!m_primary_pdev_chunks_list.empty());
-    for (auto& pdev_chunk : m_primary_pdev_chunks_list) {
-        auto* pdev = pdev_chunk.pdev;
+    assert(npdevs != 0);
+    for (uint32_t i{0}; i < npdevs; ++i) {
+        auto* pdev = m_primary_pdev_chunks_list[i].pdev;
         req->inc_ref();
         HS_LOG(TRACE, device, "Flushing pdev {}", pdev->get_devname());
         pdev->fsync(uintptr_cast(req.get()));
@@ -820,9 +1268,20 @@ void VirtualDev::get_vb_context(const sisl::blob& ctx_data) const { m_mgr->get_v
 
 void VirtualDev::update_vb_context(const sisl::blob& ctx_data) { m_mgr->update_vb_context(m_vb->vdev_id, ctx_data); }
 
+std::vector< chunk_num_t > VirtualDev::primary_chunk_ids() {
+    std::vector< chunk_num_t > ids;
+    std::lock_guard< decltype(m_mgmt_mutex) > lock{m_mgmt_mutex};
+    for (uint32_t i{0}; i < num_pdevs(); ++i) {
+        for (const auto* chunk : m_primary_pdev_chunks_list[i].chunks_in_pdev) {
+            ids.push_back(s_cast< chunk_num_t >(chunk->chunk_id()));
+        }
+    }
+    return ids;
+}
+
 uint64_t VirtualDev::available_blks() const {
     uint64_t avl_blks{0};
-    for (size_t i{0}; i < m_primary_pdev_chunks_list.size(); ++i) {
+    for (uint32_t i{0}; i < num_pdevs(); ++i) {
         for (uint32_t chunk_indx = 0; chunk_indx < m_primary_pdev_chunks_list[i].chunks_in_pdev.size(); ++chunk_indx) {
             const auto* chunk = m_primary_pdev_chunks_list[i].chunks_in_pdev[chunk_indx];
             avl_blks += chunk->blk_allocator()->available_blks();
@@ -833,7 +1292,7 @@ uint64_t VirtualDev::available_blks() const {
 
 uint64_t VirtualDev::used_size() const {
     uint64_t alloc_cnt{0};
-    for (size_t i{0}; i < m_primary_pdev_chunks_list.size(); ++i) {
+    for (uint32_t i{0}; i < num_pdevs(); ++i) {
         for (uint32_t chunk_indx = 0; chunk_indx < m_primary_pdev_chunks_list[i].chunks_in_pdev.size(); ++chunk_indx) {
             const auto* chunk = m_primary_pdev_chunks_list[i].chunks_in_pdev[chunk_indx];
             alloc_cnt += chunk->blk_allocator()->get_used_blks();
@@ -842,7 +1301,103 @@ uint64_t VirtualDev::used_size() const {
     return (alloc_cnt * block_size());
 }
 
-void VirtualDev::expand(const uint32_t addln_size) {}
+uint64_t VirtualDev::expand(uint64_t addln_size, bool rebalance) {
+    std::lock_guard< decltype(m_mgmt_mutex) > lock{m_mgmt_mutex};
+    if (num_mirrors() != 0) {
+        LOGERROR("vdev {} has mirrors, online expand is not supported for mirrored vdev", m_name);
+        return 0;
+    }
+
+    // Chunks are added only on pdevs which are new to this vdev. The chunk lists of the existing pdevs are read
+    // without lock in the allocation path and so are never modified.
+    std::vector< pdev_chunk_map > new_pcms;
+    for (auto* pdev : m_mgr->get_devices(m_pdev_group)) {
+        if (std::none_of(m_primary_pdev_chunks_list.cbegin(), m_primary_pdev_chunks_list.cend(),
+                         [pdev](const pdev_chunk_map& pcm) { return (pcm.pdev == pdev); })) {
+            new_pcms.push_back(pdev_chunk_map{pdev, {}});
+        }
+    }
+    if (new_pcms.empty()) {
+        LOGWARN("vdev {} has no new pdevs in its group to expand on", m_name);
+        return 0;
+    }
+    HS_REL_ASSERT_LE(m_primary_pdev_chunks_list.size() + new_pcms.size(), m_primary_pdev_chunks_list.capacity(),
+                     "vdev {} cannot have more than {} pdevs", m_name, m_primary_pdev_chunks_list.capacity());
+
+    auto nchunks = s_cast< uint32_t >(sisl::round_up(addln_size, m_chunk_size) / m_chunk_size);
+    if (is_data_drive_hdd()) {
+        auto const remaining_num_chunks = HDD_MAX_CHUNKS - s_num_chunks_created - m_mgr->num_sys_chunks();
+        nchunks = std::min(nchunks, s_cast< uint32_t >(remaining_num_chunks));
+    }
+
+    std::vector< PhysicalDevChunk* > new_chunks;
+    for (uint32_t i{0}; i < nchunks; ++i) {
+        auto& pcm = new_pcms[i % new_pcms.size()];
+        auto* chunk = m_mgr->alloc_chunk(pcm.pdev, m_vb->vdev_id, m_chunk_size, INVALID_CHUNK_ID);
+        if (chunk == nullptr) {
+            LOGWARN("vdev {} could allocate only {} out of {} chunks to expand", m_name, i, nchunks);
+            break;
+        }
+        chunk->set_blk_allocator(create_blk_allocator(m_allocator_type, block_size(), phys_page_size(),
+                                                      align_size(), m_chunk_size, m_auto_recovery, chunk->chunk_id(),
+                                                      true /* init */));
+        chunk->blk_allocator_mutable()->inited();
+        pcm.chunks_in_pdev.push_back(chunk);
+        new_chunks.push_back(chunk);
+        LOGINFO("vdev name {} expanded with chunk id {} chunk start offset {}, chunk size {}, pdev id {}", m_name,
+                chunk->chunk_id(), chunk->start_offset(), in_bytes(chunk->size()), pcm.pdev->dev_id());
+    }
+    if (new_chunks.empty()) { return 0; }
+
+    auto const num_added = s_cast< uint32_t >(new_chunks.size());
+    m_mgr->expand_vdev(m_vb, num_added, num_added * m_chunk_size);
+    s_num_chunks_created += num_added;
+    m_num_chunks += num_added;
+    {
+        std::unique_lock< std::mutex > lk(m_free_streams_lk);
+        m_free_streams.insert(m_free_streams.end(), new_chunks.cbegin(), new_chunks.cend());
+    }
+
+    // Publish the new pdevs only after their chunks are ready to be allocated from
+    for (auto& pcm : new_pcms) {
+        if (pcm.chunks_in_pdev.empty()) { continue; }
+        auto* const pdev = pcm.pdev;
+        add_pdev_chunk_map(std::move(pcm));
+        m_selector->add_pdev(pdev);
+    }
+
+    if (rebalance) { set_alloc_weights(); }
+    return num_added * m_chunk_size;
+}
+
+void VirtualDev::add_pdev_chunk_map(pdev_chunk_map&& pcm) {
+    HS_REL_ASSERT_LT(m_primary_pdev_chunks_list.size(), m_primary_pdev_chunks_list.capacity(),
+                     "vdev {} cannot have more than {} pdevs", m_name, m_primary_pdev_chunks_list.capacity());
+    // Within the reserved capacity, so the existing entries are not moved under the readers
+    m_primary_pdev_chunks_list.push_back(std::move(pcm));
+    m_num_pdevs.store(s_cast< uint32_t >(m_primary_pdev_chunks_list.size()), std::memory_order_release);
+}
+
+void VirtualDev::rebalance_alloc_weights() {
+    std::lock_guard< decltype(m_mgmt_mutex) > lock{m_mgmt_mutex};
+    set_alloc_weights();
+}
+
+void VirtualDev::set_alloc_weights() {
+    std::vector< uint64_t > weights;
+    auto const npdevs = num_pdevs();
+    weights.reserve(npdevs);
+    for (uint32_t i{0}; i < npdevs; ++i) {
+        auto const& pcm = m_primary_pdev_chunks_list[i];
+        uint64_t free_blks{0};
+        for (const auto* chunk : pcm.chunks_in_pdev) {
+            free_blks += chunk->blk_allocator()->available_blks();
+        }
+        weights.push_back(free_blks);
+    }
+    LOGINFO("vdev {} allocation weights per pdev (free blks) set to [{}]", m_name, fmt::join(weights, ","));
+    m_selector->set_weights(weights);
+}
 
 void VirtualDev::rm_device() {
     for (auto& pcm : m_primary_pdev_chunks_list) {
@@ -861,7 +1416,7 @@ void VirtualDev::rm_device() {
 }
 
 void VirtualDev::cp_flush() {
-    for (size_t i{0}; i < m_primary_pdev_chunks_list.size(); ++i) {
+    for (uint32_t i{0}; i < num_pdevs(); ++i) {
         for (size_t chunk_indx{0}; chunk_indx < m_primary_pdev_chunks_list[i].chunks_in_pdev.size(); ++chunk_indx) {
             auto* chunk = m_primary_pdev_chunks_list[i].chunks_in_pdev[chunk_indx];
             chunk->cp_flush();
@@ -884,8 +1439,8 @@ uint32_t VirtualDev::num_mirrors() const { return m_vb->num_mirrors; }
 nlohmann::json VirtualDev::get_status(const int log_level) const {
     nlohmann::json j;
     try {
-        for (const auto& pdev_chunks : m_primary_pdev_chunks_list) {
-            auto const chunk_list = pdev_chunks.chunks_in_pdev;
+        for (uint32_t i{0}; i < num_pdevs(); ++i) {
+            auto const chunk_list = m_primary_pdev_chunks_list[i].chunks_in_pdev;
             for (const auto& chunk : chunk_list) {
                 nlohmann::json chunk_j;
                 chunk_j["ChunkInfo"] = chunk->get_status(log_level);
@@ -900,35 +1455,191 @@ nlohmann::json VirtualDev::get_status(const int log_level) const {
 }
 
 ///////////////////////// VirtualDev Private Methods /////////////////////////////
-void VirtualDev::write_nmirror(const char* buf, const uint32_t size, PhysicalDevChunk* chunk,
-                               const uint64_t dev_offset_in) {
-    uint64_t dev_offset = dev_offset_in;
-    const uint64_t primary_chunk_offset = dev_offset - chunk->start_offset();
+struct hedged_read_state {
+    // All the fields are accessed only on the reactor which issued the read, since the read completions and the
+    // hedge timer are on that same reactor
+    std::vector< iovec > user_iovs; // Filled from the buffer of the first copy which is read successfully
+    uint64_t size{0};
+    vdev_io_comp_cb_t cb;
+    void* cookie{nullptr};
+    std::vector< PhysicalDevChunk* > copies; // Copies in the order to be read, least loaded first
+    uint64_t chunk_offset{0};                // Offset of the data within the chunk, same across copies
+    uint32_t next_copy{0};
+    uint32_t outstanding{0};
+    iomgr::timer_handle_t timer_hdl{iomgr::null_timer_handle};
+    bool completed{false};
+};
+
+bool VirtualDev::use_hedged_read() const {
+    // Hedge timer is a thread timer, which needs the read to be issued from a reactor. Reads from any other thread are
+    // done on the least loaded copy without hedging.
+    return num_mirrors() && (HS_DYNAMIC_CONFIG(device->read_hedge_threshold_us) != 0) && iomanager.am_i_io_reactor();
+}
 
-    // Write to the mirror as well
-    for (auto i : boost::irange< uint32_t >(0, num_mirrors())) {
-        for (auto* mchunk : m_mirror_chunks.find(chunk)->second) {
-            dev_offset = mchunk->start_offset() + primary_chunk_offset;
+PhysicalDevChunk* VirtualDev::pick_read_chunk(PhysicalDevChunk* primary_chunk) {
+    if (!num_mirrors()) { return primary_chunk; }
 
-            // We do not support async mirrored writes yet.
-            mchunk->physical_dev_mutable()->sync_write(buf, size, dev_offset);
+    PhysicalDevChunk* rchunk = primary_chunk;
+    auto min_reads = primary_chunk->physical_dev()->outstanding_reads();
+    for (auto* mchunk : m_mirror_chunks.find(primary_chunk)->second) {
+        auto const nreads = mchunk->physical_dev()->outstanding_reads();
+        if (nreads < min_reads) {
+            min_reads = nreads;
+            rchunk = mchunk;
         }
     }
+    if (rchunk != primary_chunk) { COUNTER_INCREMENT(m_metrics, vdev_mirror_read_count, 1); }
+    return rchunk;
+}
+
+void VirtualDev::hedged_read(const iovec* iov, int iovcnt, uint64_t size, PhysicalDevChunk* primary_chunk,
+                             uint64_t dev_offset, vdev_io_comp_cb_t cb, const void* cookie) {
+    auto hr = std::make_shared< hedged_read_state >();
+    hr->user_iovs.assign(iov, iov + iovcnt);
+    hr->size = size;
+    hr->cb = std::move(cb);
+    hr->cookie = const_cast< void* >(cookie);
+    hr->chunk_offset = dev_offset - primary_chunk->start_offset();
+
+    hr->copies.push_back(primary_chunk);
+    auto const& mchunks = m_mirror_chunks.find(primary_chunk)->second;
+    hr->copies.insert(hr->copies.end(), mchunks.cbegin(), mchunks.cend());
+    std::stable_sort(hr->copies.begin(), hr->copies.end(), [](const PhysicalDevChunk* a, const PhysicalDevChunk* b) {
+        return a->physical_dev()->outstanding_reads() < b->physical_dev()->outstanding_reads();
+    });
+    if (hr->copies.front() != primary_chunk) { COUNTER_INCREMENT(m_metrics, vdev_mirror_read_count, 1); }
+
+    issue_hedged_read(hr);
+    if (hr->completed) { return; }
+
+    hr->timer_hdl = iomanager.schedule_thread_timer(
+        HS_DYNAMIC_CONFIG(device->read_hedge_threshold_us) * 1000, false /* recurring */, nullptr /* cookie */,
+        [this, hr](void*) {
+            hr->timer_hdl = iomgr::null_timer_handle;
+            if (!hr->completed && (hr->next_copy < hr->copies.size())) {
+                COUNTER_INCREMENT(m_metrics, vdev_hedged_read_count, 1);
+                issue_hedged_read(hr);
+            }
+        });
+}
+
+void VirtualDev::issue_hedged_read(const std::shared_ptr< hedged_read_state >& hr) {
+    auto const copy_idx = hr->next_copy++;
+    auto* chunk = hr->copies[copy_idx];
+    auto* pdev = chunk->physical_dev_mutable();
+
+    // Every copy is read on its own buffer, so that a read which completes after the caller is completed never lands
+    // on the caller iovs.
+    auto* read_buf = hs_utils::iobuf_alloc(hr->size, sisl::buftag::common, pdev->align_size());
+    ++hr->outstanding;
+    async_read_internal(r_cast< char* >(read_buf), hr->size, pdev, chunk, chunk->start_offset() + hr->chunk_offset,
+                        [this, hr, read_buf, copy_idx](std::error_condition err, void*) {
+                            --hr->outstanding;
+                            if (!hr->completed) {
+                                if (!err) {
+                                    if (copy_idx != 0) {
+                                        COUNTER_INCREMENT(m_metrics, vdev_hedged_read_won_count, 1);
+                                    }
+                                    complete_hedged_read(hr, read_buf, no_error);
+                                } else {
+                                    on_hedged_read_failure(hr, err);
+                                }
+                            }
+                            hs_utils::iobuf_free(read_buf, sisl::buftag::common);
+                        },
+                        nullptr);
 }
 
-void VirtualDev::writev_nmirror(const iovec* iov, const int iovcnt, const uint32_t size, PhysicalDevChunk* chunk,
-                                const uint64_t dev_offset_in) {
-    uint64_t dev_offset = dev_offset_in;
+void VirtualDev::on_hedged_read_failure(const std::shared_ptr< hedged_read_state >& hr, std::error_condition err) {
+    if (hr->next_copy < hr->copies.size()) {
+        // Failover to the next copy right away instead of waiting for the hedge timer
+        issue_hedged_read(hr);
+    } else if (hr->outstanding == 0) {
+        complete_hedged_read(hr, nullptr, err);
+    }
+}
+
+void VirtualDev::complete_hedged_read(const std::shared_ptr< hedged_read_state >& hr, const uint8_t* buf,
+                                      std::error_condition err) {
+    hr->completed = true;
+    if (hr->timer_hdl != iomgr::null_timer_handle) {
+        iomanager.cancel_timer(hr->timer_hdl);
+        hr->timer_hdl = iomgr::null_timer_handle;
+    }
+
+    if (buf) {
+        uint64_t copied{0};
+        for (const auto& iov : hr->user_iovs) {
+            std::memcpy(iov.iov_base, buf + copied, iov.iov_len);
+            copied += iov.iov_len;
+        }
+    }
+    hr->cb(err, hr->cookie);
+}
+
+void VirtualDev::write_nmirror(const char* buf, uint32_t size, PhysicalDevChunk* chunk, uint64_t dev_offset,
+                               const boost::intrusive_ptr< vdev_req_context >& req, bool part_of_batch) {
+    fan_out_copies(chunk, dev_offset, req,
+                   [buf, size, part_of_batch](PhysicalDevChunk* copy_chunk, uint64_t copy_offset,
+                                              vdev_req_context* copy_req) {
+                       issue_write(copy_chunk->physical_dev_mutable(), buf, size, copy_offset, copy_req,
+                                   part_of_batch);
+                   });
+}
+
+void VirtualDev::writev_nmirror(const iovec* iov, int iovcnt, uint64_t size, PhysicalDevChunk* chunk,
+                                uint64_t dev_offset, const boost::intrusive_ptr< vdev_req_context >& req,
+                                bool part_of_batch) {
+    fan_out_copies(chunk, dev_offset, req,
+                   [iov, iovcnt, size, part_of_batch](PhysicalDevChunk* copy_chunk, uint64_t copy_offset,
+                                                      vdev_req_context* copy_req) {
+                       issue_writev(copy_chunk->physical_dev_mutable(), iov, iovcnt, size, copy_offset, copy_req,
+                                    part_of_batch);
+                   });
+}
+
+void VirtualDev::fan_out_copies(
+    PhysicalDevChunk* chunk, uint64_t dev_offset, const boost::intrusive_ptr< vdev_req_context >& req,
+    const std::function< void(PhysicalDevChunk*, uint64_t, vdev_req_context*) >& submit_copy) {
+    auto const& mchunks = m_mirror_chunks.find(chunk)->second;
+
+    // Parent req is completed by the last copy to complete, so set the count before submitting any of them
+    req->chunk = nullptr;
+    req->io_on_multi_pdevs = true;
+    req->outstanding_ios.set(s_cast< uint32_t >(mchunks.size() + 1));
+
     const uint64_t primary_chunk_offset = dev_offset - chunk->start_offset();
+    auto const submit = [&](PhysicalDevChunk* copy_chunk) {
+        auto copy_req = vdev_req_context::make_req_context();
+        copy_req->op_type = req->op_type;
+        copy_req->chunk = copy_chunk;
+        copy_req->parent_req = req;
+        submit_copy(copy_chunk, copy_chunk->start_offset() + primary_chunk_offset, copy_req.get());
+    };
+
+    submit(chunk);
+    for (auto* mchunk : mchunks) {
+        submit(mchunk);
+    }
+}
+
+void VirtualDev::sync_write_nmirror(const char* buf, uint32_t size, PhysicalDevChunk* chunk,
+                                    uint64_t dev_offset_in) {
+    const uint64_t primary_chunk_offset = dev_offset_in - chunk->start_offset();
 
     // Write to the mirror as well
-    for (auto i : boost::irange< uint32_t >(0, num_mirrors())) {
-        for (auto* mchunk : m_mirror_chunks.find(chunk)->second) {
-            dev_offset = mchunk->start_offset() + primary_chunk_offset;
+    for (auto* mchunk : m_mirror_chunks.find(chunk)->second) {
+        mchunk->physical_dev_mutable()->sync_write(buf, size, mchunk->start_offset() + primary_chunk_offset);
+    }
+}
 
-            // We do not support async mirrored writes yet.
-            mchunk->physical_dev_mutable()->sync_writev(iov, iovcnt, size, dev_offset);
-        }
+void VirtualDev::sync_writev_nmirror(const iovec* iov, int iovcnt, uint32_t size, PhysicalDevChunk* chunk,
+                                     uint64_t dev_offset_in) {
+    const uint64_t primary_chunk_offset = dev_offset_in - chunk->start_offset();
+
+    // Write to the mirror as well
+    for (auto* mchunk : m_mirror_chunks.find(chunk)->second) {
+        mchunk->physical_dev_mutable()->sync_writev(iov, iovcnt, size, mchunk->start_offset() + primary_chunk_offset);
     }
 }
 
@@ -1015,8 +1726,9 @@ void VirtualDev::add_primary_chunk(PhysicalDevChunk* chunk) {
         pcm.pdev = m_mgr->get_pdev(pdev_id);
         pcm.chunks_in_pdev.push_back(chunk);
 
-        m_primary_pdev_chunks_list.push_back(pcm);
-        m_selector->add_pdev(pcm.pdev);
+        auto* const pdev = pcm.pdev;
+        add_pdev_chunk_map(std::move(pcm));
+        m_selector->add_pdev(pdev);
     }
 
     auto const max_chunk_size = MAX_DATA_CHUNK_SIZE(m_blk_size);
@@ -16,6 +16,7 @@
 #pragma once
 
 #include <atomic>
+#include <condition_variable>
 #include <functional>
 #include <limits>
 #include <memory>
@@ -33,9 +34,11 @@
 #include <sisl/utility/enum.hpp>
 
 #include <homestore/homestore_decl.hpp>
+#include <homestore/small_function.hpp>
 
 #include "device.h"
 #include "device_selector.hpp"
+#include "common/reactor_obj_pool.hpp"
 
 namespace iomgr {
 class DriveInterface;
@@ -53,10 +56,17 @@ struct pdev_chunk_map {
 // ENUM(blk_allocator_type_t, uint8_t, none, fixed, varsize);
 ENUM(vdev_op_type_t, uint8_t, read, write, format, fsync);
 
-typedef std::function< void(std::error_condition, void* /* cookie */) > vdev_io_comp_cb_t;
+typedef small_function< void(std::error_condition, void* /* cookie */) > vdev_io_comp_cb_t;
 typedef std::function< void(void) > vdev_high_watermark_cb_t;
 
-struct vdev_req_context : public sisl::ObjLifeCounter< vdev_req_context > {
+/*
+ * Context of an IO on vdev. It is either allocated from a per reactor pool (make_req_context) or is embedded by the
+ * caller in its own per IO request, which derives from it and overrides free_self(), so that an IO does not need a
+ * separate allocation for its vdev context (see async_writev/async_readv taking a vdev_req_context).
+ *
+ * It is aligned to cache line, so that contexts of IOs in flight on different reactors never share a cache line.
+ */
+struct alignas(64) vdev_req_context : public sisl::ObjLifeCounter< vdev_req_context > {
     uint64_t request_id{0};                       // ID of the request
     uint64_t version{0xDEAD};                     // Version for debugging
     vdev_io_comp_cb_t cb;                         // User callback is put here
@@ -68,17 +78,20 @@ struct vdev_req_context : public sisl::ObjLifeCounter< vdev_req_context > {
     sisl::atomic_counter< uint32_t > outstanding_ios{0}; // Outstanding ios in case of multi pdev io
     PhysicalDevChunk* chunk{nullptr};                    // Chunk where the io is issued if its a single pdev io
     Clock::time_point io_start_time{Clock::now()};
+    boost::intrusive_ptr< vdev_req_context > parent_req; // Parent request, if this is one copy of a mirrored write
+    sisl::atomic_counter< uint32_t > failed_ios{0};      // Number of copies failed in case of mirrored write
+    bool qd_admitted{false}; // Is IO admitted through the pdev's adaptive queue depth
 
     void inc_ref() { intrusive_ptr_add_ref(this); }
     void dec_ref() { intrusive_ptr_release(this); }
 
     static boost::intrusive_ptr< vdev_req_context > make_req_context() {
-        return boost::intrusive_ptr< vdev_req_context >(sisl::ObjectAllocator< vdev_req_context >::make_object());
+        return boost::intrusive_ptr< vdev_req_context >(ReactorObjPool< vdev_req_context >::make_object());
     }
 
     friend void intrusive_ptr_add_ref(vdev_req_context* req) { req->refcount.increment(1); }
     friend void intrusive_ptr_release(vdev_req_context* req) {
-        if (req->refcount.decrement_testz()) { sisl::ObjectAllocator< vdev_req_context >::deallocate(req); }
+        if (req->refcount.decrement_testz()) { req->free_self(); }
     }
 
     vdev_req_context(const vdev_req_context&) = delete;
@@ -90,10 +103,15 @@ struct vdev_req_context : public sisl::ObjLifeCounter< vdev_req_context > {
 
 private:
     static std::atomic< uint64_t > s_req_id;
+    static uint64_t next_request_id();
 
 protected:
-    friend class sisl::ObjectAllocator< vdev_req_context >;
-    vdev_req_context() : request_id{s_req_id.fetch_add(1, std::memory_order_relaxed)} {}
+    friend class ReactorObjPool< vdev_req_context >;
+    vdev_req_context() : request_id{next_request_id()} {}
+
+    // Called when the last reference is dropped. A context embedded in caller's request overrides it to release the
+    // request it is embedded in.
+    virtual void free_self() { ReactorObjPool< vdev_req_context >::deallocate(this); }
 };
 
 class VirtualDevMetrics : public sisl::MetricsGroupWrapper {
@@ -108,6 +126,12 @@ public:
         REGISTER_COUNTER(default_chunk_allocation_cnt, "default chunk allocation count");
         REGISTER_COUNTER(random_chunk_allocation_cnt,
                          "random chunk allocation count"); // ideally it should be zero for hdd
+        REGISTER_COUNTER(vdev_discard_skipped_bytes, "vdev freed bytes which are not discarded (too small extent)");
+        REGISTER_COUNTER(vdev_discard_deferred_bytes, "vdev freed bytes deferred to next discard batch (over limit)");
+        REGISTER_COUNTER(vdev_mirror_read_count, "vdev reads served by a mirror copy instead of primary");
+        REGISTER_COUNTER(vdev_hedged_read_count, "vdev reads reissued on another copy after hedge threshold");
+        REGISTER_COUNTER(vdev_hedged_read_won_count, "vdev reads completed by a hedged copy before the first copy");
+        REGISTER_COUNTER(vdev_striped_alloc_count, "vdev allocations split into stripe units across pdevs");
         register_me_to_farm();
     }
 
@@ -130,6 +154,7 @@ static constexpr uint64_t CHUNK_EOF{0xabcdabcd};
 static constexpr off_t INVALID_OFFSET{std::numeric_limits< off_t >::max()};
 
 struct blkalloc_cp;
+struct hedged_read_state;
 
 class VirtualDev {
 protected:
@@ -139,8 +164,11 @@ protected:
     uint64_t m_chunk_size;   // Chunk size that will be allocated in a physical device
     std::mutex m_mgmt_mutex; // Any mutex taken for management operations (like adding/removing chunks).
 
-    // List of physical devices this virtual device uses and its corresponding chunks for the physdev
+    // List of physical devices this virtual device uses and its corresponding chunks for the physdev. Its reserved
+    // upto max pdevs and only appended to through add_pdev_chunk_map(), which publishes the new size in m_num_pdevs.
+    // Readers which can run along with expand() (IO path, cp flush, stats) use num_pdevs() and never its size().
     std::vector< pdev_chunk_map > m_primary_pdev_chunks_list;
+    std::atomic< uint32_t > m_num_pdevs{0};
 
     // For each of the primary chunk we created, this is the list of mirrored chunks. The physical devices
     // for the mirrored chunk always follows the next device pattern.
@@ -161,6 +189,18 @@ protected:
     PhysicalDevChunk* m_default_chunk{nullptr};
     PhysicalDevGroup m_pdev_group;
 
+    // Blkids freed with discard, per chunk. Pending ones are waiting for their cp to be committed, ready ones are
+    // waiting for the discard reactor, including the ones deferred by the per batch limit.
+    std::map< chunk_num_t, std::vector< BlkId > > m_pending_discard_blks;
+    std::map< chunk_num_t, std::vector< BlkId > > m_ready_discard_blks;
+    std::mutex m_pending_discard_mtx;
+    std::condition_variable m_discard_cv;
+    iomgr::io_thread_t m_discard_thread{nullptr}; // Reactor started on first flush which has anything to discard
+    uint64_t m_discard_inflight_nblks{0};
+    bool m_discard_requested{false};
+    bool m_discard_running{false}; // Batches are scheduled or running on the discard reactor
+    bool m_discard_stop{false};
+
 private:
     static uint32_t s_num_chunks_created; // vdev will not be created in parallel threads;
 
@@ -184,7 +224,7 @@ public:
     VirtualDev& operator=(const VirtualDev& other) = delete;
     VirtualDev(VirtualDev&&) noexcept = delete;
     VirtualDev& operator=(VirtualDev&&) noexcept = delete;
-    virtual ~VirtualDev() = default;
+    virtual ~VirtualDev();
 
     /// @brief Adds chunk to the vdev. It is expected that this will happen at startup time and hence it only
     /// takes lock for writing and not reading
@@ -200,10 +240,13 @@ public:
     /// TODO: organize chunks in a vector so that we can get next chunk id easily;
     PhysicalDevChunk* get_next_chunk(uint32_t dev_id, uint32_t chunk_id);
 
-    /// @brief Formats the vdev asynchronously by zeroing the entire vdev. It will use underlying physical device
-    /// capabilities to zero them if fast zero is possible, otherwise will zero block by block
-    /// @param cb Callback after formatting is completed.
-    virtual void async_format(vdev_io_comp_cb_t cb);
+    /// @brief Formats the vdev asynchronously by zeroing all the chunks on all pdevs in parallel. It will use
+    /// underlying physical device capabilities to zero them if fast zero is possible, otherwise will write zeros.
+    /// Drive offload is a blocking call and hence is done off the caller thread, which is never blocked by the format.
+    /// @param cb Callback after formatting is completed. Called right away if the vdev has no chunks to zero.
+    /// @param zero_size_per_chunk : Size to zero from the start of every chunk, 0 zeroes the entire chunk. Vdevs whose
+    /// recovery only needs the start of the chunks to be zero (say journal) can limit the format to that.
+    virtual void async_format(vdev_io_comp_cb_t cb, uint64_t zero_size_per_chunk = 0);
 
     /////////////////////// Block Allocation related methods /////////////////////////////
     /// @brief This method allocates contigous blocks in the vdev
@@ -214,7 +257,8 @@ public:
     virtual BlkAllocStatus alloc_contiguous_blk(blk_count_t nblks, const blk_alloc_hints& hints, BlkId* out_blkid);
 
     /// @brief This method allocates blocks in the vdev and it could be non-contiguous, hence multiple BlkIds are
-    /// returned
+    /// returned. If stripe_unit_size is configured and the vdev spans multiple pdevs, a large allocation is split into
+    /// stripe unit sized BlkIds on consecutive pdevs.
     /// @param nblks : Number of blocks to allocate
     /// @param hints : Hints about block allocation, (specific device to allocate, stream etc)
     /// @param out_blkid : Reference to the vector of blkids to be placed. It appends into the vector
@@ -238,6 +282,35 @@ public:
     virtual bool free_on_realtime(const BlkId& b);
     virtual void free_blk(const BlkId& b);
 
+    /// @brief Frees the blkid and discards it on the drive. If discard is enabled, the blkid is only queued here and
+    /// it is discarded and freed to the allocator on the next flush_discards(), so that it can't be reallocated while
+    /// the discard is pending. Otherwise it is freed right away, same as free_blk.
+    /// @param b : BlkId to free
+    virtual void free_blk_with_discard(const BlkId& b);
+
+    /// @brief Hands over the blkids queued by free_blk_with_discard so far to the vdev discard reactor and returns
+    /// without waiting. Discard reactor coalesces them per chunk, discards the extents on the drive (on primary and
+    /// mirror chunks) and frees them to the allocator. Extents beyond the configured limit per batch are deferred to
+    /// the batch of next flush_discards(). Callers are expected to call this only after the checkpoint which freed
+    /// these blkids is committed.
+    void flush_discards();
+
+    /// @brief Same as flush_discards(), but hands over only the given blkids, which were taken by
+    /// take_pending_discards() when the checkpoint which freed them was switched over.
+    void flush_discards(std::map< chunk_num_t, std::vector< BlkId > > blks);
+
+    /// @brief Takes out the blkids queued by free_blk_with_discard so far, so that the checkpoint being switched over
+    /// can flush them once it is committed, without the blkids freed in the next checkpoint.
+    std::map< chunk_num_t, std::vector< BlkId > > take_pending_discards();
+
+    /// @brief Stops the discard reactor after its current batch and synchronously discards and frees all the blkids
+    /// handed over by flush_discards(), ignoring the per batch limit. Blkids which are not flushed yet are left as is,
+    /// since their checkpoint is not committed. Expected to be called when the service owning the vdev is stopped.
+    void drain_discards();
+
+    /// @brief Number of blks freed with discard, which are not discarded and freed to the allocator yet
+    uint64_t discard_backlog_blks();
+
     /////////////////////// Write API related methods /////////////////////////////
     /// @brief Asynchornously write the buffer to the device on a given blkid
     /// @param buf : Buffer to write data from
@@ -263,6 +336,18 @@ public:
     void async_writev(const iovec* iov, int iovcnt, const BlkId& bid, vdev_io_comp_cb_t cb,
                       const void* cookie = nullptr, bool part_of_batch = false);
 
+    /// @brief Asynchornously write the vector of buffers to the blkid, with the request context provided by the caller.
+    /// It lets callers embed the context in their own per IO request, so that the IO does not allocate one.
+    /// @param iov : Vector of buffer to write data from
+    /// @param iovcnt : Count of buffer
+    /// @param bid  BlkId which was previously allocated. It is expected that entire size was allocated previously.
+    /// @param req : Newly constructed context with its cb and cookie set. Its reference is owned by the IO from now on
+    /// and it is released (free_self) after the callback is called.
+    /// @param part_of_batch : Is this write part of batch io. If true, caller is expected to call submit_batch at
+    /// the end of the batch, otherwise this write request will not be queued.
+    void async_writev(const iovec* iov, int iovcnt, const BlkId& bid, vdev_req_context* req,
+                      bool part_of_batch = false);
+
     /// @brief Synchronously write the buffer to the blkid
     /// @param buf : Buffer to write data from
     /// @param size : Size of the buffer
@@ -279,7 +364,8 @@ public:
 
     /////////////////////// Read API related methods /////////////////////////////
 
-    /// @brief Asynchronously read the data for a given BlkId.
+    /// @brief Asynchronously read the data for a given BlkId. If the vdev is mirrored, the read is issued on the least
+    /// loaded copy and hedged on other copies if the read_hedge_threshold_us is configured.
     /// @param buf : Buffer to read data to
     /// @param size : Size of the buffer
     /// @param bid : BlkId from data needs to be read
@@ -306,6 +392,20 @@ public:
     void async_readv(iovec* iovs, int iovcnt, uint64_t size, const BlkId& bid, vdev_io_comp_cb_t cb,
                      const void* cookie = nullptr, bool part_of_batch = false);
 
+    /// @brief Asynchronously read the data for a given BlkId to the vector of buffers, with the request context
+    /// provided by the caller. It lets callers embed the context in their own per IO request, so that the IO does not
+    /// allocate one.
+    /// @param iov : Vector of buffer to write read to
+    /// @param iovcnt : Count of buffer
+    /// @param size : Size of the actual data
+    /// @param bid : BlkId from data needs to be read
+    /// @param req : Newly constructed context with its cb and cookie set. Its reference is owned by the IO from now on
+    /// and it is released (free_self) after the callback is called.
+    /// @param part_of_batch : Is this read part of batch io. If true, caller is expected to call submit_batch at
+    /// the end of the batch, otherwise this read request will not be queued.
+    void async_readv(iovec* iovs, int iovcnt, uint64_t size, const BlkId& bid, vdev_req_context* req,
+                     bool part_of_batch = false);
+
     /// @brief Synchronously read the data for a given BlkId.
     /// @param buf : Buffer to read data to
     /// @param size : Size of the buffer
@@ -332,6 +432,13 @@ public:
     void get_vb_context(const sisl::blob& ctx_data) const;
     void update_vb_context(const sisl::blob& ctx_data);
     virtual void recovery_done();
+
+    /// @brief Info block of the vdev, with which it can be opened again through the recovery constructor
+    vdev_info_block* info_blk() { return m_vb; }
+
+    /// @brief Chunk numbers of the primary chunks of the vdev, which are the chunk numbers of BlkIds on it. Each of
+    /// them has blks_per_chunk() blks.
+    std::vector< chunk_num_t > primary_chunk_ids();
     void cp_flush();
 
     ////////////////////////// Standard Getters ///////////////////////////////
@@ -351,7 +458,20 @@ public:
 
     // Remove this virtualdev altogether
     void rm_device();
-    void expand(const uint32_t addln_size);
+
+    /// @brief Grows the vdev online by adding chunks from the pdevs of its group which are not part of this vdev yet
+    /// (say pdevs added through DeviceManager::add_device). New chunks get their own blk allocators and are available
+    /// for allocation right away. The vdev info block is updated, so they are recovered on the next boot. Mirrored
+    /// vdevs are not supported, since the mirror map is read without a lock in the IO path.
+    /// @param addln_size : Additional size needed, rounded up to the chunk size of the vdev
+    /// @param rebalance : Weigh the device selection for allocations by the free space on each pdev, so that new pdevs
+    /// take more of the new writes
+    /// @return Size actually added, 0 if there are no new pdevs or no space on them
+    virtual uint64_t expand(uint64_t addln_size, bool rebalance = true);
+
+    /// @brief Sets the allocation weight of every pdev in the vdev to its free space. Can be called any time the
+    /// free space is skewed across the pdevs. Serialized with expand.
+    void rebalance_alloc_weights();
 
     /* Create debug bitmap for all chunks */
     virtual BlkAllocStatus create_debug_bm();
@@ -440,9 +560,65 @@ protected:
                                 uint64_t dev_offset);
 
 private:
-    void write_nmirror(const char* buf, const uint32_t size, PhysicalDevChunk* chunk, const uint64_t dev_offset_in);
-    void writev_nmirror(const iovec* iov, const int iovcnt, const uint32_t size, PhysicalDevChunk* chunk,
-                        const uint64_t dev_offset_in);
+    /// @brief Appends the pdev and its chunks to the pdev list, after which it is visible to readers of num_pdevs()
+    void add_pdev_chunk_map(pdev_chunk_map&& pcm);
+    uint32_t num_pdevs() const { return m_num_pdevs.load(std::memory_order_acquire); }
+    /// @brief Weighs the device selection by the free space on each pdev. Caller is expected to hold m_mgmt_mutex
+    void set_alloc_weights();
+
+    /// @brief Issues the write/read of an IO whose context (with callback and cookie) is already prepared
+    void writev_with_req(const iovec* iov, int iovcnt, uint64_t size, PhysicalDev* pdev, PhysicalDevChunk* pchunk,
+                         uint64_t dev_offset, const boost::intrusive_ptr< vdev_req_context >& req, bool part_of_batch);
+    void readv_with_req(iovec* iovs, int iovcnt, uint64_t size, PhysicalDev* pdev, PhysicalDevChunk* pchunk,
+                        uint64_t dev_offset, const boost::intrusive_ptr< vdev_req_context >& req, bool part_of_batch);
+
+    /// @brief Writes the buffer asynchronously on the primary chunk and all its mirror chunks in parallel. The req is
+    /// completed (and its callback is called) only after all copies are written. If any copy fails, the req is
+    /// completed with the error of the first failed copy.
+    void write_nmirror(const char* buf, uint32_t size, PhysicalDevChunk* chunk, uint64_t dev_offset,
+                       const boost::intrusive_ptr< vdev_req_context >& req, bool part_of_batch);
+    void writev_nmirror(const iovec* iov, int iovcnt, uint64_t size, PhysicalDevChunk* chunk, uint64_t dev_offset,
+                        const boost::intrusive_ptr< vdev_req_context >& req, bool part_of_batch);
+
+    /// @brief Creates a child req per copy (primary and mirrors) of the parent req and calls submit_copy on each of
+    /// them with the chunk and device offset of that copy.
+    void fan_out_copies(PhysicalDevChunk* chunk, uint64_t dev_offset,
+                        const boost::intrusive_ptr< vdev_req_context >& req,
+                        const std::function< void(PhysicalDevChunk*, uint64_t, vdev_req_context*) >& submit_copy);
+
+    void sync_write_nmirror(const char* buf, uint32_t size, PhysicalDevChunk* chunk, uint64_t dev_offset_in);
+    void sync_writev_nmirror(const iovec* iov, int iovcnt, uint32_t size, PhysicalDevChunk* chunk,
+                             uint64_t dev_offset_in);
+
+    /// @brief Picks the copy (primary or one of its mirror chunks) with the least outstanding reads to read from.
+    /// Returns the primary chunk itself if there are no mirrors.
+    PhysicalDevChunk* pick_read_chunk(PhysicalDevChunk* primary_chunk);
+
+    /// @brief Whether reads are to be hedged, which needs mirrors, a hedge threshold and the caller on a reactor
+    bool use_hedged_read() const;
+
+    /// @brief Reads the data from the least loaded copy and if it is not completed within the hedge threshold (or it
+    /// fails), reissues the read on the next copy. Each copy is read on its own buffer and the first successful read is
+    /// copied to the caller iovs and completes the caller; reads which complete later are dropped. Hedge timer is
+    /// cancelled once the caller is completed.
+    void hedged_read(const iovec* iov, int iovcnt, uint64_t size, PhysicalDevChunk* primary_chunk,
+                     uint64_t dev_offset, vdev_io_comp_cb_t cb, const void* cookie);
+    void issue_hedged_read(const std::shared_ptr< hedged_read_state >& hr);
+    void on_hedged_read_failure(const std::shared_ptr< hedged_read_state >& hr, std::error_condition err);
+    void complete_hedged_read(const std::shared_ptr< hedged_read_state >& hr, const uint8_t* buf,
+                              std::error_condition err);
+
+    /// @brief Runs on the discard reactor a batch of the ready blkids for every flush_discards() request meanwhile
+    void run_discard_batches();
+
+    /// @brief Waits for the batch running on the discard reactor and stops the reactor, if started
+    void stop_discard_reactor();
+
+    /// @brief Coalesces the blkids per chunk, discards the extents on the drive and frees the blkids to the allocator.
+    /// Extents beyond the max_bytes (the first extent is always discarded, so that a large extent can't starve) are
+    /// not discarded nor freed, but returned to the caller.
+    std::map< chunk_num_t, std::vector< BlkId > > discard_batch(std::map< chunk_num_t, std::vector< BlkId > >& blks,
+                                                                uint64_t max_bytes);
 
     virtual BlkAllocStatus do_alloc_blk(blk_count_t nblks, const blk_alloc_hints& hints,
                                         std::vector< BlkId >& out_blkid);
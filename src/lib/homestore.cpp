@@ -34,6 +34,7 @@
 #include "common/homestore_config.hpp"
 #include "common/homestore_assert.hpp"
 #include "common/homestore_status_mgr.hpp"
+#include "common/io_trace.hpp"
 #include "device/physical_dev.hpp"
 #include "device/device.h"
 #include "device/virtual_dev.hpp"
@@ -158,6 +159,11 @@ void HomeStore::init(bool wait_for_init) {
     ///////////// Config related setup /////////////////////////
     HomeStoreDynamicConfig::init_settings_default();
 
+    IOTrace::set_ring_size(HS_DYNAMIC_CONFIG(generic->io_trace_ring_size));
+    IOTrace::set_enabled(HS_DYNAMIC_CONFIG(generic->io_trace_enabled));
+    m_status_mgr->register_status_cb("IOTrace",
+                                     [](const int verbosity_level) { return IOTrace::dump(verbosity_level); });
+
     // Restrict iomanager to throttle upto the app mem size allocated for us
     iomanager.set_io_memory_limit(HS_STATIC_CONFIG(input.io_mem_size()));
 
@@ -222,7 +228,12 @@ void HomeStore::shutdown(bool wait, const hs_comp_callback& done_cb) {
             m_meta_service.reset();
         }
 
-        if (has_data_service()) { m_data_service.reset(); }
+        if (has_index_service()) { m_index_service->stop(); }
+
+        if (has_data_service()) {
+            m_data_service->stop();
+            m_data_service.reset();
+        }
 
         m_dev_mgr->close_devices();
         m_dev_mgr.reset();
@@ -325,6 +336,7 @@ void HomeStore::init_done() {
     m_cp_mgr = std::make_unique< CPManager >(is_first_time_boot()); // Initialize CPManager
     m_meta_service->start(is_first_time_boot());
     m_resource_mgr->set_total_cap(m_dev_mgr->total_cap());
+    if (has_data_service()) { m_data_service->start(); }
 
     // In case of custom recovery, let consumer starts the recovery and it is consumer module's responsibilities to
     // start log store
@@ -371,6 +383,12 @@ void HomeStore::new_vdev_found(DeviceManager* dev_mgr, vdev_info_block* vb) {
     blkstore_blob* blob = r_cast< blkstore_blob* >(vb->context_data);
 
     switch (blob->type) {
+    case blkstore_type::DATA_STORE:
+    case blkstore_type::DATA_FAST_TIER_STORE:
+        // Data service opens its data vdev and, if tiering is on, its fast tier vdev
+        if (has_data_service()) { m_data_service->open_vdev(vb); }
+        break;
+
     case blkstore_type::DATA_LOGDEV_STORE:
         if (has_log_service() && m_data_log_store_size_pct) {
             m_log_service->open_vdev(vb, LogStoreService::DATA_LOG_FAMILY_IDX);
@@ -38,6 +38,7 @@ public:
     sisl::ThreadVector< BlkId >* m_free_node_blkid_list{nullptr};
     sisl::atomic_counter< int64_t > m_dirty_buf_count{0};
     cp_flush_done_cb_t m_flush_done_cb;
+    Clock::time_point m_flush_start_time; // Time at which flush of dirty buffers of this cp started
 
     std::mutex m_flush_buffer_mtx;
     flush_buffer_iterator m_buf_it;
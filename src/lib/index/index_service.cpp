@@ -68,6 +68,8 @@ void IndexService::start() {
                                                   hs()->device_mgr()->atomic_page_size({PhysicalDevGroup::FAST}));
 }
 
+void IndexService::stop() { m_vdev->drain_discards(); }
+
 void IndexService::start_threads() {
     struct Context {
         std::condition_variable cv;
@@ -17,12 +17,14 @@
 #include <homestore/btree/btree.ipp>
 #include <homestore/index_service.hpp>
 #include <homestore/homestore.hpp>
+#include <homestore/homestore_probes.hpp>
 #include "common/homestore_assert.hpp"
 
 #include "wb_cache.hpp"
 #include "index_cp.hpp"
 #include "device/virtual_dev.hpp"
 #include "common/resource_mgr.hpp"
+#include "common/io_trace.hpp"
 
 namespace homestore {
 IndexWBCache& wb_cache() { return index_service().wb_cache(); }
@@ -87,7 +89,11 @@ retry:
     // Read the buffer from virtual device
     auto idx_buf = std::make_shared< IndexBuffer >(blkid, m_node_size, m_vdev->align_size());
     auto raw_buf = idx_buf->raw_buffer();
+    IOTrace::record(io_trace_event_t::btree_node_read_start, id, m_node_size);
+    [[maybe_unused]] auto const read_start_time = Clock::now();
     auto const size = m_vdev->sync_read(r_cast< char* >(raw_buf), m_node_size, blkid);
+    IOTrace::record(io_trace_event_t::btree_node_read_done, id, m_node_size);
+    HS_PROBE(wbcache_read_miss, id, m_node_size, get_elapsed_time_us(read_start_time));
     if (size != m_node_size) { return std::make_error_condition(std::io_errc::stream); }
 
     // Create the btree node out of buffer
@@ -147,10 +153,13 @@ void IndexWBCache::async_cp_flush(CPContext* context, cp_flush_done_cb_t cp_done
     IndexCPContext* cp_ctx = s_cast< IndexCPContext* >(context);
     if (!cp_ctx->any_dirty_buffers()) {
         CP_PERIODIC_LOG(DEBUG, cp_ctx->id(), "Btree does not have any dirty buffers to flush");
+        m_vdev->flush_discards(); // Discard any blks freed by previous cp
         cp_done_cb(cp_ctx->cp());
         return; // nothing to flush
     }
 
+    HS_PROBE(wbcache_flush_start, cp_ctx->id(), cp_ctx->m_dirty_buf_count.get());
+    cp_ctx->m_flush_start_time = Clock::now();
     cp_ctx->m_flush_done_cb = std::move(cp_done_cb);
     cp_ctx->prepare_flush_iteration();
 
@@ -263,12 +272,18 @@ void IndexWBCache::get_next_bufs_internal(IndexCPContext* cp_ctx, uint32_t max_c
 }
 
 void IndexWBCache::do_free_btree_blks(IndexCPContext* cp_ctx) {
+    // Blks freed by the previous cp are safe to discard now, since that cp is committed (cps are not flushed in
+    // parallel). Blks freed by this cp are queued and discarded on next cp, as until this cp is committed, recovery
+    // could still read the old btree nodes from them.
+    m_vdev->flush_discards();
+
     BlkId* pbid;
     while ((pbid = cp_ctx->next_blkid()) != nullptr) {
-        m_vdev->free_blk(*pbid);
+        m_vdev->free_blk_with_discard(*pbid);
     }
 
     m_vdev->cp_flush(); // As of now its a sync call, since metablk manager is sync write
+    HS_PROBE(wbcache_flush_done, cp_ctx->id(), get_elapsed_time_us(cp_ctx->m_flush_start_time));
     cp_ctx->m_flush_done_cb(cp_ctx->cp());
 }
 
@@ -19,18 +19,22 @@
 #include <iterator>
 
 #include <sisl/fds/vector_pool.hpp>
+#include <sisl/fds/compress.hpp>
 #include <isa-l/crc.h>
 
 #include <homestore/logstore_service.hpp>
 #include <homestore/meta_service.hpp>
 #include <homestore/homestore.hpp>
+#include <homestore/homestore_probes.hpp>
 
 #include "log_dev.hpp"
 #include "device/journal_vdev.hpp"
+#include "common/error.h"
 #include "common/homestore_assert.hpp"
 #include "common/homestore_config.hpp"
 #include "common/homestore_flip.hpp"
 #include "common/homestore_utils.hpp"
+#include "common/io_trace.hpp"
 
 namespace homestore {
 
@@ -43,8 +47,9 @@ SISL_LOGGING_DECL(logstore)
 static bool has_data_service() { return HomeStore::instance()->has_data_service(); }
 // static BlkDataService& data_service() { return HomeStore::instance()->data_service(); }
 
-LogDev::LogDev(const logstore_family_id_t f_id, const std::string& logdev_name) :
+LogDev::LogDev(const logstore_family_id_t f_id, const uint32_t shard_idx, const std::string& logdev_name) :
         m_family_id{f_id},
+        m_shard_idx{shard_idx},
         m_logdev_meta{logdev_name} {
     m_flush_size_multiple = 0;
     if (f_id == LogStoreService::DATA_LOG_FAMILY_IDX) {
@@ -59,14 +64,19 @@ LogDev::~LogDev() = default;
 void LogDev::start(bool format, JournalVirtualDev* vdev) {
     HS_LOG_ASSERT((m_append_comp_cb != nullptr), "Expected Append callback to be registered");
     HS_LOG_ASSERT((m_store_found_cb != nullptr), "Expected Log store found callback to be registered");
-    HS_LOG_ASSERT((m_logfound_cb != nullptr), "Expected Logs found callback to be registered");
+    HS_LOG_ASSERT(((m_logfound_cb != nullptr) || (m_logs_found_batch_cb != nullptr)),
+                  "Expected Logs found callback to be registered");
 
     m_vdev = vdev;
     if (m_flush_size_multiple == 0) { m_flush_size_multiple = m_vdev->phys_page_size(); }
-    THIS_LOGDEV_LOG(INFO, "Initializing logdev with flush size multiple={}", m_flush_size_multiple);
+    logdev_blkstore_blob blob;
+    m_vdev->get_vb_context(sisl::blob{r_cast< uint8_t* >(&blob), sizeof(logdev_blkstore_blob)});
+    m_format_gen = blob.format_gen;
+    THIS_LOGDEV_LOG(INFO, "Initializing logdev shard={} with flush size multiple={} format generation={}", m_shard_idx,
+                    m_flush_size_multiple, m_format_gen);
 
     for (uint32_t i = 0; i < max_log_group; ++i) {
-        m_log_group_pool[i].start(m_flush_size_multiple, m_vdev->align_size());
+        m_log_group_pool[i].start(m_flush_size_multiple, m_vdev->align_size(), m_format_gen);
     }
     m_log_records = std::make_unique< sisl::StreamTracker< log_record > >();
     m_stopped = false;
@@ -93,12 +103,49 @@ void LogDev::start(bool format, JournalVirtualDev* vdev) {
         do_load(m_logdev_meta.get_start_dev_offset());
         m_log_records->reinit(m_log_idx);
         m_last_flush_idx = m_log_idx - 1;
+        m_last_flush_issued_idx = m_last_flush_idx;
+    }
+    {
+        std::unique_lock< std::mutex > lk{m_flush_timer_mtx};
+        m_flush_timer_on = true;
+        start_flush_timer();
+    }
+}
+
+// NOTE: Expects the flush timer lock to be held by the caller
+void LogDev::start_flush_timer() {
+    const auto period_us = LogFlushPolicy::timer_frequency_us();
+    m_flush_timer_period_us.store(period_us, std::memory_order_relaxed);
+    m_flush_timer_hdl =
+        iomanager.schedule_global_timer(period_us * 1000, true, nullptr, iomgr::thread_regex::all_worker,
+                                        [this](void* cookie) { on_flush_timer(); });
+}
+
+void LogDev::on_flush_timer() {
+    // Rearm the timer once its period changes, on the flush thread, as the timer is not cancelled in its own callback
+    if ((LogFlushPolicy::timer_frequency_us() != m_flush_timer_period_us.load(std::memory_order_relaxed)) &&
+        !m_flush_timer_rearming.exchange(true)) {
+        iomanager.run_on(logstore_service().flush_thread(m_shard_idx),
+                         [this]([[maybe_unused]] const io_thread_addr_t addr) {
+                             {
+                                 std::unique_lock< std::mutex > lk{m_flush_timer_mtx};
+                                 if (m_flush_timer_on) {
+                                     iomanager.cancel_timer(m_flush_timer_hdl);
+                                     start_flush_timer();
+                                     THIS_LOGDEV_LOG(INFO, "Flush timer rearmed with period of {} us",
+                                                     m_flush_timer_period_us.load(std::memory_order_relaxed));
+                                 }
+                             }
+                             m_flush_timer_rearming.store(false);
+                         });
+    }
+
+    if (m_pending_flush_size.load() && !m_is_flushing.load(std::memory_order_relaxed)) {
+        flush_if_needed();
+    } else if (is_meta_dirty()) {
+        // No log group is expected to persist the metadata updates anytime soon
+        persist_meta_async();
     }
-    m_flush_timer_hdl = iomanager.schedule_global_timer(
-        HS_DYNAMIC_CONFIG(logstore.flush_timer_frequency_us) * 1000, true, nullptr, iomgr::thread_regex::all_worker,
-        [this](void* cookie) {
-            if (m_pending_flush_size.load() && !m_is_flushing.load(std::memory_order_relaxed)) { flush_if_needed(); }
-        });
 }
 
 void LogDev::stop() {
@@ -119,14 +166,22 @@ void LogDev::stop() {
         m_block_flush_q_cv.wait(lk, [&] { return m_stopped; });
     }
 
+    persist_meta_if_dirty();
+    m_tail_cache.clear();
     m_log_records = nullptr;
     m_logdev_meta.reset();
     m_log_idx.store(0);
     m_pending_flush_size.store(0);
     m_is_flushing.store(false);
     m_last_flush_idx = -1;
+    m_last_flush_issued_idx = -1;
     m_last_truncate_idx = -1;
     m_last_crc = INVALID_CRC32_VALUE;
+    m_flush_policy.reset();
+    m_inflight_groups = 0;
+    m_log_group_idx = 0;
+    m_oldest_flush_group_idx = 0;
+    m_completing = false;
     if (m_block_flush_q != nullptr) {
         sisl::VectorPool< flush_blocked_callback >::free(m_block_flush_q, false /* no_cache */);
     }
@@ -136,13 +191,24 @@ void LogDev::stop() {
 
     THIS_LOGDEV_LOG(INFO, "LogDev stopped successfully");
     // cancel the timer
-    iomanager.cancel_timer(m_flush_timer_hdl);
+    {
+        std::unique_lock< std::mutex > lk{m_flush_timer_mtx};
+        iomanager.cancel_timer(m_flush_timer_hdl);
+        m_flush_timer_on = false;
+    }
     m_hs.reset();
 }
 
 void LogDev::do_load(const off_t device_cursor) {
-    log_stream_reader lstream{device_cursor, m_vdev, m_flush_size_multiple};
+    // Read ahead on the flush reactor of the shard, which has nothing to flush until the logdev is loaded
+    auto read_ahead_thread = logstore_service().flush_thread(m_shard_idx);
+    if (iomanager.am_i_io_reactor() && (iomanager.iothread_self() == read_ahead_thread)) {
+        read_ahead_thread = nullptr;
+    }
+    log_stream_reader lstream{device_cursor, m_vdev, m_flush_size_multiple, m_format_gen, read_ahead_thread};
     logid_t loaded_from{-1};
+    std::vector< log_found_record > found_records;
+    const auto start_time = Clock::now();
 
     off_t group_dev_offset;
     do {
@@ -164,38 +230,59 @@ void LogDev::do_load(const off_t device_cursor) {
         HS_REL_ASSERT_EQ(header->start_idx(), m_log_idx, "log indx is not the expected one");
         if (loaded_from == -1) { loaded_from = header->start_idx(); }
 
-        // Loop through each record within the log group and do a callback
+        // Records of a compressed group are located within its uncompressed data area
+        const sisl::byte_view data_buf = header->is_compressed() ? uncompress_group(header) : buf;
+
+        // Loop through each record within the log group and collect them to callback in a batch
         decltype(header->nrecords()) i{0};
         HS_REL_ASSERT_GT(header->nrecords(), 0, "nrecords greater then zero");
         const auto flush_ld_key =
             logdev_key{header->start_idx() + header->nrecords() - 1, group_dev_offset + header->total_size()};
+        found_records.clear();
         while (i < header->nrecords()) {
             const auto* rec = header->nth_record(i);
             const uint32_t data_offset = (rec->offset + (rec->get_inlined() ? 0 : header->oob_data_offset));
 
-            // Do a callback on the found log entry
-            sisl::byte_view b = buf;
+            sisl::byte_view b = data_buf;
             b.move_forward(data_offset);
             b.set_size(rec->size);
             if (m_last_truncate_idx == -1) { m_last_truncate_idx = header->start_idx() + i; }
-            if (m_logfound_cb) {
-                // Validate if the id is present in rollback info
-                if (m_logdev_meta.is_rolled_back(rec->store_id, header->start_idx() + i)) {
-                    THIS_LOGDEV_LOG(
-                        DEBUG, "logstore_id[{}] log_idx={}, lsn={} has been rolledback, not notifying the logstore",
-                        rec->store_id, (header->start_idx() + i), rec->store_seq_num);
-                } else {
-                    THIS_LOGDEV_LOG(TRACE, "seq num {}, log indx {}, group dev offset {} size {}", rec->store_seq_num,
-                                    (header->start_idx() + i), group_dev_offset, rec->size);
-                    m_logfound_cb(rec->store_id, rec->store_seq_num, {header->start_idx() + i, group_dev_offset},
-                                  flush_ld_key, b, (header->nrecords() - (i + 1)));
-                }
+
+            // Validate if the id is present in rollback info
+            if (m_logdev_meta.is_rolled_back(rec->store_id, header->start_idx() + i)) {
+                THIS_LOGDEV_LOG(DEBUG,
+                                "logstore_id[{}] log_idx={}, lsn={} has been rolledback, not notifying the logstore",
+                                rec->store_id, (header->start_idx() + i), rec->store_seq_num);
+            } else {
+                THIS_LOGDEV_LOG(TRACE, "seq num {}, log indx {}, group dev offset {} size {}", rec->store_seq_num,
+                                (header->start_idx() + i), group_dev_offset, rec->size);
+                found_records.push_back(log_found_record{rec->store_id, rec->store_seq_num,
+                                                         logdev_key{header->start_idx() + i, group_dev_offset},
+                                                         std::move(b), (header->nrecords() - (i + 1))});
             }
             ++i;
         }
+
+        if (m_logs_found_batch_cb) {
+            if (!found_records.empty()) { m_logs_found_batch_cb(found_records, flush_ld_key); }
+        } else if (m_logfound_cb) {
+            for (auto& r : found_records) {
+                m_logfound_cb(r.store_id, r.seq_num, r.ld_key, flush_ld_key, r.buf, r.nremaining_in_batch);
+            }
+        }
         m_log_idx = header->start_idx() + i;
         m_last_crc = header->cur_grp_crc;
     } while (true);
+    lstream.stop_read_ahead();
+
+    const auto elapsed_us = get_elapsed_time_us(start_time);
+    const auto loaded_bytes = lstream.bytes_consumed();
+    THIS_LOGDEV_LOG(INFO, "LogDev recovery loaded {} bytes of log groups in {} ms at {:.2f} MB/s with read ahead of {}",
+                    loaded_bytes, elapsed_us / 1000,
+                    (elapsed_us ? (double(loaded_bytes) / elapsed_us) * 1000000 / (1024 * 1024) : 0.0),
+                    HS_DYNAMIC_CONFIG(logstore.recovery_read_ahead_depth));
+    HISTOGRAM_OBSERVE(logstore_service().m_metrics, logdev_recovery_load_time_ms, elapsed_us / 1000);
+    COUNTER_INCREMENT(logstore_service().m_metrics, logdev_recovery_load_bytes, loaded_bytes);
 
     // Update the tail offset with where we finally end up loading, so that new append entries can be written from
     // here.
@@ -206,32 +293,70 @@ void LogDev::assert_next_pages(log_stream_reader& lstream) {
     THIS_LOGDEV_LOG(INFO,
                     "Logdev reached offset, which has invalid header, because of end of stream. Validating if it is "
                     "indeed the case or there is any corruption");
+
+    // Log groups are written in parallel, so before a crash, the groups written after the one we stopped at could have
+    // reached the device while it did not. None of them were acknowledged as completions are done in order, but we
+    // can see upto (max_log_group - 1) of them with future log_idx.
+    uint32_t n_future_groups{0};
+    logid_t last_future_idx{-1};
     for (uint32_t i{0}; i < HS_DYNAMIC_CONFIG(logstore->recovery_max_blks_read_for_additional_check); ++i) {
         const auto buf = lstream.group_in_next_page();
         if (buf.size() != 0) {
             auto* header = r_cast< const log_group_header* >(buf.bytes());
-            HS_REL_ASSERT_GT(m_log_idx.load(std::memory_order_acquire), header->start_idx(),
-                             "Found a header with future log_idx after reaching end of log. Hence rbuf which was read "
-                             "must have been corrupted, Header: {}",
+            if (header->start_idx() < m_log_idx.load(std::memory_order_acquire)) { continue; }
+            if (header->start_idx() != last_future_idx) {
+                last_future_idx = header->start_idx();
+                ++n_future_groups;
+                THIS_LOGDEV_LOG(INFO, "Found unacknowledged log group written in parallel, ignoring it, Header: {}",
+                                *header);
+            }
+            HS_REL_ASSERT_LT(n_future_groups, max_log_group,
+                             "Found more headers with future log_idx after reaching end of log than log groups could "
+                             "be in flight. Hence rbuf which was read must have been corrupted, Header: {}",
                              *header);
         }
     }
 }
 
 int64_t LogDev::append_async(const logstore_id_t store_id, const logstore_seq_num_t seq_num, const sisl::io_blob& data,
-                             void* cb_context) {
+                             void* cb_context, bool is_padded) {
     auto prev_size = m_pending_flush_size.fetch_add(data.size, std::memory_order_relaxed);
     const auto idx = m_log_idx.fetch_add(1, std::memory_order_acq_rel);
-    auto threshold_size = LogDev::flush_data_threshold_size();
-    m_log_records->create(idx, store_id, seq_num, data, cb_context);
+    m_log_records->create(idx, store_id, seq_num, data, cb_context, is_padded);
+    HS_PROBE(logdev_append, m_family_id, store_id, idx, data.size);
 
-    if (prev_size < threshold_size && ((prev_size + data.size) >= threshold_size) &&
-        !m_is_flushing.load(std::memory_order_relaxed)) {
+    if (m_flush_policy.on_append(prev_size, data.size) && !m_is_flushing.load(std::memory_order_relaxed)) {
         flush_if_needed();
     }
     return idx;
 }
 
+logid_t LogDev::append_batch_async(logstore_id_t store_id, logstore_seq_num_t start_seq_num,
+                                   const std::vector< sisl::io_blob >& blobs, const std::vector< void* >& cb_contexts) {
+    int64_t batch_size{0};
+    for (const auto& b : blobs) {
+        batch_size += b.size;
+    }
+    auto prev_size = m_pending_flush_size.fetch_add(batch_size, std::memory_order_relaxed);
+    const auto start_idx = m_log_idx.fetch_add(blobs.size(), std::memory_order_acq_rel);
+    for (size_t i{0}; i < blobs.size(); ++i) {
+        m_log_records->create(start_idx + i, store_id, start_seq_num + i, blobs[i], cb_contexts[i]);
+        HS_PROBE(logdev_append, m_family_id, store_id, start_idx + i, blobs[i].size);
+    }
+
+    if (m_flush_policy.on_append(prev_size, batch_size) && !m_is_flushing.load(std::memory_order_relaxed)) {
+        flush_if_needed();
+    }
+    return start_idx;
+}
+
+uint8_t* LogDev::alloc_reserved_buf(uint32_t size) const {
+    return hs_utils::iobuf_alloc(sisl::round_up(std::max(size, 1u), m_flush_size_multiple), sisl::buftag::logwrite,
+                                 m_flush_size_multiple);
+}
+
+void LogDev::free_reserved_buf(uint8_t* buf) const { hs_utils::iobuf_free(buf, sisl::buftag::logwrite); }
+
 log_buffer LogDev::read(const logdev_key& key, serialized_log_record& return_record_header) {
     static thread_local sisl::aligned_unique_ptr< uint8_t, sisl::buftag::logread > read_buf;
 
@@ -247,7 +372,7 @@ log_buffer LogDev::read(const logdev_key& key, serialized_log_record& return_rec
 
     auto* header = r_cast< const log_group_header* >(rbuf);
     HS_REL_ASSERT_EQ(header->magic_word(), LOG_GROUP_HDR_MAGIC, "Log header corrupted with magic mismatch!");
-    HS_REL_ASSERT_EQ(header->get_version(), log_group_header::header_version, "Log header version mismatch!");
+    HS_REL_ASSERT_LE(header->get_version(), log_group_header::header_version, "Log header version mismatch!");
     HS_REL_ASSERT_LE(header->start_idx(), key.idx, "log key offset does not match with log_idx");
     HS_REL_ASSERT_GT((header->start_idx() + header->nrecords()), key.idx, "log key offset does not match with log_idx");
     HS_LOG_ASSERT_GE(header->total_size(), header->_inline_data_offset(), "Inconsistent size data in log group");
@@ -260,10 +385,55 @@ log_buffer LogDev::read(const logdev_key& key, serialized_log_record& return_rec
         HS_REL_ASSERT_EQ(header->this_group_crc(), crc, "CRC mismatch on read data");
     }
 
-    auto record_header = header->nth_record(key.idx - header->start_log_idx);
-    uint32_t const data_offset = (record_header->offset + (record_header->get_inlined() ? 0 : header->oob_data_offset));
+    auto const rec_idx = static_cast< uint32_t >(key.idx - header->start_log_idx);
+    if (header->is_compressed()) {
+        // Records of a compressed group can be located only after uncompressing its entire data area, so read the
+        // entire group and validate its crc as well.
+        auto const group_size = sisl::round_up(header->total_size(), m_vdev->align_size());
+        uint8_t* group_buf = rbuf;
+        if (group_size > initial_read_size) {
+            group_buf = hs_utils::iobuf_alloc(group_size, sisl::buftag::logread, m_vdev->align_size());
+            m_vdev->sync_pread(group_buf, group_size, key.dev_offset);
+            header = r_cast< const log_group_header* >(group_buf);
+            crc32_t const crc = crc32_ieee(init_crc32, group_buf + sizeof(log_group_header),
+                                           header->total_size() - sizeof(log_group_header));
+            HS_REL_ASSERT_EQ(header->this_group_crc(), crc, "CRC mismatch on read data");
+        }
+
+        auto const data_buf = uncompress_group(header);
+        return_record_header = *header->nth_record(rec_idx);
+        uint32_t const data_offset =
+            (return_record_header.offset + (return_record_header.get_inlined() ? 0 : header->oob_data_offset));
+        HS_REL_ASSERT_LE(data_offset + return_record_header.size, data_buf.size(), "Log record beyond the log group");
+
+        log_buffer const b{static_cast< uint32_t >(return_record_header.size)};
+        std::memcpy(static_cast< void* >(b.bytes()), static_cast< const void* >(data_buf.bytes() + data_offset),
+                    b.size());
+        if (group_buf != rbuf) { hs_utils::iobuf_free(group_buf, sisl::buftag::logread); }
+        return b;
+    }
+
+    // Take a copy of the record slot, since rbuf could be reused below to read the data
+    auto const slot_offset = log_group_header::record_slot_offset(rec_idx);
+    serialized_log_record record_header;
+    if ((slot_offset + sizeof(serialized_log_record)) <= initial_read_size) {
+        record_header = *header->nth_record(rec_idx);
+    } else {
+        // Record slot area of a large group spans beyond the initial read, read the blocks which has this slot
+        HS_REL_ASSERT_GE(header->get_version(), 1, "Record slot beyond initial read size on version 0 log group");
+        auto const rounded_slot_offset = sisl::round_down(slot_offset, m_vdev->align_size());
+        auto const rounded_slot_size =
+            sisl::round_up(slot_offset + sizeof(serialized_log_record) - rounded_slot_offset, m_vdev->align_size());
+        auto* slot_buf = hs_utils::iobuf_alloc(rounded_slot_size, sisl::buftag::logread, m_vdev->align_size());
+        m_vdev->sync_pread(slot_buf, rounded_slot_size, key.dev_offset + rounded_slot_offset);
+        std::memcpy(voidptr_cast(&record_header),
+                    static_cast< const void* >(slot_buf + slot_offset - rounded_slot_offset),
+                    sizeof(serialized_log_record));
+        hs_utils::iobuf_free(slot_buf, sisl::buftag::logread);
+    }
+    uint32_t const data_offset = (record_header.offset + (record_header.get_inlined() ? 0 : header->oob_data_offset));
 
-    log_buffer const b{static_cast< uint32_t >(record_header->size)};
+    log_buffer const b{static_cast< uint32_t >(record_header.size)};
     if ((data_offset + b.size()) < initial_read_size) {
         std::memcpy(static_cast< void* >(b.bytes()), static_cast< const void* >(rbuf + data_offset),
                     b.size()); // Already read them enough, copy the data
@@ -290,15 +460,195 @@ log_buffer LogDev::read(const logdev_key& key, serialized_log_record& return_rec
         // Free the buffer in case we allocated above
         if (rounded_size > initial_read_size) { hs_utils::iobuf_free(rbuf, sisl::buftag::logread); }
     }
-    return_record_header =
-        serialized_log_record(record_header->size, record_header->offset, record_header->get_inlined(),
-                              record_header->store_seq_num, record_header->store_id);
+    return_record_header = record_header;
     return b;
 }
 
+// State of an async read of a batch of logdev keys, shared by the reads of all the log groups the keys are in
+struct LogDev::async_read_ctx {
+    std::vector< logdev_key > keys;
+    std::vector< log_buffer > bufs;            // Read buffer of each key, in the same order as keys
+    std::vector< std::error_condition > errs; // Error in reading each key, in the same order as keys
+    std::atomic< uint32_t > ngroups_outstanding{0};
+    log_read_callback cb;
+    bool issued_on_reactor{false};
+    iomgr::io_thread_t issuer;
+    Clock::time_point start_time{Clock::now()};
+};
+
+void LogDev::read_async(std::vector< logdev_key > keys, const log_read_callback& cb) {
+    auto ctx = std::make_shared< async_read_ctx >();
+    ctx->bufs.resize(keys.size());
+    ctx->errs.resize(keys.size());
+    ctx->cb = cb;
+    ctx->issued_on_reactor = iomanager.am_i_io_reactor();
+    if (ctx->issued_on_reactor) { ctx->issuer = iomanager.iothread_self(); }
+
+    // All the records of a log group share the dev offset of the group, so that the group is read only once
+    std::map< off_t, std::vector< uint32_t > > group_keys;
+    for (uint32_t i{0}; i < keys.size(); ++i) {
+        group_keys[keys[i].dev_offset].push_back(i);
+    }
+    ctx->keys = std::move(keys);
+    if (group_keys.empty()) {
+        complete_async_read(ctx);
+        return;
+    }
+
+    ctx->ngroups_outstanding.store(static_cast< uint32_t >(group_keys.size()), std::memory_order_release);
+    HISTOGRAM_OBSERVE(logstore_service().m_metrics, logdev_async_read_records_per_group,
+                      ctx->keys.size() / group_keys.size());
+    for (auto& [group_dev_offset, key_positions] : group_keys) {
+        read_group_async(ctx, group_dev_offset, std::move(key_positions));
+    }
+}
+
+void LogDev::read_group_async(const std::shared_ptr< async_read_ctx >& ctx, off_t group_dev_offset,
+                              std::vector< uint32_t > key_positions) {
+    // Size of the group is known only from its header, so read the initial_read_size first, which is good enough for
+    // most of the groups. Larger groups are read again in their entirety.
+    auto* buf = hs_utils::iobuf_alloc(initial_read_size, sisl::buftag::logread, m_vdev->align_size());
+    m_vdev->async_pread(
+        buf, initial_read_size, group_dev_offset,
+        [this, ctx, group_dev_offset, key_positions = std::move(key_positions), buf](std::error_condition err,
+                                                                                     void*) {
+#ifdef _PRERELEASE
+            if (homestore_flip->test_flip("logdev_async_read_error", static_cast< int >(m_family_id))) {
+                err = std::make_error_condition(std::io_errc::stream);
+            }
+#endif
+            auto const* header = r_cast< const log_group_header* >(buf);
+            if (!err && ((header->magic_word() != LOG_GROUP_HDR_MAGIC) || !header->is_layout_valid())) {
+                err = make_error_condition(homestore_error::log_group_corrupted);
+            }
+            if (err) {
+                fail_group_read(ctx, group_dev_offset, key_positions, err);
+                hs_utils::iobuf_free(buf, sisl::buftag::logread);
+                return;
+            }
+
+            auto const group_size = sisl::round_up(header->total_size(), m_vdev->align_size());
+            if (group_size <= initial_read_size) {
+                on_group_read(ctx, group_dev_offset, key_positions, buf);
+                hs_utils::iobuf_free(buf, sisl::buftag::logread);
+                return;
+            }
+            hs_utils::iobuf_free(buf, sisl::buftag::logread);
+
+            auto* group_buf = hs_utils::iobuf_alloc(group_size, sisl::buftag::logread, m_vdev->align_size());
+            m_vdev->async_pread(group_buf, group_size, group_dev_offset,
+                                [this, ctx, group_dev_offset, key_positions, group_buf](std::error_condition err,
+                                                                                         void*) {
+                                    if (err) {
+                                        fail_group_read(ctx, group_dev_offset, key_positions, err);
+                                    } else {
+                                        on_group_read(ctx, group_dev_offset, key_positions, group_buf);
+                                    }
+                                    hs_utils::iobuf_free(group_buf, sisl::buftag::logread);
+                                });
+        });
+}
+
+void LogDev::on_group_read(const std::shared_ptr< async_read_ctx >& ctx, off_t group_dev_offset,
+                           const std::vector< uint32_t >& key_positions, const uint8_t* group_buf) {
+    // Entire group is read, so unlike sync read, CRC of the group is always validated
+    auto const* header = r_cast< const log_group_header* >(group_buf);
+    crc32_t const crc = crc32_ieee(init_crc32, group_buf + sizeof(log_group_header),
+                                   header->total_size() - sizeof(log_group_header));
+    if (header->this_group_crc() != crc) {
+        THIS_LOGDEV_LOG(ERROR, "CRC mismatch on read of log group at dev_offset={}", group_dev_offset);
+        fail_group_read(ctx, group_dev_offset, key_positions,
+                        make_error_condition(homestore_error::log_group_corrupted));
+        return;
+    }
+
+    // Records of a compressed group are located within its uncompressed data area
+    sisl::byte_view uncompressed_buf;
+    const uint8_t* data_buf = group_buf;
+    uint32_t data_buf_size = header->total_size();
+    if (header->is_compressed()) {
+        uncompressed_buf = uncompress_group(header);
+        data_buf = uncompressed_buf.bytes();
+        data_buf_size = uncompressed_buf.size();
+    }
+
+    for (auto const pos : key_positions) {
+        auto const& key = ctx->keys[pos];
+        if ((key.idx < header->start_idx()) || (key.idx >= (header->start_idx() + header->nrecords()))) {
+            THIS_LOGDEV_LOG(ERROR, "log_idx={} is not in the log group at dev_offset={} of logid[{} - {})", key.idx,
+                            group_dev_offset, header->start_idx(), header->start_idx() + header->nrecords());
+            ctx->errs[pos] = make_error_condition(homestore_error::log_group_corrupted);
+            continue;
+        }
+
+        auto const* record_header = header->nth_record(static_cast< uint32_t >(key.idx - header->start_log_idx));
+        uint32_t const data_offset =
+            (record_header->offset + (record_header->get_inlined() ? 0 : header->oob_data_offset));
+        if (data_offset + record_header->size > data_buf_size) {
+            THIS_LOGDEV_LOG(ERROR, "Log record of log_idx={} is beyond the log group at dev_offset={}", key.idx,
+                            group_dev_offset);
+            ctx->errs[pos] = make_error_condition(homestore_error::log_group_corrupted);
+            continue;
+        }
+
+        log_buffer const b{static_cast< uint32_t >(record_header->size)};
+        std::memcpy(static_cast< void* >(b.bytes()), static_cast< const void* >(data_buf + data_offset), b.size());
+        ctx->bufs[pos] = b;
+    }
+    on_group_read_done(ctx);
+}
+
+void LogDev::fail_group_read(const std::shared_ptr< async_read_ctx >& ctx, off_t group_dev_offset,
+                             const std::vector< uint32_t >& key_positions, std::error_condition err) {
+    THIS_LOGDEV_LOG(ERROR, "Error={} in reading log group at dev_offset={}", err.message(), group_dev_offset);
+    COUNTER_INCREMENT(logstore_service().m_metrics, logdev_async_read_errors, 1);
+    for (auto const pos : key_positions) {
+        ctx->errs[pos] = err;
+    }
+    on_group_read_done(ctx);
+}
+
+void LogDev::on_group_read_done(const std::shared_ptr< async_read_ctx >& ctx) {
+    if (ctx->ngroups_outstanding.fetch_sub(1, std::memory_order_acq_rel) == 1) { complete_async_read(ctx); }
+}
+
+// Uncompress the data area of a compressed log group into a buffer laid out as the group was before compression, so
+// that the records of the group are located the same way as in an uncompressed group
+sisl::byte_view LogDev::uncompress_group(const log_group_header* header) {
+    auto const* cdata = header->compressed_data();
+    HS_REL_ASSERT_LE(header->_inline_data_offset() + sizeof(log_group_compressed_data) + cdata->compressed_size,
+                     header->footer_offset, "Compressed data beyond the log group start_idx={}", header->start_idx());
+
+    sisl::byte_view ubuf{header->_inline_data_offset() + cdata->uncompressed_size};
+    std::memcpy(static_cast< void* >(ubuf.bytes()), static_cast< const void* >(header), header->_inline_data_offset());
+
+    size_t uncompressed_size = cdata->uncompressed_size;
+    auto const ret = sisl::Compress::decompress(r_cast< const char* >(cdata) + sizeof(log_group_compressed_data),
+                                                r_cast< char* >(ubuf.bytes() + header->_inline_data_offset()),
+                                                cdata->compressed_size, &uncompressed_size);
+    HS_REL_ASSERT_EQ(ret, 0, "Failed to decompress log group start_idx={}", header->start_idx());
+    HS_REL_ASSERT_EQ(uint64_t{cdata->uncompressed_size}, uint64_t{uncompressed_size},
+                     "Uncompressed size mismatch of log group start_idx={}", header->start_idx());
+    return ubuf;
+}
+
+void LogDev::complete_async_read(const std::shared_ptr< async_read_ctx >& ctx) {
+    HISTOGRAM_OBSERVE(logstore_service().m_metrics, logdev_async_read_latency, get_elapsed_time_us(ctx->start_time));
+    if (ctx->issued_on_reactor && (iomanager.iothread_self() != ctx->issuer)) {
+        iomanager.run_on(ctx->issuer, [ctx]([[maybe_unused]] iomgr::io_thread_addr_t addr) {
+            ctx->cb(std::move(ctx->bufs), std::move(ctx->errs));
+        });
+    } else {
+        ctx->cb(std::move(ctx->bufs), std::move(ctx->errs));
+    }
+}
+
 logstore_id_t LogDev::reserve_store_id() {
     std::unique_lock lg{m_meta_mutex};
-    return m_logdev_meta.reserve_store(true /* persist_now */);
+    const bool batch = HS_DYNAMIC_CONFIG(logstore.batch_meta_persist_on);
+    auto const store_id = m_logdev_meta.reserve_store(!batch /* persist_now */);
+    if (batch) { m_meta_dirty_gen.fetch_add(1, std::memory_order_acq_rel); }
+    return store_id;
 }
 
 void LogDev::unreserve_store_id(const logstore_id_t store_id) {
@@ -330,7 +680,7 @@ LogGroup* LogDev::prepare_flush(const int32_t estimated_records) {
 
     assert(estimated_records > 0);
     auto* lg = make_log_group(static_cast< uint32_t >(estimated_records));
-    m_log_records->foreach_contiguous_active(m_last_flush_idx + 1,
+    m_log_records->foreach_contiguous_active(m_last_flush_issued_idx + 1,
                                              [&](int64_t idx, int64_t, log_record& record) -> bool {
                                                  if (lg->add_record(record, idx)) {
                                                      flushing_upto_idx = idx;
@@ -340,10 +690,22 @@ LogGroup* LogDev::prepare_flush(const int32_t estimated_records) {
                                                  }
                                              });
 
-    lg->finish(get_prev_crc());
+    // After a group could not meet the compress ratio, skip trying to compress the next few groups
+    auto const try_compress = HS_DYNAMIC_CONFIG(logstore.compress_feature_on) && (m_compress_skip_groups == 0);
+    lg->finish(get_prev_crc(), try_compress);
+    if (m_compress_skip_groups > 0) {
+        --m_compress_skip_groups;
+    } else if (lg->m_compress_backoff) {
+        m_compress_skip_groups = HS_DYNAMIC_CONFIG(logstore.compress_backoff_groups);
+    }
     if (sisl_unlikely(flushing_upto_idx == -1)) { return nullptr; }
-    lg->m_flush_log_idx_from = m_last_flush_idx + 1;
+    lg->m_flush_log_idx_from = m_last_flush_issued_idx + 1;
     lg->m_flush_log_idx_upto = flushing_upto_idx;
+
+    // Next group chains to this group, even before this group is written, so that groups could be in flight together
+    m_last_flush_issued_idx = flushing_upto_idx;
+    m_last_crc = lg->header()->cur_grp_crc;
+    use_log_group();
     HS_DBG_ASSERT_GE(lg->m_flush_log_idx_upto, lg->m_flush_log_idx_from, "log indx upto is smaller then log indx from");
 
     HS_DBG_ASSERT_GT(lg->header()->oob_data_offset, 0);
@@ -353,31 +715,30 @@ LogGroup* LogDev::prepare_flush(const int32_t estimated_records) {
     return lg;
 }
 
-bool LogDev::can_flush_in_this_thread() {
-    if (iomanager.am_i_io_reactor() && (iomanager.iothread_self() == logstore_service().flush_thread())) {
+bool LogDev::can_flush_in_this_thread() const {
+    if (iomanager.am_i_io_reactor() && (iomanager.iothread_self() == logstore_service().flush_thread(m_shard_idx))) {
         return true;
     }
     return (!HS_DYNAMIC_CONFIG(logstore.flush_only_in_dedicated_thread) && iomanager.am_i_worker_reactor());
 }
 
-// This method checks if in case we were to add a record of size provided, do we enter into a state which exceeds
-// our threshold. If so, it first flushes whats accumulated so far and then add the pending flush size counter with
-// the new record size
+// This method checks if the pending records are to be flushed now, as decided by the flush policy or if the pending
+// size reaches the threshold size given. If so, it flushes whats accumulated so far as a log group.
 bool LogDev::flush_if_needed(int64_t threshold_size) {
-    // If after adding the record size, if we have enough to flush or if its been too much time before we actually
-    // flushed, attempt to flush by setting the atomic bool variable.
-    if (threshold_size < 0) { threshold_size = LogDev::flush_data_threshold_size(); }
-
-    const auto elapsed_time = get_elapsed_time_us(m_last_flush_time);
+    // If we have enough to flush or if its been too much time before we actually flushed, attempt to flush by setting
+    // the atomic bool variable.
     auto const pending_sz = m_pending_flush_size.load(std::memory_order_relaxed);
-    bool const flush_by_size = (pending_sz >= threshold_size);
-    bool const flush_by_time =
-        !flush_by_size && pending_sz && (elapsed_time > HS_DYNAMIC_CONFIG(logstore.max_time_between_flush_us));
+    log_flush_reason reason;
+    if (threshold_size < 0) {
+        reason = m_flush_policy.decide(pending_sz, m_last_flush_time);
+    } else {
+        reason = (pending_sz && (pending_sz >= threshold_size)) ? log_flush_reason::size : log_flush_reason::none;
+    }
 
-    if (flush_by_size || flush_by_time) {
+    if (reason != log_flush_reason::none) {
         // First off, check if we can flush in this thread itself, if not, schedule it into different thread
         if (!can_flush_in_this_thread()) {
-            iomanager.run_on(logstore_service().flush_thread(),
+            iomanager.run_on(logstore_service().flush_thread(m_shard_idx),
                              [this]([[maybe_unused]] const io_thread_addr_t addr) { flush_if_needed(); });
             return false;
         }
@@ -386,35 +747,81 @@ bool LogDev::flush_if_needed(int64_t threshold_size) {
         if (!m_is_flushing.compare_exchange_strong(expected_flushing, true, std::memory_order_acq_rel)) {
             return false;
         }
-        THIS_LOGDEV_LOG(TRACE,
-                        "Flushing now because either pending_size={} is greater than data_threshold={} or "
-                        "elapsed time since last flush={} us is greater than max_time_between_flush={} us",
-                        pending_sz, threshold_size, elapsed_time,
-                        HS_DYNAMIC_CONFIG(logstore.max_time_between_flush_us));
+
+        // Don't start a new log group if max groups are in flight, completion of the oldest one will attempt the flush
+        // again. Also let the groups in flight drain if someone is waiting for the flush lock.
+        uint32_t inflight_groups;
+        {
+            std::unique_lock lk{m_block_flush_q_mutex};
+            inflight_groups = m_inflight_groups;
+            if (m_block_flush_q != nullptr) {
+                lk.unlock();
+                unlock_flush(false);
+                return false;
+            }
+        }
+        if (inflight_groups >= max_inflight_groups()) {
+            COUNTER_INCREMENT(logstore_service().m_metrics, logdev_flush_deferred_by_inflight, 1);
+            unlock_flush(false);
+            return false;
+        }
+
+        THIS_LOGDEV_LOG(TRACE, "Flushing now by reason={}, pending_size={} elapsed time since last flush={} us",
+                        enum_name(reason), pending_sz, get_elapsed_time_us(m_last_flush_time));
 
         m_last_flush_time = Clock::now();
         // We were able to win the flushing competition and now we gather all the flush data and reserve a slot.
         auto new_idx = m_log_idx.load(std::memory_order_relaxed) - 1;
-        if (m_last_flush_idx >= new_idx) {
+        if (m_last_flush_issued_idx >= new_idx) {
             THIS_LOGDEV_LOG(TRACE, "Log idx {} is just flushed", new_idx);
             unlock_flush(false);
             return false;
         }
 
-        auto* lg = prepare_flush(new_idx - m_last_flush_idx + 4); // Estimate 4 more extra in case of parallel writes
+        // Estimate 4 more extra in case of parallel writes
+        auto* lg = prepare_flush(new_idx - m_last_flush_issued_idx + 4);
         if (sisl_unlikely(!lg)) {
-            THIS_LOGDEV_LOG(TRACE, "Log idx {} last_flush_idx {} prepare flush failed", new_idx, m_last_flush_idx);
+            THIS_LOGDEV_LOG(TRACE, "Log idx {} last_flush_issued_idx {} prepare flush failed", new_idx,
+                            m_last_flush_issued_idx);
             unlock_flush(false);
             return false;
         }
         auto sz = m_pending_flush_size.fetch_sub(lg->actual_data_size(), std::memory_order_relaxed);
         HS_REL_ASSERT_GE((sz - lg->actual_data_size()), 0, "size {} lg size{}", sz, lg->actual_data_size());
+        m_flush_policy.on_flush_issued(reason, lg->nrecords(), sz - lg->actual_data_size());
 
         off_t offset = m_vdev->alloc_next_append_blk(lg->header()->total_size());
         lg->m_log_dev_offset = offset;
         HS_REL_ASSERT_NE(lg->m_log_dev_offset, INVALID_OFFSET, "log dev is full");
         THIS_LOGDEV_LOG(TRACE, "Flush prepared, flushing data size={} at offset={}", lg->actual_data_size(), offset);
-        do_flush(lg);
+
+        {
+            std::unique_lock lk{m_block_flush_q_mutex};
+            inflight_groups = ++m_inflight_groups;
+        }
+        HISTOGRAM_OBSERVE(logstore_service().m_metrics, logdev_flush_inflight_groups, inflight_groups);
+        const auto meta_gen = m_meta_dirty_gen.load(std::memory_order_acquire);
+        if (m_meta_persisted_gen.load(std::memory_order_acquire) < meta_gen) {
+            // Metadata updates batched so far are persisted before this log group is written, so that none of its
+            // records is durable without them, even if a persist in progress has not completed yet. It is sync IO,
+            // hence done in the meta thread of the shard, which hands the write back to the flush thread. Log groups
+            // after this one could be written meanwhile, but they are neither completed nor loaded upon recovery
+            // before this one.
+            iomanager.run_on(logstore_service().meta_thread(m_shard_idx),
+                             [this, lg, meta_gen]([[maybe_unused]] const io_thread_addr_t addr) {
+                                 persist_meta_upto(meta_gen);
+                                 iomanager.run_on(logstore_service().flush_thread(m_shard_idx),
+                                                  [this, lg]([[maybe_unused]] const io_thread_addr_t addr) {
+                                                      do_flush(lg);
+                                                  });
+                             });
+        } else {
+            do_flush(lg);
+        }
+
+        // Release the flush lock as soon as the group is issued, so that the next group can be flushed while this
+        // one is in flight.
+        unlock_flush();
         return true;
     } else {
         return false;
@@ -435,6 +842,17 @@ void LogDev::do_flush_write(LogGroup* lg) {
     if (homestore_flip->delay_flip< int >("simulate_log_flush_delay", [this, lg]() { do_flush_write(lg); },
                                           m_family_id)) {
         THIS_LOGDEV_LOG(INFO, "Delaying flush by rescheduling the async write");
+        return;
+    }
+
+    if (homestore_flip->test_flip("logdev_skip_group_write", static_cast< int >(m_family_id),
+                                  static_cast< int >(lg->m_flush_log_idx_from))) {
+        // Group is completed without writing it, as if its write was lost in a crash after later groups were written
+        THIS_LOGDEV_LOG(INFO, "Skipping write of log group of logid[{} - {}]", lg->m_flush_log_idx_from,
+                        lg->m_flush_log_idx_upto);
+        iomanager.run_on(logstore_service().flush_thread(m_shard_idx),
+                         [this, lg]([[maybe_unused]] const io_thread_addr_t addr) { on_flush_completion(lg); });
+        return;
     }
 #endif
 
@@ -442,6 +860,10 @@ void LogDev::do_flush_write(LogGroup* lg) {
     HISTOGRAM_OBSERVE(logstore_service().m_metrics, logdev_flush_size_distribution, lg->actual_data_size());
     THIS_LOGDEV_LOG(TRACE, "vdev offset={} log group total size={}", lg->m_log_dev_offset, lg->header()->total_size());
 
+    IOTrace::record(io_trace_event_t::logdev_flush_start, lg->m_flush_log_idx_from, lg->header()->total_size());
+    HS_PROBE(logdev_flush_start, m_family_id, lg->m_flush_log_idx_from, lg->nrecords(), lg->header()->total_size());
+    lg->m_flush_start_time = Clock::now();
+
     // write log
     m_vdev->async_pwritev(lg->iovecs().data(), int_cast(lg->iovecs().size()), lg->m_log_dev_offset,
                           [this, lg](std::error_condition err, void* cookie) {
@@ -455,29 +877,91 @@ void LogDev::do_flush_write(LogGroup* lg) {
 
 void LogDev::on_flush_completion(LogGroup* lg) {
     lg->m_flush_finish_time = Clock::now();
-    lg->m_post_flush_msg_rcvd_time = Clock::now();
+    HS_PROBE(logdev_flush_done, m_family_id, lg->m_flush_log_idx_from, lg->m_flush_log_idx_upto,
+             get_elapsed_time_us(lg->m_flush_start_time, lg->m_flush_finish_time));
     THIS_LOGDEV_LOG(TRACE, "Flush completed for logid[{} - {}]", lg->m_flush_log_idx_from, lg->m_flush_log_idx_upto);
 
+    {
+        std::unique_lock lk{m_comp_mutex};
+        lg->m_flush_done = true;
+        // Thread which is completing the earlier groups will complete this one as well in order
+        if (m_completing) { return; }
+        m_completing = true;
+    }
+
+    // Groups can complete out of order on the device, but they are completed in the order they are written, so that
+    // appends are called back in log idx order and last flushed idx never moves past a group not yet written.
+    while (true) {
+        LogGroup* oldest;
+        {
+            std::unique_lock lk{m_comp_mutex};
+            oldest = &m_log_group_pool[m_oldest_flush_group_idx];
+            if (!oldest->m_flush_done) {
+                m_completing = false;
+                break;
+            }
+        }
+        complete_flush_in_order(oldest);
+        {
+            std::unique_lock lk{m_comp_mutex};
+            oldest->m_flush_done = false;
+            free_log_group(oldest);
+        }
+        on_group_flush_done();
+    }
+}
+
+void LogDev::complete_flush_in_order(LogGroup* lg) {
+    lg->m_post_flush_msg_rcvd_time = Clock::now();
+    m_flush_policy.on_flush_completed(get_elapsed_time_us(lg->m_flush_start_time, lg->m_flush_finish_time));
     m_log_records->complete(lg->m_flush_log_idx_from, lg->m_flush_log_idx_upto);
     m_last_flush_idx = lg->m_flush_log_idx_upto;
     const auto flush_ld_key = logdev_key{m_last_flush_idx, lg->m_log_dev_offset + lg->header()->total_size()};
-    m_last_crc = lg->header()->cur_grp_crc;
 
     auto from_indx = lg->m_flush_log_idx_from;
     auto upto_indx = lg->m_flush_log_idx_upto;
     auto dev_offset = lg->m_log_dev_offset;
+    if (LogTailCache::capacity() != 0) {
+        // Cache the records before completing them, so that a read issued from the completion is served from cache
+        for (uint32_t i{0}; i < lg->nrecords(); ++i) {
+            auto const& slot = lg->m_record_slots[i];
+            if (auto b = lg->inlined_record(i)) {
+                m_tail_cache.put(slot.store_id, slot.store_seq_num, *b, lg->inlined_records_buf());
+            }
+        }
+    }
     for (auto idx = from_indx; idx <= upto_indx; ++idx) {
         auto& record = m_log_records->at(idx);
         m_append_comp_cb(record.store_id, logdev_key{idx, dev_offset}, flush_ld_key, upto_indx - idx, record.context);
     }
     lg->m_post_flush_process_done_time = Clock::now();
+    IOTrace::record(io_trace_event_t::logdev_flush_done, from_indx, lg->header()->total_size());
 
     HISTOGRAM_OBSERVE(logstore_service().m_metrics, logdev_flush_done_msg_time_ns,
                       get_elapsed_time_us(lg->m_flush_finish_time, lg->m_post_flush_msg_rcvd_time));
     HISTOGRAM_OBSERVE(logstore_service().m_metrics, logdev_post_flush_processing_latency,
                       get_elapsed_time_us(lg->m_post_flush_msg_rcvd_time, lg->m_post_flush_process_done_time));
-    free_log_group(lg);
-    unlock_flush();
+}
+
+void LogDev::on_group_flush_done() {
+    bool run_blocked_q{false};
+    {
+        std::unique_lock lk{m_block_flush_q_mutex};
+        --m_inflight_groups;
+        run_blocked_q = ((m_inflight_groups == 0) && (m_block_flush_q != nullptr));
+    }
+
+    if (run_blocked_q) {
+        // Waiters of flush lock are waiting for the groups in flight to drain. If flush lock is held by someone else
+        // now, they will be run when it is unlocked.
+        bool expected_flushing{false};
+        if (m_is_flushing.compare_exchange_strong(expected_flushing, true, std::memory_order_acq_rel)) {
+            unlock_flush();
+        }
+    } else {
+        // Try to do chain flushing if its really needed.
+        flush_if_needed();
+    }
 }
 
 bool LogDev::try_lock_flush(const flush_blocked_callback& cb) {
@@ -489,10 +973,13 @@ bool LogDev::try_lock_flush(const flush_blocked_callback& cb) {
         }
 
         bool expected_flushing{false};
-        if (!m_is_flushing.compare_exchange_strong(expected_flushing, true, std::memory_order_acq_rel)) {
-            // Flushing is blocked already, add it to the callback q
+        const bool locked = m_is_flushing.compare_exchange_strong(expected_flushing, true, std::memory_order_acq_rel);
+        if (!locked || (m_inflight_groups != 0)) {
+            // Flushing is blocked already or there are log groups in flight, add it to the callback q. It is called
+            // once all groups in flight are completed.
             if (m_block_flush_q == nullptr) { m_block_flush_q = sisl::VectorPool< flush_blocked_callback >::alloc(); }
             m_block_flush_q->emplace_back(cb);
+            if (locked) { m_is_flushing.store(false, std::memory_order_release); }
             return false;
         }
     }
@@ -502,15 +989,20 @@ bool LogDev::try_lock_flush(const flush_blocked_callback& cb) {
 }
 
 void LogDev::unlock_flush(bool do_flush) {
-    std::vector< flush_blocked_callback >* flush_q{nullptr};
-
-    if (m_block_flush_q != nullptr) {
-        std::unique_lock lk{m_block_flush_q_mutex};
-        flush_q = m_block_flush_q;
-        m_block_flush_q = nullptr;
-    }
+    // Blocked callbacks are run only when no log groups are in flight, otherwise completion of the last of them will
+    // run these callbacks. Unlock under the q mutex, so that a callback queued meanwhile is not missed.
+    while (true) {
+        std::vector< flush_blocked_callback >* flush_q{nullptr};
+        {
+            std::unique_lock lk{m_block_flush_q_mutex};
+            if ((m_block_flush_q == nullptr) || (m_inflight_groups != 0)) {
+                m_is_flushing.store(false, std::memory_order_release);
+                break;
+            }
+            flush_q = m_block_flush_q;
+            m_block_flush_q = nullptr;
+        }
 
-    if (flush_q) {
         for (auto& cb : *flush_q) {
             if (m_stopped) {
                 THIS_LOGDEV_LOG(INFO, "Logdev is stopped and thus not processing outstanding flush_lock_q");
@@ -520,7 +1012,6 @@ void LogDev::unlock_flush(bool do_flush) {
         }
         sisl::VectorPool< flush_blocked_callback >::free(flush_q);
     }
-    m_is_flushing.store(false, std::memory_order_release);
 
     // Try to do chain flush if its really needed.
     THIS_LOGDEV_LOG(TRACE, "Unlocked the flush, try doing chain flushing if needed");
@@ -538,6 +1029,7 @@ uint64_t LogDev::truncate(const logdev_key& key) {
         m_vdev->truncate(key.dev_offset);
         m_last_truncate_idx = key.idx;
 
+        std::vector< meta_persisted_callback > meta_waiters;
         {
             std::unique_lock< std::mutex > lk{m_meta_mutex};
 
@@ -563,7 +1055,7 @@ uint64_t LogDev::truncate(const logdev_key& key) {
             // We can remove the rollback records of those upto which logid is getting truncated
             m_logdev_meta.remove_rollback_record_upto(key.idx, false /* persist_now */);
 
-            m_logdev_meta.persist();
+            persist_meta_locked(meta_waiters);
 #ifdef _PRERELEASE
             if (garbage_collect && homestore_flip->test_flip("logdev_abort_after_garbage")) {
                 LOGINFO("logdev aborting after unreserving garbage ids");
@@ -571,6 +1063,9 @@ uint64_t LogDev::truncate(const logdev_key& key) {
             }
 #endif
         }
+        for (auto& cb : meta_waiters) {
+            cb();
+        }
     }
     return num_records_to_truncate;
 }
@@ -580,9 +1075,58 @@ void LogDev::update_store_superblk(logstore_id_t store_id, const logstore_superb
     m_logdev_meta.update_store_superblk(store_id, lsb, persist_now);
 }
 
-void LogDev::rollback(logstore_id_t store_id, logid_range_t id_range) {
-    std::unique_lock lg{m_meta_mutex};
-    m_logdev_meta.add_rollback_record(store_id, id_range, true);
+void LogDev::rollback(logstore_id_t store_id, logid_range_t id_range, const meta_persisted_callback& cb) {
+    {
+        std::unique_lock lg{m_meta_mutex};
+        const bool batch = HS_DYNAMIC_CONFIG(logstore.batch_meta_persist_on);
+        m_logdev_meta.add_rollback_record(store_id, id_range, !batch /* persist_now */);
+        if (batch) { m_meta_dirty_gen.fetch_add(1, std::memory_order_acq_rel); }
+    }
+    persist_meta_async(cb);
+}
+
+void LogDev::persist_meta_if_dirty() { persist_meta_upto(m_meta_dirty_gen.load(std::memory_order_acquire)); }
+
+void LogDev::persist_meta_upto(uint64_t gen) {
+    std::vector< meta_persisted_callback > waiters;
+    {
+        // Persisted generation is moved only after the write, so a persist in progress is waited for by the lock
+        std::unique_lock lg{m_meta_mutex};
+        if (m_meta_persisted_gen.load(std::memory_order_acquire) >= gen) { return; }
+        persist_meta_locked(waiters);
+    }
+    for (auto& cb : waiters) {
+        cb();
+    }
+}
+
+// NOTE: Expects the meta mutex to be held by the caller. Callbacks waiting for the persist are handed over to be
+// called once the mutex is released.
+void LogDev::persist_meta_locked(std::vector< meta_persisted_callback >& waiters) {
+    m_logdev_meta.persist();
+    m_meta_persisted_gen.store(m_meta_dirty_gen.load(std::memory_order_acquire), std::memory_order_release);
+    waiters = std::move(m_meta_persist_waiters);
+    m_meta_persist_waiters.clear();
+}
+
+void LogDev::persist_meta_async(const meta_persisted_callback& cb) {
+    {
+        std::unique_lock lg{m_meta_mutex};
+        if (!is_meta_dirty()) {
+            lg.unlock();
+            if (cb) { cb(); }
+            return;
+        }
+        if (cb) { m_meta_persist_waiters.push_back(cb); }
+    }
+
+    bool expected{false};
+    if (!m_meta_persist_scheduled.compare_exchange_strong(expected, true, std::memory_order_acq_rel)) { return; }
+
+    iomanager.run_on(logstore_service().meta_thread(m_shard_idx), [this]([[maybe_unused]] const io_thread_addr_t addr) {
+        m_meta_persist_scheduled.store(false, std::memory_order_release);
+        persist_meta_if_dirty();
+    });
 }
 
 void LogDev::get_status(const int verbosity, nlohmann::json& js) const {
@@ -590,11 +1134,14 @@ void LogDev::get_status(const int verbosity, nlohmann::json& js) const {
     js["last_flush_log_idx"] = m_last_flush_idx;
     js["last_truncate_log_idx"] = m_last_truncate_idx;
     js["time_since_last_log_flush_ns"] = get_elapsed_time_ns(m_last_flush_time);
+    js["flush_policy"] = m_flush_policy.get_status();
+    js["tail_cache"] = m_tail_cache.get_status(verbosity);
     if (verbosity == 2) {
         js["logdev_stopped?"] = m_stopped;
         js["is_log_flushing_now?"] = m_is_flushing.load(std::memory_order_relaxed);
         js["logdev_sb_start_offset"] = m_logdev_meta.get_start_dev_offset();
         js["logdev_sb_num_stores_reserved"] = m_logdev_meta.num_stores_reserved();
+        js["logdev_sb_persist_pending?"] = is_meta_dirty();
     }
 }
 
@@ -690,17 +1237,45 @@ logstore_id_t LogDevMetadata::reserve_store(bool persist_now) {
     logstore_superblk* sb_area = m_sb->get_logstore_superblk();
     logstore_superblk::init(sb_area[idx]);
     ++m_sb->num_stores;
-    if (persist_now) { m_sb.write(); }
+    on_sb_update(persist_now);
 
     return idx;
 }
 
 void LogDevMetadata::persist() {
-    m_sb.write();
+    if (m_sb_dirty) {
+        m_sb.write();
+        m_sb_dirty = false;
+    }
     if (m_rollback_info_dirty) {
         m_rollback_sb.write();
         m_rollback_info_dirty = false;
     }
+    if (m_nupdates_pending) {
+        COUNTER_INCREMENT(logstore_service().metrics(), logdev_meta_persist_count, 1);
+        HISTOGRAM_OBSERVE(logstore_service().metrics(), logdev_meta_updates_per_persist, m_nupdates_pending);
+        m_nupdates_pending = 0;
+    }
+}
+
+void LogDevMetadata::on_sb_update(bool persist_now) {
+    if (persist_now) {
+        m_sb.write();
+        m_sb_dirty = false;
+    } else {
+        m_sb_dirty = true;
+        ++m_nupdates_pending;
+    }
+}
+
+void LogDevMetadata::on_rollback_sb_update(bool persist_now) {
+    if (persist_now) {
+        m_rollback_sb.write();
+        m_rollback_info_dirty = false;
+    } else {
+        m_rollback_info_dirty = true;
+        ++m_nupdates_pending;
+    }
 }
 
 void LogDevMetadata::unreserve_store(logstore_id_t store_id, bool persist_now) {
@@ -717,7 +1292,7 @@ void LogDevMetadata::unreserve_store(logstore_id_t store_id, bool persist_now) {
         logstore_superblk::clear(sb_area[store_id]);
     }
     --m_sb->num_stores;
-    if (persist_now) { m_sb.write(); }
+    on_sb_update(persist_now);
 }
 
 void LogDevMetadata::update_store_superblk(logstore_id_t idx, const logstore_superblk& sb, bool persist_now) {
@@ -729,8 +1304,7 @@ void LogDevMetadata::update_store_superblk(logstore_id_t idx, const logstore_sup
 
     logstore_superblk* sb_area = m_sb->get_logstore_superblk();
     sb_area[idx] = sb;
-
-    if (persist_now) { m_sb.write(); }
+    on_sb_update(persist_now);
 }
 
 const logstore_superblk& LogDevMetadata::store_superblk(logstore_id_t idx) const {
@@ -746,7 +1320,7 @@ logstore_superblk& LogDevMetadata::mutable_store_superblk(logstore_id_t idx) {
 void LogDevMetadata::set_start_dev_offset(off_t offset, logid_t key_idx, bool persist_now) {
     m_sb->set_start_offset(offset);
     m_sb->key_idx = key_idx;
-    if (persist_now) { m_sb.write(); }
+    on_sb_update(persist_now);
 }
 
 logid_t LogDevMetadata::get_start_log_idx() const { return m_sb->key_idx; }
@@ -777,9 +1351,7 @@ void LogDevMetadata::add_rollback_record(logstore_id_t store_id, logid_range_t i
     m_rollback_info.insert({store_id, id_range});
     resize_rollback_sb_if_needed();
     m_rollback_sb->add_record(store_id, id_range);
-
-    if (persist_now) { m_rollback_sb.write(); }
-    m_rollback_info_dirty = !persist_now;
+    on_rollback_sb_update(persist_now);
 }
 
 void LogDevMetadata::remove_rollback_record_upto(logid_t upto_id, bool persist_now) {
@@ -801,8 +1373,7 @@ void LogDevMetadata::remove_rollback_record_upto(logid_t upto_id, bool persist_n
             }
         }
         resize_rollback_sb_if_needed();
-        if (persist_now) { m_rollback_sb.write(); }
-        m_rollback_info_dirty = !persist_now;
+        on_rollback_sb_update(persist_now);
     }
 }
 
@@ -818,8 +1389,7 @@ void LogDevMetadata::remove_all_rollback_records(logstore_id_t store_id, bool pe
     if (n_removed) {
         m_rollback_info.erase(store_id);
         resize_rollback_sb_if_needed();
-        if (persist_now) { m_rollback_sb.write(); }
-        m_rollback_info_dirty = !persist_now;
+        on_rollback_sb_update(persist_now);
     }
 }
 
@@ -15,13 +15,17 @@
  *********************************************************************************/
 #pragma once
 
+#include <algorithm>
 #include <atomic>
+#include <condition_variable>
 #include <cstdint>
+#include <deque>
 #include <functional>
 #include <limits>
 #include <map>
 #include <memory>
 #include <mutex>
+#include <optional>
 #include <ostream>
 #include <set>
 #include <vector>
@@ -36,6 +40,8 @@
 #include <homestore/logstore/log_store_internal.hpp>
 #include <homestore/superblk_handler.hpp>
 #include "common/homestore_config.hpp"
+#include "log_flush_policy.hpp"
+#include "log_tail_cache.hpp"
 
 namespace homestore {
 
@@ -43,8 +49,9 @@ static constexpr uint32_t LOG_GROUP_HDR_MAGIC{0xF00D1E};
 static constexpr uint32_t LOG_GROUP_FOOTER_MAGIC{0xB00D1E};
 static constexpr uint32_t dma_address_boundary{512}; // Mininum size the dma/writes to be aligned with
 static constexpr uint32_t initial_read_size{4096};
-// logdev doesn't support concurrent writes. There can only be 2 active log groups.
-static constexpr uint32_t max_log_group{2};
+// Max log groups a logdev can have in flight at any time (writes pipelined to consecutive journal offsets), the
+// actual number is limited by logstore.max_inflight_log_groups config.
+static constexpr uint32_t max_log_group{8};
 
 // clang-format off
 /*
@@ -94,22 +101,39 @@ struct log_record {
     void* context;
     logstore_id_t store_id;
     logstore_seq_num_t seq_num;
+    bool is_padded; // Data buffer is padded upto the flush size multiple, so that it is written out of band as is
 
-    log_record(const logstore_id_t& sid, const logstore_seq_num_t snum, const sisl::io_blob& d, void* const ctx) :
-            data{d}, context{ctx}, store_id{sid}, seq_num{snum} {}
+    log_record(const logstore_id_t& sid, const logstore_seq_num_t snum, const sisl::io_blob& d, void* const ctx,
+               const bool padded = false) :
+            data{d}, context{ctx}, store_id{sid}, seq_num{snum}, is_padded{padded} {}
     log_record(const log_record&) = delete;
     log_record& operator=(const log_record&) = delete;
     log_record(log_record&&) noexcept = delete;
     log_record& operator=(log_record&&) noexcept = delete;
     ~log_record() = default;
 
+    // Padded record is written out of band only if its padding is at most 1/max_oob_padding_frac of what is written,
+    // since the padding is written along with it
+    static constexpr uint64_t max_oob_padding_frac{8};
+
     size_t serialized_size() const { return sizeof(serialized_log_record) + data.size; }
     bool is_inlineable(const uint64_t flush_size_multiple) const {
+        // Copying the record into the log group is cheaper than writing out a padding which is a good part of it
+        if (is_padded) {
+            auto const padded_size = oob_size(flush_size_multiple);
+            return ((padded_size - data.size) * max_oob_padding_frac) > padded_size;
+        }
+
         // Need inlining if size is smaller or size/buffer is not in dma'ble boundary.
         return (is_size_inlineable(data.size, flush_size_multiple) ||
                 ((reinterpret_cast< uintptr_t >(data.bytes) % flush_size_multiple) != 0) || !data.aligned);
     }
 
+    // Size the record takes in the out of band data area of the log group
+    uint32_t oob_size(const uint64_t flush_size_multiple) const {
+        return is_padded ? static_cast< uint32_t >(sisl::round_up(data.size, flush_size_multiple)) : data.size;
+    }
+
     static bool is_size_inlineable(const size_t sz, const uint64_t flush_size_multiple) {
         return ((sz < HS_DYNAMIC_CONFIG(logstore.optimal_inline_data_size)) || ((sz % flush_size_multiple) != 0));
     }
@@ -118,13 +142,35 @@ struct log_record {
 };
 
 /************************************* Log Group Section ************************************/
+// Codec the data area of a log group is compressed with
+enum class log_group_codec : uint8_t {
+    none = 0,
+    sisl_compress = 1, // sisl::Compress
+};
+
+/*
+ * Data area (inline data followed by oob data) of a compressed log group is written right after the record slots,
+ * prefixed by this header, and followed by the footer. Record slots and the header offsets of the group describe the
+ * uncompressed layout, where the oob data follows the inline data without any padding, so that records are located
+ * the same way once the data area is uncompressed.
+ */
+#pragma pack(1)
+struct log_group_compressed_data {
+    uint32_t uncompressed_size; // Size of the data area before compression
+    uint32_t compressed_size;   // Size of the compressed data following this header
+};
+#pragma pack()
+
 /* This structure represents a group commit log header */
 #pragma pack(1)
 struct log_group_header {
-    static constexpr uint8_t header_version{0};
+    // Version 1: Record slot area is not limited to the first initial_read_size bytes of the group, but can span
+    // multiple pages (upto logstore.max_records_in_a_log_group records). Version 0 groups are still readable.
+    // Version 2: Data area of the group could be compressed, with the codec kept in the second byte of version.
+    static constexpr uint8_t header_version{2};
 
     uint32_t magic;
-    uint32_t version;
+    uint32_t version;            // Header version in the lowest byte, followed by the codec of the data area
     uint32_t n_log_records;      // Total number of log records
     logid_t start_log_idx;       // log id of the first log record
     uint32_t group_size;         // Total size of this group including this header
@@ -167,24 +213,50 @@ struct log_group_header {
 
     uint32_t magic_word() const { return magic; }
     uint8_t get_version() const { return static_cast< uint8_t >(version); }
+    log_group_codec codec() const { return static_cast< log_group_codec >((version >> 8) & 0xFF); }
+    void set_codec(const log_group_codec c) {
+        version = (version & ~uint32_t{0xFF00}) | (static_cast< uint32_t >(c) << 8);
+    }
+    bool is_compressed() const { return (codec() != log_group_codec::none); }
+    const log_group_compressed_data* compressed_data() const {
+        return reinterpret_cast< const log_group_compressed_data* >(inline_area());
+    }
     logid_t start_idx() const { return start_log_idx; }
     uint32_t nrecords() const { return n_log_records; }
     uint32_t total_size() const { return group_size; }
     crc32_t this_group_crc() const { return cur_grp_crc; }
     crc32_t prev_group_crc() const { return prev_grp_crc; }
     uint32_t _inline_data_offset() const { return inline_data_offset; }
+
+    // Offset of the nth record slot from start of the group
+    static uint64_t record_slot_offset(const uint32_t n) {
+        return sizeof(log_group_header) + (static_cast< uint64_t >(n) * sizeof(serialized_log_record));
+    }
+
+    // Does the layout of the header look valid, before trusting its offsets to read the rest of the group
+    bool is_layout_valid() const {
+        return (get_version() <= header_version) && (n_log_records > 0) &&
+               (record_slot_offset(n_log_records) <= inline_data_offset) && (inline_data_offset <= group_size) &&
+               (footer_offset < group_size) &&
+               (!is_compressed() ||
+                ((codec() == log_group_codec::sisl_compress) &&
+                 ((inline_data_offset + sizeof(log_group_compressed_data)) <= footer_offset)));
+    }
 };
 #pragma pack()
 
 #pragma pack(1)
 struct log_group_footer {
-    static constexpr uint8_t footer_version{0};
+    // Version 1: Footer carries the format generation of the journal, so that groups of an earlier format of the same
+    // journal are not taken as valid groups. Padding of version 0 footers is not initialized.
+    static constexpr uint8_t footer_version{1};
 
-    log_group_footer() : magic{LOG_GROUP_FOOTER_MAGIC}, version{footer_version} {}
+    log_group_footer(const uint32_t gen) : magic{LOG_GROUP_FOOTER_MAGIC}, version{footer_version}, format_gen{gen} {}
     uint32_t magic : 24;
     uint32_t version : 8;
     logid_t start_log_idx;
-    uint8_t padding[12];
+    uint32_t format_gen;
+    uint8_t padding[8];
 };
 #pragma pack()
 
@@ -197,10 +269,11 @@ std::basic_ostream< charT, traits >& operator<<(std::basic_ostream< charT, trait
 
     // print the stream
     const auto s{fmt::format(
-        "magic = {} version={} n_log_records = {} start_log_idx = {} group_size = {} inline_data_offset = {} "
+        "magic = {} version={} codec={} n_log_records = {} start_log_idx = {} group_size = {} inline_data_offset = {} "
         "oob_data_offset = {} prev_grp_crc = {} cur_grp_crc = {}",
-        header.magic, header.version, header.n_log_records, header.start_log_idx, header.group_size,
-        header.inline_data_offset, header.oob_data_offset, header.prev_grp_crc, header.cur_grp_crc)};
+        header.magic, header.get_version(), static_cast< uint32_t >(header.codec()), header.n_log_records,
+        header.start_log_idx, header.group_size, header.inline_data_offset, header.oob_data_offset,
+        header.prev_grp_crc, header.cur_grp_crc)};
     out_string_stream << s;
     out_stream << out_string_stream.str();
 
@@ -225,11 +298,13 @@ public:
     static constexpr uint32_t optimal_num_records{16};
     static constexpr uint32_t estimated_iovs{10};
     static constexpr size_t inline_log_buf_size{512 * optimal_num_records};
-    static constexpr uint32_t max_records_in_a_batch{(initial_read_size - sizeof(log_group_header)) /
-                                                     sizeof(serialized_log_record)};
 
     friend class LogDev;
 
+    static uint32_t max_records_in_a_batch() {
+        return std::max(HS_DYNAMIC_CONFIG(logstore.max_records_in_a_log_group), optimal_num_records);
+    }
+
     LogGroup();
     LogGroup(const LogGroup&) = delete;
     LogGroup& operator=(const LogGroup&) = delete;
@@ -237,14 +312,14 @@ public:
     LogGroup& operator=(LogGroup&&) noexcept = delete;
     ~LogGroup() = default;
 
-    void start(const uint64_t flush_size_multiple, const uint32_t align_size);
+    void start(const uint64_t flush_size_multiple, const uint32_t align_size, const uint32_t format_gen);
     void stop();
     void reset(const uint32_t max_records);
     void create_overflow_buf(const uint32_t min_needed);
     bool add_record(const log_record& record, const int64_t log_idx);
     bool can_accomodate(const log_record& record) const { return (m_nrecords <= m_max_records); }
 
-    const iovec_array& finish(const crc32_t prev_crc);
+    const iovec_array& finish(const crc32_t prev_crc, const bool try_compress = false);
     crc32_t compute_crc();
 
     log_group_header* header() { return reinterpret_cast< log_group_header* >(m_cur_log_buf); }
@@ -259,14 +334,28 @@ public:
     auto flush_log_idx_upto() const { return m_flush_log_idx_upto; }
     auto log_dev_offset() const { return m_log_dev_offset; }
 
-    sisl::aligned_unique_ptr< uint8_t, sisl::buftag::logwrite > m_log_buf;
+    /// @brief View of the nth record of the group, if it is inlined into the group buffer. Buffer is shared with the
+    /// view, so it stays valid after the group is reused.
+    std::optional< log_buffer > inlined_record(uint32_t n) const;
+
+    /// @brief Buffer the views of the inlined records are into
+    const sisl::byte_array& inlined_records_buf() const { return m_overflow_log_buf ? m_overflow_log_buf : m_log_buf; }
+
+    // Buffers are shared with the views of the inlined records given out, and are replaced on reset if still shared
+    sisl::byte_array m_log_buf;
     sisl::aligned_unique_ptr< uint8_t, sisl::buftag::logwrite > m_footer_buf;
-    sisl::aligned_unique_ptr< uint8_t, sisl::buftag::logwrite > m_overflow_log_buf;
+    sisl::byte_array m_overflow_log_buf;
 
     uint8_t* m_cur_log_buf;
     uint32_t m_cur_buf_len;
     uint32_t m_footer_buf_len;
 
+    // Compressed group is written entirely from m_compress_buf, data area is gathered in m_compress_src beforehand
+    sisl::aligned_unique_ptr< uint8_t, sisl::buftag::logwrite > m_compress_buf;
+    uint32_t m_compress_buf_len{0};
+    std::vector< uint8_t > m_compress_src;
+    bool m_compress_backoff{false}; // Group was tried to compress, but written uncompressed as of poor ratio
+
     serialized_log_record* m_record_slots;
     uint32_t m_inline_data_pos;
     uint32_t m_oob_data_pos;
@@ -282,13 +371,18 @@ public:
     off_t m_log_dev_offset;
 
     uint64_t m_flush_multiple_size{0};
+    uint32_t m_align_size{0};
+    uint32_t m_format_gen{0}; // Format generation of the journal, stamped on the footer
+    Clock::time_point m_flush_start_time;             // Time at which the write of log group is issued
     Clock::time_point m_flush_finish_time;            // Time at which flush is completed
+    bool m_flush_done{false}; // Write is completed, but waiting for earlier groups to complete (under m_comp_mutex)
     Clock::time_point m_post_flush_msg_rcvd_time;     // Time at which flush done message delivered
     Clock::time_point m_post_flush_process_done_time; // Time at which entire log group cb is called
 
 private:
     log_group_footer* add_and_get_footer();
     bool new_iovec_for_footer() const;
+    bool compress();
 };
 
 template < typename charT, typename traits >
@@ -479,7 +573,10 @@ public:
     logdev_superblk* create();
     void reset();
     std::vector< std::pair< logstore_id_t, logstore_superblk > > load();
+
+    // Persist the updates which were not persisted right away (persist_now=false), all of them in one write
     void persist();
+    bool is_dirty() const { return m_sb_dirty || m_rollback_info_dirty; }
 
     bool is_empty() const { return m_sb.is_empty(); }
 
@@ -515,6 +612,8 @@ private:
 
     uint32_t store_capacity() const;
     void remove_all_rollback_records(logstore_id_t id);
+    void on_sb_update(bool persist_now);
+    void on_rollback_sb_update(bool persist_now);
 
 private:
     superblk< logdev_superblk > m_sb;
@@ -522,7 +621,9 @@ private:
     std::unique_ptr< sisl::IDReserver > m_id_reserver;
     std::set< logstore_id_t > m_store_info;
     std::multimap< logstore_id_t, logid_range_t > m_rollback_info;
+    bool m_sb_dirty{false};
     bool m_rollback_info_dirty{false};
+    uint32_t m_nupdates_pending{0}; // Updates not persisted yet, which are coalesced into the next persist
 };
 
 class HomeStore;
@@ -531,18 +632,30 @@ class JournalVirtualDev;
 
 class log_stream_reader {
 public:
-    log_stream_reader(off_t device_cursor, JournalVirtualDev* vdev, uint64_t min_read_size);
+    // Bulks are read ahead on the read_ahead_thread reactor if given, which is expected to be other than the reader
+    log_stream_reader(off_t device_cursor, JournalVirtualDev* vdev, uint64_t min_read_size, uint32_t format_gen,
+                      iomgr::io_thread_t read_ahead_thread = nullptr);
     log_stream_reader(const log_stream_reader&) = delete;
     log_stream_reader& operator=(const log_stream_reader&) = delete;
     log_stream_reader(log_stream_reader&&) noexcept = delete;
     log_stream_reader& operator=(log_stream_reader&&) noexcept = delete;
-    ~log_stream_reader() = default;
+    ~log_stream_reader();
 
     sisl::byte_view next_group(off_t* out_dev_offset);
     sisl::byte_view group_in_next_page();
 
+    // Stop reading ahead, waiting for the read in progress, after which the vdev cursor is no longer moved by this reader
+    void stop_read_ahead();
+
+    // Bytes of the stream consumed as log groups so far
+    uint64_t bytes_consumed() const { return static_cast< uint64_t >(m_cur_read_bytes); }
+
 private:
     sisl::byte_view read_next_bytes(uint64_t nbytes);
+    sisl::byte_view read_ahead_bytes(uint64_t nbytes);
+    bool claim_read_ahead();
+    void schedule_read_ahead();
+    void read_ahead_next_bulk();
 
 private:
     JournalVirtualDev* m_vdev;
@@ -551,10 +664,32 @@ private:
     off_t m_cur_read_bytes{0};
     crc32_t m_prev_crc{0};
     uint64_t m_read_size_multiple;
+    uint32_t m_format_gen; // Groups of any other format generation are from an earlier format, 0 skips the check
+
+    // Bulks of the stream read ahead on the reactor, in the stream order, upto m_read_ahead_depth of them. The reactor
+    // reads one bulk at a time and reschedules itself for the next, so that it is not held for the entire read ahead.
+    uint32_t m_read_ahead_depth{0};
+    uint64_t m_bulk_read_size{0};
+    iomgr::io_thread_t m_read_ahead_thread;
+    std::mutex m_read_ahead_mtx;
+    std::condition_variable m_read_ahead_cv;
+    std::deque< sisl::byte_view > m_read_ahead_bufs;
+    bool m_read_ahead_scheduled{false}; // Read of the next bulk is scheduled or in progress on the reactor
+    bool m_read_ahead_stopped{false};
+    bool m_read_ahead_eof{false}; // Read ahead hit a read error or zero bytes read
 };
 
 struct meta_blk;
 
+// Log record found while loading the logdev, given to the log stores in a batch of all the records of its log group
+struct log_found_record {
+    logstore_id_t store_id;
+    logstore_seq_num_t seq_num;
+    logdev_key ld_key;
+    log_buffer buf;
+    uint32_t nremaining_in_batch;
+};
+
 class LogDev {
     friend class HomeLogStore;
 public:
@@ -564,13 +699,16 @@ public:
     typedef std::function< void(logstore_id_t, logstore_seq_num_t, logdev_key, logdev_key, log_buffer, uint32_t) >
         log_found_callback;
     typedef std::function< void(logstore_id_t, const logstore_superblk&) > store_found_callback;
+    typedef std::function< void(std::vector< log_buffer >, std::vector< std::error_condition >) > log_read_callback;
+    typedef std::function< void(const std::vector< log_found_record >&, logdev_key) > logs_found_batch_callback;
     typedef std::function< void(void) > flush_blocked_callback;
+    typedef std::function< void(void) > meta_persisted_callback;
 
     static inline int64_t flush_data_threshold_size() {
         return HS_DYNAMIC_CONFIG(logstore.flush_threshold_size) - sizeof(log_group_header);
     }
 
-    LogDev(logstore_family_id_t f_id, const std::string& metablk_name);
+    LogDev(logstore_family_id_t f_id, uint32_t shard_idx, const std::string& metablk_name);
     LogDev(const LogDev&) = delete;
     LogDev& operator=(const LogDev&) = delete;
     LogDev(LogDev&&) noexcept = delete;
@@ -602,11 +740,38 @@ public:
      * structure which could be 8K
      * @param cb_context Context to put upon a callback once append is. Upon completion the registered callback is
      * called.
+     * @param is_padded Data is in a buffer from alloc_reserved_buf, which is written out of band along with its
+     * padding, without copying it into the log group, unless the padding is a good part of it.
      *
      * @return logid_t : log_idx of the log of the data.
      */
     logid_t append_async(logstore_id_t store_id, logstore_seq_num_t seq_num, const sisl::io_blob& data,
-                         void* cb_context);
+                         void* cb_context, bool is_padded = false);
+
+    /**
+     * @brief Allocate a buffer for a log record to be serialized in place, which is dma aligned and padded upto the
+     * flush size multiple of the logdev, so that it can be written as is.
+     *
+     * @param size Max size of the log record
+     * @return uint8_t* Buffer, which is freed with free_reserved_buf
+     */
+    uint8_t* alloc_reserved_buf(uint32_t size) const;
+    void free_reserved_buf(uint8_t* buf) const;
+
+    /**
+     * @brief Append a batch of data to the log device asynchronously, as consecutive log ids and upper layer seq_nums.
+     * Log ids of the entire batch are reserved at once and the need of flush is checked once for the batch. Upon
+     * completion of each of them, the registered append callback is called with its context.
+     *
+     * @param store_id: The upper layer store id for these log records
+     * @param start_seq_num: Upper layer store seq_num of the first data in the batch
+     * @param blobs : Data to be appended, which are expected to be valid till their append callbacks are done
+     * @param cb_contexts Context of each of the data, to put upon its callback
+     *
+     * @return logid_t : log_idx of the first data in the batch, the rest follows it.
+     */
+    logid_t append_batch_async(logstore_id_t store_id, logstore_seq_num_t start_seq_num,
+                               const std::vector< sisl::io_blob >& blobs, const std::vector< void* >& cb_contexts);
 
     /**
      * @brief Read the log id from the device offset
@@ -622,6 +787,17 @@ public:
      */
     log_buffer read(const logdev_key& key, serialized_log_record& record_header);
 
+    /**
+     * @brief Read the logs of the keys asynchronously. Each log group the keys are in is read only once and in its
+     * entirety, so that the header and CRC of the group are validated before its records are copied out.
+     *
+     * @param keys logdev keys of the logs to read
+     * @param cb Callback upon completion of all the reads, with the log buffers and the errors in the same order as
+     * keys. Log of a key whose group could not be read or failed the validation has an empty buffer and its error
+     * set. If the read was issued from an io reactor, the callback is called on that same reactor.
+     */
+    void read_async(std::vector< logdev_key > keys, const log_read_callback& cb);
+
     /**
      * @brief Load the data from the blkstore starting with offset. This method loads data in bulk and then call
      * the registered logfound_cb with key and buffer. NOTE: This method is not thread safe. It is expected to be called
@@ -654,6 +830,16 @@ public:
      */
     void register_logfound_cb(const log_found_callback& cb) { m_logfound_cb = cb; }
 
+    /**
+     * @brief Register the callback to receive new logs during recovery from the device, all the logs of a log group
+     * in one call. If registered, it is called instead of the one registered with register_logfound_cb.
+     * NOTE: This method is not thread safe.
+     *
+     * @param cb Callback which is called with all the logs found in a log group (other than the rolled back ones) and
+     * the logdev key upto which the log group is flushed.
+     */
+    void register_logs_found_batch_cb(const logs_found_batch_callback& cb) { m_logs_found_batch_cb = cb; }
+
     /**
      * @brief Register the callback when a store is found during loading phase
      *
@@ -667,6 +853,9 @@ public:
 
     /**
      * @brief Reserve logstore id and persist if needed. It persists the entire map about the logstore id inside the
+     * logdev super block. With logstore.batch_meta_persist_on, it is persisted along with other metadata updates before
+     * the next log group of the logdev is written (or by the flush timer if there are no appends), so that no log
+     * record of the store is durable without it.
      *
      * @return uint32_t : Return the reserved id
      */
@@ -704,8 +893,9 @@ public:
     crc32_t get_prev_crc() const { return m_last_crc; }
 
     /**
-     * @brief This method attempts to block the log flush and then make a callback cb. If it is already blocked,
-     * then after previous flush is completed, it will make the callback (while log flush is still under blocked state)
+     * @brief This method attempts to block the log flush and then make a callback cb. If it is already blocked or
+     * there are log groups in flight, then after all of them are completed, it will make the callback (while log flush
+     * is still under blocked state). No new log group is flushed while a callback is waiting.
      *
      * @param cb Callback
      * @return true or false based on if it is able to block the flush right away.
@@ -728,16 +918,34 @@ public:
 
     /**
      * @brief Rollback the logid range specific to the given store id. This method persists the information
-     * synchronously to the underlying storage. Once rolledback those logids in this range are ignored (only for
-     * this logstore) during load.
+     * synchronously to the underlying storage, or with logstore.batch_meta_persist_on in the meta thread of the shard,
+     * which is anyway before the next log group of the logdev is written. Once rolledback those logids in this range
+     * are ignored (only for this logstore) during load.
      *
      * @param store_id : Store id whose logids are to be rolled back or invalidated
      * @param id_range : Log id range to rollback/invalidate
+     * @param cb : [OPTIONAL] Callback once the rollback is persisted
      */
-    void rollback(logstore_id_t store_id, logid_range_t id_range);
+    void rollback(logstore_id_t store_id, logid_range_t id_range, const meta_persisted_callback& cb = nullptr);
 
     void update_store_superblk(logstore_id_t idx, const logstore_superblk& meta, bool persist_now);
 
+    /**
+     * @brief Persist the metadata updates of the logdev batched so far, if any. It does sync IO.
+     */
+    void persist_meta_if_dirty();
+
+    /**
+     * @brief Persist the metadata updates of the logdev batched so far, if any, in the meta thread of the shard.
+     *
+     * @param cb : [OPTIONAL] Callback once the updates batched so far are persisted, right away if there are none
+     */
+    void persist_meta_async(const meta_persisted_callback& cb = nullptr);
+    bool is_meta_dirty() const {
+        return (m_meta_persisted_gen.load(std::memory_order_acquire) <
+                m_meta_dirty_gen.load(std::memory_order_acquire));
+    }
+
     void get_status(int verbosity, nlohmann::json& out_json) const;
     bool flush_if_needed(int64_t threshold_size = -1);
 
@@ -749,15 +957,30 @@ public:
     logdev_key get_last_flush_ld_key() const { return logdev_key{m_last_flush_idx, m_last_flush_dev_offset}; }
 
     LogDevMetadata& log_dev_meta() { return m_logdev_meta; }
-    static bool can_flush_in_this_thread();
+    LogTailCache& tail_cache() { return m_tail_cache; }
+    uint64_t flush_timer_period_us() const { return m_flush_timer_period_us.load(std::memory_order_relaxed); }
+    bool can_flush_in_this_thread() const;
+    uint32_t shard_idx() const { return m_shard_idx; }
 
 private:
+    void persist_meta_upto(uint64_t gen);
+    void persist_meta_locked(std::vector< meta_persisted_callback >& waiters);
+
+    // Called under flush lock and only when there is a free log group, i.e. less than max_log_group in flight
     LogGroup* make_log_group(uint32_t estimated_records) {
         m_log_group_pool[m_log_group_idx].reset(estimated_records);
         return &m_log_group_pool[m_log_group_idx];
     }
 
-    void free_log_group(LogGroup* lg) { m_log_group_idx = !m_log_group_idx; }
+    // Log group made is going to be written, next one is made from the next in the ring
+    void use_log_group() { m_log_group_idx = (m_log_group_idx + 1) % max_log_group; }
+
+    // Log groups are completed in order and hence freed in the order they were made
+    void free_log_group(LogGroup* lg) { m_oldest_flush_group_idx = (m_oldest_flush_group_idx + 1) % max_log_group; }
+
+    static uint32_t max_inflight_groups() {
+        return std::clamp(HS_DYNAMIC_CONFIG(logstore.max_inflight_log_groups), 1u, max_log_group);
+    }
 
     LogGroup* prepare_flush(int32_t estimated_record);
 
@@ -765,8 +988,23 @@ private:
     void do_flush_write(LogGroup* lg);
     void flush_by_size(uint32_t min_threshold, uint32_t new_record_size = 0, logid_t new_idx = -1);
     void on_flush_completion(LogGroup* lg);
+    void start_flush_timer();
+    void on_flush_timer();
+    void complete_flush_in_order(LogGroup* lg);
+    void on_group_flush_done();
     void do_load(off_t offset);
 
+    struct async_read_ctx;
+    void read_group_async(const std::shared_ptr< async_read_ctx >& ctx, off_t group_dev_offset,
+                          std::vector< uint32_t > key_positions);
+    void on_group_read(const std::shared_ptr< async_read_ctx >& ctx, off_t group_dev_offset,
+                       const std::vector< uint32_t >& key_positions, const uint8_t* group_buf);
+    void fail_group_read(const std::shared_ptr< async_read_ctx >& ctx, off_t group_dev_offset,
+                         const std::vector< uint32_t >& key_positions, std::error_condition err);
+    void on_group_read_done(const std::shared_ptr< async_read_ctx >& ctx);
+    void complete_async_read(const std::shared_ptr< async_read_ctx >& ctx);
+    static sisl::byte_view uncompress_group(const log_group_header* header);
+
 #if 0
     log_group_header* read_validate_header(uint8_t* buf, uint32_t size, bool* read_more);
     sisl::byte_array read_next_header(uint32_t max_buf_reads);
@@ -782,43 +1020,63 @@ private:
         m_log_records;                              // The container which stores all in-memory log records
     std::atomic< logid_t > m_log_idx{0};            // Generator of log idx
     std::atomic< int64_t > m_pending_flush_size{0}; // How much flushable logs are pending
-    std::atomic< bool > m_is_flushing{false}; // Is LogDev currently flushing (so far supports one flusher at a time)
+    std::atomic< bool > m_is_flushing{false};       // Flush lock, held while preparing and issuing a log group
+    uint32_t m_inflight_groups{0}; // Log groups written but not completed yet (under m_block_flush_q_mutex)
     bool m_stopped{false}; // Is Logdev stopped. We don't need lock here, because it is updated under flush lock
     logstore_family_id_t m_family_id; // The family id this logdev is part of
+    uint32_t m_shard_idx;             // Shard of the family this logdev is, which decides its flush thread
     JournalVirtualDev* m_vdev{nullptr};
-    HomeStoreSafePtr m_hs; // Back pointer to homestore
+    uint32_t m_format_gen{0}; // Format generation of the journal, 0 for journals formatted before it was introduced
+    HomeStoreSafePtr m_hs;    // Back pointer to homestore
 
     std::multimap< logid_t, logstore_id_t > m_garbage_store_ids;
     Clock::time_point m_last_flush_time;
+    LogFlushPolicy m_flush_policy; // Decides when the pending records are flushed as a log group
+    LogTailCache m_tail_cache;     // Recently appended records of the log stores of this logdev
 
-    logid_t m_last_flush_idx{-1}; // Track last flushed, last device offset and truncated log idx
+    logid_t m_last_flush_idx{-1};        // Track last flushed, last device offset and truncated log idx
+    logid_t m_last_flush_issued_idx{-1}; // Last log idx, which is part of a log group written (could be in flight)
     off_t m_last_flush_dev_offset{0};
     logid_t m_last_truncate_idx{-1};
 
     crc32_t m_last_crc{INVALID_CRC32_VALUE};
     log_append_comp_callback m_append_comp_cb{nullptr};
     log_found_callback m_logfound_cb{nullptr};
+    logs_found_batch_callback m_logs_found_batch_cb{nullptr};
     store_found_callback m_store_found_cb{nullptr};
 
     // LogDev Info block related fields
     std::mutex m_meta_mutex;
     LogDevMetadata m_logdev_meta;
+    // Every batched metadata update bumps the dirty generation, which is persisted once the persisted one catches up
+    std::atomic< uint64_t > m_meta_dirty_gen{0};
+    std::atomic< uint64_t > m_meta_persisted_gen{0};
+    std::atomic< bool > m_meta_persist_scheduled{false};          // Persist of the batched updates is scheduled
+    std::vector< meta_persisted_callback > m_meta_persist_waiters; // Waiting for the batched updates to be persisted
 
     // Block flush Q request Q
     std::mutex m_block_flush_q_mutex;
     std::condition_variable m_block_flush_q_cv;
-    std::mutex m_comp_mutex;
+    std::mutex m_comp_mutex;  // Protects in order completion of the log groups in flight
+    bool m_completing{false}; // Is there a thread completing the log groups in order now
     std::vector< flush_blocked_callback >* m_block_flush_q{nullptr};
 
     void* m_sb_cookie{nullptr};
     uint64_t m_flush_size_multiple{0};
 
-    // Pool for creating log group
+    // Pool for creating log group, used as a ring of groups in flight in the order they are written
     LogGroup m_log_group_pool[max_log_group];
-    uint32_t m_log_group_idx{0};
+    uint32_t m_log_group_idx{0};          // Next log group to be prepared
+    uint32_t m_oldest_flush_group_idx{0}; // Oldest log group in flight, which is completed next
+    uint32_t m_compress_skip_groups{0};   // Groups to be written without trying to compress, as of poor ratio
     std::atomic< bool > m_flush_status = false;
-    // Timer handle
+
+    // Flush timer, which is rearmed once its period derived from the hotswappable settings changes
+    std::mutex m_flush_timer_mtx;
     iomgr::timer_handle_t m_flush_timer_hdl;
+    bool m_flush_timer_on{false};
+    std::atomic< uint64_t > m_flush_timer_period_us{0};
+    std::atomic< bool > m_flush_timer_rearming{false};
 }; // LogDev
 
 } // namespace homestore
@@ -0,0 +1,148 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#include <algorithm>
+#include <cmath>
+
+#include <homestore/logstore_service.hpp>
+
+#include "common/homestore_config.hpp"
+#include "log_dev.hpp"
+#include "log_flush_policy.hpp"
+
+namespace homestore {
+
+static void update_ewma(std::atomic< double >& avg, double sample) {
+    auto const cur = avg.load(std::memory_order_relaxed);
+    avg.store((cur == 0.0) ? sample : (cur * 7 + sample) / 8, std::memory_order_relaxed);
+}
+
+uint64_t LogFlushPolicy::timer_frequency_us() {
+    if (!HS_DYNAMIC_CONFIG(logstore.adaptive_flush_on)) { return HS_DYNAMIC_CONFIG(logstore.flush_timer_frequency_us); }
+
+    // Records pending when appends stop are flushed by the timer, so it runs a few times within the latency target
+    return std::max(HS_DYNAMIC_CONFIG(logstore.flush_latency_target_us) / 4, uint64_t{20});
+}
+
+bool LogFlushPolicy::on_append(const int64_t prev_pending_size, const int64_t size) {
+    if (prev_pending_size <= 0) { m_pending_since.store(Clock::now(), std::memory_order_relaxed); }
+
+    if (!HS_DYNAMIC_CONFIG(logstore.adaptive_flush_on)) {
+        auto const threshold_size = LogDev::flush_data_threshold_size();
+        return ((prev_pending_size < threshold_size) && ((prev_pending_size + size) >= threshold_size));
+    }
+    return (decide(prev_pending_size + size, Clock::time_point{}) != log_flush_reason::none);
+}
+
+log_flush_reason LogFlushPolicy::decide(const int64_t pending_size, const Clock::time_point last_flush_time) const {
+    if (pending_size <= 0) { return log_flush_reason::none; }
+
+    if (!HS_DYNAMIC_CONFIG(logstore.adaptive_flush_on)) {
+        if (pending_size >= LogDev::flush_data_threshold_size()) { return log_flush_reason::size; }
+        return (get_elapsed_time_us(last_flush_time) > HS_DYNAMIC_CONFIG(logstore.max_time_between_flush_us))
+            ? log_flush_reason::time
+            : log_flush_reason::none;
+    }
+
+    if (pending_size >= s_cast< int64_t >(HS_DYNAMIC_CONFIG(logstore.adaptive_flush_max_size))) {
+        return log_flush_reason::size;
+    }
+
+    // Append time of the oldest pending record could be unknown, if it raced with the issue of the last log group
+    auto const pending_since = m_pending_since.load(std::memory_order_relaxed);
+    if (pending_since == Clock::time_point{}) { return log_flush_reason::latency; }
+
+    auto const waited_us = get_elapsed_time_us(pending_since);
+    auto const budget_us = latency_budget_us();
+    if (waited_us >= budget_us) { return log_flush_reason::latency; }
+
+    // No point in waiting any longer, if not even one more record is expected to be appended within the budget
+    if ((m_arrival_rate.load(std::memory_order_relaxed) * (budget_us - waited_us)) < 1.0) {
+        return log_flush_reason::idle;
+    }
+    return log_flush_reason::none;
+}
+
+void LogFlushPolicy::on_flush_issued(const log_flush_reason reason, const uint32_t nrecords,
+                                     const int64_t remaining_pending_size) {
+    auto const now = Clock::now();
+    auto& metrics = logstore_service().metrics();
+    switch (reason) {
+    case log_flush_reason::size:
+        COUNTER_INCREMENT(metrics, logdev_flush_by_size_count, 1);
+        break;
+    case log_flush_reason::time:
+        COUNTER_INCREMENT(metrics, logdev_flush_by_time_count, 1);
+        break;
+    case log_flush_reason::latency:
+        COUNTER_INCREMENT(metrics, logdev_flush_by_latency_count, 1);
+        break;
+    case log_flush_reason::idle:
+        COUNTER_INCREMENT(metrics, logdev_flush_by_idle_count, 1);
+        break;
+    default:
+        break;
+    }
+
+    auto const pending_since = m_pending_since.load(std::memory_order_relaxed);
+    if (pending_since != Clock::time_point{}) {
+        HISTOGRAM_OBSERVE(metrics, logdev_flush_batch_wait_us, get_elapsed_time_us(pending_since, now));
+    }
+    HISTOGRAM_OBSERVE(metrics, logdev_flush_latency_budget_us, latency_budget_us());
+
+    // Arrival rate is measured between the issue of consecutive log groups, so that a group flushed right away under
+    // low load doesn't make it look like a burst
+    auto const elapsed_us = std::max(get_elapsed_time_us(m_last_issue_time, now), uint64_t{1});
+    m_last_issue_time = now;
+    update_ewma(m_arrival_rate, s_cast< double >(nrecords) / elapsed_us);
+
+    // Records appended while this group was prepared are pending from now on, which is a close enough approximation
+    m_pending_since.store((remaining_pending_size > 0) ? now : Clock::time_point{}, std::memory_order_relaxed);
+}
+
+void LogFlushPolicy::on_flush_completed(const uint64_t latency_us) {
+    auto const sample = s_cast< double >(latency_us);
+    update_ewma(m_flush_latency_dev, std::abs(sample - m_flush_latency_us.load(std::memory_order_relaxed)));
+    update_ewma(m_flush_latency_us, sample);
+    HISTOGRAM_OBSERVE(logstore_service().metrics(), logdev_flush_write_latency_us, latency_us);
+}
+
+// Time the oldest pending record can wait for more records, so that it is still written within the latency target.
+// p99 of the write latency is approximated as its mean plus 3 times its mean absolute deviation.
+uint64_t LogFlushPolicy::latency_budget_us() const {
+    auto const write_latency_us =
+        m_flush_latency_us.load(std::memory_order_relaxed) + 3 * m_flush_latency_dev.load(std::memory_order_relaxed);
+    auto const target_us = s_cast< double >(HS_DYNAMIC_CONFIG(logstore.flush_latency_target_us));
+    return (write_latency_us >= target_us) ? 0 : s_cast< uint64_t >(target_us - write_latency_us);
+}
+
+void LogFlushPolicy::reset() {
+    m_pending_since.store(Clock::time_point{}, std::memory_order_relaxed);
+    m_last_issue_time = Clock::now();
+    m_arrival_rate.store(0.0, std::memory_order_relaxed);
+    m_flush_latency_us.store(0.0, std::memory_order_relaxed);
+    m_flush_latency_dev.store(0.0, std::memory_order_relaxed);
+}
+
+nlohmann::json LogFlushPolicy::get_status() const {
+    nlohmann::json js;
+    js["adaptive"] = HS_DYNAMIC_CONFIG(logstore.adaptive_flush_on);
+    js["arrival_rate_per_sec"] = m_arrival_rate.load(std::memory_order_relaxed) * 1000000;
+    js["write_latency_us"] = m_flush_latency_us.load(std::memory_order_relaxed);
+    js["write_latency_deviation_us"] = m_flush_latency_dev.load(std::memory_order_relaxed);
+    js["latency_budget_us"] = latency_budget_us();
+    return js;
+}
+} // namespace homestore
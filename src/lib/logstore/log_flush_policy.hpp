@@ -0,0 +1,81 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#include <nlohmann/json.hpp>
+#include <sisl/utility/enum.hpp>
+
+#include <homestore/logstore/log_store_internal.hpp>
+
+namespace homestore {
+
+ENUM(log_flush_reason, uint8_t, none, size, time, latency, idle)
+
+/*
+ * LogFlushPolicy: Decides when a logdev flushes its pending log records as a log group (group commit).
+ *
+ * With logstore.adaptive_flush_on, it estimates the arrival rate of the records and the latency of writing a log group
+ * to the device, and accumulates the records only as long as the oldest pending record could still be written within
+ * logstore.flush_latency_target_us. Waiting longer gives larger log groups, but there is no point in waiting if no more
+ * records are expected in the remaining time, so the records are flushed right away under low load. A group reaching
+ * logstore.adaptive_flush_max_size is flushed regardless.
+ *
+ * Otherwise, records are flushed by the fixed logstore.flush_threshold_size and logstore.max_time_between_flush_us.
+ *
+ * Estimates are updated by a single thread each (flush issue is under the flush lock of the logdev and completions are
+ * in order), while decisions are taken by any appending thread, hence they are atomics read without a lock.
+ */
+class LogFlushPolicy {
+public:
+    LogFlushPolicy() = default;
+    LogFlushPolicy(const LogFlushPolicy&) = delete;
+    LogFlushPolicy& operator=(const LogFlushPolicy&) = delete;
+    LogFlushPolicy(LogFlushPolicy&&) noexcept = delete;
+    LogFlushPolicy& operator=(LogFlushPolicy&&) noexcept = delete;
+
+    /// @brief Frequency of the timer which checks for flush, if no append does so meanwhile. Logdev rearms its timer
+    /// once this changes with the settings.
+    static uint64_t timer_frequency_us();
+
+    /// @brief Note the append of a record of given size to the pending records. Returns if it is to be flushed now.
+    bool on_append(int64_t prev_pending_size, int64_t size);
+
+    /// @brief Reason for which the pending records are to be flushed now, none if they are not
+    log_flush_reason decide(int64_t pending_size, Clock::time_point last_flush_time) const;
+
+    /// @brief Note the issue of a log group, with the records still pending after it
+    void on_flush_issued(log_flush_reason reason, uint32_t nrecords, int64_t remaining_pending_size);
+
+    /// @brief Note the completion of the write of a log group to the device
+    void on_flush_completed(uint64_t latency_us);
+
+    void reset();
+    nlohmann::json get_status() const;
+
+private:
+    uint64_t latency_budget_us() const;
+
+private:
+    std::atomic< Clock::time_point > m_pending_since{Clock::time_point{}}; // Append time of oldest pending record
+    Clock::time_point m_last_issue_time{Clock::now()};
+    std::atomic< double > m_arrival_rate{0.0};       // Records appended per us
+    std::atomic< double > m_flush_latency_us{0.0};   // Mean latency to write a log group
+    std::atomic< double > m_flush_latency_dev{0.0};  // Mean absolute deviation of the latency to write a log group
+};
+} // namespace homestore
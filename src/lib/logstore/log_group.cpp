@@ -16,8 +16,10 @@
 #include <cstring>
 
 #include <isa-l/crc.h>
+#include <sisl/fds/compress.hpp>
 
 #include <homestore/logstore/log_store.hpp>
+#include <homestore/logstore_service.hpp>
 #include "common/homestore_assert.hpp"
 #include "log_dev.hpp"
 
@@ -25,13 +27,15 @@ namespace homestore {
 SISL_LOGGING_DECL(logstore)
 
 LogGroup::LogGroup() = default;
-void LogGroup::start(const uint64_t flush_multiple_size, const uint32_t align_size) {
+void LogGroup::start(const uint64_t flush_multiple_size, const uint32_t align_size, const uint32_t format_gen) {
     m_iovecs.reserve(estimated_iovs);
     m_flush_multiple_size = flush_multiple_size;
+    m_align_size = align_size;
+    m_format_gen = format_gen;
 
     // TO DO: Might need to differentiate based on data or fast type
     m_cur_buf_len = sisl::round_up(inline_log_buf_size, flush_multiple_size);
-    m_log_buf = sisl::aligned_unique_ptr< uint8_t, sisl::buftag::logwrite >::make_sized(align_size, m_cur_buf_len);
+    m_log_buf = sisl::make_byte_array(m_cur_buf_len, align_size, sisl::buftag::logwrite);
 
     m_footer_buf_len = sisl::round_up(sizeof(log_group_footer), flush_multiple_size);
     m_footer_buf =
@@ -42,32 +46,41 @@ void LogGroup::stop() {
     m_log_buf.reset();
     m_overflow_log_buf.reset();
     m_footer_buf.reset();
+    m_compress_buf.reset();
+    m_compress_buf_len = 0;
+    m_compress_src = std::vector< uint8_t >{};
 }
 
 void LogGroup::reset(const uint32_t max_records) {
     m_cur_buf_len = sisl::round_up(inline_log_buf_size, m_flush_multiple_size);
-    m_cur_log_buf = m_log_buf.get();
+    // Records of the previous use of the buffer are still in tail cache
+    if (m_log_buf.use_count() > 1) {
+        m_log_buf = sisl::make_byte_array(m_cur_buf_len, m_align_size, sisl::buftag::logwrite);
+    }
+    m_cur_log_buf = m_log_buf->bytes;
     m_record_slots = reinterpret_cast< serialized_log_record* >(m_cur_log_buf + sizeof(log_group_header));
-    m_inline_data_pos = sizeof(log_group_header) + (sizeof(serialized_log_record) * max_records);
+    m_max_records = std::min(max_records, max_records_in_a_batch());
+    m_inline_data_pos = log_group_header::record_slot_offset(m_max_records);
     m_oob_data_pos = 0;
 
     m_overflow_log_buf = nullptr;
     m_nrecords = 0;
-    m_max_records = std::min(max_records, max_records_in_a_batch);
     m_actual_data_size = 0;
 
     m_iovecs.clear();
     m_iovecs.emplace_back(static_cast< void* >(m_cur_log_buf), m_inline_data_pos);
+
+    // Record slots of a large group could by itself go beyond the inline buffer
+    if (m_inline_data_pos >= m_cur_buf_len) { create_overflow_buf(m_inline_data_pos); }
 }
 
 void LogGroup::create_overflow_buf(const uint32_t min_needed) {
     auto const new_len = sisl::round_up(std::max(min_needed, m_cur_buf_len * 2), m_flush_multiple_size);
-    auto new_buf =
-        sisl::aligned_unique_ptr< uint8_t, sisl::buftag::logwrite >::make_sized(m_flush_multiple_size, new_len);
-    std::memcpy(s_cast< void* >(new_buf.get()), s_cast< const void* >(m_cur_log_buf), m_cur_buf_len);
+    auto new_buf = sisl::make_byte_array(new_len, m_flush_multiple_size, sisl::buftag::logwrite);
+    std::memcpy(s_cast< void* >(new_buf->bytes), s_cast< const void* >(m_cur_log_buf), m_cur_buf_len);
 
     m_overflow_log_buf = std::move(new_buf);
-    m_cur_log_buf = m_overflow_log_buf.get();
+    m_cur_log_buf = m_overflow_log_buf->bytes;
     m_cur_buf_len = new_len;
     m_record_slots = r_cast< serialized_log_record* >(m_cur_log_buf + sizeof(log_group_header));
 
@@ -104,41 +117,54 @@ bool LogGroup::add_record(const log_record& record, const int64_t log_idx) {
         m_inline_data_pos += record.data.size;
         m_iovecs[0].iov_len = m_inline_data_pos;
     } else {
-        // We do not round it now, it will be rounded during finish
+        // We do not round it now, it will be rounded during finish. Padded buffer is written along with its padding.
+        auto const oob_size = record.oob_size(m_flush_multiple_size);
         m_record_slots[m_nrecords].offset = m_oob_data_pos;
         m_record_slots[m_nrecords].set_inlined(false);
-        m_iovecs.emplace_back(s_cast< void* >(record.data.bytes), record.data.size);
-        m_oob_data_pos += record.data.size;
+        m_iovecs.emplace_back(s_cast< void* >(record.data.bytes), oob_size);
+        m_oob_data_pos += oob_size;
     }
     ++m_nrecords;
 
     return true;
 }
 
+std::optional< log_buffer > LogGroup::inlined_record(uint32_t n) const {
+    const auto& slot = m_record_slots[n];
+    if (!slot.get_inlined()) { return std::nullopt; }
+
+    // Record slots and inlined data are in the overflow buffer, once the group outgrew its inline buffer
+    return log_buffer{inlined_records_buf(), slot.offset, slot.size};
+}
+
 bool LogGroup::new_iovec_for_footer() const {
     return ((m_inline_data_pos + sizeof(log_group_footer)) >= m_cur_buf_len || m_oob_data_pos != 0);
 }
 
-const iovec_array& LogGroup::finish(const crc32_t prev_crc) {
-    // add footer
-    auto footer = add_and_get_footer();
+const iovec_array& LogGroup::finish(const crc32_t prev_crc, const bool try_compress) {
+    m_compress_backoff = false;
+    if (!try_compress || !compress()) {
+        // add footer
+        auto footer = add_and_get_footer();
 
-    m_iovecs[0].iov_len = sisl::round_up(m_iovecs[0].iov_len, m_flush_multiple_size);
+        m_iovecs[0].iov_len = sisl::round_up(m_iovecs[0].iov_len, m_flush_multiple_size);
 
-    log_group_header* hdr = new (header()) log_group_header{};
-    hdr->n_log_records = m_nrecords;
-    hdr->prev_grp_crc = prev_crc;
-    hdr->inline_data_offset = sizeof(log_group_header) + (m_max_records * sizeof(serialized_log_record));
-    hdr->oob_data_offset = m_iovecs[0].iov_len;
-    if (new_iovec_for_footer()) {
-        hdr->footer_offset = hdr->oob_data_offset + m_oob_data_pos;
-        hdr->group_size = hdr->footer_offset + m_footer_buf_len;
-    } else {
-        hdr->footer_offset = m_inline_data_pos;
-        hdr->group_size = hdr->oob_data_offset;
+        log_group_header* hdr = new (header()) log_group_header{};
+        hdr->n_log_records = m_nrecords;
+        hdr->inline_data_offset = sizeof(log_group_header) + (m_max_records * sizeof(serialized_log_record));
+        hdr->oob_data_offset = m_iovecs[0].iov_len;
+        if (new_iovec_for_footer()) {
+            hdr->footer_offset = hdr->oob_data_offset + m_oob_data_pos;
+            hdr->group_size = hdr->footer_offset + m_footer_buf_len;
+        } else {
+            hdr->footer_offset = m_inline_data_pos;
+            hdr->group_size = hdr->oob_data_offset;
+        }
+        footer->start_log_idx = hdr->start_log_idx;
     }
-    HS_DBG_ASSERT_LE((hdr->footer_offset + sizeof(log_group_footer)), hdr->group_size);
 
+    log_group_header* hdr = header();
+    HS_DBG_ASSERT_LE((hdr->footer_offset + sizeof(log_group_footer)), hdr->group_size);
 #ifndef NDEBUG
     uint64_t len = 0;
     for (auto const& iv : m_iovecs) {
@@ -147,20 +173,101 @@ const iovec_array& LogGroup::finish(const crc32_t prev_crc) {
     HS_DBG_ASSERT_EQ(hdr->group_size, len, "length is not same");
 #endif
 
-    footer->start_log_idx = hdr->start_log_idx;
+    hdr->prev_grp_crc = prev_crc;
     hdr->cur_grp_crc = compute_crc();
 
     return m_iovecs;
 }
 
+// Compress the inline and oob data area of the group into m_compress_buf, which then replaces all the iovecs of the
+// group. Returns false if the group is to be written uncompressed.
+bool LogGroup::compress() {
+    auto const inline_data_offset = s_cast< uint32_t >(log_group_header::record_slot_offset(m_max_records));
+    auto const inline_data_size = m_inline_data_pos - inline_data_offset;
+    auto const data_size = inline_data_size + m_oob_data_pos;
+    if ((m_nrecords == 0) || (data_size < HS_DYNAMIC_CONFIG(logstore.compress_min_data_size))) { return false; }
+
+    // Data area needs to be contiguous to compress, gather the oob buffers after the inline data
+    const uint8_t* src = m_cur_log_buf + inline_data_offset;
+    if (m_oob_data_pos != 0) {
+        if (m_compress_src.size() < data_size) { m_compress_src.resize(data_size); }
+        std::memcpy(s_cast< void* >(m_compress_src.data()), s_cast< const void* >(src), inline_data_size);
+        auto pos = inline_data_size;
+        for (size_t i{1}; i < m_iovecs.size(); ++i) {
+            std::memcpy(s_cast< void* >(m_compress_src.data() + pos), m_iovecs[i].iov_base, m_iovecs[i].iov_len);
+            pos += m_iovecs[i].iov_len;
+        }
+        src = m_compress_src.data();
+    }
+
+    auto const compressed_pos = inline_data_offset + s_cast< uint32_t >(sizeof(log_group_compressed_data));
+    auto const max_len =
+        s_cast< uint32_t >(sisl::round_up(compressed_pos + sisl::Compress::max_compress_len(data_size) +
+                                              sizeof(log_group_footer),
+                                          m_flush_multiple_size));
+    if (max_len > m_compress_buf_len) {
+        m_compress_buf =
+            sisl::aligned_unique_ptr< uint8_t, sisl::buftag::logwrite >::make_sized(m_flush_multiple_size, max_len);
+        m_compress_buf_len = max_len;
+    }
+    uint8_t* buf = m_compress_buf.get();
+
+    size_t compressed_size = m_compress_buf_len - compressed_pos - sizeof(log_group_footer);
+    auto const ret = sisl::Compress::compress(r_cast< const char* >(src), r_cast< char* >(buf + compressed_pos),
+                                              data_size, &compressed_size);
+    if (ret != 0) {
+        LOGERRORMOD(logstore, "Compress of log group data size={} failed with ret={}, writing it uncompressed",
+                    data_size, ret);
+        return false;
+    }
+
+    auto const ratio_percent = s_cast< uint32_t >(uint64_t{compressed_size} * 100 / data_size);
+    if (ratio_percent > HS_DYNAMIC_CONFIG(logstore.compress_ratio_limit)) {
+        // back off compression if compress ratio doesn't meet criteria.
+        HS_PERIODIC_LOG(INFO, logstore, "Bypass compress of log group as percent ratio: {} is exceeding limit: {}",
+                        ratio_percent, HS_DYNAMIC_CONFIG(logstore.compress_ratio_limit));
+        COUNTER_INCREMENT(logstore_service().metrics(), logdev_compress_backoff_count, 1);
+        m_compress_backoff = true;
+        return false;
+    }
+    COUNTER_INCREMENT(logstore_service().metrics(), logdev_compress_success_count, 1);
+    HISTOGRAM_OBSERVE(logstore_service().metrics(), logdev_compress_ratio_percent, ratio_percent);
+
+    // Header and record slots are kept as is, followed by the compressed data and then the footer
+    auto const start_log_idx = header()->start_log_idx;
+    std::memcpy(s_cast< void* >(buf), s_cast< const void* >(m_cur_log_buf), inline_data_offset);
+    m_cur_log_buf = buf;
+
+    auto* cdata = r_cast< log_group_compressed_data* >(buf + inline_data_offset);
+    cdata->uncompressed_size = data_size;
+    cdata->compressed_size = s_cast< uint32_t >(compressed_size);
+    auto const footer_offset = compressed_pos + cdata->compressed_size;
+    auto* footer = new (buf + footer_offset) log_group_footer(m_format_gen);
+
+    log_group_header* hdr = new (header()) log_group_header{};
+    hdr->set_codec(log_group_codec::sisl_compress);
+    hdr->n_log_records = m_nrecords;
+    hdr->start_log_idx = start_log_idx;
+    hdr->inline_data_offset = inline_data_offset;
+    hdr->oob_data_offset = m_inline_data_pos; // oob data follows the inline data in the uncompressed data area
+    hdr->footer_offset = footer_offset;
+    hdr->group_size =
+        s_cast< uint32_t >(sisl::round_up(footer_offset + sizeof(log_group_footer), m_flush_multiple_size));
+    footer->start_log_idx = start_log_idx;
+
+    m_iovecs.clear();
+    m_iovecs.emplace_back(s_cast< void* >(buf), hdr->group_size);
+    return true;
+}
+
 log_group_footer* LogGroup::add_and_get_footer() {
     log_group_footer* footer;
     if (new_iovec_for_footer()) {
         // allocate a new iovec if there are out of band buffers or inline buffer doesn't have enough space
         m_iovecs.emplace_back(static_cast< void* >(m_footer_buf.get()), m_footer_buf_len);
-        footer = new (m_footer_buf.get()) log_group_footer();
+        footer = new (m_footer_buf.get()) log_group_footer(m_format_gen);
     } else {
-        footer = new ((void*)((uint8_t*)m_iovecs[0].iov_base + m_inline_data_pos)) log_group_footer();
+        footer = new ((void*)((uint8_t*)m_iovecs[0].iov_base + m_inline_data_pos)) log_group_footer(m_format_gen);
         m_iovecs[0].iov_len += sizeof(log_group_footer);
     }
     return footer;
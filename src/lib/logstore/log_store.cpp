@@ -13,6 +13,7 @@
  * specific language governing permissions and limitations under the License.
  *
  *********************************************************************************/
+#include <algorithm>
 #include <iterator>
 #include <string>
 
@@ -36,7 +37,8 @@ SISL_LOGGING_DECL(logstore)
 HomeLogStore::HomeLogStore(LogStoreFamily& family, logstore_id_t id, bool append_mode, logstore_seq_num_t start_lsn) :
         m_store_id{id},
         m_logstore_family{family},
-        m_logdev{family.logdev()},
+        m_logdev{family.logdev(family.shard_of(id))},
+        m_logdev_store_id{family.shard_store_id(id)},
         m_records{"HomeLogStoreRecords", start_lsn - 1},
         m_append_mode{append_mode},
         m_seq_num{start_lsn},
@@ -96,7 +98,8 @@ void HomeLogStore::write_async(logstore_req* req, const log_req_comp_cb_t& cb) {
     m_records.create(req->seq_num);
     COUNTER_INCREMENT(m_metrics, logstore_append_count, 1);
     HISTOGRAM_OBSERVE(m_metrics, logstore_record_size, req->data.size);
-    m_logdev.append_async(m_store_id, req->seq_num, req->data, static_cast< void* >(req));
+    m_logdev.append_async(m_logdev_store_id, req->seq_num, req->data, static_cast< void* >(req),
+                          req->is_reserved_buf);
 }
 
 void HomeLogStore::write_async(logstore_seq_num_t seq_num, const sisl::io_blob& b, void* cookie,
@@ -118,7 +121,88 @@ logstore_seq_num_t HomeLogStore::append_async(const sisl::io_blob& b, void* cook
     return seq_num;
 }
 
+sisl::io_blob HomeLogStore::reserve_append(uint32_t max_size) {
+    return sisl::io_blob{m_logdev.alloc_reserved_buf(max_size), max_size, true /* aligned */};
+}
+
+logstore_seq_num_t HomeLogStore::commit_append_async(const sisl::io_blob& reserved, uint32_t size, void* cookie,
+                                                     const log_write_comp_cb_t& cb) {
+    HS_DBG_ASSERT_EQ(m_append_mode, true, "commit_append_async can be called only on append only mode");
+    HS_REL_ASSERT_LE(size, reserved.size, "Record size is more than the size reserved");
+    const auto seq_num = m_seq_num.fetch_add(1, std::memory_order_acq_rel);
+
+    auto* req = logstore_req::make(this, seq_num, sisl::io_blob{reserved.bytes, size, true /* aligned */},
+                                   true /* is_write_req */);
+    req->cookie = cookie;
+    req->is_reserved_buf = true;
+    COUNTER_INCREMENT(m_metrics, logstore_reserved_append_count, 1);
+    write_async(req, [this, cb](logstore_req* req, logdev_key written_lkey) {
+        if (cb) { cb(req->seq_num, req->data, written_lkey, req->cookie); }
+        m_logdev.free_reserved_buf(req->data.bytes);
+        logstore_req::free(req);
+    });
+    return seq_num;
+}
+
+void HomeLogStore::cancel_append(const sisl::io_blob& reserved) { m_logdev.free_reserved_buf(reserved.bytes); }
+
+// Batch of appends, which is completed when the last of its records (the one with highest lsn) is completed
+struct append_batch_req {
+    std::atomic< uint32_t > noutstanding;
+    logstore_seq_num_t start_lsn;
+    uint32_t nrecords;
+    void* cookie;
+    log_batch_write_comp_cb_t cb;
+};
+
+logstore_seq_num_t HomeLogStore::append_batch_async(const std::vector< sisl::io_blob >& blobs, void* cookie,
+                                                    const log_batch_write_comp_cb_t& cb) {
+    HS_DBG_ASSERT_EQ(m_append_mode, true, "append_batch_async can be called only on append only mode");
+    HS_REL_ASSERT(!blobs.empty(), "append_batch_async called with empty batch");
+    auto const nrecords = static_cast< uint32_t >(blobs.size());
+    auto const start_lsn = m_seq_num.fetch_add(nrecords, std::memory_order_acq_rel);
+    if (start_lsn == 0) { m_safe_truncation_boundary.ld_key = m_logdev.get_last_flush_ld_key(); }
+
+    auto* batch = new append_batch_req{{nrecords}, start_lsn, nrecords, cookie, cb};
+    static const log_req_comp_cb_t s_batch_record_comp_cb = [](logstore_req* req, logdev_key ld_key) {
+        auto* batch = static_cast< append_batch_req* >(req->cookie);
+        logstore_req::free(req);
+        if (batch->noutstanding.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            if (batch->cb) { batch->cb(batch->start_lsn, batch->nrecords, ld_key, batch->cookie); }
+            delete batch;
+        }
+    };
+
+    const auto start_time = Clock::now();
+    std::vector< void* > reqs(nrecords);
+    for (uint32_t i{0}; i < nrecords; ++i) {
+        auto* req = logstore_req::make(this, start_lsn + i, blobs[i], true /* is_write_req */);
+        req->cookie = batch;
+        req->cb = s_batch_record_comp_cb;
+        req->start_time = start_time;
+        m_records.create(start_lsn + i);
+        HISTOGRAM_OBSERVE(m_metrics, logstore_record_size, blobs[i].size);
+        reqs[i] = req;
+    }
+    COUNTER_INCREMENT(m_metrics, logstore_append_count, nrecords);
+    HISTOGRAM_OBSERVE(m_metrics, logstore_append_batch_size, nrecords);
+    m_logdev.append_batch_async(m_logdev_store_id, start_lsn, blobs, reqs);
+    return start_lsn;
+}
+
 log_buffer HomeLogStore::read_sync(logstore_seq_num_t seq_num) {
+    const logdev_key ld_key = read_key(seq_num);
+
+    const auto start_time = Clock::now();
+    THIS_LOGSTORE_LOG(TRACE, "Reading lsn={}:{} mapped to logdev_key=[idx={} dev_offset={}]", m_store_id, seq_num,
+                      ld_key.idx, ld_key.dev_offset);
+    COUNTER_INCREMENT(m_metrics, logstore_read_count, 1);
+    const auto b = read_record(seq_num, ld_key);
+    HISTOGRAM_OBSERVE(m_metrics, logstore_read_latency, get_elapsed_time_us(start_time));
+    return b;
+}
+
+logdev_key HomeLogStore::read_key(logstore_seq_num_t seq_num) {
     // If seq_num has not been flushed yet, but issued, then we flush them before reading
     auto const s = m_records.status(seq_num);
     if (s.is_out_of_range || s.is_hole) {
@@ -135,37 +219,140 @@ log_buffer HomeLogStore::read_sync(logstore_seq_num_t seq_num) {
         THIS_LOGSTORE_LOG(ERROR, "ld_key not valid {}", seq_num);
         throw std::out_of_range("key not valid");
     }
+    return ld_key;
+}
+
+log_buffer HomeLogStore::read_record(logstore_seq_num_t seq_num, const logdev_key& ld_key) {
+    if (auto b = m_logdev.tail_cache().get(m_logdev_store_id, seq_num); b) {
+        COUNTER_INCREMENT(m_metrics, logstore_tail_cache_hit_count, 1);
+        return *b;
+    }
+    COUNTER_INCREMENT(m_metrics, logstore_tail_cache_miss_count, 1);
 
-    const auto start_time = Clock::now();
-    THIS_LOGSTORE_LOG(TRACE, "Reading lsn={}:{} mapped to logdev_key=[idx={} dev_offset={}]", m_store_id, seq_num,
-                      ld_key.idx, ld_key.dev_offset);
-    COUNTER_INCREMENT(m_metrics, logstore_read_count, 1);
     serialized_log_record header;
-    const auto b = m_logdev.read(ld_key, header);
-    HISTOGRAM_OBSERVE(m_metrics, logstore_read_latency, get_elapsed_time_us(start_time));
-    return b;
+    return m_logdev.read(ld_key, header);
 }
-#if 0
+
 void HomeLogStore::read_async(logstore_req* req, const log_found_cb_t& cb) {
-    HS_LOG_ASSERT( ((cb != nullptr) || (m_comp_cb != nullptr)),
-              "Expected either cb is not null or default cb registered");
-    auto record = m_records.at(req->seq_num);
-    logdev_key ld_key = record.m_dev_key;
-    req->cb = cb;
-    m_logdev.read_async(ld_key, (void*)req);
+    HS_LOG_ASSERT(((cb != nullptr) || (m_found_cb != nullptr)),
+                  "Expected either cb is not null or default cb registered");
+    read_async(std::vector< logstore_seq_num_t >{req->seq_num}, req->cookie, (cb != nullptr) ? cb : m_found_cb);
 }
 
 void HomeLogStore::read_async(logstore_seq_num_t seq_num, void* cookie, const log_found_cb_t& cb) {
-    auto record = m_records.at(seq_num);
-    logdev_key ld_key = record.m_dev_key;
-    sisl::io_blob b;
-    auto* req = logstore_req::make(this, seq_num, &b, false /* not write */);
-    read_async(req, [cookie, cb](logstore_seq_num_t seq_num, log_buffer log_buf, void* cookie) {
-            cb(seq, log_buf, cookie);
-            logstore_req::free(req);
-            });
+    read_async(std::vector< logstore_seq_num_t >{seq_num}, cookie, cb);
+}
+
+void HomeLogStore::read_async(const std::vector< logstore_seq_num_t >& seq_nums, void* cookie,
+                              const log_found_cb_t& cb, const log_read_err_cb_t& err_cb) {
+    // Validate all of them upfront, so that either all or none of them are read
+    logstore_seq_num_t wait_lsn{invalid_lsn()};
+    for (auto const seq_num : seq_nums) {
+        auto const s = m_records.status(seq_num);
+        if (s.is_out_of_range || s.is_hole) {
+            THIS_LOGSTORE_LOG(DEBUG, "ld_key not valid {}", seq_num);
+            throw std::out_of_range("key not valid");
+        }
+        if (!s.is_completed) { wait_lsn = std::max(wait_lsn, seq_num); }
+    }
+    COUNTER_INCREMENT(m_metrics, logstore_read_count, seq_nums.size());
+    if (wait_lsn == invalid_lsn()) {
+        do_read_async(seq_nums, cookie, cb, err_cb);
+        return;
+    }
+
+    // Queue the read until the lsns are flushed, instead of blocking the caller (which could be an io reactor) on it
+    THIS_LOGSTORE_LOG(TRACE, "Reading upto lsn={}:{} before flushed, queueing the read behind flush", m_store_id,
+                      wait_lsn);
+    std::function< void() > resume = [this, shared_this = shared_from_this(), seq_nums, cookie, cb, err_cb]() {
+        do_read_async(seq_nums, cookie, cb, err_cb);
+    };
+    if (iomanager.am_i_io_reactor()) {
+        resume = [issuer = iomanager.iothread_self(), read = std::move(resume)]() {
+            iomanager.run_on(issuer, [read]([[maybe_unused]] iomgr::io_thread_addr_t addr) { read(); });
+        };
+    }
+    {
+        std::unique_lock lk{m_pending_reads_mtx};
+        // Count it and check again, in case the completion of the lsn checked for pending reads before it was counted
+        m_npending_reads.fetch_add(1);
+        if (m_records.status(wait_lsn).is_active) {
+            m_pending_reads.emplace_back(wait_lsn, std::move(resume));
+            resume = nullptr;
+        } else {
+            m_npending_reads.fetch_sub(1);
+        }
+    }
+
+    if (resume == nullptr) {
+        m_logdev.flush_if_needed(1);
+    } else {
+        do_read_async(seq_nums, cookie, cb, err_cb);
+    }
+}
+
+void HomeLogStore::resume_pending_reads() {
+    std::vector< std::function< void() > > ready;
+    {
+        std::unique_lock lk{m_pending_reads_mtx};
+        // Lsn which is no longer active is either completed or rolled back, which the read finds out
+        auto it = std::remove_if(m_pending_reads.begin(), m_pending_reads.end(), [&](auto& r) {
+            if (m_records.status(r.first).is_active) { return false; }
+            ready.push_back(std::move(r.second));
+            return true;
+        });
+        m_pending_reads.erase(it, m_pending_reads.end());
+        m_npending_reads.fetch_sub(ready.size());
+    }
+    for (auto& resume : ready) {
+        resume();
+    }
+}
+
+void HomeLogStore::do_read_async(const std::vector< logstore_seq_num_t >& seq_nums, void* cookie,
+                                 const log_found_cb_t& cb, const log_read_err_cb_t& err_cb) {
+    auto const on_error = [this, cookie, cb, err_cb](logstore_seq_num_t seq_num, std::error_condition err) {
+        THIS_LOGSTORE_LOG(ERROR, "Failed to read lsn={}:{} error={}", m_store_id, seq_num, err.message());
+        (err_cb != nullptr) ? err_cb(seq_num, err, cookie) : cb(seq_num, log_buffer{}, cookie);
+    };
+
+    std::vector< logstore_seq_num_t > dev_seq_nums;
+    std::vector< logdev_key > dev_keys;
+    for (size_t i{0}; i < seq_nums.size(); ++i) {
+        // A queued read could find its lsn truncated or rolled back by the time it is flushed
+        auto const s = m_records.status(seq_nums[i]);
+        if (s.is_out_of_range || s.is_hole || !s.is_completed) {
+            on_error(seq_nums[i], std::make_error_condition(std::errc::result_out_of_range));
+            continue;
+        }
+
+        if (auto b = m_logdev.tail_cache().get(m_logdev_store_id, seq_nums[i]); b) {
+            COUNTER_INCREMENT(m_metrics, logstore_tail_cache_hit_count, 1);
+            cb(seq_nums[i], *b, cookie);
+            continue;
+        }
+        COUNTER_INCREMENT(m_metrics, logstore_tail_cache_miss_count, 1);
+        dev_seq_nums.push_back(seq_nums[i]);
+        dev_keys.push_back(m_records.at(seq_nums[i]).m_dev_key);
+    }
+    if (dev_keys.empty()) { return; }
+
+    THIS_LOGSTORE_LOG(TRACE, "Reading {} lsns [{}...] asynchronously from logdev", dev_seq_nums.size(),
+                      dev_seq_nums.front());
+    m_logdev.read_async(std::move(dev_keys),
+                        [this, shared_this = shared_from_this(), dev_seq_nums = std::move(dev_seq_nums), cookie, cb,
+                         on_error, start_time = Clock::now()](std::vector< log_buffer > bufs,
+                                                              std::vector< std::error_condition > errs) {
+                            HISTOGRAM_OBSERVE(m_metrics, logstore_read_latency, get_elapsed_time_us(start_time));
+                            for (size_t i{0}; i < bufs.size(); ++i) {
+                                if (errs[i]) {
+                                    on_error(dev_seq_nums[i], errs[i]);
+                                } else {
+                                    cb(dev_seq_nums[i], bufs[i], cookie);
+                                }
+                            }
+                        });
 }
-#endif
 
 void HomeLogStore::on_write_completion(logstore_req* req, const logdev_key& ld_key) {
     // Upon completion, create the mapping between seq_num and log dev key
@@ -178,6 +365,7 @@ void HomeLogStore::on_write_completion(logstore_req* req, const logdev_key& ld_k
 
     // Update the maximum lsn we have seen for this batch for this store, it is needed to create truncation barrier
     m_flush_batch_max_lsn = std::max(m_flush_batch_max_lsn, req->seq_num);
+
     HISTOGRAM_OBSERVE(m_metrics, logstore_append_latency, get_elapsed_time_us(req->start_time));
     (req->cb) ? req->cb(req, ld_key) : m_comp_cb(req, ld_key);
 
@@ -185,6 +373,7 @@ void HomeLogStore::on_write_completion(logstore_req* req, const logdev_key& ld_k
         // Sync flush is waiting for this lsn to be completed, wake up the sync flush cv
         m_sync_flush_cv.notify_one();
     }
+    if (m_npending_reads.load() != 0) { resume_pending_reads(); }
 }
 
 void HomeLogStore::on_read_completion(logstore_req* req, const logdev_key& ld_key) {
@@ -210,6 +399,14 @@ void HomeLogStore::on_log_found(logstore_seq_num_t seq_num, const logdev_key& ld
 void HomeLogStore::on_batch_completion(const logdev_key& flush_batch_ld_key) {
     assert(m_flush_batch_max_lsn != std::numeric_limits< logstore_seq_num_t >::min());
 
+    // Store which neither had any pending device truncation nor barriers was not part of the device truncations, catch
+    // up with them as it participates again from now on
+    const bool participating = m_safe_truncation_boundary.pending_dev_truncation || !m_truncation_barriers.empty();
+    if (!participating) {
+        const auto trunc_upto = m_logstore_family.truncation_heap(m_logdev.shard_idx()).truncated_upto();
+        if (trunc_upto.idx > m_safe_truncation_boundary.ld_key.idx) { m_safe_truncation_boundary.ld_key = trunc_upto; }
+    }
+
     // Create a new truncation barrier for this completion key
     if (m_truncation_barriers.size() && (m_truncation_barriers.back().seq_num >= m_flush_batch_max_lsn)) {
         m_truncation_barriers.back().ld_key = flush_batch_ld_key;
@@ -217,6 +414,7 @@ void HomeLogStore::on_batch_completion(const logdev_key& flush_batch_ld_key) {
         m_truncation_barriers.push_back({m_flush_batch_max_lsn, flush_batch_ld_key});
     }
     m_flush_batch_max_lsn = std::numeric_limits< logstore_seq_num_t >::min(); // Reset the flush batch for next batch.
+    if (!participating) { update_truncation_heap(); }
 }
 
 void HomeLogStore::truncate(logstore_seq_num_t upto_seq_num, bool in_memory_truncate_only) {
@@ -244,7 +442,9 @@ void HomeLogStore::truncate(logstore_seq_num_t upto_seq_num, bool in_memory_trun
     auto shared_this = shared_from_this();
     const bool locked_now = m_logdev.try_lock_flush([shared_this, upto_seq_num, in_memory_truncate_only]() {
         shared_this->do_truncate(upto_seq_num);
-        if (!in_memory_truncate_only) { shared_this->get_family().do_device_truncate(); }
+        if (!in_memory_truncate_only) {
+            shared_this->get_family().do_device_truncate(shared_this->m_logdev.shard_idx());
+        }
     });
 
     if (locked_now) { m_logdev.unlock_flush(); }
@@ -254,9 +454,10 @@ void HomeLogStore::truncate(logstore_seq_num_t upto_seq_num, bool in_memory_trun
 void HomeLogStore::do_truncate(logstore_seq_num_t upto_seq_num) {
     m_records.truncate(upto_seq_num);
     m_safe_truncation_boundary.seq_num.store(upto_seq_num, std::memory_order_release);
+    m_logdev.tail_cache().truncate(m_logdev_store_id, upto_seq_num);
 
     // Need to update the superblock with meta, we don't persist yet, will be done as part of log dev truncation
-    m_logdev.update_store_superblk(m_store_id, logstore_superblk{upto_seq_num + 1}, false /* persist_now */);
+    m_logdev.update_store_superblk(m_logdev_store_id, logstore_superblk{upto_seq_num + 1}, false /* persist_now */);
 
     const int ind = search_max_le(upto_seq_num);
     if (ind < 0) {
@@ -277,12 +478,20 @@ void HomeLogStore::do_truncate(logstore_seq_num_t upto_seq_num) {
     m_safe_truncation_boundary.pending_dev_truncation = true;
 
     m_truncation_barriers.erase(m_truncation_barriers.begin(), m_truncation_barriers.begin() + ind + 1);
+    update_truncation_heap();
 }
 
-// NOTE: This method assumes the flush lock is already acquired by the caller
-const truncation_info& HomeLogStore::pre_device_truncation() {
-    m_safe_truncation_boundary.active_writes_not_part_of_truncation = (m_truncation_barriers.size() > 0);
-    return m_safe_truncation_boundary;
+// Device truncation considers this store, only while it has any pending device truncation or active writes not part of
+// the truncation yet. NOTE: This method assumes the flush lock is already acquired by the caller
+void HomeLogStore::update_truncation_heap() {
+    auto& heap = m_logstore_family.truncation_heap(m_logdev.shard_idx());
+    m_safe_truncation_boundary.active_writes_not_part_of_truncation = !m_truncation_barriers.empty();
+    if (m_safe_truncation_boundary.pending_dev_truncation ||
+        m_safe_truncation_boundary.active_writes_not_part_of_truncation) {
+        heap.update(m_store_id, m_safe_truncation_boundary.ld_key);
+    } else {
+        heap.remove(m_store_id);
+    }
 }
 
 // NOTE: This method assumes the flush lock is already acquired by the caller
@@ -291,6 +500,7 @@ void HomeLogStore::post_device_truncation(const logdev_key& trunc_upto_loc) {
         // This method is expected to be called always with this
         m_safe_truncation_boundary.pending_dev_truncation = false;
         m_safe_truncation_boundary.ld_key = trunc_upto_loc;
+        update_truncation_heap();
     } else {
         HS_REL_ASSERT(0,
                       "We expect post_device_truncation to be called only for logstores which has min of all "
@@ -375,10 +585,7 @@ nlohmann::json HomeLogStore::dump_log_store(const log_dump_req& dump_req) {
 
 void HomeLogStore::foreach (int64_t start_idx, const std::function< bool(logstore_seq_num_t, log_buffer) >& cb) {
     m_records.foreach_all_completed(start_idx, [&](int64_t cur_idx, homestore::logstore_record& record) -> bool {
-        // do a sync read
-        serialized_log_record header;
-        auto log_buf = m_logdev.read(record.m_dev_key, header);
-        return cb(cur_idx, log_buf);
+        return cb(cur_idx, read_record(cur_idx, record.m_dev_key));
     });
 }
 
@@ -393,7 +600,7 @@ logstore_seq_num_t HomeLogStore::get_contiguous_completed_seq_num(logstore_seq_n
 void HomeLogStore::flush_sync(logstore_seq_num_t upto_seq_num) {
     // Logdev flush is async call and if flush_sync is called on the same thread which could potentially do logdev
     // flush, waiting sync would cause deadlock.
-    HS_DBG_ASSERT_EQ(LogDev::can_flush_in_this_thread(), false,
+    HS_DBG_ASSERT_EQ(m_logdev.can_flush_in_this_thread(), false,
                      "Logstore flush sync cannot be called on same thread which could do logdev flush");
 
     if (upto_seq_num == invalid_lsn()) { upto_seq_num = m_records.active_upto(); }
@@ -445,11 +652,9 @@ uint64_t HomeLogStore::rollback_async(logstore_seq_num_t to_lsn, on_rollback_cb_
     logid_range_t logid_range = std::make_pair(m_records.at(to_lsn + 1).m_dev_key.idx,
                                                m_records.at(from_lsn).m_dev_key.idx); // Get the logid range to rollback
     m_records.rollback(to_lsn); // Rollback all bitset records and from here on, we can't access any lsns beyond to_lsn
+    m_logdev.tail_cache().rollback(m_logdev_store_id, to_lsn);
 
     if (m_logdev.try_lock_flush([logid_range, to_lsn, this, comp_cb = std::move(cb)]() {
-            // Rollback the log_ids in the range, for this log store (which persists this info in its superblk)
-            m_logdev.rollback(m_store_id, logid_range);
-
             // Remove all truncation barriers on rolled back lsns
             for (auto it = std::rbegin(m_truncation_barriers); it != std::rend(m_truncation_barriers); ++it) {
                 if (it->seq_num > to_lsn) {
@@ -459,7 +664,13 @@ uint64_t HomeLogStore::rollback_async(logstore_seq_num_t to_lsn, on_rollback_cb_
                 }
             }
             m_flush_batch_max_lsn = invalid_lsn(); // Reset the flush batch for next batch.
-            if (comp_cb) { comp_cb(to_lsn); }
+            update_truncation_heap();
+
+            // Rollback the log_ids in the range, for this log store (which persists this info in its superblk). The
+            // rollback is completed only once it is persisted, which could be after the flush is unlocked.
+            m_logdev.rollback(m_logdev_store_id, logid_range, [to_lsn, comp_cb]() {
+                if (comp_cb) { comp_cb(to_lsn); }
+            });
         })) {
         m_logdev.unlock_flush();
     }
@@ -476,7 +687,7 @@ nlohmann::json HomeLogStore::get_status(int verbosity) const {
     js["truncation_pending_on_device?"] = m_safe_truncation_boundary.pending_dev_truncation;
     js["truncation_parallel_to_writes?"] = m_safe_truncation_boundary.active_writes_not_part_of_truncation;
     js["logstore_records"] = m_records.get_status(verbosity);
-    js["logstore_sb_first_lsn"] = m_logdev.log_dev_meta().store_superblk(m_store_id).m_first_seq_num;
+    js["logstore_sb_first_lsn"] = m_logdev.log_dev_meta().store_superblk(m_logdev_store_id).m_first_seq_num;
     return js;
 }
 
@@ -31,15 +31,48 @@ namespace homestore {
 SISL_LOGGING_DECL(logstore)
 
 LogStoreFamily::LogStoreFamily(logstore_family_id_t f_id) :
-        m_family_id{f_id}, m_name{std::string("LogDevFamily") + std::to_string(f_id)}, m_log_dev{f_id, m_name} {}
+        m_family_id{f_id}, m_name{std::string("LogDevFamily") + std::to_string(f_id)} {}
+
+void LogStoreFamily::create_logdev(uint32_t shard_idx, uint32_t nshards) {
+    if (m_logdevs.empty()) {
+        m_logdevs.resize(nshards);
+        m_last_flush_info.resize(nshards);
+        for (uint32_t i{0}; i < nshards; ++i) {
+            m_truncation_heaps.emplace_back(std::make_unique< LogTruncationHeap >());
+        }
+    }
+    HS_REL_ASSERT_EQ(m_logdevs.size(), nshards, "Number of logdev shards of family {} mismatch", m_family_id);
+    if (m_logdevs[shard_idx]) { return; }
+
+    // First shard keeps the meta blk name of the unsharded logdev, so that an existing journal is loaded as is
+    const std::string name{(shard_idx == 0) ? m_name : (m_name + "_shard" + std::to_string(shard_idx))};
+    m_logdevs[shard_idx] = std::make_unique< LogDev >(m_family_id, shard_idx, name);
+}
 
-void LogStoreFamily::start(bool format, JournalVirtualDev* blk_store) {
-    m_log_dev.register_store_found_cb(bind_this(LogStoreFamily::on_log_store_found, 2));
-    m_log_dev.register_append_cb(bind_this(LogStoreFamily::on_io_completion, 5));
-    m_log_dev.register_logfound_cb(bind_this(LogStoreFamily::on_logfound, 6));
+void LogStoreFamily::start(bool format, const std::vector< JournalVirtualDev* >& vdevs) {
+    HS_REL_ASSERT_EQ(vdevs.size(), m_logdevs.size(), "Journal vdevs of family {} mismatch logdev shards", m_family_id);
+    for (uint32_t shard_idx{0}; shard_idx < num_logdevs(); ++shard_idx) {
+        HS_REL_ASSERT(vdevs[shard_idx] != nullptr, "Journal vdev of logdev shard {}-{} is not found", m_family_id,
+                      shard_idx);
 
-    // Start the logdev, which loads the device in case of recovery.
-    m_log_dev.start(format, blk_store);
+        // Logdev of the shard knows the stores only by their shard store id, translate them to family store id
+        auto& ld = logdev(shard_idx);
+        ld.register_store_found_cb([this, shard_idx](logstore_id_t id, const logstore_superblk& sb) {
+            on_log_store_found(family_store_id(shard_idx, id), sb);
+        });
+        ld.register_append_cb([this, shard_idx](logstore_id_t id, logdev_key ld_key, logdev_key flush_ld_key,
+                                                uint32_t nremaining_in_batch, void* ctx) {
+            on_io_completion(shard_idx, family_store_id(shard_idx, id), ld_key, flush_ld_key, nremaining_in_batch,
+                             ctx);
+        });
+        ld.register_logs_found_batch_cb(
+            [this, shard_idx](const std::vector< log_found_record >& records, logdev_key flush_ld_key) {
+                on_logs_found(shard_idx, records, flush_ld_key);
+            });
+
+        // Start the logdev, which loads the device in case of recovery.
+        ld.start(format, vdevs[shard_idx]);
+    }
     for (auto it{std::begin(m_unopened_store_io)}; it != std::end(m_unopened_store_io); ++it) {
         LOGINFO("skip log entries for store id {}-{}, ios {}", m_family_id, it->first, it->second);
     }
@@ -54,7 +87,7 @@ void LogStoreFamily::start(bool format, JournalVirtualDev* blk_store) {
         for (auto it{std::begin(m_unopened_store_id)}; it != std::end(m_unopened_store_id);) {
             if (m.find(*it) == m.end()) {
                 // Not opened even on second time check, simply unreserve id
-                m_log_dev.unreserve_store_id(*it);
+                logdev(shard_of(*it)).unreserve_store_id(shard_store_id(*it));
             }
             it = m_unopened_store_id.erase(it);
         }
@@ -74,11 +107,18 @@ void LogStoreFamily::start(bool format, JournalVirtualDev* blk_store) {
 
 void LogStoreFamily::stop() {
     m_id_logstore_map.wlock()->clear();
-    m_log_dev.stop();
+    for (auto& ld : m_logdevs) {
+        ld->stop();
+    }
+    for (auto& heap : m_truncation_heaps) {
+        heap->clear();
+    }
 }
 
 std::shared_ptr< HomeLogStore > LogStoreFamily::create_new_log_store(bool append_mode) {
-    auto const store_id = m_log_dev.reserve_store_id();
+    // Spread the log stores across the logdev shards
+    auto const shard_idx = m_next_shard.fetch_add(1, std::memory_order_relaxed) % num_logdevs();
+    auto const store_id = family_store_id(shard_idx, logdev(shard_idx).reserve_store_id());
     std::shared_ptr< HomeLogStore > lstore;
     lstore = std::make_shared< HomeLogStore >(*this, store_id, append_mode, 0);
 
@@ -105,23 +145,36 @@ void LogStoreFamily::remove_log_store(logstore_id_t store_id) {
     LOGINFO("Removing log store id {}-{}", m_family_id, store_id);
     auto ret = m_id_logstore_map.wlock()->erase(store_id);
     HS_REL_ASSERT((ret == 1), "try to remove invalid store_id {}-{}", m_family_id, store_id);
-    m_log_dev.unreserve_store_id(store_id);
+    logdev(shard_of(store_id)).tail_cache().remove_store(shard_store_id(store_id));
+    truncation_heap(shard_of(store_id)).remove(store_id);
+    logdev(shard_of(store_id)).unreserve_store_id(shard_store_id(store_id));
 }
 
 void LogStoreFamily::device_truncate_in_user_reactor(const std::shared_ptr< truncate_req >& treq) {
-    const bool locked_now = m_log_dev.try_lock_flush([this, treq]() {
+    // Every shard is truncated independently under its own flush lock
+    for (uint32_t shard_idx{0}; shard_idx < num_logdevs(); ++shard_idx) {
+        device_truncate_shard(shard_idx, treq);
+    }
+}
+
+void LogStoreFamily::device_truncate_shard(uint32_t shard_idx, const std::shared_ptr< truncate_req >& treq) {
+    auto& ld = logdev(shard_idx);
+    const bool locked_now = ld.try_lock_flush([this, shard_idx, treq]() {
         if (iomanager.am_i_tight_loop_reactor()) {
-            iomanager.run_on(
-                logstore_service().m_truncate_thread,
-                [this, treq]([[maybe_unused]] iomgr::io_thread_addr_t addr) { device_truncate_in_user_reactor(treq); });
+            iomanager.run_on(logstore_service().m_truncate_thread,
+                             [this, shard_idx, treq]([[maybe_unused]] iomgr::io_thread_addr_t addr) {
+                                 device_truncate_shard(shard_idx, treq);
+                             });
         } else {
-            const logdev_key trunc_upto = do_device_truncate(treq->dry_run);
+            const logdev_key trunc_upto = do_device_truncate(shard_idx, treq->dry_run);
             bool done{false};
             if (treq->cb || treq->wait_till_done) {
                 {
                     std::lock_guard< std::mutex > lk{treq->mtx};
                     done = (--treq->trunc_outstanding == 0);
-                    treq->m_trunc_upto_result[m_family_id] = trunc_upto;
+                    // Family is reported truncated only upto its least truncated shard
+                    auto& family_trunc_upto = treq->m_trunc_upto_result[m_family_id];
+                    if (trunc_upto.idx < family_trunc_upto.idx) { family_trunc_upto = trunc_upto; }
                 }
             }
             if (done) {
@@ -130,7 +183,7 @@ void LogStoreFamily::device_truncate_in_user_reactor(const std::shared_ptr< trun
             }
         }
     });
-    if (locked_now) { m_log_dev.unlock_flush(); }
+    if (locked_now) { ld.unlock_flush(); }
 }
 
 void LogStoreFamily::on_log_store_found(logstore_id_t store_id, const logstore_superblk& sb) {
@@ -152,7 +205,7 @@ void LogStoreFamily::on_log_store_found(logstore_id_t store_id, const logstore_s
 
 static thread_local std::vector< std::shared_ptr< HomeLogStore > > s_cur_flush_batch_stores;
 
-void LogStoreFamily::on_io_completion(logstore_id_t id, logdev_key ld_key, logdev_key flush_ld_key,
+void LogStoreFamily::on_io_completion(uint32_t shard_idx, logstore_id_t id, logdev_key ld_key, logdev_key flush_ld_key,
                                       uint32_t nremaining_in_batch, void* ctx) {
     auto* req = s_cast< logstore_req* >(ctx);
     HomeLogStore* log_store = req->log_store;
@@ -160,40 +213,42 @@ void LogStoreFamily::on_io_completion(logstore_id_t id, logdev_key ld_key, logde
     if (req->is_write) {
         HS_LOG_ASSERT_EQ(log_store->get_store_id(), id, "Expecting store id in log store and io completion to match");
         log_store->on_write_completion(req, ld_key);
-        on_batch_completion(log_store, nremaining_in_batch, flush_ld_key);
+        on_batch_completion(shard_idx, log_store, nremaining_in_batch, flush_ld_key);
     } else {
         log_store->on_read_completion(req, ld_key);
     }
 }
 
-void LogStoreFamily::on_logfound(logstore_id_t id, logstore_seq_num_t seq_num, logdev_key ld_key,
-                                 logdev_key flush_ld_key, log_buffer buf, uint32_t nremaining_in_batch) {
+void LogStoreFamily::on_logs_found(uint32_t shard_idx, const std::vector< log_found_record >& records,
+                                   logdev_key flush_ld_key) {
+    // All the records of a log group are looked up under a single lock
     auto m = m_id_logstore_map.rlock();
-    auto const it = m->find(id);
-    if (it == m->end()) {
-        auto [unopened_it, inserted] = m_unopened_store_io.insert(std::make_pair<>(id, 0));
-        if (inserted) {
-            // HS_REL_ASSERT(0, "log id  {}-{} not found", m_family_id, id);
+    for (const auto& r : records) {
+        auto const id = family_store_id(shard_idx, r.store_id);
+        auto const it = m->find(id);
+        if (it == m->end()) {
+            ++m_unopened_store_io[id];
+            continue;
         }
-        ++unopened_it->second;
-        return;
+        auto& log_store = it->second.m_log_store;
+        if (!log_store) { continue; }
+        log_store->on_log_found(r.seq_num, r.ld_key, flush_ld_key, r.buf);
+        on_batch_completion(shard_idx, log_store.get(), r.nremaining_in_batch, flush_ld_key);
     }
-    auto& log_store = it->second.m_log_store;
-    if (!log_store) { return; }
-    log_store->on_log_found(seq_num, ld_key, flush_ld_key, buf);
-    on_batch_completion(log_store.get(), nremaining_in_batch, flush_ld_key);
 }
 
-void LogStoreFamily::on_batch_completion(HomeLogStore* log_store, uint32_t nremaining_in_batch,
+void LogStoreFamily::on_batch_completion(uint32_t shard_idx, HomeLogStore* log_store, uint32_t nremaining_in_batch,
                                          logdev_key flush_ld_key) {
+    // Batches of different shards complete in parallel, but a batch is completed entirely by one thread
+    auto& last_flush_info = m_last_flush_info[shard_idx];
 
     /* check if it is a first update on this log store */
     auto id = log_store->get_store_id();
-    const auto it = m_last_flush_info.find(id);
-    if ((it == std::end(m_last_flush_info)) || (it->second != flush_ld_key.idx)) {
+    const auto it = last_flush_info.find(id);
+    if ((it == std::end(last_flush_info)) || (it->second != flush_ld_key.idx)) {
         // first time completion in this batch for a given store_id
-        m_last_flush_info.insert_or_assign(id, flush_ld_key.idx);
-        if (it == std::end(m_last_flush_info)) { s_cur_flush_batch_stores.push_back(log_store->shared_from_this()); }
+        last_flush_info.insert_or_assign(id, flush_ld_key.idx);
+        if (it == std::end(last_flush_info)) { s_cur_flush_batch_stores.push_back(log_store->shared_from_this()); }
     }
     if (nremaining_in_batch == 0) {
         // This batch is completed, call all log stores participated in this batch about the end of batch
@@ -203,70 +258,54 @@ void LogStoreFamily::on_batch_completion(HomeLogStore* log_store, uint32_t nrema
             l->on_batch_completion(flush_ld_key);
         }
         s_cur_flush_batch_stores.clear();
-        m_last_flush_info.clear();
+        last_flush_info.clear();
     }
 }
 
-logdev_key LogStoreFamily::do_device_truncate(bool dry_run) {
-    static thread_local std::vector< std::shared_ptr< HomeLogStore > > m_min_trunc_stores;
-    static thread_local std::vector< std::shared_ptr< HomeLogStore > > m_non_participating_stores;
-
-    m_min_trunc_stores.clear();
-    m_non_participating_stores.clear();
-    logdev_key min_safe_ld_key = logdev_key::out_of_bound_ld_key();
-
-    std::string dbg_str{"Format [store_id:trunc_lsn:logidx:dev_trunc_pending?:active_writes_in_trucate?] "};
-    m_id_logstore_map.withRLock([this, &min_safe_ld_key, &dbg_str](auto& id_logstore_map) {
-        for (auto& id_logstore : id_logstore_map) {
-            auto& store_ptr = id_logstore.second.m_log_store;
-            const auto& trunc_info = store_ptr->pre_device_truncation();
-
-            if (!trunc_info.pending_dev_truncation && !trunc_info.active_writes_not_part_of_truncation) {
-                // This log store neither has any pending device truncation nor active logstore io going on for now.
-                // Ignore this log store for min safe boundary calculation.
-                fmt::format_to(std::back_inserter(dbg_str), "[{}:None] ", store_ptr->get_store_id());
-                m_non_participating_stores.push_back(store_ptr);
-                continue;
-            }
+logdev_key LogStoreFamily::do_device_truncate(uint32_t shard_idx, bool dry_run) {
+    static thread_local std::vector< logstore_id_t > s_min_trunc_store_ids;
+    static thread_local std::vector< std::shared_ptr< HomeLogStore > > s_min_trunc_stores;
 
-            fmt::format_to(std::back_inserter(dbg_str), "[{}:{}:{}:{}:{}] ", store_ptr->get_store_id(),
-                           trunc_info.seq_num, trunc_info.ld_key.idx, trunc_info.pending_dev_truncation,
-                           trunc_info.active_writes_not_part_of_truncation);
-            if (trunc_info.ld_key.idx > min_safe_ld_key.idx) { continue; }
-
-            if (trunc_info.ld_key.idx < min_safe_ld_key.idx) {
-                // New minimum safe l entry
-                min_safe_ld_key = trunc_info.ld_key;
-                m_min_trunc_stores.clear();
-            }
-            m_min_trunc_stores.push_back(store_ptr);
-        }
-    });
+    // Only the log stores which have any pending device truncation or active logstore io are in the heap, others are
+    // ignored for min safe boundary calculation.
+    auto& heap = truncation_heap(shard_idx);
+    s_min_trunc_store_ids.clear();
+    logdev_key min_safe_ld_key = heap.min(s_min_trunc_store_ids);
 
     if ((min_safe_ld_key == logdev_key::out_of_bound_ld_key()) || (min_safe_ld_key.idx < 0)) {
-        HS_PERIODIC_LOG(
-            INFO, logstore,
-            "[Family={}] No log store append on any log stores, skipping device truncation, all_logstore_info:<{}>",
-            m_family_id, dbg_str);
+        HS_PERIODIC_LOG(INFO, logstore,
+                        "[Family={}-{}] No log store append on any log stores, skipping device truncation, "
+                        "participating logstores={}",
+                        m_family_id, shard_idx, heap.size());
         return min_safe_ld_key;
     }
 
-    // Got the safest log id to truncate and actually truncate upto the safe log idx to the log device
-    if (!dry_run) { m_log_dev.truncate(min_safe_ld_key); }
     HS_PERIODIC_LOG(INFO, logstore,
-                    "[Family={}] LogDevice truncate, all_logstore_info:<{}> safe log dev key to truncate={}",
-                    m_family_id, dbg_str, min_safe_ld_key);
+                    "[Family={}-{}] LogDevice truncate, participating logstores={} logstores with min boundary={} "
+                    "safe log dev key to truncate={} dry_run={}",
+                    m_family_id, shard_idx, heap.size(), s_min_trunc_store_ids.size(), min_safe_ld_key, dry_run);
 
-    // We call post device truncation only to the log stores whose prepared truncation points are fully
-    // truncated or to stores which didn't particpate in this device truncation.
-    for (auto& store_ptr : m_min_trunc_stores) {
-        store_ptr->post_device_truncation(min_safe_ld_key);
-    }
-    for (auto& store_ptr : m_non_participating_stores) {
+    // Dry run only reports the safe log dev key, leaving the device, the heap and the log stores untouched
+    if (dry_run) { return min_safe_ld_key; }
+
+    // Got the safest log id to truncate and actually truncate upto the safe log idx to the log device
+    logdev(shard_idx).truncate(min_safe_ld_key);
+
+    // We call post device truncation only to the log stores whose prepared truncation points are fully truncated.
+    // Stores which didn't participate in this device truncation catch up with it, when they participate again.
+    heap.set_truncated_upto(min_safe_ld_key);
+    m_id_logstore_map.withRLock([](auto& id_logstore_map) {
+        for (auto const id : s_min_trunc_store_ids) {
+            auto const it = id_logstore_map.find(id);
+            if ((it != id_logstore_map.cend()) && it->second.m_log_store) {
+                s_min_trunc_stores.push_back(it->second.m_log_store);
+            }
+        }
+    });
+    for (auto& store_ptr : s_min_trunc_stores) {
         store_ptr->post_device_truncation(min_safe_ld_key);
     }
-    m_min_trunc_stores.clear(); // Not clearing here, would cause a shared_ptr ref holding.
-    m_non_participating_stores.clear();
+    s_min_trunc_stores.clear(); // Not clearing here, would cause a shared_ptr ref holding.
 
     return min_safe_ld_key;
 }
@@ -300,8 +339,18 @@ nlohmann::json LogStoreFamily::get_status(int verbosity) const {
     }
     js["logstores_unopened"] = std::move(unopened);
 
-    // Logdev status
-    m_log_dev.get_status(verbosity, js);
+    // Logdev status, of each shard separately if sharded
+    if (num_logdevs() == 1) {
+        m_logdevs[0]->get_status(verbosity, js);
+        js["truncation_heap"] = m_truncation_heaps[0]->get_status();
+    } else {
+        for (uint32_t shard_idx{0}; shard_idx < num_logdevs(); ++shard_idx) {
+            nlohmann::json shard_js;
+            m_logdevs[shard_idx]->get_status(verbosity, shard_js);
+            shard_js["truncation_heap"] = m_truncation_heaps[shard_idx]->get_status();
+            js["logdev_shard_" + std::to_string(shard_idx)] = std::move(shard_js);
+        }
+    }
 
     // All logstores
     m_id_logstore_map.withRLock([&](auto& id_logstore_map) {
@@ -33,6 +33,7 @@
 #include <homestore/logstore_service.hpp>
 #include <homestore/logstore/log_store_internal.hpp>
 #include "log_dev.hpp"
+#include "log_truncation_heap.hpp"
 
 namespace homestore {
 struct log_dump_req;
@@ -49,7 +50,7 @@ struct truncate_req {
     bool wait_till_done{false};
     bool dry_run{false};
     LogStoreService::device_truncate_cb_t cb;
-    std::array< logdev_key, LogStoreService::num_log_families > m_trunc_upto_result;
+    std::array< logdev_key, LogStoreService::num_log_families > m_trunc_upto_result; // Minimum across family shards
     int trunc_outstanding{0};
 };
 
@@ -68,7 +69,13 @@ public:
     LogStoreFamily& operator=(const LogStoreFamily&) = delete;
     LogStoreFamily& operator=(LogStoreFamily&&) noexcept = delete;
 
-    void start(const bool format, JournalVirtualDev* blk_store);
+    /**
+     * @brief Create the logdev of the given shard, if not created already. Every shard is on its own journal vdev and
+     * it is expected to be called for all the shards before the meta service is started.
+     */
+    void create_logdev(uint32_t shard_idx, uint32_t nshards);
+
+    void start(const bool format, const std::vector< JournalVirtualDev* >& vdevs);
     void stop();
 
     std::shared_ptr< HomeLogStore > create_new_log_store(bool append_mode = false);
@@ -83,31 +90,45 @@ public:
 
     nlohmann::json dump_log_store(const log_dump_req& dum_req);
 
-    LogDev& logdev() { return m_log_dev; }
+    // Log stores are spread across the logdev shards by store id, store id i is on shard (i % nshards) and it is
+    // known to the logdev of the shard by its shard store id (i / nshards)
+    uint32_t num_logdevs() const { return static_cast< uint32_t >(m_logdevs.size()); }
+    LogDev& logdev(uint32_t shard_idx = 0) { return *m_logdevs[shard_idx]; }
+    uint32_t shard_of(logstore_id_t store_id) const { return store_id % num_logdevs(); }
+    logstore_id_t shard_store_id(logstore_id_t store_id) const { return store_id / num_logdevs(); }
+    logstore_id_t family_store_id(uint32_t shard_idx, logstore_id_t shard_store_id) const {
+        return shard_store_id * num_logdevs() + shard_idx;
+    }
+
+    LogTruncationHeap& truncation_heap(uint32_t shard_idx) { return *m_truncation_heaps[shard_idx]; }
 
     nlohmann::json get_status(int verbosity) const;
     std::string get_name() const { return m_name; }
 
     logstore_family_id_t get_family_id() const { return m_family_id; }
 
-    logdev_key do_device_truncate(bool dry_run = false);
+    // Truncates the logdev of the given shard upto the min safe truncation point of all its log stores. NOTE: It
+    // expects the flush lock of the logdev shard to be held by the caller
+    logdev_key do_device_truncate(uint32_t shard_idx, bool dry_run = false);
 
 private:
-
+    void device_truncate_shard(uint32_t shard_idx, const std::shared_ptr< truncate_req >& treq);
     void on_log_store_found(logstore_id_t store_id, const logstore_superblk& meta);
-    void on_io_completion(logstore_id_t id, logdev_key ld_key, logdev_key flush_idx, uint32_t nremaining_in_batch,
-                          void* ctx);
-    void on_logfound(logstore_id_t id, logstore_seq_num_t seq_num, logdev_key ld_key, logdev_key flush_ld_key,
-                     log_buffer buf, uint32_t nremaining_in_batch);
-    void on_batch_completion(HomeLogStore* log_store, uint32_t nremaining_in_batch, logdev_key flush_ld_key);
+    void on_io_completion(uint32_t shard_idx, logstore_id_t id, logdev_key ld_key, logdev_key flush_idx,
+                          uint32_t nremaining_in_batch, void* ctx);
+    void on_logs_found(uint32_t shard_idx, const std::vector< log_found_record >& records, logdev_key flush_ld_key);
+    void on_batch_completion(uint32_t shard_idx, HomeLogStore* log_store, uint32_t nremaining_in_batch,
+                             logdev_key flush_ld_key);
 
 public:
     folly::Synchronized< std::unordered_map< logstore_id_t, logstore_info_t > > m_id_logstore_map;
     std::unordered_map< logstore_id_t, uint64_t > m_unopened_store_io;
     std::unordered_set< logstore_id_t > m_unopened_store_id;
-    std::unordered_map< logstore_id_t, logid_t > m_last_flush_info;
+    std::vector< std::unordered_map< logstore_id_t, logid_t > > m_last_flush_info; // Per logdev shard
     logstore_family_id_t m_family_id;
     std::string m_name;
-    LogDev m_log_dev;
+    std::vector< std::unique_ptr< LogDev > > m_logdevs; // Logdev shards
+    std::vector< std::unique_ptr< LogTruncationHeap > > m_truncation_heaps; // Per logdev shard
+    std::atomic< uint32_t > m_next_shard{0};            // Shard on which next log store is created
 };
 } // namespace homestore
@@ -14,6 +14,8 @@
  *
  *********************************************************************************/
 #include <iterator>
+#include <limits>
+#include <random>
 #include <string>
 
 #include <fmt/format.h>
@@ -23,9 +25,12 @@
 #include <homestore/meta_service.hpp>
 #include <homestore/logstore_service.hpp>
 #include <homestore/homestore.hpp>
+#include <homestore/checkpoint/cp_mgr.hpp>
 
 #include "common/homestore_assert.hpp"
+#include "common/homestore_config.hpp"
 #include "common/homestore_status_mgr.hpp"
+#include "checkpoint/cp.hpp"
 #include "device/device.h"
 #include "device/journal_vdev.hpp"
 #include "device/physical_dev.hpp"
@@ -37,6 +42,25 @@ SISL_LOGGING_DECL(logstore)
 
 LogStoreService& logstore_service() { return hs()->logstore_service(); }
 
+// Metadata updates batched by the logdevs, such as log stores created, are made durable on every CP flush
+class LogStoreCPCallbacks : public CPCallbacks {
+public:
+    LogStoreCPCallbacks(LogStoreService* svc) : m_svc{svc} {}
+    virtual ~LogStoreCPCallbacks() = default;
+
+    std::unique_ptr< CPContext > on_switchover_cp(CP* cur_cp, CP* new_cp) override {
+        return std::make_unique< CPContext >(new_cp->id());
+    }
+    void cp_flush(CP* cp, cp_flush_done_cb_t&& done_cb) override {
+        m_svc->persist_meta_async([cp, done_cb = std::move(done_cb)]() { done_cb(cp); });
+    }
+    void cp_cleanup(CP* cp) override {}
+    int cp_progress_percent() override { return 100; }
+
+private:
+    LogStoreService* m_svc;
+};
+
 /////////////////////////////////////// LogStoreService Section ///////////////////////////////////////
 LogStoreService::LogStoreService() :
         m_logstore_families{std::make_unique< LogStoreFamily >(DATA_LOG_FAMILY_IDX),
@@ -45,31 +69,65 @@ LogStoreService::LogStoreService() :
 void LogStoreService::create_vdev(uint64_t size, logstore_family_id_t family, vdev_io_comp_cb_t format_cb) {
     const auto atomic_page_size = hs()->device_mgr()->atomic_page_size({PhysicalDevGroup::FAST});
 
-    struct blkstore_blob blob;
-    if (family == DATA_LOG_FAMILY_IDX) {
-        blob.type = blkstore_type::DATA_LOGDEV_STORE;
-        m_data_logdev_vdev = std::make_unique< JournalVirtualDev >(
-            hs()->device_mgr(), "data_logdev", PhysicalDevGroup::FAST, size, 0 /* nmirror */, true /* is_stripe */,
-            atomic_page_size /* blk_size */, (char*)&blob, sizeof(blkstore_blob), true /* auto_recovery */);
-        m_data_logdev_vdev->async_format(std::move(format_cb));
-    } else {
-        blob.type = blkstore_type::CTRL_LOGDEV_STORE;
-        m_ctrl_logdev_vdev = std::make_unique< JournalVirtualDev >(
-            hs()->device_mgr(), "ctrl_logdev", PhysicalDevGroup::FAST, size, 0 /* nmirror */, true /* is_stripe */,
-            atomic_page_size /* blk_size */, (char*)&blob, sizeof(blkstore_blob), true /* auto_recovery */);
-        m_ctrl_logdev_vdev->async_format(std::move(format_cb));
+    // Journal is not zeroed entirely, log groups left by an earlier format are rejected by their format generation
+    // anywhere in the journal, be it at the start or after the end of the log. Start of the journal is zeroed only to
+    // avoid reading the previous contents on the first recovery.
+    const uint64_t journal_format_size = HS_DYNAMIC_CONFIG(logstore.bulk_read_size);
+    static std::random_device s_rd;
+    std::uniform_int_distribution< uint32_t > gen_dist{1, std::numeric_limits< uint32_t >::max()};
+
+    // Data family is sharded into multiple logdevs, each on its own journal vdev, so that appends of the log stores
+    // on different shards are grouped and written in parallel. Size of the family is split equally among them.
+    const uint32_t nshards =
+        (family == DATA_LOG_FAMILY_IDX) ? std::max(HS_DYNAMIC_CONFIG(logstore.num_data_logdev_shards), 1u) : 1u;
+
+    // Format is completed to the caller only after journal vdevs of all shards are formatted
+    struct format_context {
+        std::atomic< uint32_t > pending;
+        std::mutex mtx;
+        std::error_condition err;
+        vdev_io_comp_cb_t cb;
+    };
+    auto ctx = std::make_shared< format_context >();
+    ctx->pending.store(nshards);
+    ctx->cb = std::move(format_cb);
+
+    for (uint32_t shard_idx{0}; shard_idx < nshards; ++shard_idx) {
+        logdev_blkstore_blob blob;
+        blob.type =
+            (family == DATA_LOG_FAMILY_IDX) ? blkstore_type::DATA_LOGDEV_STORE : blkstore_type::CTRL_LOGDEV_STORE;
+        blob.shard_idx = s_cast< uint16_t >(shard_idx);
+        blob.nshards = s_cast< uint16_t >(nshards);
+        blob.format_gen = gen_dist(s_rd);
+
+        auto* vdev = add_logdev_vdev(
+            family, shard_idx, nshards,
+            std::make_unique< JournalVirtualDev >(hs()->device_mgr(), logdev_vdev_name(family, shard_idx),
+                                                  PhysicalDevGroup::FAST, size / nshards, 0 /* nmirror */,
+                                                  true /* is_stripe */, atomic_page_size /* blk_size */, (char*)&blob,
+                                                  sizeof(logdev_blkstore_blob), true /* auto_recovery */));
+        vdev->async_format(
+            [ctx](std::error_condition err, void* cookie) {
+                if (err) {
+                    std::unique_lock< std::mutex > lk{ctx->mtx};
+                    ctx->err = err;
+                }
+                if (ctx->pending.fetch_sub(1, std::memory_order_acq_rel) == 1) { ctx->cb(ctx->err, cookie); }
+            },
+            journal_format_size);
     }
 }
 
 bool LogStoreService::open_vdev(vdev_info_block* vb, logstore_family_id_t family) {
     bool ret{true};
-    if (family == DATA_LOG_FAMILY_IDX) {
-        m_data_logdev_vdev = std::make_unique< JournalVirtualDev >(hs()->device_mgr(), "data_logdev", vb,
-                                                                   PhysicalDevGroup::FAST, vb->is_failed(), false);
-    } else {
-        m_ctrl_logdev_vdev = std::make_unique< JournalVirtualDev >(hs()->device_mgr(), "ctrl_logdev", vb,
-                                                                   PhysicalDevGroup::FAST, vb->is_failed(), false);
-    }
+    const auto* blob = r_cast< const logdev_blkstore_blob* >(vb->context_data);
+    const uint32_t nshards = std::max(uint32_t{blob->nshards}, 1u);
+    const uint32_t shard_idx = blob->shard_idx;
+    HS_REL_ASSERT_LT(shard_idx, nshards, "Invalid logdev shard of journal vdev {}", vb->get_vdev_id());
+
+    add_logdev_vdev(family, shard_idx, nshards,
+                    std::make_unique< JournalVirtualDev >(hs()->device_mgr(), logdev_vdev_name(family, shard_idx), vb,
+                                                          PhysicalDevGroup::FAST, vb->is_failed(), false));
 
     if (vb->is_failed()) {
         LOGERROR("{} vdev is in failed state", vb->get_vdev_id());
@@ -78,6 +136,25 @@ bool LogStoreService::open_vdev(vdev_info_block* vb, logstore_family_id_t family
     return ret;
 }
 
+JournalVirtualDev* LogStoreService::add_logdev_vdev(logstore_family_id_t family, uint32_t shard_idx, uint32_t nshards,
+                                                    std::unique_ptr< JournalVirtualDev > vdev) {
+    auto& vdevs = m_logdev_vdevs[family];
+    if (vdevs.empty()) { vdevs.resize(nshards); }
+    HS_REL_ASSERT_EQ(vdevs.size(), nshards, "Journal vdevs of family {} mismatch on number of logdev shards", family);
+    HS_REL_ASSERT(!vdevs[shard_idx], "Duplicate journal vdev for logdev shard {}-{}", family, shard_idx);
+
+    // Logdev of the shard is created now, so that its meta blks are found when meta service is started
+    m_logstore_families[family]->create_logdev(shard_idx, nshards);
+    vdevs[shard_idx] = std::move(vdev);
+    return vdevs[shard_idx].get();
+}
+
+std::string LogStoreService::logdev_vdev_name(logstore_family_id_t family, uint32_t shard_idx) {
+    std::string name{(family == DATA_LOG_FAMILY_IDX) ? "data_logdev" : "ctrl_logdev"};
+    if (shard_idx != 0) { name += "_shard" + std::to_string(shard_idx); }
+    return name;
+}
+
 void LogStoreService::start(const bool format) {
     // hs()->status_mgr()->register_status_cb("LogStore", bind_this(LogStoreService::get_status, 1));
 
@@ -85,11 +162,18 @@ void LogStoreService::start(const bool format) {
     start_threads();
 
     // Start the logstore families
-    m_logstore_families[DATA_LOG_FAMILY_IDX]->start(format, m_data_logdev_vdev.get());
-    m_logstore_families[CTRL_LOG_FAMILY_IDX]->start(format, m_ctrl_logdev_vdev.get());
+    for (size_t f{0}; f < num_log_families; ++f) {
+        std::vector< JournalVirtualDev* > vdevs;
+        for (auto& vdev : m_logdev_vdevs[f]) {
+            vdevs.push_back(vdev.get());
+        }
+        m_logstore_families[f]->start(format, vdevs);
+    }
+    hs()->cp_mgr().register_consumer(cp_consumer_t::LOG_SVC, std::make_unique< LogStoreCPCallbacks >(this));
 }
 
 void LogStoreService::stop() {
+    hs()->cp_mgr().register_consumer(cp_consumer_t::LOG_SVC, nullptr);
     device_truncate(nullptr, true, false);
     for (auto& f : m_logstore_families) {
         f->stop();
@@ -116,12 +200,33 @@ void LogStoreService::remove_log_store(const logstore_family_id_t family_id, con
     COUNTER_DECREMENT(m_metrics, logstores_count, 1);
 }
 
+void LogStoreService::persist_meta_async(const std::function< void() >& cb) {
+    std::vector< LogDev* > logdevs;
+    for (auto& f : m_logstore_families) {
+        for (uint32_t shard_idx{0}; shard_idx < f->num_logdevs(); ++shard_idx) {
+            logdevs.push_back(&f->logdev(shard_idx));
+        }
+    }
+
+    auto noutstanding = std::make_shared< std::atomic< size_t > >(logdevs.size());
+    for (auto* ld : logdevs) {
+        ld->persist_meta_async([noutstanding, cb]() {
+            if ((noutstanding->fetch_sub(1, std::memory_order_acq_rel) == 1) && cb) { cb(); }
+        });
+    }
+}
+
 void LogStoreService::device_truncate(const device_truncate_cb_t& cb, const bool wait_till_done, const bool dry_run) {
     const auto treq = std::make_shared< truncate_req >();
     treq->wait_till_done = wait_till_done;
     treq->dry_run = dry_run;
     treq->cb = cb;
-    if (treq->wait_till_done) { treq->trunc_outstanding = m_logstore_families.size(); }
+    treq->m_trunc_upto_result.fill(logdev_key::out_of_bound_ld_key());
+    if (treq->wait_till_done || treq->cb) {
+        for (auto& l : m_logstore_families) {
+            treq->trunc_outstanding += l->num_logdevs();
+        }
+    }
 
     for (auto& l : m_logstore_families) {
         l->device_truncate_in_user_reactor(treq);
@@ -135,7 +240,9 @@ void LogStoreService::device_truncate(const device_truncate_cb_t& cb, const bool
 
 void LogStoreService::flush_if_needed() {
     for (auto& f : m_logstore_families) {
-        f->logdev().flush_if_needed();
+        for (uint32_t shard_idx{0}; shard_idx < f->num_logdevs(); ++shard_idx) {
+            f->logdev(shard_idx).flush_if_needed();
+        }
     }
 }
 
@@ -143,7 +250,7 @@ LogDev& LogStoreService::data_logdev() { return data_log_family()->logdev(); }
 LogDev& LogStoreService::ctrl_logdev() { return ctrl_log_family()->logdev(); }
 
 void LogStoreService::send_flush_msg() {
-    iomanager.run_on(m_flush_thread, [this]([[maybe_unused]] const io_thread_addr_t addr) { flush_if_needed(); });
+    iomanager.run_on(flush_thread(), [this]([[maybe_unused]] const io_thread_addr_t addr) { flush_if_needed(); });
 }
 
 void LogStoreService::start_threads() {
@@ -154,17 +261,41 @@ void LogStoreService::start_threads() {
     };
     auto ctx = std::make_shared< Context >();
 
-    m_flush_thread = nullptr;
-    iomanager.create_reactor("log_flush_thread", TIGHT_LOOP | ADAPTIVE_LOOP, [this, &ctx](bool is_started) {
-        if (is_started) {
-            m_flush_thread = iomanager.iothread_self();
-            {
-                std::unique_lock< std::mutex > lk{ctx->mtx};
-                ++(ctx->thread_cnt);
+    // One flush thread for every logdev shard index
+    size_t nflush_threads{1};
+    for (auto& vdevs : m_logdev_vdevs) {
+        nflush_threads = std::max(nflush_threads, vdevs.size());
+    }
+    m_flush_threads.assign(nflush_threads, nullptr);
+    for (size_t i{0}; i < nflush_threads; ++i) {
+        const std::string name{(i == 0) ? std::string{"log_flush_thread"} : ("log_flush_thread_" + std::to_string(i))};
+        iomanager.create_reactor(name, TIGHT_LOOP | ADAPTIVE_LOOP, [this, &ctx, i](bool is_started) {
+            if (is_started) {
+                m_flush_threads[i] = iomanager.iothread_self();
+                {
+                    std::unique_lock< std::mutex > lk{ctx->mtx};
+                    ++(ctx->thread_cnt);
+                }
+                ctx->cv.notify_one();
             }
-            ctx->cv.notify_one();
-        }
-    });
+        });
+    }
+
+    // One meta thread for every logdev shard index, which does the sync IO of persisting the logdev metadata
+    m_meta_threads.assign(nflush_threads, nullptr);
+    for (size_t i{0}; i < nflush_threads; ++i) {
+        const std::string name{(i == 0) ? std::string{"logstore_meta"} : ("logstore_meta_" + std::to_string(i))};
+        iomanager.create_reactor(name, INTERRUPT_LOOP, [this, &ctx, i](bool is_started) {
+            if (is_started) {
+                m_meta_threads[i] = iomanager.iothread_self();
+                {
+                    std::unique_lock< std::mutex > lk{ctx->mtx};
+                    ++(ctx->thread_cnt);
+                }
+                ctx->cv.notify_one();
+            }
+        });
+    }
 
     m_truncate_thread = nullptr;
     iomanager.create_reactor("logstore_truncater", INTERRUPT_LOOP, [this, &ctx](bool is_started) {
@@ -179,7 +310,7 @@ void LogStoreService::start_threads() {
     });
     {
         std::unique_lock< std::mutex > lk{ctx->mtx};
-        ctx->cv.wait(lk, [&ctx] { return (ctx->thread_cnt == 2); });
+        ctx->cv.wait(lk, [&ctx, nflush_threads] { return (ctx->thread_cnt == (2 * nflush_threads) + 1); });
     }
 }
 
@@ -208,15 +339,21 @@ nlohmann::json LogStoreService::get_status(const int verbosity) const {
 
 uint32_t LogStoreService::used_size() const {
     uint32_t sz{0};
-    if (m_data_logdev_vdev) { sz += m_data_logdev_vdev->used_size(); }
-    if (m_ctrl_logdev_vdev) { sz += m_ctrl_logdev_vdev->used_size(); }
+    for (auto& vdevs : m_logdev_vdevs) {
+        for (auto& vdev : vdevs) {
+            if (vdev) { sz += vdev->used_size(); }
+        }
+    }
     return sz;
 }
 
 uint32_t LogStoreService::total_size() const {
     uint32_t sz{0};
-    if (m_data_logdev_vdev) { sz += m_data_logdev_vdev->size(); }
-    if (m_ctrl_logdev_vdev) { sz += m_ctrl_logdev_vdev->size(); }
+    for (auto& vdevs : m_logdev_vdevs) {
+        for (auto& vdev : vdevs) {
+            if (vdev) { sz += vdev->size(); }
+        }
+    }
     return sz;
 }
 
@@ -226,18 +363,56 @@ LogStoreServiceMetrics::LogStoreServiceMetrics() : sisl::MetricsGroup("LogStores
                      {"op", "write"});
     REGISTER_COUNTER(logstore_read_count, "Total number of read requests to log stores", "logstore_op_count",
                      {"op", "read"});
+    REGISTER_COUNTER(logstore_tail_cache_hit_count, "Number of log store reads served from tail cache",
+                     "logstore_tail_cache_count", {"op", "hit"});
+    REGISTER_COUNTER(logstore_tail_cache_miss_count, "Number of log store reads not found in tail cache",
+                     "logstore_tail_cache_count", {"op", "miss"});
+    REGISTER_COUNTER(logstore_tail_cache_evict_count, "Number of records evicted from tail cache by its size limit");
+    REGISTER_COUNTER(logstore_reserved_append_count, "Number of appends from buffers reserved by log stores");
+    REGISTER_HISTOGRAM(logstore_append_batch_size, "Number of records appended in a batch append",
+                       HistogramBucketsType(ExponentialOfTwoBuckets));
     REGISTER_HISTOGRAM(logstore_append_latency, "Logstore append latency", "logstore_op_latency", {"op", "write"});
     REGISTER_HISTOGRAM(logstore_read_latency, "Logstore read latency", "logstore_op_latency", {"op", "read"});
     REGISTER_HISTOGRAM(logdev_flush_size_distribution, "Distribution of flush data size",
                        HistogramBucketsType(ExponentialOfTwoBuckets));
     REGISTER_HISTOGRAM(logdev_flush_records_distribution, "Distribution of num records to flush",
-                       HistogramBucketsType(LinearUpto128Buckets));
+                       HistogramBucketsType(ExponentialOfTwoBuckets));
     REGISTER_HISTOGRAM(logstore_record_size, "Distribution of log record size",
                        HistogramBucketsType(ExponentialOfTwoBuckets));
     REGISTER_HISTOGRAM(logdev_flush_done_msg_time_ns, "Logdev flush completion msg time in ns");
     REGISTER_HISTOGRAM(logdev_post_flush_processing_latency,
                        "Logdev post flush processing (including callbacks) latency");
     REGISTER_HISTOGRAM(logdev_fsync_time_us, "Logdev fsync completion time in us");
+    REGISTER_HISTOGRAM(logdev_flush_inflight_groups, "Number of log groups in flight when a log group is written",
+                       HistogramBucketsType(LinearUpto128Buckets));
+    REGISTER_HISTOGRAM(logdev_recovery_load_time_ms, "Time taken by a logdev to load its log groups upon recovery");
+    REGISTER_COUNTER(logdev_recovery_load_bytes, "Bytes of log groups loaded by logdevs upon recovery");
+    REGISTER_COUNTER(logdev_recovery_read_ahead_bulks, "Number of bulks read ahead by logdevs upon recovery");
+    REGISTER_COUNTER(logdev_recovery_read_ahead_waits,
+                     "Number of times logdev recovery waited for the bulk being read ahead");
+    REGISTER_HISTOGRAM(logdev_async_read_latency, "Latency of async read of a batch of logs in us");
+    REGISTER_HISTOGRAM(logdev_async_read_records_per_group, "Avg number of logs read from a log group by async read",
+                       HistogramBucketsType(ExponentialOfTwoBuckets));
+    REGISTER_COUNTER(logdev_async_read_errors, "Number of log groups failed to be read or validated by async read");
+    REGISTER_COUNTER(logdev_flush_deferred_by_inflight, "Number of times flush deferred as max log groups in flight");
+    REGISTER_COUNTER(logdev_flush_by_size_count, "Number of log groups flushed as pending size reached the limit",
+                     "logdev_flush_decision_count", {"reason", "size"});
+    REGISTER_COUNTER(logdev_flush_by_time_count, "Number of log groups flushed as max time between flushes elapsed",
+                     "logdev_flush_decision_count", {"reason", "time"});
+    REGISTER_COUNTER(logdev_flush_by_latency_count, "Number of log groups flushed as latency budget ran out",
+                     "logdev_flush_decision_count", {"reason", "latency"});
+    REGISTER_COUNTER(logdev_flush_by_idle_count, "Number of log groups flushed as no more records are expected",
+                     "logdev_flush_decision_count", {"reason", "idle"});
+    REGISTER_HISTOGRAM(logdev_flush_batch_wait_us, "Time the oldest record of a log group waited for its flush in us");
+    REGISTER_HISTOGRAM(logdev_flush_latency_budget_us, "Time records could wait to be batched by adaptive flush in us");
+    REGISTER_HISTOGRAM(logdev_flush_write_latency_us, "Latency of writing a log group to the device in us");
+    REGISTER_COUNTER(logdev_compress_success_count, "Number of log groups written compressed");
+    REGISTER_COUNTER(logdev_compress_backoff_count, "Number of log groups written uncompressed as of poor ratio");
+    REGISTER_HISTOGRAM(logdev_compress_ratio_percent, "Percent ratio of compressed to uncompressed log group data",
+                       HistogramBucketsType(LinearUpto128Buckets));
+    REGISTER_COUNTER(logdev_meta_persist_count, "Number of times batched logdev metadata updates are persisted");
+    REGISTER_HISTOGRAM(logdev_meta_updates_per_persist, "Number of logdev metadata updates coalesced in a persist",
+                       HistogramBucketsType(ExponentialOfTwoBuckets));
 
     register_me_to_farm();
 }
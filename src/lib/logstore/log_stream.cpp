@@ -13,7 +13,12 @@
  * specific language governing permissions and limitations under the License.
  *
  *********************************************************************************/
+#include <cstring>
+
 #include <isa-l/crc.h>
+#include <iomgr/iomgr.hpp>
+
+#include <homestore/logstore_service.hpp>
 
 #include "common/homestore_assert.hpp"
 #include "common/homestore_config.hpp"
@@ -24,9 +29,69 @@
 namespace homestore {
 SISL_LOGGING_DECL(logstore)
 
-log_stream_reader::log_stream_reader(off_t device_cursor, JournalVirtualDev* store, uint64_t read_size_multiple) :
-        m_vdev{store}, m_first_group_cursor{device_cursor}, m_read_size_multiple{read_size_multiple} {
+log_stream_reader::log_stream_reader(off_t device_cursor, JournalVirtualDev* store, uint64_t read_size_multiple,
+                                     uint32_t format_gen, iomgr::io_thread_t read_ahead_thread) :
+        m_vdev{store},
+        m_first_group_cursor{device_cursor},
+        m_read_size_multiple{read_size_multiple},
+        m_format_gen{format_gen},
+        m_read_ahead_depth{read_ahead_thread ? HS_DYNAMIC_CONFIG(logstore.recovery_read_ahead_depth) : 0},
+        m_bulk_read_size{uint64_cast(sisl::round_up(HS_DYNAMIC_CONFIG(logstore.bulk_read_size), read_size_multiple))},
+        m_read_ahead_thread{std::move(read_ahead_thread)} {
     m_vdev->lseek(m_first_group_cursor);
+    if (m_read_ahead_depth) {
+        m_read_ahead_scheduled = true;
+        schedule_read_ahead();
+    }
+}
+
+log_stream_reader::~log_stream_reader() { stop_read_ahead(); }
+
+void log_stream_reader::stop_read_ahead() {
+    std::unique_lock< std::mutex > lk{m_read_ahead_mtx};
+    m_read_ahead_stopped = true;
+    m_read_ahead_cv.wait(lk, [this] { return !m_read_ahead_scheduled; });
+}
+
+// Claims the read of the next bulk, if there is room for it and it is not claimed already. The claimer is expected to
+// schedule the read, outside the lock. NOTE: Expects the read ahead lock to be held by the caller
+bool log_stream_reader::claim_read_ahead() {
+    if (m_read_ahead_scheduled || m_read_ahead_stopped || m_read_ahead_eof ||
+        (m_read_ahead_bufs.size() >= m_read_ahead_depth)) {
+        return false;
+    }
+    m_read_ahead_scheduled = true;
+    return true;
+}
+
+void log_stream_reader::schedule_read_ahead() {
+    iomanager.run_on(m_read_ahead_thread,
+                     [this]([[maybe_unused]] iomgr::io_thread_addr_t addr) { read_ahead_next_bulk(); });
+}
+
+void log_stream_reader::read_ahead_next_bulk() {
+    auto buf = hs_utils::create_byte_view(m_bulk_read_size, true, sisl::buftag::logread, m_vdev->align_size());
+    const auto prev_pos = m_vdev->seeked_pos();
+    const auto actual_read = m_vdev->sync_next_read(buf.bytes(), m_bulk_read_size);
+    LOGDEBUGMOD(logstore, "LogStream read ahead {} bytes from vdev offset {} and vdev cur offset {}", actual_read,
+                prev_pos, m_vdev->seeked_pos());
+    COUNTER_INCREMENT(logstore_service().metrics(), logdev_recovery_read_ahead_bulks, 1);
+    bool schedule_next{false};
+    {
+        std::unique_lock< std::mutex > lk{m_read_ahead_mtx};
+        if (actual_read <= 0) {
+            m_read_ahead_eof = true;
+        } else {
+            buf.set_size(actual_read);
+            m_read_ahead_bufs.push_back(std::move(buf));
+        }
+        m_read_ahead_scheduled = false;
+        schedule_next = claim_read_ahead();
+    }
+    m_read_ahead_cv.notify_all();
+
+    // Next bulk is read as a separate run on the reactor, so that the reactor is yielded in between the bulks
+    if (schedule_next) { schedule_read_ahead(); }
 }
 
 sisl::byte_view log_stream_reader::next_group(off_t* out_dev_offset) {
@@ -56,6 +121,22 @@ read_again:
         return ret_buf;
     }
 
+    // Validate the header layout before trusting its size, since the group (including its record slots) can span
+    // multiple pages and a stale or torn header could point us to read far beyond
+    if (!header->is_layout_valid()) {
+        LOGINFOMOD(logstore,
+                   "Logdev data at pos {} has header with invalid layout version={} nrecords={} group_size={}, must "
+                   "have come to end of logdev",
+                   m_vdev->dev_offset(m_cur_read_bytes), header->get_version(), header->nrecords(),
+                   header->total_size());
+        *out_dev_offset = m_vdev->dev_offset(m_cur_read_bytes);
+
+        // move it by dma boundary if header is not valid
+        m_prev_crc = 0;
+        m_cur_read_bytes += m_read_size_multiple;
+        return ret_buf;
+    }
+
     if (header->total_size() > m_cur_log_buf.size()) {
         LOGINFOMOD(logstore, "Logstream group size {} is more than available buffer size {}, reading from store",
                    header->total_size(), m_cur_log_buf.size());
@@ -95,7 +176,21 @@ read_again:
         m_cur_read_bytes += m_read_size_multiple;
         return ret_buf;
     }
-    HS_DBG_ASSERT_EQ(footer->version, log_group_footer::footer_version, "Log footer version mismatch");
+    HS_DBG_ASSERT_LE(footer->version, log_group_footer::footer_version, "Log footer version mismatch");
+
+    // Journal is not zeroed entirely on format, so a group left by an earlier format of the journal can look valid
+    // (including its footer and crc), if the first group is read from there or just after the end of the log.
+    if ((m_format_gen != 0) && ((footer->version < 1) || (footer->format_gen != m_format_gen))) {
+        LOGINFOMOD(logstore, "Log group at pos {} is of format generation {} instead of {}, must have come to end",
+                   m_vdev->dev_offset(m_cur_read_bytes), (footer->version < 1) ? 0 : footer->format_gen,
+                   m_format_gen);
+        *out_dev_offset = m_vdev->dev_offset(m_cur_read_bytes);
+
+        // move it by dma boundary if header is not valid
+        m_prev_crc = 0;
+        m_cur_read_bytes += m_read_size_multiple;
+        return ret_buf;
+    }
 
     // verify crc with data
     const crc32_t cur_crc =
@@ -131,6 +226,8 @@ sisl::byte_view log_stream_reader::group_in_next_page() {
 }
 
 sisl::byte_view log_stream_reader::read_next_bytes(uint64_t nbytes) {
+    if (m_read_ahead_depth) { return read_ahead_bytes(nbytes); }
+
     // TO DO: Might need to address alignment based on data or fast type
     auto out_buf =
         hs_utils::create_byte_view(nbytes + m_cur_log_buf.size(), true, sisl::buftag::logread, m_vdev->align_size());
@@ -148,4 +245,44 @@ sisl::byte_view log_stream_reader::read_next_bytes(uint64_t nbytes) {
     ret_buf.set_size(actual_read + m_cur_log_buf.size());
     return ret_buf;
 }
+
+// Same as read_next_bytes, but takes the bulks already read ahead (waiting for them if needed) instead of reading
+sisl::byte_view log_stream_reader::read_ahead_bytes(uint64_t nbytes) {
+    std::vector< sisl::byte_view > bulks;
+    uint64_t new_bytes{0};
+    while (new_bytes < nbytes) {
+        bool schedule{false};
+        {
+            std::unique_lock< std::mutex > lk{m_read_ahead_mtx};
+            if (m_read_ahead_bufs.empty() && !m_read_ahead_eof) {
+                COUNTER_INCREMENT(logstore_service().metrics(), logdev_recovery_read_ahead_waits, 1);
+                m_read_ahead_cv.wait(lk, [this] { return !m_read_ahead_bufs.empty() || m_read_ahead_eof; });
+            }
+            if (m_read_ahead_bufs.empty()) { break; }
+            new_bytes += m_read_ahead_bufs.front().size();
+            bulks.push_back(std::move(m_read_ahead_bufs.front()));
+            m_read_ahead_bufs.pop_front();
+            schedule = claim_read_ahead(); // Fill the bulk taken
+        }
+        if (schedule) { schedule_read_ahead(); }
+    }
+    HS_REL_ASSERT_NE(new_bytes, 0, "zero bytes are read");
+
+    // Nothing left from the previous buffer, which is the common case, the bulk can be used as is without a copy
+    if ((m_cur_log_buf.size() == 0) && (bulks.size() == 1)) { return bulks[0]; }
+
+    auto out_buf = hs_utils::create_byte_view(new_bytes + m_cur_log_buf.size(), true, sisl::buftag::logread,
+                                              m_vdev->align_size());
+    uint64_t pos{0};
+    if (m_cur_log_buf.size()) {
+        std::memcpy(out_buf.bytes(), m_cur_log_buf.bytes(), m_cur_log_buf.size());
+        pos += m_cur_log_buf.size();
+    }
+    for (const auto& b : bulks) {
+        std::memcpy(out_buf.bytes() + pos, b.bytes(), b.size());
+        pos += b.size();
+    }
+    out_buf.set_size(pos);
+    return out_buf;
+}
 } // namespace homestore
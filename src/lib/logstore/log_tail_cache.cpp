@@ -0,0 +1,168 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#include <string>
+
+#include <fmt/format.h>
+#include <homestore/logstore_service.hpp>
+
+#include "common/homestore_config.hpp"
+#include "log_tail_cache.hpp"
+
+namespace homestore {
+
+void LogTailCache::put(logstore_id_t store_id, logstore_seq_num_t seq_num, const log_buffer& buf,
+                       const sisl::byte_array& group_buf) {
+    const uint64_t cap = capacity();
+    if ((cap == 0) || (group_buf->size > cap)) { return; }
+
+    std::unique_lock< std::mutex > lg{m_mtx};
+    auto& records = m_store_records[store_id];
+    const cached_record r{buf, group_buf.get()};
+    if (auto it = records.find(seq_num); it != records.end()) {
+        // Same lsn appended again after a rollback, it is already in the evict order
+        release(it->second);
+        it->second = r;
+    } else {
+        records.emplace(seq_num, r);
+        m_evict_order.emplace_back(store_id, seq_num);
+        ++m_nrecords;
+    }
+
+    auto& info = m_group_bufs[r.group_buf];
+    if (info.nrecords++ == 0) {
+        info.size = group_buf->size;
+        m_size += info.size;
+    }
+    evict(cap);
+}
+
+std::optional< log_buffer > LogTailCache::get(logstore_id_t store_id, logstore_seq_num_t seq_num) const {
+    std::unique_lock< std::mutex > lg{m_mtx};
+    auto const sit = m_store_records.find(store_id);
+    if (sit == m_store_records.cend()) { return std::nullopt; }
+
+    auto const it = sit->second.find(seq_num);
+    if (it == sit->second.cend()) { return std::nullopt; }
+    return it->second.buf;
+}
+
+void LogTailCache::truncate(logstore_id_t store_id, logstore_seq_num_t upto_seq_num) {
+    std::unique_lock< std::mutex > lg{m_mtx};
+    auto sit = m_store_records.find(store_id);
+    if (sit == m_store_records.end()) { return; }
+
+    auto& records = sit->second;
+    auto const end_it = records.upper_bound(upto_seq_num);
+    for (auto it = records.begin(); it != end_it; ++it) {
+        release(it->second);
+        --m_nrecords;
+    }
+    records.erase(records.begin(), end_it);
+    compact_evict_order();
+}
+
+void LogTailCache::rollback(logstore_id_t store_id, logstore_seq_num_t to_seq_num) {
+    std::unique_lock< std::mutex > lg{m_mtx};
+    auto sit = m_store_records.find(store_id);
+    if (sit == m_store_records.end()) { return; }
+
+    auto& records = sit->second;
+    auto const start_it = records.upper_bound(to_seq_num);
+    for (auto it = start_it; it != records.end(); ++it) {
+        release(it->second);
+        --m_nrecords;
+    }
+    records.erase(start_it, records.end());
+}
+
+void LogTailCache::remove_store(logstore_id_t store_id) {
+    std::unique_lock< std::mutex > lg{m_mtx};
+    auto sit = m_store_records.find(store_id);
+    if (sit == m_store_records.end()) { return; }
+
+    for (const auto& [seq_num, r] : sit->second) {
+        release(r);
+        --m_nrecords;
+    }
+    m_store_records.erase(sit);
+    compact_evict_order();
+}
+
+void LogTailCache::clear() {
+    std::unique_lock< std::mutex > lg{m_mtx};
+    m_store_records.clear();
+    m_group_bufs.clear();
+    m_evict_order.clear();
+    m_size = 0;
+    m_nrecords = 0;
+}
+
+void LogTailCache::evict(uint64_t capacity) {
+    while ((m_size > capacity) && !m_evict_order.empty()) {
+        auto const [store_id, seq_num] = m_evict_order.front();
+        m_evict_order.pop_front();
+
+        auto sit = m_store_records.find(store_id);
+        if (sit == m_store_records.end()) { continue; }
+        auto it = sit->second.find(seq_num);
+        if (it == sit->second.end()) { continue; } // Already evicted by truncation or rollback
+
+        release(it->second);
+        --m_nrecords;
+        sit->second.erase(it);
+        COUNTER_INCREMENT(logstore_service().metrics(), logstore_tail_cache_evict_count, 1);
+    }
+}
+
+// Uncharge the group buffer of the record once its last cached record is gone
+void LogTailCache::release(const cached_record& r) {
+    auto const it = m_group_bufs.find(r.group_buf);
+    if (--it->second.nrecords != 0) { return; }
+    m_size -= it->second.size;
+    m_group_bufs.erase(it);
+}
+
+// Drop the entries of the records which are no longer cached from the evict order, once they outnumber the cached ones
+void LogTailCache::compact_evict_order() {
+    if (m_evict_order.size() <= (2 * m_nrecords + 1024)) { return; }
+
+    std::deque< std::pair< logstore_id_t, logstore_seq_num_t > > order;
+    for (const auto& [store_id, seq_num] : m_evict_order) {
+        auto const sit = m_store_records.find(store_id);
+        if ((sit != m_store_records.cend()) && (sit->second.count(seq_num) != 0)) {
+            order.emplace_back(store_id, seq_num);
+        }
+    }
+    m_evict_order = std::move(order);
+}
+
+nlohmann::json LogTailCache::get_status(int verbosity) const {
+    nlohmann::json js;
+    std::unique_lock< std::mutex > lg{m_mtx};
+    js["size"] = m_size;
+    js["nrecords"] = m_nrecords;
+    js["ngroup_bufs"] = m_group_bufs.size();
+    js["capacity"] = capacity();
+    if (verbosity == 2) {
+        for (const auto& [store_id, records] : m_store_records) {
+            if (records.empty()) { continue; }
+            js["logstore_id_" + std::to_string(store_id)] =
+                fmt::format("lsn=[{}-{}]", records.cbegin()->first, records.crbegin()->first);
+        }
+    }
+    return js;
+}
+} // namespace homestore
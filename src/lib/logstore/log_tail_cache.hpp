@@ -0,0 +1,108 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+
+#include <nlohmann/json.hpp>
+#include <sisl/fds/buffer.hpp>
+
+#include <homestore/logstore/log_store_internal.hpp>
+#include "common/homestore_config.hpp"
+
+namespace homestore {
+
+/*
+ * LogTailCache: Bounded set of the recently appended log records of the log stores of a logdev, so that reads of the
+ * tail of a log store (which followers and state machine appliers do constantly) are served without a device read.
+ * Every logdev has its own cache, so the lock is shared only by the log stores of the logdev.
+ *
+ * Records are put by the logdev upon completion of their log group, as views into the buffer of the log group they are
+ * serialized in, so nothing is copied; the log group takes a new buffer for its next use while its old one is retained
+ * by the cache. Records written out of band (not inlined into the group buffer) are not cached. Cache is charged with
+ * the whole buffer of a log group once, when its first record is put, since that is the memory retained until its last
+ * record is evicted. Records are evicted in the order they were put, once the retained buffers exceed
+ * logstore.tail_cache_size_mb, and the buffer of a log group is freed once all of its records are evicted.
+ * Truncation, rollback and removal of a log store evicts its records right away, so that the cache never serves a
+ * record the log store no longer has. Cached buffers are shared with the readers, which are not expected to modify
+ * them.
+ */
+class LogTailCache {
+public:
+    LogTailCache() = default;
+    LogTailCache(const LogTailCache&) = delete;
+    LogTailCache& operator=(const LogTailCache&) = delete;
+    LogTailCache(LogTailCache&&) noexcept = delete;
+    LogTailCache& operator=(LogTailCache&&) noexcept = delete;
+
+    static uint64_t capacity() { return uint64_t{HS_DYNAMIC_CONFIG(logstore.tail_cache_size_mb)} * 1024 * 1024; }
+
+    /// @brief Put the record appended to the log store in the cache, which retains its buffer
+    /// @param group_buf : Buffer of the log group which buf is a view into
+    void put(logstore_id_t store_id, logstore_seq_num_t seq_num, const log_buffer& buf,
+             const sisl::byte_array& group_buf);
+
+    /// @brief Get the record of the log store from the cache, if present
+    std::optional< log_buffer > get(logstore_id_t store_id, logstore_seq_num_t seq_num) const;
+
+    /// @brief Evict all the records of the log store upto (and including) the seq_num
+    void truncate(logstore_id_t store_id, logstore_seq_num_t upto_seq_num);
+
+    /// @brief Evict all the records of the log store beyond the seq_num
+    void rollback(logstore_id_t store_id, logstore_seq_num_t to_seq_num);
+
+    /// @brief Evict all the records of the log store
+    void remove_store(logstore_id_t store_id);
+
+    /// @brief Evict all the records
+    void clear();
+
+    nlohmann::json get_status(int verbosity) const;
+
+private:
+    struct cached_record {
+        log_buffer buf;
+        const void* group_buf; // Buffer of the log group retained by buf
+    };
+
+    // Group buffer retained by the cached records, charged to the cache once
+    struct group_buf_info {
+        uint64_t size{0};
+        uint32_t nrecords{0};
+    };
+
+    void evict(uint64_t capacity);
+    void compact_evict_order();
+    void release(const cached_record& r);
+
+private:
+    mutable std::mutex m_mtx;
+    std::unordered_map< logstore_id_t, std::map< logstore_seq_num_t, cached_record > > m_store_records;
+    std::unordered_map< const void*, group_buf_info > m_group_bufs;
+
+    // Records in the order they were put, which is the order they are evicted. Records evicted by truncation, rollback
+    // or removal of the store are left here and skipped while evicting.
+    std::deque< std::pair< logstore_id_t, logstore_seq_num_t > > m_evict_order;
+    uint64_t m_size{0};     // Total size of the group buffers retained
+    uint64_t m_nrecords{0}; // Total records cached
+};
+} // namespace homestore
@@ -0,0 +1,139 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#include "log_truncation_heap.hpp"
+
+namespace homestore {
+
+void LogTruncationHeap::update(logstore_id_t store_id, const logdev_key& ld_key) {
+    std::unique_lock< std::mutex > lg{m_mtx};
+    auto const it = m_heap_pos.find(store_id);
+    if (it == m_heap_pos.end()) {
+        m_heap.emplace_back(ld_key, store_id);
+        m_heap_pos.emplace(store_id, m_heap.size() - 1);
+        sift_up(m_heap.size() - 1);
+        return;
+    }
+
+    auto const pos = it->second;
+    auto const prev_idx = m_heap[pos].first.idx;
+    m_heap[pos].first = ld_key;
+    if (ld_key.idx < prev_idx) {
+        sift_up(pos);
+    } else if (ld_key.idx > prev_idx) {
+        sift_down(pos);
+    }
+}
+
+void LogTruncationHeap::remove(logstore_id_t store_id) {
+    std::unique_lock< std::mutex > lg{m_mtx};
+    auto const it = m_heap_pos.find(store_id);
+    if (it == m_heap_pos.end()) { return; }
+
+    auto const pos = it->second;
+    auto const last = m_heap.size() - 1;
+    if (pos != last) { swap_entries(pos, last); }
+    m_heap.pop_back();
+    m_heap_pos.erase(store_id);
+    if (pos != last) {
+        // Entry moved in from the end could belong either above or below this position
+        sift_up(pos);
+        sift_down(pos);
+    }
+}
+
+logdev_key LogTruncationHeap::min(std::vector< logstore_id_t >& min_stores) const {
+    std::unique_lock< std::mutex > lg{m_mtx};
+    if (m_heap.empty()) { return logdev_key::out_of_bound_ld_key(); }
+
+    // Entries having the min are the root and its descendants having the min, none under an entry greater than min
+    auto const min_idx = m_heap[0].first.idx;
+    static thread_local std::vector< size_t > s_visit;
+    s_visit.clear();
+    s_visit.push_back(0);
+    while (!s_visit.empty()) {
+        auto const pos = s_visit.back();
+        s_visit.pop_back();
+        if (m_heap[pos].first.idx != min_idx) { continue; }
+
+        min_stores.push_back(m_heap[pos].second);
+        for (auto child = 2 * pos + 1; (child <= 2 * pos + 2) && (child < m_heap.size()); ++child) {
+            s_visit.push_back(child);
+        }
+    }
+    return m_heap[0].first;
+}
+
+logdev_key LogTruncationHeap::truncated_upto() const {
+    std::unique_lock< std::mutex > lg{m_mtx};
+    return m_truncated_upto;
+}
+
+void LogTruncationHeap::set_truncated_upto(const logdev_key& ld_key) {
+    std::unique_lock< std::mutex > lg{m_mtx};
+    m_truncated_upto = ld_key;
+}
+
+size_t LogTruncationHeap::size() const {
+    std::unique_lock< std::mutex > lg{m_mtx};
+    return m_heap.size();
+}
+
+void LogTruncationHeap::clear() {
+    std::unique_lock< std::mutex > lg{m_mtx};
+    m_heap.clear();
+    m_heap_pos.clear();
+    m_truncated_upto = logdev_key{};
+}
+
+void LogTruncationHeap::sift_up(size_t pos) {
+    while (pos > 0) {
+        auto const parent = (pos - 1) / 2;
+        if (m_heap[parent].first.idx <= m_heap[pos].first.idx) { break; }
+        swap_entries(pos, parent);
+        pos = parent;
+    }
+}
+
+void LogTruncationHeap::sift_down(size_t pos) {
+    while (true) {
+        auto smallest = pos;
+        for (auto child = 2 * pos + 1; (child <= 2 * pos + 2) && (child < m_heap.size()); ++child) {
+            if (m_heap[child].first.idx < m_heap[smallest].first.idx) { smallest = child; }
+        }
+        if (smallest == pos) { break; }
+        swap_entries(pos, smallest);
+        pos = smallest;
+    }
+}
+
+void LogTruncationHeap::swap_entries(size_t pos1, size_t pos2) {
+    std::swap(m_heap[pos1], m_heap[pos2]);
+    m_heap_pos[m_heap[pos1].second] = pos1;
+    m_heap_pos[m_heap[pos2].second] = pos2;
+}
+
+nlohmann::json LogTruncationHeap::get_status() const {
+    nlohmann::json js;
+    std::unique_lock< std::mutex > lg{m_mtx};
+    js["participating_logstores"] = m_heap.size();
+    js["truncated_upto_logdev_key"] = m_truncated_upto.to_string();
+    if (!m_heap.empty()) {
+        js["min_safe_logdev_key"] = m_heap[0].first.to_string();
+        js["min_safe_logstore_id"] = m_heap[0].second;
+    }
+    return js;
+}
+} // namespace homestore
@@ -0,0 +1,76 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#include <homestore/logstore/log_store_internal.hpp>
+
+namespace homestore {
+
+/*
+ * LogTruncationHeap: Safe device truncation boundaries of the log stores of a logdev shard, kept in a min-heap indexed
+ * by the store id, so that the boundary upto which the logdev can be truncated is found without visiting every store.
+ *
+ * A log store is in the heap only while it participates in the device truncation, that is when it has a truncation
+ * pending on the device or has appends not truncated yet. Each store updates its own entry as its boundary changes,
+ * which costs O(log n). Stores not participating are not visited by device truncation at all, instead they catch up
+ * with the device truncation point (truncated_upto) when they participate again.
+ */
+class LogTruncationHeap {
+public:
+    LogTruncationHeap() = default;
+    LogTruncationHeap(const LogTruncationHeap&) = delete;
+    LogTruncationHeap& operator=(const LogTruncationHeap&) = delete;
+    LogTruncationHeap(LogTruncationHeap&&) noexcept = delete;
+    LogTruncationHeap& operator=(LogTruncationHeap&&) noexcept = delete;
+
+    /// @brief Insert the safe truncation boundary of the log store, or update it if the store is already present
+    void update(logstore_id_t store_id, const logdev_key& ld_key);
+
+    /// @brief Remove the log store, if present
+    void remove(logstore_id_t store_id);
+
+    /// @brief Minimum of the boundaries of all the log stores, out of bound key if there are none. The stores having
+    /// the minimum boundary are filled in min_stores.
+    logdev_key min(std::vector< logstore_id_t >& min_stores) const;
+
+    /// @brief Device truncation point of the logdev, which stores not participating are considered truncated upto
+    logdev_key truncated_upto() const;
+    void set_truncated_upto(const logdev_key& ld_key);
+
+    size_t size() const;
+    void clear();
+    nlohmann::json get_status() const;
+
+private:
+    void sift_up(size_t pos);
+    void sift_down(size_t pos);
+    void swap_entries(size_t pos1, size_t pos2);
+
+private:
+    mutable std::mutex m_mtx;
+    std::vector< std::pair< logdev_key, logstore_id_t > > m_heap; // Ordered by the logdev key idx
+    std::unordered_map< logstore_id_t, size_t > m_heap_pos;     // Position of each store in the heap
+    logdev_key m_truncated_upto;
+};
+} // namespace homestore
@@ -13,110 +13,258 @@
  * specific language governing permissions and limitations under the License.
  *
  *********************************************************************************/
+#include <algorithm>
+#include <atomic>
 #include <condition_variable>
 #include <cstdint>
+#include <cstring>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <memory>
 #include <mutex>
 #include <string>
 #include <vector>
 
 #include <benchmark/benchmark.h>
+#include <iomgr/io_environment.hpp>
 #include <sisl/logging/logging.h>
 #include <sisl/options/options.h>
 
+#include <homestore/homestore.hpp>
+#include <homestore/homestore_decl.hpp>
+#include <homestore/logstore_service.hpp>
+#include <homestore/logstore/log_store.hpp>
+#include "common/homestore_assert.hpp"
+#include "common/homestore_config.hpp"
 #include "logstore/log_dev.hpp"
 
-SISL_LOGGING_INIT(HOMESTORE_LOG_MODS)
+using namespace homestore;
 RCU_REGISTER_INIT
+SISL_LOGGING_INIT(HOMESTORE_LOG_MODS)
 
-static constexpr size_t ITERATIONS{100000};
-static constexpr size_t THREADS{64};
+static const std::string LOGDEV_BENCH_FILE_PREFIX{"/tmp/log_dev_benchmark_"};
 
-static std::vector< logdev_key > s_log_keys;
-static uint64_t first_offset{~static_cast< uint64_t >(0)};
+/* Benchmarks the group commit of the data logdev through num_logstores log stores, with the data log family sharded
+ * into logdev_shards logdevs (log stores are spread across the shards), and the recovery of the journal so written.
+ * append_pipelined: qdepth appends are kept outstanding all the time, while each logdev is allowed to have 1 upto
+ * max_log_group log groups in flight (logstore.max_inflight_log_groups). It reports the append throughput along with
+ * the average and p99 latency of an append (from issue till its completion callback).
+ * recovery: homestore is restarted with logstore.recovery_read_ahead_depth of 0 (no read ahead) upto 4, reporting the
+ * rate at which the journal is recovered (bytes/s is the journal size over the time homestore takes to start).
+ */
+class LogDevBench {
+public:
+    LogDevBench(const LogDevBench&) = delete;
+    LogDevBench& operator=(const LogDevBench&) = delete;
+    LogDevBench(LogDevBench&&) noexcept = delete;
+    LogDevBench& operator=(LogDevBench&&) noexcept = delete;
+    ~LogDevBench() = default;
 
-void test_append(benchmark::State& state) {
-    uint64_t counter{0};
-    for ([[maybe_unused]] auto current_state : state) { // Loops upto iteration count
-        my_request* req{nullptr};
-        benchmark::DoNotOptimize(req = new my_request());
-        LogDev::instance()->append();
+    static LogDevBench& instance() {
+        static LogDevBench inst;
+        return inst;
+    }
+
+    // Returns the time taken to init homestore in us, which upon restart includes the recovery of the logdevs
+    uint64_t start_homestore(bool restart = false) {
+        const auto ndevices = SISL_OPTIONS["num_devs"].as< uint32_t >();
+        const auto dev_size = SISL_OPTIONS["dev_size_mb"].as< uint64_t >() * 1024 * 1024;
+        const auto nthreads = SISL_OPTIONS["num_threads"].as< uint32_t >();
+
+        std::vector< dev_info > device_info;
+        if (!restart) { LOGINFO("creating {} device files with each of size {} ", ndevices, in_bytes(dev_size)); }
+        for (uint32_t i{0}; i < ndevices; ++i) {
+            const std::filesystem::path fpath{LOGDEV_BENCH_FILE_PREFIX + std::to_string(i + 1)};
+            if (!restart) {
+                std::ofstream ofs{fpath.string(), std::ios::binary | std::ios::out};
+                std::filesystem::resize_file(fpath, dev_size);
+            }
+            device_info.emplace_back(std::filesystem::canonical(fpath).string(), HSDevType::Data);
+        }
+        m_ndevices = ndevices;
+
+        LOGINFO("Starting iomgr with {} threads, spdk: {}", nthreads, SISL_OPTIONS["spdk"].as< bool >());
+        ioenvironment.with_iomgr(nthreads, SISL_OPTIONS["spdk"].as< bool >());
+
+        const auto nshards = SISL_OPTIONS["logdev_shards"].as< uint32_t >();
+        HS_SETTINGS_FACTORY().modifiable_settings([nshards](auto& s) { s.logstore.num_data_logdev_shards = nshards; });
+        HS_SETTINGS_FACTORY().save();
+
+        hs_input_params params;
+        params.app_mem_size = ((ndevices * dev_size) * 15) / 100;
+        params.data_devices = device_info;
+        const auto start_time = Clock::now();
+        HomeStore::instance()
+            ->with_params(params)
+            .with_meta_service(5.0)
+            .with_log_service(60.0, 10.0)
+            .before_init_devices([this, restart]() {
+                if (!restart) { return; }
+                for (const auto store_id : m_store_ids) {
+                    logstore_service().open_log_store(
+                        LogStoreService::DATA_LOG_FAMILY_IDX, store_id, false /* append_mode */,
+                        [this](std::shared_ptr< HomeLogStore > log_store) { m_log_stores.push_back(log_store); });
+                }
+            })
+            .init(true /* wait_for_init */);
+        const auto init_time_us = get_elapsed_time_us(start_time);
+
+        if (!restart) {
+            for (uint32_t i{0}; i < SISL_OPTIONS["num_logstores"].as< uint32_t >(); ++i) {
+                m_log_stores.push_back(logstore_service().create_new_log_store(LogStoreService::DATA_LOG_FAMILY_IDX,
+                                                                               false /* append_mode */));
+                m_store_ids.push_back(m_log_stores.back()->get_store_id());
+            }
+            m_record_size = SISL_OPTIONS["record_size"].as< uint32_t >();
+            m_buf = iomanager.iobuf_alloc(512, m_record_size);
+            std::memset(m_buf, 0xab, m_record_size);
+        }
+        return init_time_us;
+    }
+
+    // Restarts homestore, which recovers all the log groups appended so far. Returns the time taken by the restart
+    uint64_t restart_homestore() {
+        stop_homestore();
+        return start_homestore(true /* restart */);
     }
-    std::cout << "Counter = " << counter << "\n";
-}
 
-[[nodiscard]] static std::shared_ptr< iomgr::ioMgr > start_homestore(const uint32_t ndevices, const uint64_t dev_size,
-                                                                     const uint32_t nthreads) {
-    std::vector< dev_info > device_info;
-    // these should be static so that they stay in scope in the lambda in case function ends before lambda completes
-    static std::mutex start_mutex;
-    static std::condition_variable cv;
-    static bool inited;
-
-    inited = false;
-    LOGINFO("creating {} device files with each of size {} ", ndevices, dev_size);
-    for (uint32_t i{0}; i < ndevices; ++i) {
-        const std::filesystem::path fpath{"/tmp/" + std::to_string(i + 1)};
-        std::ofstream ofs{fpath.string(), std::ios::binary | std::ios::out};
-        std::filesystem::resize_file(fpath, dev_size);
-        device_info.emplace_back(std::filesystem::canonical(fpath).string(), HSDevType::Data);
+    void shutdown() {
+        iomanager.iobuf_free(m_buf);
+        stop_homestore();
+
+        for (uint32_t i{0}; i < m_ndevices; ++i) {
+            std::filesystem::remove(LOGDEV_BENCH_FILE_PREFIX + std::to_string(i + 1));
+        }
     }
 
-    LOGINFO("Creating iomgr with {} threads", nthreads);
-    auto iomgr_obj{std::make_shared< iomgr::ioMgr >(2, nthreads)};
-
-    const uint64_t app_mem_size{((ndevices * dev_size) * 15) / 100};
-    LOGINFO("Initialize and start HomeBlks with app_mem_size = {}", app_mem_size);
-
-    boost::uuids::string_generator gen;
-    init_params params;
-    params.open_flags = homestore::io_flag::DIRECT_IO;
-    params.min_virtual_page_size = 4096;
-    params.app_mem_size = app_mem_size;
-    params.devices = device_info;
-    params.iomgr = iomgr_obj;
-    params.init_done_cb = [&iomgr_obj, &tl_start_mutex = start_mutex, &tl_cv = cv,
-                           &tl_inited = inited](std::error_condition err, const out_params& params) {
-        iomgr_obj->start();
-        LOGINFO("HomeBlks Init completed");
+    // Appends nappends records keeping qdepth of them outstanding and waits for all of them to complete. Latency of
+    // each append is added to m_latencies_us.
+    void run_appends(uint32_t qdepth, uint64_t nappends) {
+        m_nappends = nappends;
+        m_issued.store(0);
+        m_completed = 0;
+        m_issue_times.resize(nappends);
+        m_cur_latencies_us.assign(nappends, 0);
+
+        iomanager.run_on(iomgr::thread_regex::random_worker, [this, qdepth](iomgr::io_thread_addr_t) {
+            for (uint32_t i{0}; i < qdepth; ++i) {
+                issue_append();
+            }
+        });
+
         {
-            std::unique_lock< std::mutex > lk{tl_start_mutex};
-            tl_inited = true;
+            std::unique_lock< std::mutex > lk{m_mtx};
+            m_cv.wait(lk, [this] { return (m_completed == m_nappends); });
         }
-        tl_cv.notify_one();
-    };
-    params.vol_mounted_cb = [](const VolumePtr& vol_obj, vol_state state) {};
-    params.vol_state_change_cb = [](const VolumePtr& vol, vol_state old_state, vol_state new_state) {};
-    params.vol_found_cb = [](boost::uuids::uuid uuid) -> bool { return true; };
-    VolInterface::init(params);
-
-    {
-        std::unique_lock< std::mutex > lk{start_mutex};
-        cv.wait(lk, [] { return inited; });
+        m_latencies_us.insert(m_latencies_us.end(), m_cur_latencies_us.begin(), m_cur_latencies_us.end());
     }
-    return iomgr_obj;
-}
 
-static void on_append_completion(const logdev_key lkey, void* const ctx) {
-    s_log_keys.push_back(lkey);
-    LOGINFO("Append completed with log_idx = {} offset = {}", lkey.idx, lkey.dev_offset);
-    if (first_offset == ~static_cast< uint64_t >(0)) { first_offset = lkey.dev_offset; }
-}
+    void reset_latencies() { m_latencies_us.clear(); }
 
-static void on_log_found(const logdev_key lkey, const log_buffer buf) {
-    s_log_keys.push_back(lkey);
-    LOGINFO("Found a log with log_idx = {} offset = {}", lkey.idx, lkey.dev_offset);
+    // Returns the average and the p99 latency in us of all the appends since last reset
+    std::pair< double, double > latency_stats() {
+        if (m_latencies_us.empty()) { return {0.0, 0.0}; }
+        std::sort(m_latencies_us.begin(), m_latencies_us.end());
+        uint64_t total{0};
+        for (const auto l : m_latencies_us) {
+            total += l;
+        }
+        return {double(total) / m_latencies_us.size(), double(m_latencies_us[(m_latencies_us.size() - 1) * 99 / 100])};
+    }
+
+    uint32_t record_size() const { return m_record_size; }
+
+private:
+    LogDevBench() = default;
+
+    void stop_homestore() {
+        m_log_stores.clear();
+        HomeStore::instance()->shutdown();
+        HomeStore::reset_instance();
+        iomanager.stop();
+    }
+
+    void issue_append() {
+        const auto n = m_issued.fetch_add(1, std::memory_order_acq_rel);
+        if (n >= m_nappends) { return; }
+
+        m_issue_times[n] = Clock::now();
+        m_log_stores[n % m_log_stores.size()]->append_async(
+            sisl::io_blob{m_buf, m_record_size, false}, r_cast< void* >(n),
+            [this](logstore_seq_num_t, sisl::io_blob&, bool success, void* ctx) {
+                HS_REL_ASSERT(success, "Append failed");
+                on_append_completion(r_cast< uint64_t >(ctx));
+            });
+    }
+
+    void on_append_completion(uint64_t n) {
+        m_cur_latencies_us[n] = get_elapsed_time_us(m_issue_times[n]);
+        bool done{false};
+        {
+            std::unique_lock< std::mutex > lk{m_mtx};
+            done = (++m_completed == m_nappends);
+        }
+        if (done) {
+            m_cv.notify_one();
+        } else {
+            issue_append();
+        }
+    }
+
+private:
+    std::vector< std::shared_ptr< HomeLogStore > > m_log_stores;
+    std::vector< logstore_id_t > m_store_ids;
+    uint32_t m_ndevices{0};
+    uint8_t* m_buf{nullptr};
+    uint32_t m_record_size{512};
+
+    uint64_t m_nappends{0};
+    std::atomic< uint64_t > m_issued{0};
+    uint64_t m_completed{0};
+    std::vector< Clock::time_point > m_issue_times;
+    std::vector< uint64_t > m_cur_latencies_us;
+    std::vector< uint64_t > m_latencies_us;
+    std::mutex m_mtx;
+    std::condition_variable m_cv;
+};
+
+#define logdev_bench LogDevBench::instance()
+
+static void append_pipelined(benchmark::State& state) {
+    const auto inflight = s_cast< uint32_t >(state.range(0));
+    const auto qdepth = SISL_OPTIONS["qdepth"].as< uint32_t >();
+    const auto nappends = SISL_OPTIONS["num_appends"].as< uint64_t >();
+    HS_SETTINGS_FACTORY().modifiable_settings([inflight](auto& s) { s.logstore.max_inflight_log_groups = inflight; });
+    HS_SETTINGS_FACTORY().save();
+
+    logdev_bench.reset_latencies();
+    for ([[maybe_unused]] auto s : state) {
+        logdev_bench.run_appends(qdepth, nappends);
+    }
+
+    const auto [avg_us, p99_us] = logdev_bench.latency_stats();
+    state.counters["lat_avg_us"] = benchmark::Counter(avg_us);
+    state.counters["lat_p99_us"] = benchmark::Counter(p99_us);
+    state.SetItemsProcessed(state.iterations() * nappends);
+    state.SetBytesProcessed(state.iterations() * nappends * logdev_bench.record_size());
+    state.SetLabel(std::to_string(inflight) + " log group(s) in flight, " +
+                   std::to_string(SISL_OPTIONS["logdev_shards"].as< uint32_t >()) + " logdev shard(s)");
 }
 
-static void setup() {
-    auto iomgr_obj = start_homestore(SISL_OPTIONS["num_devs"].as< uint32_t >(),
-                                     SISL_OPTIONS["dev_size_mb"].as< uint64_t >() * 1024 * 1024,
-                                     SISL_OPTIONS["num_threads"].as< uint32_t >());
+static void recovery(benchmark::State& state) {
+    const auto read_ahead_depth = s_cast< uint32_t >(state.range(0));
+    HS_SETTINGS_FACTORY().modifiable_settings(
+        [read_ahead_depth](auto& s) { s.logstore.recovery_read_ahead_depth = read_ahead_depth; });
+    HS_SETTINGS_FACTORY().save();
 
-    LogDev::instance()->register_append_cb(on_append_completion);
-    LogDev::instance()->register_logfound_cb(on_log_found);
+    const uint64_t journal_size = logstore_service().used_size();
+    for ([[maybe_unused]] auto s : state) {
+        state.SetIterationTime(double(logdev_bench.restart_homestore()) / 1000000);
+    }
+    state.SetBytesProcessed(state.iterations() * journal_size);
+    state.SetLabel("read ahead depth " + std::to_string(read_ahead_depth) + ", journal of " +
+                   std::to_string(journal_size / (1024 * 1024)) + "MB");
 }
 
 SISL_OPTIONS_ENABLE(logging, log_dev_benchmark)
@@ -126,17 +274,33 @@ SISL_OPTION_GROUP(log_dev_benchmark,
                   (num_devs, "", "num_devs", "number of devices to create",
                    ::cxxopts::value< uint32_t >()->default_value("2"), "number"),
                   (dev_size_mb, "", "dev_size_mb", "size of each device in MB",
-                   ::cxxopts::value< uint64_t >()->default_value("5120"), "number"));
-
-BENCHMARK(test_append)->Iterations(ITERATIONS)->Threads(THREADS);
+                   ::cxxopts::value< uint64_t >()->default_value("5120"), "number"),
+                  (qdepth, "", "qdepth", "number of appends outstanding at any time",
+                   ::cxxopts::value< uint32_t >()->default_value("64"), "number"),
+                  (num_appends, "", "num_appends", "number of appends per iteration",
+                   ::cxxopts::value< uint64_t >()->default_value("100000"), "number"),
+                  (record_size, "", "record_size", "size of each log record",
+                   ::cxxopts::value< uint32_t >()->default_value("512"), "number"),
+                  (num_logstores, "", "num_logstores", "number of log stores appends are spread across",
+                   ::cxxopts::value< uint32_t >()->default_value("1"), "number"),
+                  (logdev_shards, "", "logdev_shards", "number of logdevs the data log family is sharded into",
+                   ::cxxopts::value< uint32_t >()->default_value("1"), "number"),
+                  (spdk, "", "spdk", "spdk", ::cxxopts::value< bool >()->default_value("false"), "true or false"));
 
-SISL_OPTIONS_ENABLE(logging)
 int main(int argc, char** argv) {
     SISL_OPTIONS_LOAD(argc, argv, logging, log_dev_benchmark)
     sisl::logging::SetLogger("log_dev_benchmark");
     spdlog::set_pattern("[%D %T%z] [%^%l%$] [%n] [%t] %v");
 
-    setup();
+    logdev_bench.start_homestore();
+    benchmark::RegisterBenchmark("append_pipelined", append_pipelined)
+        ->RangeMultiplier(2)
+        ->Range(1, max_log_group)
+        ->Iterations(3)
+        ->UseRealTime();
+    benchmark::RegisterBenchmark("recovery", recovery)->Arg(0)->Arg(2)->Arg(4)->Iterations(3)->UseManualTime();
     ::benchmark::Initialize(&argc, argv);
     ::benchmark::RunSpecifiedBenchmarks();
+    std::cout << "Metrics: " << sisl::MetricsFarm::getInstance().get_result_in_json()["LogStores"].dump(4) << "\n";
+    logdev_bench.shutdown();
 }
@@ -0,0 +1,492 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <iomgr/io_environment.hpp>
+#include <sisl/logging/logging.h>
+#include <sisl/options/options.h>
+
+#include <homestore/homestore.hpp>
+#include "device/device.h"
+#include "device/physical_dev.hpp"
+#include "device/virtual_dev.hpp"
+#include "blkdata_svc/data_tier_mgr.hpp"
+#include "common/homestore_config.hpp"
+#include "common/homestore_flip.hpp"
+
+using namespace homestore;
+
+RCU_REGISTER_INIT
+SISL_LOGGING_INIT(HOMESTORE_LOG_MODS)
+
+SISL_OPTIONS_ENABLE(logging, test_data_tier)
+SISL_LOGGING_DECL(test_data_tier)
+
+constexpr uint32_t dma_alignment = 512;
+
+// Home and fast tier vdevs are created directly on data devices, with a DataTierMgr on them. Mover timer is left idle
+// and passes are run by the tests, so that extents move at known points.
+class DataTierTest : public ::testing::Test {
+public:
+    virtual void SetUp() override {
+        const auto ndevices = SISL_OPTIONS["num_devs"].as< uint32_t >();
+        m_dev_size = SISL_OPTIONS["dev_size_mb"].as< uint64_t >() * 1024 * 1024;
+
+        std::vector< dev_info > device_info;
+        for (uint32_t i{0}; i < ndevices; ++i) {
+            const std::filesystem::path fpath{"/tmp/test_data_tier_" + std::to_string(i + 1)};
+            std::ofstream ofs{fpath.string(), std::ios::binary | std::ios::out};
+            std::filesystem::resize_file(fpath, m_dev_size);
+            m_dev_files.push_back(fpath.string());
+            device_info.emplace_back(std::filesystem::canonical(fpath).string(), HSDevType::Data);
+        }
+
+        ioenvironment.with_iomgr(SISL_OPTIONS["num_threads"].as< uint32_t >(), SISL_OPTIONS["spdk"].as< bool >());
+
+        hs_input_params params;
+        params.app_mem_size = ((ndevices * m_dev_size) * 15) / 100;
+        params.data_devices = device_info;
+        HomeStore::instance()->with_params(params).with_meta_service(15.0).init(true /* wait_for_init */);
+
+        m_prev_mover_interval_ms = HS_DYNAMIC_CONFIG(data_tier->mover_interval_ms);
+        m_prev_high_wm = HS_DYNAMIC_CONFIG(data_tier->demote_high_watermark_pct);
+        m_prev_low_wm = HS_DYNAMIC_CONFIG(data_tier->demote_low_watermark_pct);
+        m_prev_read_threshold = HS_DYNAMIC_CONFIG(data_tier->promote_read_threshold);
+        HS_SETTINGS_FACTORY().modifiable_settings([](auto& s) {
+            s.data_tier.mover_interval_ms = 3600 * 1000;
+            s.data_tier.promote_read_threshold = read_threshold;
+        });
+        HS_SETTINGS_FACTORY().save();
+
+        m_home = std::make_unique< VirtualDev >(hs()->device_mgr(), "test_tier_home", PhysicalDevGroup::DATA,
+                                                blk_allocator_type_t::varsize, (m_dev_size * ndevices * 20) / 100,
+                                                0 /* nmirror */, true /* is_stripe */, blk_size, nullptr, 0);
+
+        data_tier_blkstore_blob blob;
+        blob.type = blkstore_type::DATA_FAST_TIER_STORE;
+        blob.tier_id = 0x7e57;
+        blob.nhdr_runs = 0;
+        m_fast = std::make_unique< VirtualDev >(hs()->device_mgr(), "test_tier_fast", PhysicalDevGroup::DATA,
+                                                blk_allocator_type_t::varsize, (m_dev_size * ndevices * 5) / 100,
+                                                0 /* nmirror */, true /* is_stripe */, blk_size, (char*)&blob,
+                                                sizeof(data_tier_blkstore_blob), true /* auto_recovery */);
+        m_tier = std::make_unique< DataTierMgr >(m_home.get(), m_fast.get(), blk_size);
+        m_tier->start();
+    }
+
+    virtual void TearDown() override {
+        m_tier.reset();
+        m_fast.reset();
+        m_home.reset();
+        HS_SETTINGS_FACTORY().modifiable_settings([this](auto& s) {
+            s.data_tier.mover_interval_ms = m_prev_mover_interval_ms;
+            s.data_tier.demote_high_watermark_pct = m_prev_high_wm;
+            s.data_tier.demote_low_watermark_pct = m_prev_low_wm;
+            s.data_tier.promote_read_threshold = m_prev_read_threshold;
+        });
+        HS_SETTINGS_FACTORY().save();
+
+        HomeStore::instance()->shutdown(true);
+        HomeStore::reset_instance();
+        iomanager.stop();
+        for (const auto& f : m_dev_files) {
+            std::filesystem::remove(f);
+        }
+    }
+
+    // Drops all the in memory state of the tier and opens the fast vdev again, as a restart would
+    void restart_tier() {
+        m_tier.reset();
+        auto* vb = m_fast->info_blk();
+        m_fast.reset();
+        m_fast = std::make_unique< VirtualDev >(hs()->device_mgr(), "test_tier_fast", vb, PhysicalDevGroup::DATA,
+                                                blk_allocator_type_t::varsize, false /* recovery_init */,
+                                                true /* auto_recovery */);
+        m_tier = std::make_unique< DataTierMgr >(m_home.get(), m_fast.get(), blk_size);
+        m_tier->recover();
+        m_fast->recovery_done();
+        m_tier->start();
+    }
+
+    static void set_watermarks(uint32_t high_wm, uint32_t low_wm) {
+        HS_SETTINGS_FACTORY().modifiable_settings([high_wm, low_wm](auto& s) {
+            s.data_tier.demote_high_watermark_pct = high_wm;
+            s.data_tier.demote_low_watermark_pct = low_wm;
+        });
+        HS_SETTINGS_FACTORY().save();
+    }
+    void restore_watermarks() { set_watermarks(m_prev_high_wm, m_prev_low_wm); }
+
+    BlkId alloc_home(blk_count_t nblks) {
+        blk_alloc_hints hints;
+        hints.is_contiguous = true;
+        BlkId bid;
+        EXPECT_EQ(m_home->alloc_contiguous_blk(nblks, hints, &bid), BlkAllocStatus::SUCCESS);
+        return bid;
+    }
+
+    void write(const BlkId& bid, uint8_t pattern) {
+        auto const size = bid.get_nblks() * blk_size;
+        auto* buf = iomanager.iobuf_alloc(dma_alignment, size);
+        std::memset(buf, pattern, size);
+        iovec iov{buf, size};
+        std::promise< std::error_condition > p;
+        m_tier->async_writev(
+            &iov, 1, bid, [&p](std::error_condition ec) { p.set_value(ec); }, false /* part_of_batch */);
+        auto const err = p.get_future().get();
+        iomanager.iobuf_free(buf);
+        ASSERT_FALSE(err) << "Write failed with error " << err.message();
+        m_patterns[bid.to_integer()] = pattern;
+    }
+
+    void validate(const BlkId& bid) {
+        auto const size = bid.get_nblks() * blk_size;
+        auto* buf = iomanager.iobuf_alloc(dma_alignment, size);
+        iovec iov{buf, size};
+        std::promise< std::error_condition > p;
+        m_tier->async_readv(
+            &iov, 1, bid, [&p](std::error_condition ec) { p.set_value(ec); }, false /* part_of_batch */);
+        auto const err = p.get_future().get();
+        ASSERT_FALSE(err) << "Read failed with error " << err.message();
+        ASSERT_TRUE(is_filled(buf, size, m_patterns[bid.to_integer()])) << "Data mismatch on " << bid.to_string();
+        iomanager.iobuf_free(buf);
+    }
+
+    // Reads home vdev directly, bypassing the tier
+    bool home_has_latest(const BlkId& bid) {
+        auto const size = bid.get_nblks() * blk_size;
+        auto* buf = iomanager.iobuf_alloc(dma_alignment, size);
+        EXPECT_EQ(m_home->sync_read(r_cast< char* >(buf), size, bid), s_cast< ssize_t >(size));
+        auto const ret = is_filled(buf, size, m_patterns[bid.to_integer()]);
+        iomanager.iobuf_free(buf);
+        return ret;
+    }
+
+    static bool is_filled(const uint8_t* buf, uint32_t size, uint8_t pattern) {
+        for (uint32_t i{0}; i < size; ++i) {
+            if (buf[i] != pattern) { return false; }
+        }
+        return true;
+    }
+
+    static uint64_t tier_counter(const std::string& desc) {
+        auto const j = sisl::MetricsFarm::getInstance().get_result_in_json();
+        return j["DataTier"]["DataTier"]["Counters"][desc].get< uint64_t >();
+    }
+    static uint64_t fast_writes() { return tier_counter("Number of writes which landed on fast tier"); }
+    static uint64_t fast_reads() { return tier_counter("Number of reads served from fast tier"); }
+    static uint64_t home_reads() { return tier_counter("Number of reads served from hdd tier"); }
+    static uint64_t destages() { return tier_counter("Number of dirty extents written back to hdd tier"); }
+    static uint64_t demotions() { return tier_counter("Number of extents demoted from fast tier"); }
+    static uint64_t promotions() { return tier_counter("Number of extents promoted to fast tier"); }
+    static uint64_t recovered() { return tier_counter("Number of extents found on fast tier on recovery"); }
+
+#ifdef _PRERELEASE
+    static void inject_crash(const std::string& flip_name) {
+        flip::FlipClient* fc = HomeStoreFlip::client_instance();
+        flip::FlipFrequency freq;
+        freq.set_count(1);
+        freq.set_percent(100);
+        fc->inject_noreturn_flip(flip_name, {}, freq);
+    }
+#endif
+
+protected:
+    static constexpr uint32_t blk_size{4096};
+    static constexpr uint32_t read_threshold{2};
+
+    uint64_t m_dev_size{0};
+    std::vector< std::string > m_dev_files;
+    std::unique_ptr< VirtualDev > m_home;
+    std::unique_ptr< VirtualDev > m_fast;
+    std::unique_ptr< DataTierMgr > m_tier;
+    std::map< uint64_t, uint8_t > m_patterns; // Latest pattern written on each home blkid
+
+    uint64_t m_prev_mover_interval_ms;
+    uint32_t m_prev_high_wm;
+    uint32_t m_prev_low_wm;
+    uint32_t m_prev_read_threshold;
+};
+
+TEST_F(DataTierTest, PlaceWriteBackAndDestage) {
+    LOGINFO("Step 1: Writes are placed on fast tier and completed without writing home");
+    std::vector< BlkId > bids;
+    auto const writes_before = fast_writes();
+    for (uint8_t i{0}; i < 4; ++i) {
+        bids.push_back(alloc_home(8));
+        write(bids.back(), i + 1);
+    }
+    ASSERT_EQ(fast_writes(), writes_before + bids.size());
+    auto const reads_before = fast_reads();
+    for (const auto& bid : bids) {
+        validate(bid);
+        ASSERT_FALSE(home_has_latest(bid)) << "Fast tier is expected to be write-back";
+    }
+    ASSERT_EQ(fast_reads(), reads_before + bids.size());
+
+    LOGINFO("Step 2: Extents written in the last pass are not written back");
+    auto const destages_before = destages();
+    m_tier->run_mover_pass();
+    ASSERT_EQ(destages(), destages_before);
+
+    LOGINFO("Step 3: Idle dirty extents are written back on the next pass and stay on fast tier");
+    m_tier->run_mover_pass();
+    ASSERT_EQ(destages(), destages_before + bids.size());
+    for (const auto& bid : bids) {
+        ASSERT_TRUE(home_has_latest(bid)) << "Extent not written back " << bid.to_string();
+        validate(bid);
+    }
+    ASSERT_EQ(fast_reads(), reads_before + (2 * bids.size()));
+
+    LOGINFO("Step 4: Overwrite of an extent on fast tier is not written home till the next write back");
+    write(bids[0], 0xaa);
+    validate(bids[0]);
+    ASSERT_FALSE(home_has_latest(bids[0]));
+}
+
+TEST_F(DataTierTest, DemoteAboveHighWatermark) {
+    LOGINFO("Step 1: Place extents on fast tier, one of them is written back");
+    std::vector< BlkId > bids;
+    for (uint8_t i{0}; i < 4; ++i) {
+        bids.push_back(alloc_home(16));
+        write(bids.back(), i + 1);
+    }
+    m_tier->run_mover_pass();
+    m_tier->run_mover_pass();
+    write(bids[1], 0x55);
+
+    LOGINFO("Step 2: Lower the watermarks, all extents are demoted and dirty ones are written back first");
+    set_watermarks(0, 0);
+    auto const demotions_before = demotions();
+    m_tier->run_mover_pass();
+    ASSERT_EQ(demotions(), demotions_before + bids.size());
+
+    LOGINFO("Step 3: Data is read from home now");
+    auto const fast_reads_before = fast_reads();
+    auto const home_reads_before = home_reads();
+    for (const auto& bid : bids) {
+        ASSERT_TRUE(home_has_latest(bid)) << "Demoted extent not written back " << bid.to_string();
+        validate(bid);
+    }
+    ASSERT_EQ(fast_reads(), fast_reads_before);
+    ASSERT_EQ(home_reads(), home_reads_before + bids.size());
+
+    LOGINFO("Step 4: Demoted extents are not recovered");
+    restart_tier();
+    ASSERT_EQ(recovered(), 0);
+    for (const auto& bid : bids) {
+        validate(bid);
+    }
+    restore_watermarks();
+}
+
+TEST_F(DataTierTest, PromoteHotExtent) {
+    LOGINFO("Step 1: With placement off, writes go only home");
+    set_watermarks(0, 0);
+    auto const hot = alloc_home(8);
+    auto const other = alloc_home(8);
+    auto const writes_before = fast_writes();
+    write(hot, 0x11);
+    write(other, 0x22);
+    ASSERT_EQ(fast_writes(), writes_before);
+    ASSERT_TRUE(home_has_latest(hot));
+
+    LOGINFO("Step 2: Extent read often from home is promoted on the next pass");
+    // Placement stays off, while promotion is allowed below the low watermark
+    set_watermarks(0, 70);
+    for (uint32_t i{0}; i < read_threshold; ++i) {
+        validate(hot);
+    }
+
+#ifdef _PRERELEASE
+    // A home write in flight on another range should not hold off the promotion
+    flip::FlipClient* fc = HomeStoreFlip::client_instance();
+    flip::FlipFrequency freq;
+    freq.set_count(1);
+    freq.set_percent(100);
+    flip::FlipCondition dont_care_cond;
+    fc->create_condition("", flip::Operator::DONT_CARE, (int)1, &dont_care_cond);
+    fc->inject_delay_flip("simulate_pdev_delay", {dont_care_cond, dont_care_cond}, freq, 2000000 /* 2s */);
+
+    auto const size = other.get_nblks() * blk_size;
+    auto* buf = iomanager.iobuf_alloc(dma_alignment, size);
+    std::memset(buf, 0x33, size);
+    iovec iov{buf, size};
+    std::atomic< bool > other_written{false};
+    std::promise< std::error_condition > p;
+    m_tier->async_writev(
+        &iov, 1, other,
+        [&](std::error_condition ec) {
+            other_written.store(true);
+            p.set_value(ec);
+        },
+        false /* part_of_batch */);
+#endif
+
+    auto const promotions_before = promotions();
+    m_tier->run_mover_pass();
+    ASSERT_EQ(promotions(), promotions_before + 1);
+
+#ifdef _PRERELEASE
+    ASSERT_FALSE(other_written.load()) << "Home write did not overlap the promotion, delay it longer";
+    ASSERT_FALSE(p.get_future().get());
+    iomanager.iobuf_free(buf);
+    m_patterns[other.to_integer()] = 0x33;
+    validate(other);
+#endif
+
+    LOGINFO("Step 3: Promoted extent is read from fast tier and written only on it");
+    auto const fast_reads_before = fast_reads();
+    validate(hot);
+    ASSERT_EQ(fast_reads(), fast_reads_before + 1);
+    write(hot, 0x44);
+    validate(hot);
+    ASSERT_FALSE(home_has_latest(hot));
+
+    LOGINFO("Step 4: Promoted extent is recovered with its latest data");
+    restart_tier();
+    ASSERT_EQ(recovered(), 1);
+    validate(hot);
+    validate(other);
+    restore_watermarks();
+}
+
+TEST_F(DataTierTest, RecoverDirtyExtents) {
+    LOGINFO("Step 1: Place extents and restart before they are written back");
+    std::vector< BlkId > bids;
+    for (uint8_t i{0}; i < 4; ++i) {
+        bids.push_back(alloc_home(s_cast< blk_count_t >(4 * (i + 1))));
+        write(bids.back(), i + 1);
+    }
+    restart_tier();
+    ASSERT_EQ(recovered(), bids.size());
+    for (const auto& bid : bids) {
+        ASSERT_FALSE(home_has_latest(bid));
+        validate(bid);
+    }
+
+    LOGINFO("Step 2: Freed extent is not recovered");
+    std::promise< void > p;
+    m_tier->async_free_blk(bids[0], [&p]() { p.set_value(); });
+    p.get_future().get();
+    restart_tier();
+    ASSERT_EQ(recovered(), bids.size() - 1);
+
+    LOGINFO("Step 3: Recovered extents are dirty and are written back");
+    m_tier->run_mover_pass();
+    m_tier->run_mover_pass();
+    for (size_t i{1}; i < bids.size(); ++i) {
+        ASSERT_TRUE(home_has_latest(bids[i]));
+        validate(bids[i]);
+    }
+}
+
+#ifdef _PRERELEASE
+TEST_F(DataTierTest, CrashDuringPromotion) {
+    set_watermarks(0, 0);
+    auto const bid = alloc_home(8);
+    write(bid, 0x66);
+    set_watermarks(0, 70);
+
+    LOGINFO("Step 1: Crash after the copy, before the header is written. Copy is not recovered.");
+    for (uint32_t i{0}; i < read_threshold; ++i) {
+        validate(bid);
+    }
+    inject_crash("data_tier_crash_after_promote_copy");
+    m_tier->run_mover_pass();
+    restart_tier();
+    ASSERT_EQ(recovered(), 0);
+    auto home_reads_before = home_reads();
+    validate(bid);
+    ASSERT_EQ(home_reads(), home_reads_before + 1);
+
+    LOGINFO("Step 2: Crash after the header is written. Copy is recovered and has the data.");
+    for (uint32_t i{1}; i < read_threshold; ++i) {
+        validate(bid);
+    }
+    inject_crash("data_tier_crash_after_promote_seal");
+    m_tier->run_mover_pass();
+    restart_tier();
+    ASSERT_EQ(recovered(), 1);
+    auto const fast_reads_before = fast_reads();
+    validate(bid);
+    ASSERT_EQ(fast_reads(), fast_reads_before + 1);
+    restore_watermarks();
+}
+
+TEST_F(DataTierTest, CrashDuringDemotion) {
+    LOGINFO("Step 1: Place extents on fast tier and overwrite one of them");
+    std::vector< BlkId > bids;
+    for (uint8_t i{0}; i < 2; ++i) {
+        bids.push_back(alloc_home(8));
+        write(bids.back(), i + 1);
+    }
+    write(bids[0], 0x77);
+
+    LOGINFO("Step 2: Demote both, crash after the first is written back but before its header is zeroed");
+    set_watermarks(0, 0);
+    inject_crash("data_tier_crash_before_drop");
+    auto const demotions_before = demotions();
+    m_tier->run_mover_pass();
+    ASSERT_EQ(demotions(), demotions_before + 1);
+    restart_tier();
+
+    LOGINFO("Step 3: Extent whose demotion crashed is recovered, both have the latest data on either tier");
+    ASSERT_EQ(recovered(), 1);
+    for (const auto& bid : bids) {
+        ASSERT_TRUE(home_has_latest(bid));
+        validate(bid);
+    }
+
+    LOGINFO("Step 4: Recovered extent is demoted again");
+    m_tier->run_mover_pass();
+    ASSERT_EQ(demotions(), 1);
+    for (const auto& bid : bids) {
+        validate(bid);
+    }
+    restore_watermarks();
+}
+#endif
+
+SISL_OPTION_GROUP(test_data_tier,
+                  (num_threads, "", "num_threads", "number of threads",
+                   ::cxxopts::value< uint32_t >()->default_value("2"), "number"),
+                  (num_devs, "", "num_devs", "number of devices to create",
+                   ::cxxopts::value< uint32_t >()->default_value("2"), "number"),
+                  (dev_size_mb, "", "dev_size_mb", "size of each device in MB",
+                   ::cxxopts::value< uint64_t >()->default_value("1024"), "number"),
+                  (spdk, "", "spdk", "spdk", ::cxxopts::value< bool >()->default_value("false"), "true or false"));
+
+int main(int argc, char* argv[]) {
+    SISL_OPTIONS_LOAD(argc, argv, logging, test_data_tier);
+    ::testing::InitGoogleTest(&argc, argv);
+    sisl::logging::SetLogger("test_data_tier");
+    spdlog::set_pattern("[%D %T%z] [%^%l%$] [%n] [%t] %v");
+
+    return RUN_ALL_TESTS();
+}
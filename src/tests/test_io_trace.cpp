@@ -0,0 +1,133 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <sisl/logging/logging.h>
+#include <sisl/options/options.h>
+
+#include "common/io_trace.hpp"
+
+using namespace homestore;
+
+SISL_LOGGING_INIT(test_io_trace, iomgr, flip, io_wd)
+SISL_OPTIONS_ENABLE(logging, test_io_trace)
+
+TEST(IOTraceRingTest, SnapshotKeepsLatestInOrder) {
+    IOTraceRing ring{8, "test"};
+    for (uint64_t i{0}; i < 20; ++i) {
+        ring.record(io_trace_record{i * 10, i, 4096, io_trace_event_t::vdev_submit, 1, 0});
+    }
+
+    std::vector< io_trace_record > recs;
+    ASSERT_EQ(ring.snapshot(recs), 20u);
+    ASSERT_EQ(recs.size(), ring.capacity());
+    for (size_t i{0}; i < recs.size(); ++i) {
+        ASSERT_EQ(recs[i].id, 20 - recs.size() + i) << "Records are not the latest or not in order";
+    }
+}
+
+TEST(IOTraceRingTest, SnapshotWhileRecording) {
+    IOTraceRing ring{1024, "test"};
+    std::atomic< bool > stop{false};
+    std::thread writer{[&ring, &stop]() {
+        uint64_t i{0};
+        while (!stop.load()) {
+            ring.record(io_trace_record{i, i, static_cast< uint32_t >(i), io_trace_event_t::vdev_submit, 0, 0});
+            ++i;
+        }
+    }};
+
+    std::vector< io_trace_record > recs;
+    for (uint32_t iter{0}; iter < 100; ++iter) {
+        recs.clear();
+        ring.snapshot(recs);
+        for (size_t i{1}; i < recs.size(); ++i) {
+            // ts and id are written together and successive records have successive ids
+            ASSERT_EQ(recs[i].id, recs[i - 1].id + 1) << "Snapshot has an overwritten record";
+            ASSERT_EQ(recs[i].ts_ns, recs[i].id);
+            ASSERT_EQ(recs[i].arg, static_cast< uint32_t >(recs[i].id)) << "Snapshot has a torn record";
+        }
+    }
+    stop.store(true);
+    writer.join();
+}
+
+TEST(IOTraceTest, DumpHasPerThreadRecords) {
+    IOTrace::set_enabled(true);
+    std::thread t{[]() {
+        IOTrace::record(io_trace_event_t::cp_flush_start, 7);
+        IOTrace::record(io_trace_event_t::cp_flush_done, 7);
+    }};
+    t.join();
+
+    bool found{false};
+    const auto js = IOTrace::dump(1);
+    for (const auto& thr : js["threads"]) {
+        if (thr["total_recorded"].get< uint64_t >() != 2) { continue; }
+        const auto& events = thr["events"];
+        ASSERT_EQ(events.size(), 2u);
+        ASSERT_EQ(events[0][1].get< std::string >(), "cp_flush_start");
+        ASSERT_EQ(events[1][1].get< std::string >(), "cp_flush_done");
+        ASSERT_LE(events[0][0].get< uint64_t >(), events[1][0].get< uint64_t >());
+        found = true;
+    }
+    ASSERT_TRUE(found) << "Records of the thread are not in the dump";
+
+    IOTrace::set_enabled(false);
+    IOTrace::record(io_trace_event_t::cp_flush_start, 8);
+    ASSERT_EQ(IOTrace::dump(0)["threads"].size(), js["threads"].size()) << "Disabled trace created a ring";
+}
+
+TEST(IOTraceTest, RingsOfExitedThreadsAreFreed) {
+    IOTrace::set_enabled(true);
+    const auto rings_before = IOTrace::dump(0)["threads"].size();
+    for (uint32_t i{0}; i < 64; ++i) {
+        std::thread t{[i]() { IOTrace::record(io_trace_event_t::cp_switchover, i); }};
+        t.join();
+    }
+
+    const auto js = IOTrace::dump(1);
+    uint32_t exited{0};
+    for (const auto& thr : js["threads"]) {
+        if (thr["exited"].get< bool >()) { ++exited; }
+    }
+    ASSERT_GT(exited, 0u) << "Rings of the exited threads are not dumped";
+    ASSERT_LT(js["threads"].size(), rings_before + 64) << "Rings of the exited threads are not freed";
+
+    // Latest exited thread is still in the dump
+    const auto& last = js["threads"].back();
+    ASSERT_TRUE(last["exited"].get< bool >());
+    ASSERT_EQ(last["events"][0][2].get< uint64_t >(), 63u);
+    IOTrace::set_enabled(false);
+}
+
+SISL_OPTION_GROUP(test_io_trace,
+                  (num_threads, "", "num_threads", "number of threads",
+                   ::cxxopts::value< uint32_t >()->default_value("2"), "number"));
+
+int main(int argc, char* argv[]) {
+    int parsed_argc{argc};
+    ::testing::InitGoogleTest(&parsed_argc, argv);
+    SISL_OPTIONS_LOAD(parsed_argc, argv, logging, test_io_trace);
+    sisl::logging::SetLogger("test_io_trace");
+    spdlog::set_pattern("[%D %T%z] [%^%l%$] [%n] [%t] %v");
+
+    return RUN_ALL_TESTS();
+}
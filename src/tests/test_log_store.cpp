@@ -20,6 +20,7 @@
 #include <condition_variable>
 #include <cstdint>
 #include <cstdlib>
+#include <cstring>
 #include <filesystem>
 #include <fstream>
 #include <functional>
@@ -30,6 +31,7 @@
 #include <mutex>
 #include <optional>
 #include <random> // std::default_random_engine
+#include <set>
 #include <stdexcept>
 #include <string>
 #include <thread>
@@ -45,6 +47,7 @@
 #include <gtest/gtest.h>
 
 #include <homestore/homestore.hpp>
+#include <homestore/checkpoint/cp_mgr.hpp>
 #include <homestore/logstore_service.hpp>
 
 #include "logstore/log_dev.hpp"
@@ -118,6 +121,7 @@ public:
     void reset_recovery() {
         m_n_recovered_lsns = 0;
         m_n_recovered_truncated_lsns = 0;
+        m_recovered_lsns.clear();
     }
 
     void insert_next_batch(uint32_t batch_size, uint32_t nholes = 0) {
@@ -151,6 +155,7 @@ public:
                                          [io_memory, d, this](logstore_seq_num_t seq_num, const sisl::io_blob& b,
                                                               logdev_key ld_key, void* ctx) {
                                              assert(ld_key);
+                                             m_lsn_log_idx.wlock()->insert_or_assign(seq_num, ld_key.idx);
                                              if (io_memory) {
                                                  iomanager.iobuf_free(uintptr_cast(d));
                                              } else {
@@ -266,6 +271,114 @@ public:
         }
     }
 
+    // Read all the completed lsns (other than holes) asynchronously in batches of batch_size and validate them
+    void read_async_validate(uint32_t batch_size) {
+        std::vector< logstore_seq_num_t > lsns;
+        const auto upto = m_cur_lsn.load() - 1;
+        for (auto i = m_log_store->truncated_upto() + 1; i < upto; ++i) {
+            if (m_hole_lsns.rlock()->count(i) == 0) { lsns.push_back(i); }
+        }
+
+        std::mutex mtx;
+        std::condition_variable cv;
+        size_t nread{0};
+        for (size_t start{0}; start < lsns.size(); start += batch_size) {
+            const std::vector< logstore_seq_num_t > batch{lsns.begin() + start,
+                                                          lsns.begin() + std::min(start + batch_size, lsns.size())};
+            m_log_store->read_async(batch, nullptr, [&](logstore_seq_num_t seq_num, log_buffer b, void*) {
+                auto* tl = r_cast< test_log_data* >(b.bytes());
+                EXPECT_EQ(tl->total_size(), b.size())
+                    << "Size Mismatch for lsn=" << m_log_store->get_store_id() << ":" << seq_num;
+                validate_data(tl, seq_num);
+
+                std::unique_lock< std::mutex > lk{mtx};
+                ++nread;
+                cv.notify_one();
+            });
+        }
+
+        std::unique_lock< std::mutex > lk{mtx};
+        cv.wait(lk, [&] { return (nread == lsns.size()); });
+    }
+
+    // Appends the records and reads them back asynchronously from an io reactor before they are flushed. Reads are
+    // expected to be queued behind the flush, instead of blocking the reactor, and called back on the same reactor.
+    void read_unflushed_from_reactor_validate(uint32_t nrecords) {
+        std::mutex mtx;
+        std::condition_variable cv;
+        uint32_t nwritten{0};
+        uint32_t nread{0};
+        bool read_before_flush{false};
+        const auto start_lsn = m_cur_lsn.fetch_add(nrecords);
+
+        iomanager.run_on(iomgr::thread_regex::random_worker, [&](iomgr::io_thread_addr_t) {
+            const auto reader = iomanager.iothread_self();
+            std::vector< logstore_seq_num_t > lsns;
+            for (auto lsn = start_lsn; lsn < start_lsn + nrecords; ++lsn) {
+                bool io_memory{false};
+                auto* d = prepare_data(lsn, io_memory);
+                m_log_store->write_async(lsn, {uintptr_cast(d), d->total_size(), false}, nullptr,
+                                         [&, io_memory, d](logstore_seq_num_t seq_num, const sisl::io_blob& b,
+                                                           logdev_key ld_key, void* ctx) {
+                                             m_lsn_log_idx.wlock()->insert_or_assign(seq_num, ld_key.idx);
+                                             if (io_memory) {
+                                                 iomanager.iobuf_free(uintptr_cast(d));
+                                             } else {
+                                                 std::free(voidptr_cast(d));
+                                             }
+                                             std::unique_lock< std::mutex > lk{mtx};
+                                             ++nwritten;
+                                             cv.notify_one();
+                                         });
+                lsns.push_back(lsn);
+            }
+
+            read_before_flush = (m_log_store->get_contiguous_completed_seq_num(0) < lsns.back());
+            m_log_store->read_async(lsns, nullptr, [&, reader](logstore_seq_num_t seq_num, log_buffer b, void*) {
+                EXPECT_EQ(iomanager.iothread_self(), reader)
+                    << "Read of lsn=" << m_log_store->get_store_id() << ":" << seq_num << " called back elsewhere";
+                auto* tl = r_cast< test_log_data* >(b.bytes());
+                EXPECT_EQ(tl->total_size(), b.size())
+                    << "Size Mismatch for lsn=" << m_log_store->get_store_id() << ":" << seq_num;
+                validate_data(tl, seq_num);
+
+                std::unique_lock< std::mutex > lk{mtx};
+                ++nread;
+                cv.notify_one();
+            });
+        });
+
+        std::unique_lock< std::mutex > lk{mtx};
+        cv.wait(lk, [&] { return (nwritten == nrecords) && (nread == nrecords); });
+        EXPECT_TRUE(read_before_flush) << "Expected the records to be read before they are flushed";
+    }
+
+    // Reads the last lsn asynchronously while the read of its log group fails, expecting the error callback only
+    void read_async_error_validate() {
+        const auto lsn = m_cur_lsn.load() - 1;
+        std::mutex mtx;
+        std::condition_variable cv;
+        bool done{false};
+        m_log_store->read_async(
+            {lsn}, nullptr,
+            [&](logstore_seq_num_t seq_num, log_buffer, void*) {
+                ADD_FAILURE() << "Read of lsn=" << m_log_store->get_store_id() << ":" << seq_num << " not failed";
+                std::unique_lock< std::mutex > lk{mtx};
+                done = true;
+                cv.notify_one();
+            },
+            [&](logstore_seq_num_t seq_num, std::error_condition err, void*) {
+                EXPECT_EQ(seq_num, lsn);
+                EXPECT_TRUE(err) << "Expected error for lsn=" << m_log_store->get_store_id() << ":" << seq_num;
+                std::unique_lock< std::mutex > lk{mtx};
+                done = true;
+                cv.notify_one();
+            });
+
+        std::unique_lock< std::mutex > lk{mtx};
+        cv.wait(lk, [&] { return done; });
+    }
+
     void fill_hole_and_validate() {
         const auto start = m_log_store->truncated_upto();
         m_hole_lsns.withWLock([&](auto& holes_list) {
@@ -317,9 +430,25 @@ public:
         // m_log_store->read(id);
     }
 
+    // Validates that neither the truncated lsns nor the rolled back lsns (upto rolled_back_upto) are in tail cache
+    void tail_cache_validate(logstore_seq_num_t rolled_back_upto = -1) {
+        auto& cache = m_log_store->get_logdev().tail_cache();
+        const auto store_id = m_log_store->get_logdev_store_id();
+        for (logstore_seq_num_t lsn{0}; lsn <= m_log_store->truncated_upto(); ++lsn) {
+            ASSERT_FALSE(cache.get(store_id, lsn).has_value()) << "Truncated lsn " << lsn << " in tail cache";
+        }
+        for (auto lsn = m_cur_lsn.load(); lsn <= rolled_back_upto; ++lsn) {
+            ASSERT_FALSE(cache.get(store_id, lsn).has_value()) << "Rolled back lsn " << lsn << " in tail cache";
+        }
+    }
+
+    bool is_tail_cached(logstore_seq_num_t lsn) const {
+        return m_log_store->get_logdev().tail_cache().get(m_log_store->get_logdev_store_id(), lsn).has_value();
+    }
+
     void rollback_record_count(uint32_t expected_count) {
         auto actual_count =
-            m_log_store->get_family().logdev().log_dev_meta().num_rollback_records(m_log_store->get_store_id());
+            m_log_store->get_logdev().log_dev_meta().num_rollback_records(m_log_store->get_logdev_store_id());
         ASSERT_EQ(actual_count, expected_count);
     }
 
@@ -331,7 +460,28 @@ public:
         validate_data(tl, lsn);
 
         // Count only the ones which are after truncated, because recovery could receive even truncated lsns
-        (lsn > m_truncated_upto_lsn) ? ++m_n_recovered_lsns : ++m_n_recovered_truncated_lsns;
+        if (lsn > m_truncated_upto_lsn) {
+            ++m_n_recovered_lsns;
+            m_recovered_lsns.insert(lsn);
+        } else {
+            ++m_n_recovered_truncated_lsns;
+        }
+    }
+
+    // Updates the highest log idx among the lsns written after from_idx which are recovered, and the lowest log idx and
+    // count of those which are not recovered
+    void lost_lsns_validate(logid_t from_idx, logid_t& max_recovered_idx, logid_t& min_lost_idx, size_t& nlost) {
+        m_lsn_log_idx.withRLock([&](const auto& lsn_log_idx) {
+            for (const auto& [lsn, idx] : lsn_log_idx) {
+                if ((idx <= from_idx) || (lsn <= m_truncated_upto_lsn)) { continue; }
+                if (m_recovered_lsns.count(lsn)) {
+                    max_recovered_idx = std::max(max_recovered_idx, idx);
+                } else {
+                    min_lost_idx = std::min(min_lost_idx, idx);
+                    ++nlost;
+                }
+            }
+        });
     }
 
     void truncate(const logstore_seq_num_t lsn) {
@@ -396,6 +546,8 @@ private:
     std::atomic< logstore_seq_num_t > m_cur_lsn = 0;
     std::shared_ptr< HomeLogStore > m_log_store;
     folly::Synchronized< std::map< logstore_seq_num_t, bool > > m_hole_lsns;
+    folly::Synchronized< std::map< logstore_seq_num_t, logid_t > > m_lsn_log_idx; // Log idx each lsn is written at
+    std::set< logstore_seq_num_t > m_recovered_lsns;
     int64_t m_n_recovered_lsns = 0;
     int64_t m_n_recovered_truncated_lsns = 0;
     logstore_family_id_t m_family;
@@ -421,7 +573,7 @@ public:
         return inst;
     }
 
-    void start_homestore(bool restart = false) {
+    void start_homestore(bool restart = false, bool keep_files = false) {
         auto const ndevices = SISL_OPTIONS["num_devs"].as< uint32_t >();
         auto const dev_size = SISL_OPTIONS["dev_size_mb"].as< uint64_t >() * 1024 * 1024;
 
@@ -458,7 +610,7 @@ public:
         } else {
             /* create files */
             LOGINFO("creating {} device files with each of size {} ", ndevices, in_bytes(dev_size));
-            if (!restart) init_files(ndevices, dev_size);
+            if (!restart && !keep_files) init_files(ndevices, dev_size);
             for (uint32_t i{0}; i < ndevices; ++i) {
                 const std::filesystem::path fpath{s_fpath_root + std::to_string(i + 1)};
                 device_info.emplace_back(std::filesystem::canonical(fpath).string(), HSDevType::Data);
@@ -485,6 +637,7 @@ public:
             .with_log_service(60.0, 10.0)
             .before_init_devices([this, restart, n_log_stores]() {
                 if (restart) {
+                    if (m_on_restart_open_cb) { m_on_restart_open_cb(); }
                     for (uint32_t i{0}; i < n_log_stores; ++i) {
                         SampleLogStoreClient* client = m_log_store_clients[i].get();
                         logstore_service().open_log_store(client->m_family, client->m_store_id, false /* append_mode */,
@@ -509,6 +662,22 @@ public:
         }
     }
 
+    // Restarts homestore on freshly formatted devices with a new set of log stores. With keep_old_data, only the
+    // device superblocks are wiped, so the new format lands on top of whatever the previous one left in the journal
+    void reformat_homestore(bool keep_old_data = false) {
+        auto const ndevices = SISL_OPTIONS["num_devs"].as< uint32_t >();
+        shutdown(ndevices, !keep_old_data /* cleanup */);
+        if (auto hsrv = ioenvironment.get_http_server(); hsrv) hsrv->stop();
+        if (keep_old_data) {
+            m_log_store_clients.clear();
+            wipe_superblocks(ndevices);
+        }
+        for (auto& idx : m_highest_log_idx) {
+            idx.store(-1);
+        }
+        start_homestore(false /* restart */, keep_old_data /* keep_files */);
+    }
+
     void shutdown(uint32_t ndevices, bool cleanup = true) {
         HomeStore::instance()->shutdown();
         HomeStore::reset_instance();
@@ -529,6 +698,16 @@ public:
         }
     }
 
+    void wipe_superblocks(uint32_t ndevices) {
+        static constexpr size_t wipe_size{64 * 1024};
+        const std::vector< char > zeros(wipe_size, 0);
+        for (uint32_t i{0}; i < ndevices; ++i) {
+            const std::string fpath{s_fpath_root + std::to_string(i + 1)};
+            std::fstream fs{fpath, std::ios::binary | std::ios::in | std::ios::out};
+            fs.write(zeros.data(), zeros.size());
+        }
+    }
+
     void remove_files(uint32_t ndevices) {
         for (uint32_t i{0}; i < ndevices; ++i) {
             const std::string fpath{s_fpath_root + std::to_string(i + 1)};
@@ -556,10 +735,14 @@ public:
 
     logid_t highest_log_idx(logstore_family_id_t fid) const { return m_highest_log_idx[fid].load(); }
 
+    // Opens the log stores a test created on its own, other than the ones of clients, upon restart
+    void on_restart_open(std::function< void() > cb) { m_on_restart_open_cb = std::move(cb); }
+
 private:
     const static std::string s_fpath_root;
     std::vector< std::string > m_dev_names;
     std::function< void() > m_on_schedule_io_cb;
+    std::function< void() > m_on_restart_open_cb;
     test_log_store_comp_cb_t m_io_closure;
     std::vector< std::unique_ptr< SampleLogStoreClient > > m_log_store_clients;
     std::array< std::atomic< logid_t >, LogStoreService::num_log_families > m_highest_log_idx = {-1, -1};
@@ -567,6 +750,38 @@ private:
 
 const std::string SampleDB::s_fpath_root{"/tmp/log_store_dev_"};
 
+// Changes the logstore settings for a test and restores all of them to what they were before the test, once it goes
+// out of scope, so that a test failing midway does not leave its settings behind for the rest of the tests
+class LogStoreSettingsGuard {
+public:
+    template < typename ChangeT >
+    explicit LogStoreSettingsGuard(const ChangeT& change) {
+        HS_SETTINGS_FACTORY().modifiable_settings([this](auto& s) {
+            m_restore = [saved = s.logstore]() {
+                HS_SETTINGS_FACTORY().modifiable_settings([&saved](auto& s) { s.logstore = saved; });
+                HS_SETTINGS_FACTORY().save();
+            };
+        });
+        apply(change);
+    }
+
+    LogStoreSettingsGuard(const LogStoreSettingsGuard&) = delete;
+    LogStoreSettingsGuard(LogStoreSettingsGuard&&) noexcept = delete;
+    LogStoreSettingsGuard& operator=(const LogStoreSettingsGuard&) = delete;
+    LogStoreSettingsGuard& operator=(LogStoreSettingsGuard&&) noexcept = delete;
+    ~LogStoreSettingsGuard() { m_restore(); }
+
+    // Changes the settings further midway through the test
+    template < typename ChangeT >
+    void apply(const ChangeT& change) {
+        HS_SETTINGS_FACTORY().modifiable_settings([&change](auto& s) { change(s.logstore); });
+        HS_SETTINGS_FACTORY().save();
+    }
+
+private:
+    std::function< void() > m_restore;
+};
+
 class LogStoreTest : public ::testing::Test {
 public:
     LogStoreTest() = default;
@@ -642,12 +857,105 @@ protected:
                           [&] { return (m_nrecords_waiting_to_issue == 0) && (m_nrecords_waiting_to_complete == 0); });
     }
 
+    // Inserts the records sequentially with the q depth and waits for all of them to complete
+    void insert_and_wait(uint64_t n_total_records, uint32_t q_depth = 40) {
+        init(n_total_records);
+        kickstart_inserts(1, q_depth);
+        wait_for_inserts();
+    }
+
+    // Restarts homestore, validates all the records are recovered and reinits for the records to be inserted next
+    void restart_and_validate(uint64_t n_total_records) {
+        SampleDB::instance().start_homestore(true /* restart */);
+        recovery_validate();
+        init(n_total_records);
+    }
+
     void read_validate(bool expect_all_completed = false) {
         for (const auto& lsc : SampleDB::instance().m_log_store_clients) {
             lsc->read_validate(expect_all_completed);
         }
     }
 
+    void tail_cache_validate() {
+        for (const auto& lsc : SampleDB::instance().m_log_store_clients) {
+            lsc->tail_cache_validate();
+        }
+    }
+
+    // Validates that the tail cache of every logdev is charged with the whole group buffers retained by its records
+    // and that they stay within its capacity
+    void tail_cache_size_validate() {
+        for (const auto& lsc : SampleDB::instance().m_log_store_clients) {
+            const auto js = lsc->m_log_store->get_logdev().tail_cache().get_status(0);
+            const auto size = js["size"].get< uint64_t >();
+            ASSERT_LE(size, LogTailCache::capacity()) << "Tail cache retains more than its capacity";
+            ASSERT_GE(size, js["ngroup_bufs"].get< uint64_t >() * LogGroup::inline_log_buf_size)
+                << "Tail cache is not charged with the whole group buffers retained";
+        }
+    }
+
+    static uint64_t logstore_counter(const std::string& desc) {
+        auto const j = sisl::MetricsFarm::getInstance().get_result_in_json();
+        return j["LogStores"]["AllLogStores"]["Counters"][desc].get< uint64_t >();
+    }
+    static uint64_t tail_cache_hits() { return logstore_counter("Number of log store reads served from tail cache"); }
+    static uint64_t tail_cache_misses() {
+        return logstore_counter("Number of log store reads not found in tail cache");
+    }
+    static uint64_t read_ahead_bulks() {
+        return logstore_counter("Number of bulks read ahead by logdevs upon recovery");
+    }
+    static uint64_t tail_cache_evictions() {
+        return logstore_counter("Number of records evicted from tail cache by its size limit");
+    }
+
+    struct flush_reason_counts {
+        uint64_t size;
+        uint64_t time;
+        uint64_t latency;
+        uint64_t idle;
+
+        uint64_t total() const { return size + time + latency + idle; }
+    };
+    static flush_reason_counts flush_reasons() {
+        return flush_reason_counts{
+            logstore_counter("Number of log groups flushed as pending size reached the limit"),
+            logstore_counter("Number of log groups flushed as max time between flushes elapsed"),
+            logstore_counter("Number of log groups flushed as latency budget ran out"),
+            logstore_counter("Number of log groups flushed as no more records are expected")};
+    }
+
+    // Waits for the flush timer of each logdev to be rearmed with the period of the current settings
+    void flush_timer_rearm_validate(uint64_t expected_period_us) {
+        for (const auto& lsc : SampleDB::instance().m_log_store_clients) {
+            auto& logdev = lsc->m_log_store->get_logdev();
+            for (uint32_t i{0}; (logdev.flush_timer_period_us() != expected_period_us) && (i < 1000); ++i) {
+                std::this_thread::sleep_for(std::chrono::milliseconds{1});
+            }
+            ASSERT_EQ(logdev.flush_timer_period_us(), expected_period_us)
+                << "Flush timer of shard " << logdev.shard_idx() << " is not rearmed upon new latency target";
+        }
+    }
+
+    void read_async_validate(uint32_t batch_size) {
+        for (const auto& lsc : SampleDB::instance().m_log_store_clients) {
+            lsc->read_async_validate(batch_size);
+        }
+    }
+
+    void read_unflushed_from_reactor_validate(uint32_t nrecords) {
+        for (const auto& lsc : SampleDB::instance().m_log_store_clients) {
+            lsc->read_unflushed_from_reactor_validate(nrecords);
+        }
+    }
+
+    void read_async_error_validate() {
+        for (const auto& lsc : SampleDB::instance().m_log_store_clients) {
+            lsc->read_async_error_validate();
+        }
+    }
+
     void iterate_validate(bool expect_all_completed = false) {
         for (const auto& lsc : SampleDB::instance().m_log_store_clients) {
             lsc->iterate_validate(expect_all_completed);
@@ -808,8 +1116,40 @@ protected:
         }
     }
 
+    // Validates the recovery stopped at a log group of the family which was lost, after from_idx: none of the groups
+    // written after it are recovered, even though they made it to the device. Stores of other families recover all.
+    void lost_group_recovery_validate(logstore_family_id_t fid, logid_t from_idx, logid_t lost_group_min_idx) {
+        logid_t max_recovered_idx{-1};
+        logid_t min_lost_idx{std::numeric_limits< logid_t >::max()};
+        size_t nlost{0};
+        for (const auto& lsc : SampleDB::instance().m_log_store_clients) {
+            if (lsc->m_family != fid) {
+                lsc->recovery_validate();
+            } else {
+                lsc->lost_lsns_validate(from_idx, max_recovered_idx, min_lost_idx, nlost);
+            }
+        }
+        ASSERT_GT(nlost, 0u) << "Records of the lost log group are recovered";
+        ASSERT_GE(min_lost_idx, lost_group_min_idx) << "Records before the lost log group are not recovered";
+        ASSERT_LT(max_recovered_idx, min_lost_idx) << "Log groups written after the lost log group are recovered";
+    }
+
     void rollback_validate(uint32_t num_lsns_to_rollback) { pick_log_store()->rollback_validate(num_lsns_to_rollback); }
 
+    // Rolls back the last lsns of a log store, which are expected to be in tail cache, and validates they are evicted
+    void rollback_tail_cache_validate(uint32_t num_lsns_to_rollback) {
+        auto* lsc = pick_log_store();
+        const auto last_lsn = lsc->m_cur_lsn.load() - 1;
+        bool any_cached{false};
+        for (auto lsn = last_lsn - num_lsns_to_rollback + 1; lsn <= last_lsn; ++lsn) {
+            any_cached = any_cached || lsc->is_tail_cached(lsn);
+        }
+        ASSERT_TRUE(any_cached) << "Expected the last appended lsns to be in tail cache";
+
+        lsc->rollback_validate(num_lsns_to_rollback);
+        lsc->tail_cache_validate(last_lsn);
+    }
+
     void post_truncate_rollback_validate() {
         for (size_t i{0}; i < SampleDB::instance().m_log_store_clients.size(); ++i) {
             const auto& lsc = SampleDB::instance().m_log_store_clients[i];
@@ -830,12 +1170,15 @@ protected:
         size_t exp_garbage_store_count{0};
 
         for (logstore_family_id_t fid{0}; fid < LogStoreService::num_log_families; ++fid) {
-            std::vector< logstore_id_t > reg_ids, garbage_ids;
-            LogDev& ld = (fid == LogStoreService::DATA_LOG_FAMILY_IDX) ? logstore_service().data_logdev()
-                                                                       : logstore_service().ctrl_logdev();
-            ld.get_registered_store_ids(reg_ids, garbage_ids);
-            actual_valid_ids += reg_ids.size() - garbage_ids.size();
-            actual_garbage_ids += garbage_ids.size();
+            LogStoreFamily* family = (fid == LogStoreService::DATA_LOG_FAMILY_IDX)
+                ? logstore_service().data_log_family()
+                : logstore_service().ctrl_log_family();
+            for (uint32_t shard_idx{0}; shard_idx < family->num_logdevs(); ++shard_idx) {
+                std::vector< logstore_id_t > reg_ids, garbage_ids;
+                family->logdev(shard_idx).get_registered_store_ids(reg_ids, garbage_ids);
+                actual_valid_ids += reg_ids.size() - garbage_ids.size();
+                actual_garbage_ids += garbage_ids.size();
+            }
 
             auto upto_count = find_garbage_upto(fid, SampleDB::instance().highest_log_idx(fid) + 1);
             decltype(upto_count) count{0};
@@ -847,6 +1190,16 @@ protected:
         ASSERT_EQ(actual_garbage_ids, exp_garbage_store_count);
     }
 
+    void validate_logdev_shards() {
+        for (const auto& lsc : SampleDB::instance().m_log_store_clients) {
+            auto& family = lsc->m_log_store->get_family();
+            const auto store_id = lsc->m_log_store->get_store_id();
+            const auto shard_idx = family.shard_of(store_id);
+            ASSERT_EQ(lsc->m_log_store->get_logdev().shard_idx(), shard_idx);
+            ASSERT_EQ(family.family_store_id(shard_idx, lsc->m_log_store->get_logdev_store_id()), store_id);
+        }
+    }
+
     void delete_validate(uint32_t idx) {
         auto& db = SampleDB::instance();
         auto fid = db.m_log_store_clients[idx]->m_family;
@@ -1188,6 +1541,297 @@ TEST_F(LogStoreTest, FlushSync) {
     this->wait_for_inserts();
 }
 
+TEST_F(LogStoreTest, PipelinedFlushOutOfOrderThenRecover) {
+    const auto num_records = SISL_OPTIONS["num_records"].as< uint32_t >();
+    LOGINFO("Step 1: Allow max log groups to be in flight, so that log groups are flushed in parallel");
+    LogStoreSettingsGuard settings{[](auto& ls) { ls.max_inflight_log_groups = max_log_group; }};
+
+#ifdef _PRERELEASE
+    LOGINFO("Step 2: Delay the write of one log group, so that the groups written after it complete before it");
+    flip::FlipClient* fc = HomeStoreFlip::client_instance();
+
+    flip::FlipFrequency freq;
+    freq.set_count(1);
+    freq.set_percent(100);
+
+    flip::FlipCondition dont_care_cond;
+    fc->create_condition("", flip::Operator::DONT_CARE, (int)1, &dont_care_cond);
+    fc->inject_delay_flip("simulate_log_flush_delay", {dont_care_cond}, freq, 100000); // Delay by 100ms
+#endif
+
+    LOGINFO("Step 3: Issue sequential inserts with q depth of 40");
+    this->insert_and_wait(num_records);
+
+    LOGINFO("Step 4: Read all the inserts one by one for each log store to validate if what is written is valid");
+    this->read_validate(true);
+
+    LOGINFO("Step 5: Restart homestore and validate the recovery of log groups written in parallel");
+    this->restart_and_validate(num_records);
+
+    LOGINFO("Step 6: Truncate");
+    this->truncate_validate();
+}
+
+TEST_F(LogStoreTest, PipelinedFlushLostGroupThenRecover) {
+#ifdef _PRERELEASE
+    const auto num_records = SISL_OPTIONS["num_records"].as< uint32_t >();
+    LOGINFO("Step 1: Allow max log groups to be in flight, so that log groups are flushed in parallel");
+    LogStoreSettingsGuard settings{[](auto& ls) { ls.max_inflight_log_groups = max_log_group; }};
+
+    LOGINFO("Step 2: Skip the write of a data log group midway, as if it was lost in a crash after later groups");
+    const auto fid = LogStoreService::DATA_LOG_FAMILY_IDX;
+    const auto from_idx = SampleDB::instance().highest_log_idx(fid);
+    const logid_t lost_group_min_idx = from_idx + (num_records / 4);
+    flip::FlipClient* fc = HomeStoreFlip::client_instance();
+
+    flip::FlipFrequency freq;
+    freq.set_count(1);
+    freq.set_percent(100);
+
+    flip::FlipCondition family_cond;
+    flip::FlipCondition idx_cond;
+    fc->create_condition("", flip::Operator::EQUAL, (int)fid, &family_cond);
+    fc->create_condition("", flip::Operator::GREATER_THAN_OR_EQUAL, (int)lost_group_min_idx, &idx_cond);
+    fc->inject_noreturn_flip("logdev_skip_group_write", {family_cond, idx_cond}, freq);
+
+    LOGINFO("Step 3: Issue sequential inserts with q depth of 40");
+    this->insert_and_wait(num_records);
+
+    LOGINFO("Step 4: Restart homestore and validate recovery stops at the lost log group");
+    SampleDB::instance().start_homestore(true /* restart */);
+    this->lost_group_recovery_validate(fid, from_idx, lost_group_min_idx);
+
+    LOGINFO("Step 5: Reformat homestore, as the log stores lost their records, for rest of the tests");
+    SampleDB::instance().reformat_homestore();
+#endif
+}
+
+TEST_F(LogStoreTest, LargeLogGroupsThenRecover) {
+    const auto num_records = SISL_OPTIONS["num_records"].as< uint32_t >();
+    LOGINFO("Step 1: Raise the flush threshold, so that thousands of records are accumulated into one log group");
+    LogStoreSettingsGuard settings{[](auto& ls) {
+        ls.max_time_between_flush_us = 20000ul; // 20ms
+        ls.flush_threshold_size = 4194304ul;    // 4MB
+        ls.max_records_in_a_log_group = 8192;
+    }};
+
+    LOGINFO("Step 2: Issue sequential inserts with q depth of 2000");
+    this->insert_and_wait(num_records, 2000);
+
+    LOGINFO("Step 3: Read all the inserts, including those whose record slots are beyond first page of the group");
+    this->read_validate(true);
+
+    LOGINFO("Step 4: Restart homestore and validate the recovery of large log groups");
+    this->restart_and_validate(num_records);
+
+    LOGINFO("Step 5: Truncate");
+    this->truncate_validate();
+}
+
+TEST_F(LogStoreTest, ShardedLogDevInsertThenRecover) {
+    static constexpr uint32_t nshards{3};
+    const auto num_records = SISL_OPTIONS["num_records"].as< uint32_t >();
+    LOGINFO("Step 1: Reformat homestore with the data log family sharded into {} logdevs", nshards);
+    LogStoreSettingsGuard settings{[](auto& ls) { ls.num_data_logdev_shards = nshards; }};
+    SampleDB::instance().reformat_homestore();
+    ASSERT_EQ(logstore_service().data_log_family()->num_logdevs(), nshards);
+    ASSERT_EQ(logstore_service().ctrl_log_family()->num_logdevs(), 1u);
+
+    LOGINFO("Step 2: Validate the log stores are spread across the shards by their store id");
+    this->validate_logdev_shards();
+
+    LOGINFO("Step 3: Issue sequential inserts with q depth of 40 and read them back");
+    this->insert_and_wait(num_records);
+    this->read_validate(true);
+
+    LOGINFO("Step 4: Restart homestore with shards config reset, journal should still be loaded with its shards");
+    settings.apply([](auto& ls) { ls.num_data_logdev_shards = 1; });
+    SampleDB::instance().start_homestore(true /* restart */);
+    ASSERT_EQ(logstore_service().data_log_family()->num_logdevs(), nshards);
+    this->recovery_validate();
+    this->init(num_records);
+
+    LOGINFO("Step 5: Truncate, which truncates every shard upto its own safe logdev key");
+    this->truncate_validate();
+
+    LOGINFO("Step 6: Reformat homestore with unsharded data log family for rest of the tests");
+    SampleDB::instance().reformat_homestore();
+    ASSERT_EQ(logstore_service().data_log_family()->num_logdevs(), 1u);
+}
+
+TEST_F(LogStoreTest, RecoverWithAndWithoutReadAhead) {
+    const auto num_records = SISL_OPTIONS["num_records"].as< uint32_t >();
+
+    LOGINFO("Step 1: Issue sequential inserts with q depth of 40, with a small bulk read size to have many bulk reads");
+    LogStoreSettingsGuard settings{[](auto& ls) { ls.bulk_read_size = 16 * 1024; }};
+    this->insert_and_wait(num_records);
+
+    LOGINFO("Step 2: Restart homestore without read ahead and validate recovery");
+    settings.apply([](auto& ls) { ls.recovery_read_ahead_depth = 0; });
+    auto bulks_before = read_ahead_bulks();
+    auto start_time = Clock::now();
+    this->restart_and_validate(num_records);
+    LOGINFO("Restart and recovery without read ahead took {} ms", get_elapsed_time_ms(start_time));
+    ASSERT_EQ(read_ahead_bulks(), bulks_before) << "Expected no bulks to be read ahead with read ahead depth of 0";
+
+    LOGINFO("Step 3: Restart homestore with deep read ahead and validate recovery");
+    settings.apply([](auto& ls) { ls.recovery_read_ahead_depth = 8; });
+    bulks_before = read_ahead_bulks();
+    start_time = Clock::now();
+    this->restart_and_validate(num_records);
+    LOGINFO("Restart and recovery with read ahead depth of 8 took {} ms, waited for the bulk being read {} times",
+            get_elapsed_time_ms(start_time),
+            logstore_counter("Number of times logdev recovery waited for the bulk being read ahead"));
+    ASSERT_GT(read_ahead_bulks(), bulks_before) << "Expected bulks to be read ahead on the flush reactor";
+
+    LOGINFO("Step 4: Truncate");
+    this->truncate_validate();
+}
+
+TEST_F(LogStoreTest, ReformatOverDirtyJournal) {
+    const auto num_records = SISL_OPTIONS["num_records"].as< uint32_t >();
+
+    LOGINFO("Step 1: Fill the journal well beyond the region that format zeroes out");
+    this->insert_and_wait(num_records);
+
+    LOGINFO("Step 2: Reformat homestore over the old journal contents, with a tiny zeroed region");
+    LogStoreSettingsGuard settings{[](auto& ls) { ls.bulk_read_size = 16 * 1024; }};
+    SampleDB::instance().reformat_homestore(true /* keep_old_data */);
+
+    LOGINFO("Step 3: Insert fewer records than before, so that the new tail ends amidst groups of the old format");
+    this->insert_and_wait(num_records / 4);
+    this->read_validate(true);
+
+    LOGINFO("Step 4: Restart homestore and validate only the records of the new format are recovered");
+    this->restart_and_validate(num_records);
+    this->read_validate(true);
+
+    LOGINFO("Step 5: Reformat homestore on clean devices for rest of the tests");
+    SampleDB::instance().reformat_homestore();
+}
+
+TEST_F(LogStoreTest, TailCacheEvictThenRead) {
+    LOGINFO("Step 1: Shrink the tail cache to 1MB, so that most of the records are evicted from it while inserting");
+    LogStoreSettingsGuard settings{[](auto& ls) { ls.tail_cache_size_mb = 1; }};
+
+    LOGINFO("Step 2: Issue sequential inserts with q depth of 40");
+    const auto evictions_before = tail_cache_evictions();
+    this->insert_and_wait(SISL_OPTIONS["num_records"].as< uint32_t >());
+    ASSERT_GT(tail_cache_evictions(), evictions_before) << "Expected records to be evicted beyond 1MB";
+    this->tail_cache_size_validate();
+
+    LOGINFO("Step 3: Read and iterate all the records, which are served from both tail cache and device");
+    const auto hits_before = tail_cache_hits();
+    const auto misses_before = tail_cache_misses();
+    this->read_validate(true);
+    this->iterate_validate(true);
+    ASSERT_GT(tail_cache_hits(), hits_before) << "Expected the recent records to be read from tail cache";
+    ASSERT_GT(tail_cache_misses(), misses_before) << "Expected the evicted records to be read from device";
+
+    LOGINFO("Step 4: Rollback the last few records of a log store and validate they are not served from tail cache");
+    this->rollback_tail_cache_validate(10);
+
+    LOGINFO("Step 5: Truncate all of the inserts and validate truncated records are not served from tail cache");
+    this->truncate_validate();
+    this->tail_cache_validate();
+}
+
+TEST_F(LogStoreTest, AsyncReadInBatches) {
+    LOGINFO("Step 1: Disable the tail cache, so that all the reads are served from device");
+    LogStoreSettingsGuard settings{[](auto& ls) { ls.tail_cache_size_mb = 0; }};
+
+    LOGINFO("Step 2: Issue sequential inserts with q depth of 40");
+    this->insert_and_wait(SISL_OPTIONS["num_records"].as< uint32_t >());
+
+    LOGINFO("Step 3: Read all the records asynchronously one at a time and in batches, which span log groups");
+    this->read_async_validate(1);
+    this->read_async_validate(32);
+
+    LOGINFO("Step 4: Truncate all of the inserts and validate");
+    this->truncate_validate();
+}
+
+TEST_F(LogStoreTest, AsyncReadUnflushedFromReactor) {
+    LOGINFO("Step 1: Flush only by time, every 100ms, so that the records stay unflushed while they are read");
+    LogStoreSettingsGuard settings{[](auto& ls) {
+        ls.flush_threshold_size = 64 * 1024 * 1024;
+        ls.max_time_between_flush_us = 100000;
+    }};
+
+    LOGINFO("Step 2: Append records on an io reactor and read them right away, before they are flushed");
+    this->read_unflushed_from_reactor_validate(16);
+
+    LOGINFO("Step 3: Read all the records asynchronously, now that they are flushed");
+    this->read_async_validate(8);
+
+#ifdef _PRERELEASE
+    LOGINFO("Step 4: Fail the read of a log group and validate the error is called back instead of the data");
+    flip::FlipClient* fc = HomeStoreFlip::client_instance();
+    flip::FlipFrequency freq;
+    freq.set_count(SampleDB::instance().m_log_store_clients.size());
+    freq.set_percent(100);
+
+    flip::FlipCondition dont_care_cond;
+    fc->create_condition("", flip::Operator::DONT_CARE, (int)1, &dont_care_cond);
+    fc->inject_noreturn_flip("logdev_async_read_error", {dont_care_cond}, freq);
+    this->read_async_error_validate();
+#endif
+
+    LOGINFO("Step 5: Truncate all of the inserts and validate");
+    this->truncate_validate();
+}
+
+TEST_F(LogStoreTest, CompressedLogGroupsThenRecover) {
+    const auto num_records = SISL_OPTIONS["num_records"].as< uint32_t >();
+    LOGINFO("Step 1: Turn on compression of log groups and disable the tail cache, so that reads are from device");
+    LogStoreSettingsGuard settings{[](auto& ls) {
+        ls.compress_feature_on = true;
+        ls.compress_min_data_size = 0;
+        ls.tail_cache_size_mb = 0;
+    }};
+
+    LOGINFO("Step 2: Issue sequential inserts with q depth of 40, whose data is all compressible");
+    this->insert_and_wait(num_records);
+
+    LOGINFO("Step 3: Read all the records synchronously and asynchronously, which uncompresses their log groups");
+    this->read_validate(true);
+    this->read_async_validate(32);
+
+    LOGINFO("Step 4: Restart homestore and validate the recovery of compressed log groups");
+    this->restart_and_validate(num_records);
+
+    LOGINFO("Step 5: Truncate");
+    this->truncate_validate();
+}
+
+TEST_F(LogStoreTest, AdaptiveFlushWithLatencyTargets) {
+    const auto num_records = SISL_OPTIONS["num_records"].as< uint32_t >();
+    LogStoreSettingsGuard settings{[](auto& ls) { ls.adaptive_flush_on = true; }};
+    std::vector< uint64_t > ngroups;
+    for (const uint64_t target_us : {100ul, 20000ul}) {
+        LOGINFO("Step 1: Set the append latency target of adaptive flush to {} us", target_us);
+        settings.apply([target_us](auto& ls) { ls.flush_latency_target_us = target_us; });
+        this->flush_timer_rearm_validate(std::max(target_us / 4, 20ul));
+
+        LOGINFO("Step 2: Issue sequential inserts with q depth of 40 and validate the reasons log groups are flushed");
+        const auto before = flush_reasons();
+        this->insert_and_wait(num_records);
+        const auto after = flush_reasons();
+        ASSERT_EQ(after.time, before.time) << "Adaptive flush is not expected to flush by max time between flushes";
+        ASSERT_GT((after.latency - before.latency) + (after.idle - before.idle), 0u)
+            << "Expected log groups to be flushed by latency budget or idleness with target of " << target_us << " us";
+        ngroups.push_back(after.total() - before.total());
+        LOGINFO("Flushed {} log groups with latency target of {} us (size={} latency={} idle={})", ngroups.back(),
+                target_us, after.size - before.size, after.latency - before.latency, after.idle - before.idle);
+
+        LOGINFO("Step 3: Read back and truncate");
+        this->read_validate(true);
+        this->truncate_validate();
+    }
+    ASSERT_LT(ngroups[1], ngroups[0])
+        << "Expected a looser latency target to batch the same appends into fewer and larger log groups";
+}
+
 TEST_F(LogStoreTest, Rollback) {
     LOGINFO("Step 1: Reinit the 500 records on a single logstore to start rollback test");
     this->init(500, {std::make_pair(1ull, 100)}); // Last entry = 500
@@ -1326,6 +1970,497 @@ TEST_F(LogStoreTest, WriteSyncThenRead) {
     }
 }
 
+TEST_F(LogStoreTest, BatchAppendThenRead) {
+    std::shared_ptr< HomeLogStore > tmp_log_store =
+        logstore_service().create_new_log_store(LogStoreService::DATA_LOG_FAMILY_IDX, true /* append_mode */);
+    const auto store_id = tmp_log_store->get_store_id();
+    LOGINFO("Created new append mode log store -> id {}", store_id);
+
+    static constexpr uint32_t nbatches{20};
+    std::vector< std::vector< test_log_data* > > batch_data(nbatches);
+    std::vector< bool > io_memory;
+    std::mutex mtx;
+    std::condition_variable cv;
+    uint32_t ncompleted{0};
+
+    LOGINFO("Step 1: Append {} batches of growing size, with a completion callback for each batch", nbatches);
+    logstore_seq_num_t next_lsn{0};
+    for (uint32_t batch{0}; batch < nbatches; ++batch) {
+        std::vector< sisl::io_blob > blobs;
+        for (uint32_t i{0}; i <= batch; ++i) {
+            bool is_io_memory{false};
+            auto* d = SampleLogStoreClient::prepare_data(next_lsn + i, is_io_memory);
+            batch_data[batch].push_back(d);
+            io_memory.push_back(is_io_memory);
+            blobs.emplace_back(uintptr_cast(d), d->total_size(), false);
+        }
+
+        const auto start_lsn = tmp_log_store->append_batch_async(
+            blobs, nullptr,
+            [&, batch, expected_lsn = next_lsn](logstore_seq_num_t lsn, uint32_t nrecords, logdev_key ld_key, void*) {
+                EXPECT_EQ(lsn, expected_lsn) << "Start lsn mismatch for batch " << batch;
+                EXPECT_EQ(nrecords, batch + 1) << "Number of records mismatch for batch " << batch;
+                EXPECT_TRUE(ld_key.is_valid());
+
+                std::unique_lock< std::mutex > lk{mtx};
+                ++ncompleted;
+                cv.notify_one();
+            });
+        ASSERT_EQ(start_lsn, next_lsn) << "Batch is expected to get lsns contiguous to the previous batch";
+        next_lsn += batch + 1;
+    }
+
+    {
+        std::unique_lock< std::mutex > lk{mtx};
+        cv.wait(lk, [&] { return (ncompleted == nbatches); });
+    }
+
+    LOGINFO("Step 2: Read back all {} records of the batches and validate", next_lsn);
+    uint32_t n{0};
+    for (auto& data : batch_data) {
+        for (auto* d : data) {
+            auto b = tmp_log_store->read_sync(n);
+            auto* tl = r_cast< test_log_data* >(b.bytes());
+            ASSERT_EQ(tl->total_size(), b.size()) << "Size Mismatch for lsn=" << store_id << ":" << n;
+            ASSERT_EQ(std::memcmp(tl->get_data(), d->get_data(), tl->size), 0) << "Data mismatch for lsn=" << n;
+
+            if (io_memory[n]) {
+                iomanager.iobuf_free(uintptr_cast(d));
+            } else {
+                std::free(voidptr_cast(d));
+            }
+            ++n;
+        }
+    }
+
+    logstore_service().remove_log_store(LogStoreService::DATA_LOG_FAMILY_IDX, store_id);
+}
+
+TEST_F(LogStoreTest, PaddedRecordInlining) {
+    static constexpr uint64_t flush_size{4096};
+    const auto is_inlineable = [](uint32_t size) {
+        std::vector< uint8_t > buf(size);
+        const log_record rec{0, 0, sisl::io_blob{buf.data(), size, false}, nullptr, true /* padded */};
+        return rec.is_inlineable(flush_size);
+    };
+
+    LOGINFO("Step 1: Padded records which are mostly padding are inlined, instead of writing the padding out of band");
+    ASSERT_TRUE(is_inlineable(100));
+    ASSERT_TRUE(is_inlineable(600));
+    ASSERT_TRUE(is_inlineable(2048));
+    ASSERT_TRUE(is_inlineable(flush_size + 1));
+
+    LOGINFO("Step 2: Padded records with little padding are written out of band as is");
+    ASSERT_FALSE(is_inlineable(flush_size));
+    ASSERT_FALSE(is_inlineable(flush_size - 100));
+    ASSERT_FALSE(is_inlineable((4 * flush_size) - 1000));
+}
+
+TEST_F(LogStoreTest, ReservedAppendThenRead) {
+    // Tail cache is off by default, but turned off explicitly, so that the records are read back from the device
+    LogStoreSettingsGuard settings{[](auto& ls) { ls.tail_cache_size_mb = 0; }};
+    std::shared_ptr< HomeLogStore > tmp_log_store =
+        logstore_service().create_new_log_store(LogStoreService::DATA_LOG_FAMILY_IDX, true /* append_mode */);
+    const auto store_id = tmp_log_store->get_store_id();
+    LOGINFO("Created new append mode log store -> id {}", store_id);
+
+    static constexpr uint32_t nrecords{200};
+    std::mutex mtx;
+    std::condition_variable cv;
+    uint32_t ncompleted{0};
+
+    LOGINFO("Step 1: Serialize {} records of varying size in place into reserved buffers and append them", nrecords);
+    std::vector< uint32_t > sizes;
+    for (uint32_t i{0}; i < nrecords; ++i) {
+        // Mix of small records which are inlined and large ones, some of which are written from the reserved buffer
+        // as is, depending on how much of their padding would be written along
+        const uint32_t sz = (i % 2) ? (i * 97) % 256 : 4096 + (i * 131) % 8192;
+        auto reserved = tmp_log_store->reserve_append(sizeof(test_log_data) + sz + 100);
+
+        test_log_data* d = new (reserved.bytes) test_log_data();
+        d->size = sz;
+        std::memset(voidptr_cast(d->get_data()), static_cast< char >((i % 94) + 33), sz);
+        sizes.push_back(sz);
+
+        const auto lsn = tmp_log_store->commit_append_async(
+            reserved, d->total_size(), nullptr,
+            [&](logstore_seq_num_t seq_num, const sisl::io_blob& b, logdev_key ld_key, void*) {
+                EXPECT_TRUE(ld_key.is_valid());
+                std::unique_lock< std::mutex > lk{mtx};
+                ++ncompleted;
+                cv.notify_one();
+            });
+        ASSERT_EQ(lsn, i);
+    }
+
+    LOGINFO("Step 2: Reserve and cancel a buffer without appending");
+    tmp_log_store->cancel_append(tmp_log_store->reserve_append(4096));
+
+    {
+        std::unique_lock< std::mutex > lk{mtx};
+        cv.wait(lk, [&] { return (ncompleted == nrecords); });
+    }
+
+    const auto validate_records = [&]() {
+        for (uint32_t i{0}; i < nrecords; ++i) {
+            auto b = tmp_log_store->read_sync(i);
+            auto* tl = r_cast< test_log_data* >(b.bytes());
+            ASSERT_EQ(tl->size, sizes[i]) << "Size Mismatch for lsn=" << store_id << ":" << i;
+            ASSERT_EQ(tl->total_size(), b.size()) << "Size Mismatch for lsn=" << store_id << ":" << i;
+            const std::string expected(static_cast< size_t >(tl->size), static_cast< char >((i % 94) + 33));
+            ASSERT_EQ(std::string(r_cast< const char* >(tl->get_data()), tl->size), expected)
+                << "Data mismatch for lsn=" << store_id << ":" << i;
+        }
+    };
+
+    LOGINFO("Step 3: Read back all {} records and validate", nrecords);
+    validate_records();
+
+    LOGINFO("Step 4: Restart homestore and validate the records, including the padded ones, are recovered as is");
+    SampleDB::instance().on_restart_open([&]() {
+        logstore_service().open_log_store(
+            LogStoreService::DATA_LOG_FAMILY_IDX, store_id, true /* append_mode */,
+            [&tmp_log_store](std::shared_ptr< HomeLogStore > log_store) { tmp_log_store = std::move(log_store); });
+    });
+    tmp_log_store.reset();
+    SampleDB::instance().start_homestore(true /* restart */);
+    SampleDB::instance().on_restart_open(nullptr);
+    ASSERT_TRUE(tmp_log_store) << "Log store " << store_id << " is not reopened upon restart";
+    validate_records();
+
+    logstore_service().remove_log_store(LogStoreService::DATA_LOG_FAMILY_IDX, store_id);
+}
+
+TEST_F(LogStoreTest, TruncateManyLogStores) {
+    auto* family = logstore_service().data_log_family();
+    static constexpr uint32_t nstores{1000};
+
+    // Device truncation key of the family, the minimum across its logdev shards, found by visiting every log store
+    // which participates in it. Log stores of a shard are visited under the flush lock of the shard, so that no log
+    // group completion updates them meanwhile.
+    const auto expected_trunc_idx = [&family](size_t& nparticipating, size_t& heap_size) {
+        logid_t min_idx{std::numeric_limits< logid_t >::max()};
+        heap_size = 0;
+        for (uint32_t shard_idx{0}; shard_idx < family->num_logdevs(); ++shard_idx) {
+            std::mutex mtx;
+            std::condition_variable cv;
+            bool visited{false};
+            const auto visit = [&]() {
+                family->m_id_logstore_map.withRLock([&](auto& id_logstore_map) {
+                    for (const auto& [id, info] : id_logstore_map) {
+                        if ((family->shard_of(id) != shard_idx) || !info.m_log_store) { continue; }
+                        const auto js = info.m_log_store->get_status(0);
+                        if (!js["truncation_pending_on_device?"].get< bool >() &&
+                            !js["truncation_parallel_to_writes?"].get< bool >()) {
+                            continue;
+                        }
+                        ++nparticipating;
+                        const auto key_str = js["truncated_upto_logdev_key"].get< std::string >(); // "Logid=<idx> ..."
+                        min_idx = std::min< logid_t >(min_idx, std::stoll(key_str.substr(key_str.find('=') + 1)));
+                    }
+                });
+                heap_size += family->truncation_heap(shard_idx).size();
+                std::unique_lock< std::mutex > lk{mtx};
+                visited = true;
+                cv.notify_one();
+            };
+
+            auto& ld = family->logdev(shard_idx);
+            if (ld.try_lock_flush(visit)) { ld.unlock_flush(); }
+            std::unique_lock< std::mutex > lk{mtx};
+            cv.wait(lk, [&] { return visited; });
+        }
+        return min_idx;
+    };
+
+    // Expected key is found before the dry run, which is then expected to leave the heap as is
+    const auto validate_device_truncation = [&](const std::string& step) {
+        size_t nparticipating{0};
+        size_t heap_size{0};
+        const auto expected_idx = expected_trunc_idx(nparticipating, heap_size);
+        ASSERT_EQ(heap_size, nparticipating) << "Participating log stores mismatch " << step;
+
+        logdev_key trunc_key;
+        logstore_service().device_truncate(
+            [&trunc_key](const auto& trunc_lds) { trunc_key = trunc_lds[LogStoreService::DATA_LOG_FAMILY_IDX]; },
+            true /* wait_till_done */, true /* dry_run */);
+        ASSERT_EQ(trunc_key.idx, expected_idx) << "Device truncation key mismatch " << step;
+
+        size_t nparticipating_after{0};
+        ASSERT_EQ(expected_trunc_idx(nparticipating_after, heap_size), expected_idx)
+            << "Dry run of device truncation changed the log stores " << step;
+        ASSERT_EQ(nparticipating_after, nparticipating) << "Dry run of device truncation changed the heap " << step;
+    };
+
+    std::vector< uint8_t > data(64, 'x');
+    const auto append_to = [&data](const std::vector< std::shared_ptr< HomeLogStore > >& stores) {
+        std::mutex mtx;
+        std::condition_variable cv;
+        size_t ncompleted{0};
+        for (auto& store : stores) {
+            store->append_async(sisl::io_blob{data.data(), static_cast< uint32_t >(data.size()), false}, nullptr,
+                                [&](logstore_seq_num_t, const sisl::io_blob&, logdev_key ld_key, void*) {
+                                    EXPECT_TRUE(ld_key.is_valid());
+                                    std::unique_lock< std::mutex > lk{mtx};
+                                    ++ncompleted;
+                                    cv.notify_one();
+                                });
+        }
+        std::unique_lock< std::mutex > lk{mtx};
+        cv.wait(lk, [&] { return (ncompleted == stores.size()); });
+    };
+
+    validate_device_truncation("before creating log stores");
+
+    LOGINFO("Step 1: Create {} log stores and append a record to each of them", nstores);
+    std::vector< std::shared_ptr< HomeLogStore > > stores;
+    for (uint32_t i{0}; i < nstores; ++i) {
+        stores.push_back(
+            logstore_service().create_new_log_store(LogStoreService::DATA_LOG_FAMILY_IDX, true /* append_mode */));
+    }
+    append_to(stores);
+    validate_device_truncation("after appends");
+
+    LOGINFO("Step 2: Truncate all the log stores in memory, so that all of them wait for device truncation");
+    for (auto& store : stores) {
+        store->truncate(0, true /* in_memory_truncate_only */);
+    }
+    validate_device_truncation("after in memory truncation");
+
+    LOGINFO("Step 3: Remove every other log store");
+    std::vector< std::shared_ptr< HomeLogStore > > remaining;
+    for (uint32_t i{0}; i < nstores; ++i) {
+        if (i % 2) {
+            remaining.push_back(stores[i]);
+        } else {
+            logstore_service().remove_log_store(LogStoreService::DATA_LOG_FAMILY_IDX, stores[i]->get_store_id());
+        }
+    }
+    stores.clear();
+    validate_device_truncation("after removal");
+
+    LOGINFO("Step 4: Restart homestore and validate the recovered log stores are back in the heap");
+    std::vector< logstore_id_t > remaining_ids;
+    for (auto& store : remaining) {
+        remaining_ids.push_back(store->get_store_id());
+        store.reset();
+    }
+    SampleDB::instance().on_restart_open([&remaining, &remaining_ids]() {
+        for (size_t i{0}; i < remaining_ids.size(); ++i) {
+            logstore_service().open_log_store(
+                LogStoreService::DATA_LOG_FAMILY_IDX, remaining_ids[i], true /* append_mode */,
+                [&remaining, i](std::shared_ptr< HomeLogStore > log_store) { remaining[i] = std::move(log_store); });
+        }
+    });
+    SampleDB::instance().start_homestore(true /* restart */);
+    SampleDB::instance().on_restart_open(nullptr);
+    family = logstore_service().data_log_family();
+    for (size_t i{0}; i < remaining.size(); ++i) {
+        ASSERT_TRUE(remaining[i]) << "Log store " << remaining_ids[i] << " is not reopened upon restart";
+    }
+    ASSERT_GT(family->truncation_heap(0).size(), 0u) << "Recovered log stores are expected to be in the heap";
+    validate_device_truncation("after restart");
+
+    LOGINFO("Step 5: Truncate the device and then append again to some of the log stores");
+    logstore_service().device_truncate(nullptr, true /* wait_till_done */);
+    validate_device_truncation("after device truncation");
+
+    std::vector< std::shared_ptr< HomeLogStore > > active;
+    for (uint32_t i{0}; i < remaining.size(); i += 4) {
+        active.push_back(remaining[i]);
+    }
+    append_to(active);
+    validate_device_truncation("after appends on idle log stores");
+
+    LOGINFO("Step 6: Truncate the log stores appended again one by one, along with the device");
+    for (auto& store : active) {
+        store->truncate(1);
+    }
+    validate_device_truncation("after truncation of log stores appended again");
+
+    for (auto& store : remaining) {
+        logstore_service().remove_log_store(LogStoreService::DATA_LOG_FAMILY_IDX, store->get_store_id());
+    }
+    validate_device_truncation("after removal of all log stores");
+}
+
+TEST_F(LogStoreTest, CreateManyLogStoresThenAppend) {
+    auto* family = logstore_service().data_log_family();
+    static constexpr uint32_t nstores{1000};
+
+    const auto validate_meta_persisted = [&family](const std::string& step) {
+        for (uint32_t shard_idx{0}; shard_idx < family->num_logdevs(); ++shard_idx) {
+            nlohmann::json js;
+            family->logdev(shard_idx).get_status(2, js);
+            ASSERT_FALSE(js["logdev_sb_persist_pending?"].get< bool >())
+                << "Log store reservations are not persisted on logdev shard " << shard_idx << " " << step;
+        }
+    };
+
+    LOGINFO("Step 1: Create {} log stores, whose reservations are persisted in batches", nstores);
+    Timer timer;
+    std::vector< std::shared_ptr< HomeLogStore > > stores;
+    for (uint32_t i{0}; i < nstores; ++i) {
+        stores.push_back(
+            logstore_service().create_new_log_store(LogStoreService::DATA_LOG_FAMILY_IDX, true /* append_mode */));
+    }
+    LOGINFO("Created {} log stores in {} seconds", nstores, timer.elapsed());
+
+    LOGINFO("Step 2: Validate all of them are registered with the logdev of their shard");
+    std::vector< std::set< logstore_id_t > > registered_ids(family->num_logdevs());
+    for (uint32_t shard_idx{0}; shard_idx < family->num_logdevs(); ++shard_idx) {
+        std::vector< logstore_id_t > reg_ids, garbage_ids;
+        family->logdev(shard_idx).get_registered_store_ids(reg_ids, garbage_ids);
+        registered_ids[shard_idx].insert(reg_ids.begin(), reg_ids.end());
+    }
+    for (const auto& store : stores) {
+        ASSERT_EQ(registered_ids[family->shard_of(store->get_store_id())].count(store->get_logdev_store_id()), 1u)
+            << "Log store " << store->get_store_id() << " is not registered with its logdev";
+    }
+
+    LOGINFO("Step 3: Trigger a CP flush and validate the batched reservations are persisted by then");
+    {
+        std::mutex mtx;
+        std::condition_variable cv;
+        bool cp_done{false};
+        hs()->cp_mgr().trigger_cp_flush(
+            [&](bool success) {
+                EXPECT_TRUE(success) << "CP flush failed";
+                std::unique_lock< std::mutex > lk{mtx};
+                cp_done = true;
+                cv.notify_one();
+            },
+            true /* force */);
+        std::unique_lock< std::mutex > lk{mtx};
+        cv.wait(lk, [&] { return cp_done; });
+    }
+    validate_meta_persisted("after CP flush");
+
+    LOGINFO("Step 4: Append to a log store of every shard and validate the batched reservations are persisted by then");
+    std::vector< uint8_t > data(64, 'x');
+    std::mutex mtx;
+    std::condition_variable cv;
+    uint32_t ncompleted{0};
+    const uint32_t nappends = 2 * family->num_logdevs();
+    for (uint32_t i{0}; i < nappends; ++i) {
+        stores[i]->append_async(sisl::io_blob{data.data(), static_cast< uint32_t >(data.size()), false}, nullptr,
+                                [&](logstore_seq_num_t, const sisl::io_blob&, logdev_key ld_key, void*) {
+                                    EXPECT_TRUE(ld_key.is_valid());
+                                    std::unique_lock< std::mutex > lk{mtx};
+                                    ++ncompleted;
+                                    cv.notify_one();
+                                });
+    }
+    {
+        std::unique_lock< std::mutex > lk{mtx};
+        cv.wait(lk, [&] { return (ncompleted == nappends); });
+    }
+    validate_meta_persisted("after appends");
+
+    LOGINFO("Step 5: Restart homestore and validate all the {} log stores are recovered", nstores);
+    std::vector< logstore_id_t > store_ids;
+    for (auto& store : stores) {
+        store_ids.push_back(store->get_store_id());
+        store.reset();
+    }
+    SampleDB::instance().on_restart_open([&stores, &store_ids]() {
+        for (size_t i{0}; i < store_ids.size(); ++i) {
+            logstore_service().open_log_store(
+                LogStoreService::DATA_LOG_FAMILY_IDX, store_ids[i], true /* append_mode */,
+                [&stores, i](std::shared_ptr< HomeLogStore > log_store) { stores[i] = std::move(log_store); });
+        }
+    });
+    SampleDB::instance().start_homestore(true /* restart */);
+    SampleDB::instance().on_restart_open(nullptr);
+    family = logstore_service().data_log_family();
+    for (size_t i{0}; i < stores.size(); ++i) {
+        ASSERT_TRUE(stores[i]) << "Log store " << store_ids[i] << " is not recovered upon restart";
+    }
+
+    LOGINFO("Step 6: Remove all the log stores");
+    for (auto& store : stores) {
+        logstore_service().remove_log_store(LogStoreService::DATA_LOG_FAMILY_IDX, store->get_store_id());
+    }
+}
+
+TEST_F(LogStoreTest, RollbackThenRestartWithBatchedMeta) {
+    LogStoreSettingsGuard settings{[](auto& ls) { ls.batch_meta_persist_on = true; }};
+    std::shared_ptr< HomeLogStore > tmp_log_store =
+        logstore_service().create_new_log_store(LogStoreService::DATA_LOG_FAMILY_IDX, true /* append_mode */);
+    const auto store_id = tmp_log_store->get_store_id();
+    static constexpr uint32_t nrecords{10};
+    static constexpr logstore_seq_num_t rollback_to_lsn{4};
+
+    LOGINFO("Step 1: Append {} records to a new log store", nrecords);
+    std::vector< uint8_t > data(64, 'x');
+    std::mutex mtx;
+    std::condition_variable cv;
+    uint32_t ncompleted{0};
+    for (uint32_t i{0}; i < nrecords; ++i) {
+        tmp_log_store->append_async(sisl::io_blob{data.data(), static_cast< uint32_t >(data.size()), false}, nullptr,
+                                    [&](logstore_seq_num_t, const sisl::io_blob&, logdev_key ld_key, void*) {
+                                        EXPECT_TRUE(ld_key.is_valid());
+                                        std::unique_lock< std::mutex > lk{mtx};
+                                        ++ncompleted;
+                                        cv.notify_one();
+                                    });
+    }
+    {
+        std::unique_lock< std::mutex > lk{mtx};
+        cv.wait(lk, [&] { return (ncompleted == nrecords); });
+    }
+
+    LOGINFO("Step 2: Rollback to lsn {} and validate the rollback is persisted by the time it completes",
+            rollback_to_lsn);
+    bool rollback_done{false};
+    bool persist_pending{true};
+    tmp_log_store->rollback_async(rollback_to_lsn, [&](logstore_seq_num_t to_lsn) {
+        EXPECT_EQ(to_lsn, rollback_to_lsn);
+        nlohmann::json js;
+        tmp_log_store->get_logdev().get_status(2, js);
+        std::unique_lock< std::mutex > lk{mtx};
+        persist_pending = js["logdev_sb_persist_pending?"].get< bool >();
+        rollback_done = true;
+        cv.notify_one();
+    });
+    {
+        std::unique_lock< std::mutex > lk{mtx};
+        cv.wait(lk, [&] { return rollback_done; });
+    }
+    ASSERT_FALSE(persist_pending) << "Rollback is completed before it is persisted";
+
+    LOGINFO("Step 3: Restart homestore and validate the log store and its rollback are recovered");
+    SampleDB::instance().on_restart_open([&]() {
+        logstore_service().open_log_store(
+            LogStoreService::DATA_LOG_FAMILY_IDX, store_id, true /* append_mode */,
+            [&tmp_log_store](std::shared_ptr< HomeLogStore > log_store) { tmp_log_store = std::move(log_store); });
+    });
+    tmp_log_store.reset();
+    SampleDB::instance().start_homestore(true /* restart */);
+    SampleDB::instance().on_restart_open(nullptr);
+    ASSERT_TRUE(tmp_log_store) << "Log store " << store_id << " is not recovered upon restart";
+    for (logstore_seq_num_t lsn{0}; lsn <= rollback_to_lsn; ++lsn) {
+        ASSERT_EQ(tmp_log_store->read_sync(lsn).size(), data.size()) << "Size mismatch for lsn=" << lsn;
+    }
+
+    LOGINFO("Step 4: Append after recovery and validate it continues right after the rolled back lsn");
+    ncompleted = 0;
+    const auto lsn =
+        tmp_log_store->append_async(sisl::io_blob{data.data(), static_cast< uint32_t >(data.size()), false}, nullptr,
+                                    [&](logstore_seq_num_t, const sisl::io_blob&, logdev_key, void*) {
+                                        std::unique_lock< std::mutex > lk{mtx};
+                                        ++ncompleted;
+                                        cv.notify_one();
+                                    });
+    ASSERT_EQ(lsn, rollback_to_lsn + 1) << "Rolled back lsns are recovered upon restart";
+    {
+        std::unique_lock< std::mutex > lk{mtx};
+        cv.wait(lk, [&] { return (ncompleted == 1); });
+    }
+
+    logstore_service().remove_log_store(LogStoreService::DATA_LOG_FAMILY_IDX, store_id);
+}
+
 SISL_OPTIONS_ENABLE(logging, test_log_store)
 SISL_OPTION_GROUP(test_log_store,
                   (num_threads, "", "num_threads", "number of threads",
@@ -13,15 +13,18 @@
  * specific language governing permissions and limitations under the License.
  *
  *********************************************************************************/
+#include <atomic>
 #include <chrono>
 #include <condition_variable>
 #include <cstdint>
+#include <cstring>
 #include <filesystem>
 #include <fstream>
 #include <map>
 #include <memory>
 #include <mutex>
 #include <random>
+#include <thread>
 
 #include <gtest/gtest.h>
 #include <iomgr/aio_drive_interface.hpp>
@@ -31,8 +34,12 @@
 #include <farmhash.h>
 
 #include <homestore/homestore.hpp>
+#include "device/device.h"
+#include "device/physical_dev.hpp"
 #include "device/virtual_dev.hpp"
 #include "device/journal_vdev.hpp"
+#include "common/homestore_config.hpp"
+#include "common/homestore_flip.hpp"
 #include "common/homestore_utils.hpp"
 
 using namespace homestore;
@@ -101,6 +108,7 @@ public:
     virtual void TearDown() override {
         m_vdev.reset();
         HomeStore::instance()->shutdown(true);
+        HomeStore::reset_instance();
         iomanager.stop();
     }
 
@@ -353,6 +361,618 @@ private:
 
 TEST_F(VDevIOTest, VDevIOTest) { this->execute(); }
 
+class VDevExpandTest : public ::testing::Test {
+public:
+    virtual void SetUp() override {
+        const auto ndevices = SISL_OPTIONS["num_devs"].as< uint32_t >();
+        m_dev_size = SISL_OPTIONS["dev_size_mb"].as< uint64_t >() * 1024 * 1024;
+
+        std::vector< dev_info > device_info;
+        for (uint32_t i{0}; i < ndevices; ++i) {
+            device_info.emplace_back(create_dev_file(i + 1), HSDevType::Data);
+        }
+
+        ioenvironment.with_iomgr(SISL_OPTIONS["num_threads"].as< uint32_t >(), SISL_OPTIONS["spdk"].as< bool >());
+
+        hs_input_params params;
+        params.app_mem_size = ((ndevices * m_dev_size) * 15) / 100;
+        params.data_devices = device_info;
+        HomeStore::instance()->with_params(params).with_meta_service(15.0).init(true /* wait_for_init */);
+
+        m_vdev = std::make_unique< VirtualDev >(hs()->device_mgr(), "test_expand_vdev", PhysicalDevGroup::DATA,
+                                                blk_allocator_type_t::varsize, (m_dev_size * ndevices * 20) / 100,
+                                                0 /* nmirror */, true /* is_stripe */, 4096 /* blk_size */, nullptr, 0);
+    }
+
+    virtual void TearDown() override {
+        m_vdev.reset();
+        HomeStore::instance()->shutdown(true);
+        HomeStore::reset_instance();
+        iomanager.stop();
+        for (const auto& f : m_dev_files) {
+            std::filesystem::remove(f);
+        }
+    }
+
+    std::string create_dev_file(uint32_t n) {
+        const std::filesystem::path fpath{"/tmp/test_vdev_expand_" + std::to_string(n)};
+        std::ofstream ofs{fpath.string(), std::ios::binary | std::ios::out};
+        std::filesystem::resize_file(fpath, m_dev_size);
+        m_dev_files.push_back(fpath.string());
+        return std::filesystem::canonical(fpath).string();
+    }
+
+protected:
+    uint64_t m_dev_size{0};
+    std::vector< std::string > m_dev_files;
+    std::unique_ptr< VirtualDev > m_vdev;
+};
+
+TEST_F(VDevExpandTest, ExpandOnNewDevice) {
+    const auto size_before = m_vdev->size();
+    LOGINFO("Step 1: Expand without any new device should not add any chunk");
+    ASSERT_EQ(m_vdev->expand(size_before), 0);
+
+    LOGINFO("Step 2: Add a new device and expand the vdev on it");
+    auto* new_pdev = hs()->device_mgr()->add_device(
+        dev_info{create_dev_file(SISL_OPTIONS["num_devs"].as< uint32_t >() + 1), HSDevType::Data});
+    ASSERT_NE(new_pdev, nullptr);
+    const auto added = m_vdev->expand(size_before, true /* rebalance */);
+    ASSERT_GE(added, size_before);
+    ASSERT_EQ(m_vdev->size(), size_before + added);
+
+    LOGINFO("Step 3: Allocate and do IO, new device is expected to get its share of allocations");
+    constexpr uint32_t io_size{4096};
+    auto* wbuf = iomanager.iobuf_alloc(dma_alignment, io_size);
+    auto* rbuf = iomanager.iobuf_alloc(dma_alignment, io_size);
+    uint32_t new_pdev_allocs{0};
+    std::vector< BlkId > bids;
+    for (uint32_t i{0}; i < 100; ++i) {
+        ASSERT_EQ(m_vdev->alloc_blk(1, blk_alloc_hints{}, bids), BlkAllocStatus::SUCCESS);
+        const auto& bid = bids.back();
+        if (hs()->device_mgr()->get_chunk(bid.get_chunk_num())->physical_dev() != new_pdev) { continue; }
+
+        ++new_pdev_allocs;
+        std::memset(wbuf, i, io_size);
+        ASSERT_EQ(m_vdev->sync_write(r_cast< const char* >(wbuf), io_size, bid), s_cast< ssize_t >(io_size));
+        ASSERT_EQ(m_vdev->sync_read(r_cast< char* >(rbuf), io_size, bid), s_cast< ssize_t >(io_size));
+        ASSERT_EQ(std::memcmp(wbuf, rbuf, io_size), 0) << "Data mismatch on blk " << bid.to_string();
+    }
+    ASSERT_GT(new_pdev_allocs, 0) << "No allocation went to the new device";
+
+    for (const auto& bid : bids) {
+        m_vdev->free_blk(bid);
+    }
+    iomanager.iobuf_free(wbuf);
+    iomanager.iobuf_free(rbuf);
+}
+
+TEST_F(VDevExpandTest, FormatFromReactor) {
+    constexpr uint32_t io_size{4096};
+    auto* wbuf = iomanager.iobuf_alloc(dma_alignment, io_size);
+    auto* rbuf = iomanager.iobuf_alloc(dma_alignment, io_size);
+    std::memset(wbuf, 0xcd, io_size);
+    BlkId bid;
+    ASSERT_EQ(m_vdev->alloc_contiguous_blk(1, blk_alloc_hints{}, &bid), BlkAllocStatus::SUCCESS);
+    ASSERT_EQ(m_vdev->sync_write(r_cast< const char* >(wbuf), io_size, bid), s_cast< ssize_t >(io_size));
+
+    LOGINFO("Step 1: Format issued from a reactor should complete on that reactor, with the data zeroed");
+    std::mutex mtx;
+    std::condition_variable cv;
+    bool done{false};
+    bool same_thread{false};
+    std::error_condition format_err;
+    iomanager.run_on(iomgr::thread_regex::random_worker, [&](iomgr::io_thread_addr_t) {
+        auto const issuer = iomanager.iothread_self();
+        m_vdev->async_format([&, issuer](std::error_condition err, void*) {
+            std::unique_lock< std::mutex > lk{mtx};
+            format_err = err;
+            same_thread = (iomanager.iothread_self() == issuer);
+            done = true;
+            cv.notify_one();
+        });
+    });
+    {
+        std::unique_lock< std::mutex > lk{mtx};
+        cv.wait(lk, [&done] { return done; });
+    }
+    ASSERT_FALSE(format_err) << "Format failed with error " << format_err.message();
+    ASSERT_TRUE(same_thread) << "Format completed on a different reactor";
+    ASSERT_EQ(m_vdev->sync_read(r_cast< char* >(rbuf), io_size, bid), s_cast< ssize_t >(io_size));
+    std::memset(wbuf, 0, io_size);
+    ASSERT_EQ(std::memcmp(wbuf, rbuf, io_size), 0) << "Blk is not zeroed by the format";
+
+    m_vdev->free_blk(bid);
+    iomanager.iobuf_free(wbuf);
+    iomanager.iobuf_free(rbuf);
+}
+
+class VDevDiscardTest : public VDevExpandTest {
+public:
+    virtual void SetUp() override {
+        VDevExpandTest::SetUp();
+        m_prev_discard_enabled = HS_DYNAMIC_CONFIG(device->discard_enabled);
+        m_prev_min_discard_size = HS_DYNAMIC_CONFIG(device->min_discard_size);
+        m_prev_max_discard_bytes = HS_DYNAMIC_CONFIG(device->max_discard_bytes_per_batch);
+        HS_SETTINGS_FACTORY().modifiable_settings([](auto& s) {
+            s.device.discard_enabled = true;
+            s.device.min_discard_size = blk_size;
+            s.device.max_discard_bytes_per_batch = max_discard_bytes;
+        });
+        HS_SETTINGS_FACTORY().save();
+    }
+
+    virtual void TearDown() override {
+        HS_SETTINGS_FACTORY().modifiable_settings([this](auto& s) {
+            s.device.discard_enabled = m_prev_discard_enabled;
+            s.device.min_discard_size = m_prev_min_discard_size;
+            s.device.max_discard_bytes_per_batch = m_prev_max_discard_bytes;
+        });
+        HS_SETTINGS_FACTORY().save();
+        VDevExpandTest::TearDown();
+    }
+
+    // Allocates nblks sized blkids with a gap in between, so that the freed ones are not coalesced into one extent
+    std::vector< BlkId > alloc_and_write(uint32_t count, blk_count_t nblks) {
+        std::vector< BlkId > bids;
+        auto* wbuf = iomanager.iobuf_alloc(dma_alignment, nblks * blk_size);
+        std::memset(wbuf, 0xab, nblks * blk_size);
+        for (uint32_t i{0}; i < 2 * count; ++i) {
+            BlkId bid;
+            EXPECT_EQ(m_vdev->alloc_contiguous_blk(nblks, blk_alloc_hints{}, &bid), BlkAllocStatus::SUCCESS);
+            if (i % 2) {
+                m_gap_bids.push_back(bid);
+                continue;
+            }
+            EXPECT_EQ(m_vdev->sync_write(r_cast< const char* >(wbuf), nblks * blk_size, bid),
+                      s_cast< ssize_t >(nblks * blk_size));
+            bids.push_back(bid);
+        }
+        iomanager.iobuf_free(wbuf);
+        return bids;
+    }
+
+    // Waits for the discard thread to finish the batch, which reduces the backlog below the given count
+    uint64_t wait_for_backlog_below(uint64_t nblks) {
+        auto const start = Clock::now();
+        auto backlog = m_vdev->discard_backlog_blks();
+        while ((backlog >= nblks) && (get_elapsed_time_sec(start) < 30)) {
+            std::this_thread::sleep_for(std::chrono::milliseconds{10});
+            backlog = m_vdev->discard_backlog_blks();
+        }
+        return backlog;
+    }
+
+    bool is_discarded(const BlkId& bid) {
+        // Discard on a file backed device punches a hole, which reads back as zeros
+        std::vector< uint8_t > zeros(bid.get_nblks() * blk_size, 0);
+        auto* rbuf = iomanager.iobuf_alloc(dma_alignment, zeros.size());
+        m_vdev->sync_read(r_cast< char* >(rbuf), zeros.size(), bid);
+        bool const ret = (std::memcmp(rbuf, zeros.data(), zeros.size()) == 0);
+        iomanager.iobuf_free(rbuf);
+        return ret;
+    }
+
+    void free_gap_bids() {
+        for (const auto& bid : m_gap_bids) {
+            m_vdev->free_blk(bid);
+        }
+        m_gap_bids.clear();
+    }
+
+protected:
+    static constexpr uint32_t blk_size{4096};
+    static constexpr uint64_t max_discard_bytes{16 * blk_size};
+
+    std::vector< BlkId > m_gap_bids;
+    bool m_prev_discard_enabled;
+    uint64_t m_prev_min_discard_size;
+    uint64_t m_prev_max_discard_bytes;
+};
+
+TEST_F(VDevDiscardTest, DeferOverLimitToNextBatch) {
+    constexpr uint32_t nblks_per_bid{4};
+    constexpr uint32_t count{32};
+    auto const bids = alloc_and_write(count, nblks_per_bid);
+
+    LOGINFO("Step 1: Free blks with discard, they should not be freed until flush_discards is called");
+    for (const auto& bid : bids) {
+        m_vdev->free_blk_with_discard(bid);
+    }
+    uint64_t backlog = count * nblks_per_bid;
+    ASSERT_EQ(m_vdev->discard_backlog_blks(), backlog);
+    for (const auto& bid : bids) {
+        ASSERT_TRUE(m_vdev->is_blk_alloced(bid)) << "Blk " << bid.to_string() << " freed before its discard";
+    }
+
+    LOGINFO("Step 2: Flush the discards batch by batch, each batch should discard upto the limit and defer the rest");
+    uint32_t nbatches{0};
+    while (backlog != 0) {
+        m_vdev->flush_discards();
+        auto const new_backlog = wait_for_backlog_below(backlog);
+        ASSERT_LT(new_backlog, backlog) << "Discard batch did not make progress";
+        ASSERT_LE((backlog - new_backlog) * blk_size, max_discard_bytes) << "Discard batch exceeded the limit";
+        backlog = new_backlog;
+        ++nbatches;
+    }
+    ASSERT_GE(nbatches, (count * nblks_per_bid * blk_size) / max_discard_bytes);
+
+    LOGINFO("Step 3: All blks are freed after {} batches, validate they are discarded", nbatches);
+    auto const* pdev = hs()->device_mgr()->get_chunk(bids[0].get_chunk_num())->physical_dev();
+    bool const discard_supported = pdev->is_discard_supported();
+    for (const auto& bid : bids) {
+        ASSERT_FALSE(m_vdev->is_blk_alloced(bid)) << "Blk " << bid.to_string() << " not freed after its discard";
+        if (discard_supported) { ASSERT_TRUE(is_discarded(bid)) << "Blk " << bid.to_string() << " not discarded"; }
+    }
+    free_gap_bids();
+}
+
+TEST_F(VDevDiscardTest, DrainOnStop) {
+    constexpr uint32_t nblks_per_bid{4};
+    constexpr uint32_t count{32};
+    auto const flushed_bids = alloc_and_write(count, nblks_per_bid);
+    auto const unflushed_bids = alloc_and_write(count, nblks_per_bid);
+
+    LOGINFO("Step 1: Free blks with discard and flush only the first half");
+    for (const auto& bid : flushed_bids) {
+        m_vdev->free_blk_with_discard(bid);
+    }
+    m_vdev->flush_discards();
+    for (const auto& bid : unflushed_bids) {
+        m_vdev->free_blk_with_discard(bid);
+    }
+
+    LOGINFO("Step 2: Drain should discard all flushed blks ignoring the limit, but leave the unflushed ones");
+    m_vdev->drain_discards();
+    ASSERT_EQ(m_vdev->discard_backlog_blks(), count * nblks_per_bid);
+    for (const auto& bid : flushed_bids) {
+        ASSERT_FALSE(m_vdev->is_blk_alloced(bid)) << "Flushed blk " << bid.to_string() << " not freed on drain";
+    }
+    for (const auto& bid : unflushed_bids) {
+        ASSERT_TRUE(m_vdev->is_blk_alloced(bid)) << "Unflushed blk " << bid.to_string() << " discarded on drain";
+    }
+
+    LOGINFO("Step 3: Flush after drain should not restart the discard thread");
+    m_vdev->flush_discards();
+    std::this_thread::sleep_for(std::chrono::milliseconds{100});
+    ASSERT_EQ(m_vdev->discard_backlog_blks(), count * nblks_per_bid);
+    free_gap_bids();
+}
+
+TEST_F(VDevDiscardTest, FlushOnlyTheSwitchedOverCP) {
+    constexpr uint32_t nblks_per_bid{4};
+    constexpr uint32_t count{4}; // Blks of each cp fit in one discard batch
+    auto const prev_cp_bids = alloc_and_write(count, nblks_per_bid);
+    auto const next_cp_bids = alloc_and_write(count, nblks_per_bid);
+
+    LOGINFO("Step 1: Free blks in a cp and take them out on its switchover, then free more blks in the next cp");
+    for (const auto& bid : prev_cp_bids) {
+        m_vdev->free_blk_with_discard(bid);
+    }
+    auto prev_cp_blks = m_vdev->take_pending_discards();
+    for (const auto& bid : next_cp_bids) {
+        m_vdev->free_blk_with_discard(bid);
+    }
+
+    LOGINFO("Step 2: Flush the blks of the switched over cp, blks of the next cp should be left as is");
+    m_vdev->flush_discards(std::move(prev_cp_blks));
+    ASSERT_EQ(wait_for_backlog_below((count * nblks_per_bid) + 1), count * nblks_per_bid);
+    for (const auto& bid : prev_cp_bids) {
+        ASSERT_FALSE(m_vdev->is_blk_alloced(bid)) << "Blk " << bid.to_string() << " of committed cp not freed";
+    }
+    for (const auto& bid : next_cp_bids) {
+        ASSERT_TRUE(m_vdev->is_blk_alloced(bid)) << "Blk " << bid.to_string() << " of next cp freed before commit";
+    }
+
+    m_vdev->flush_discards();
+    ASSERT_EQ(wait_for_backlog_below(1), 0u);
+    free_gap_bids();
+}
+
+class VDevHedgedReadTest : public VDevExpandTest {
+public:
+    virtual void SetUp() override {
+        VDevExpandTest::SetUp();
+        m_vdev = std::make_unique< VirtualDev >(hs()->device_mgr(), vdev_name, PhysicalDevGroup::DATA,
+                                                blk_allocator_type_t::varsize, (m_dev_size * 20) / 100, 1 /* nmirror */,
+                                                true /* is_stripe */, io_size, nullptr, 0);
+        m_prev_hedge_threshold_us = HS_DYNAMIC_CONFIG(device->read_hedge_threshold_us);
+        HS_SETTINGS_FACTORY().modifiable_settings(
+            [](auto& s) { s.device.read_hedge_threshold_us = hedge_threshold_us; });
+        HS_SETTINGS_FACTORY().save();
+
+        m_wbuf = iomanager.iobuf_alloc(dma_alignment, io_size);
+        m_rbuf = iomanager.iobuf_alloc(dma_alignment, io_size);
+        std::memset(m_wbuf, 0xcd, io_size);
+        ASSERT_EQ(m_vdev->alloc_contiguous_blk(1, blk_alloc_hints{}, &m_bid), BlkAllocStatus::SUCCESS);
+        ASSERT_EQ(m_vdev->sync_write(r_cast< const char* >(m_wbuf), io_size, m_bid), s_cast< ssize_t >(io_size));
+    }
+
+    virtual void TearDown() override {
+        m_vdev->free_blk(m_bid);
+        iomanager.iobuf_free(m_wbuf);
+        iomanager.iobuf_free(m_rbuf);
+        HS_SETTINGS_FACTORY().modifiable_settings(
+            [this](auto& s) { s.device.read_hedge_threshold_us = m_prev_hedge_threshold_us; });
+        HS_SETTINGS_FACTORY().save();
+        VDevExpandTest::TearDown();
+    }
+
+    // Reads the blk asynchronously, from a worker reactor if on_reactor is set, else from this thread, and validates
+    // that it is completed on the thread it is issued from.
+    void read_and_validate(bool on_reactor) {
+        std::mutex mtx;
+        std::condition_variable cv;
+        bool done{false};
+        std::error_condition read_err;
+        bool same_thread{false};
+
+        std::memset(m_rbuf, 0, io_size);
+        auto issue_read = [&]() {
+            auto const issuer = std::this_thread::get_id();
+            m_vdev->async_read(r_cast< char* >(m_rbuf), io_size, m_bid, [&, issuer](std::error_condition err, void*) {
+                std::unique_lock< std::mutex > lk{mtx};
+                read_err = err;
+                same_thread = (std::this_thread::get_id() == issuer);
+                done = true;
+                cv.notify_one();
+            });
+        };
+        if (on_reactor) {
+            iomanager.run_on(iomgr::thread_regex::random_worker, [&](iomgr::io_thread_addr_t) { issue_read(); });
+        } else {
+            issue_read();
+        }
+
+        std::unique_lock< std::mutex > lk{mtx};
+        cv.wait(lk, [&done] { return done; });
+        ASSERT_FALSE(read_err) << "Read failed with error " << read_err.message();
+        if (on_reactor) { ASSERT_TRUE(same_thread) << "Read completed on a different reactor"; }
+        ASSERT_EQ(std::memcmp(m_wbuf, m_rbuf, io_size), 0) << "Data mismatch";
+    }
+
+    static uint64_t vdev_counter(const std::string& desc) {
+        auto const j = sisl::MetricsFarm::getInstance().get_result_in_json();
+        return j["VirtualDev"][vdev_name]["Counters"][desc].get< uint64_t >();
+    }
+
+    static uint64_t hedged_count() { return vdev_counter("vdev reads reissued on another copy after hedge threshold"); }
+    static uint64_t hedged_won_count() {
+        return vdev_counter("vdev reads completed by a hedged copy before the first copy");
+    }
+
+protected:
+    static constexpr const char* vdev_name{"test_hedged_vdev"};
+    static constexpr uint32_t io_size{4096};
+    static constexpr uint64_t hedge_threshold_us{2000};
+
+    uint64_t m_prev_hedge_threshold_us;
+    uint8_t* m_wbuf{nullptr};
+    uint8_t* m_rbuf{nullptr};
+    BlkId m_bid;
+};
+
+TEST_F(VDevHedgedReadTest, HedgeOnDelayedCopy) {
+    LOGINFO("Step 1: Read which completes within the threshold should not be hedged");
+    auto hedged_before = hedged_count();
+    read_and_validate(true /* on_reactor */);
+    std::this_thread::sleep_for(std::chrono::microseconds{10 * hedge_threshold_us});
+    ASSERT_EQ(hedged_count(), hedged_before) << "Hedge timer not cancelled after the read is completed";
+
+    LOGINFO("Step 2: Read issued from a non reactor thread should be done without hedging");
+    read_and_validate(false /* on_reactor */);
+    ASSERT_EQ(hedged_count(), hedged_before);
+
+#ifdef _PRERELEASE
+    flip::FlipClient* fc = HomeStoreFlip::client_instance();
+    flip::FlipFrequency freq;
+    freq.set_count(1);
+    freq.set_percent(100);
+    flip::FlipCondition dont_care_cond;
+    fc->create_condition("", flip::Operator::DONT_CARE, (int)1, &dont_care_cond);
+
+    LOGINFO("Step 3: Delay the first read well beyond the threshold, a hedged read should be issued on the mirror");
+    auto const won_before = hedged_won_count();
+    fc->inject_delay_flip("simulate_pdev_delay", {dont_care_cond, dont_care_cond}, freq, 200000 /* 200ms */);
+    auto const start = std::chrono::steady_clock::now();
+    read_and_validate(true /* on_reactor */);
+    ASSERT_LT(std::chrono::steady_clock::now() - start, std::chrono::milliseconds{200})
+        << "Caller is not completed by the hedged read, it waited for the delayed read";
+    ASSERT_EQ(hedged_count(), hedged_before + 1) << "Hedged read not issued for a delayed read";
+    ASSERT_EQ(hedged_won_count(), won_before + 1) << "Hedged read did not complete before the delayed read";
+    hedged_before = hedged_count();
+
+    LOGINFO("Step 4: Fail the first read, it should fail over to the mirror and return its data");
+    fc->inject_noreturn_flip("io_read_comp_error_flip", {}, freq);
+    read_and_validate(true /* on_reactor */);
+    ASSERT_EQ(hedged_count(), hedged_before) << "Failover should not wait for the hedge timer";
+#endif
+}
+
+class VDevQDepthTest : public VDevExpandTest {
+public:
+    virtual void SetUp() override {
+        VDevExpandTest::SetUp();
+        m_prev_target_latency_us = HS_DYNAMIC_CONFIG(device->qdepth_target_latency_us);
+        m_prev_qdepth_min = HS_DYNAMIC_CONFIG(device->qdepth_min);
+        m_prev_qdepth_max = HS_DYNAMIC_CONFIG(device->qdepth_max);
+        HS_SETTINGS_FACTORY().modifiable_settings([](auto& s) {
+            s.device.qdepth_target_latency_us = target_latency_us;
+            s.device.qdepth_min = qdepth_min;
+            s.device.qdepth_max = qdepth_max;
+        });
+        HS_SETTINGS_FACTORY().save();
+
+        // A device which is not part of any vdev, so that no other IO goes through its queue depth
+        m_pdev = hs()->device_mgr()->add_device(
+            dev_info{create_dev_file(SISL_OPTIONS["num_devs"].as< uint32_t >() + 1), HSDevType::Data});
+        ASSERT_NE(m_pdev, nullptr);
+    }
+
+    virtual void TearDown() override {
+        HS_SETTINGS_FACTORY().modifiable_settings([this](auto& s) {
+            s.device.qdepth_target_latency_us = m_prev_target_latency_us;
+            s.device.qdepth_min = m_prev_qdepth_min;
+            s.device.qdepth_max = m_prev_qdepth_max;
+        });
+        HS_SETTINGS_FACTORY().save();
+        VDevExpandTest::TearDown();
+    }
+
+    // Admits n IOs and returns how many of them are admitted right away. The rest are queued and counted in
+    // m_dispatched when they are issued by a completion.
+    uint32_t admit(uint32_t n) {
+        uint32_t admitted{0};
+        for (uint32_t i{0}; i < n; ++i) {
+            if (m_pdev->qd_admit([this]() { return [this]() { ++m_dispatched; }; })) { ++admitted; }
+        }
+        return admitted;
+    }
+
+    void complete(uint32_t n, uint64_t latency_us, bool adjust_limit = true) {
+        for (uint32_t i{0}; i < n; ++i) {
+            m_pdev->qd_on_completion(latency_us, adjust_limit);
+        }
+    }
+
+    // Runs one full window of IOs at the current limit with the given latency and returns the new limit
+    uint32_t run_window(uint64_t latency_us) {
+        auto const limit = m_pdev->qd_limit();
+        EXPECT_EQ(admit(limit), limit) << "IOs within the limit are expected to be admitted right away";
+        complete(limit, latency_us);
+        return m_pdev->qd_limit();
+    }
+
+protected:
+    static constexpr uint64_t target_latency_us{1000};
+    static constexpr uint32_t qdepth_min{4};
+    static constexpr uint32_t qdepth_max{16};
+    static constexpr uint64_t fast_latency_us{target_latency_us / 10};
+    static constexpr uint64_t slow_latency_us{target_latency_us * 10};
+
+    uint64_t m_prev_target_latency_us;
+    uint32_t m_prev_qdepth_min;
+    uint32_t m_prev_qdepth_max;
+    PhysicalDev* m_pdev{nullptr};
+    uint32_t m_dispatched{0};
+};
+
+TEST_F(VDevQDepthTest, WindowShrinkAndGrow) {
+    LOGINFO("Step 1: Limit starts at the max queue depth and does not grow beyond it");
+    ASSERT_EQ(m_pdev->qd_limit(), qdepth_max);
+    ASSERT_EQ(run_window(fast_latency_us), qdepth_max);
+
+    LOGINFO("Step 2: Limit is not adjusted before a full window of completions is seen");
+    ASSERT_EQ(admit(qdepth_max), qdepth_max);
+    complete(qdepth_max - 1, slow_latency_us);
+    ASSERT_EQ(m_pdev->qd_limit(), qdepth_max);
+    complete(1, slow_latency_us);
+    ASSERT_EQ(m_pdev->qd_limit(), qdepth_max / 2) << "Limit is expected to be halved once per window";
+
+    LOGINFO("Step 3: Completions which do not adjust the limit (errors) are not part of the window");
+    ASSERT_EQ(admit(qdepth_max / 2), qdepth_max / 2);
+    complete(qdepth_max / 2, slow_latency_us, false /* adjust_limit */);
+    ASSERT_EQ(m_pdev->qd_limit(), qdepth_max / 2);
+
+    LOGINFO("Step 4: Limit keeps halving with slow windows, but not below the min queue depth");
+    ASSERT_EQ(run_window(slow_latency_us), qdepth_min);
+    ASSERT_EQ(run_window(slow_latency_us), qdepth_min);
+
+    LOGINFO("Step 5: Window whose average latency is within target grows the limit by one, despite a slower IO");
+    ASSERT_EQ(admit(qdepth_min), qdepth_min);
+    complete(qdepth_min - 1, fast_latency_us);
+    complete(1, target_latency_us * 2);
+    ASSERT_EQ(m_pdev->qd_limit(), qdepth_min + 1);
+
+    LOGINFO("Step 6: Limit grows additively back to the max queue depth with fast windows");
+    for (auto expected = qdepth_min + 2; expected <= qdepth_max; ++expected) {
+        ASSERT_EQ(run_window(fast_latency_us), expected);
+    }
+    ASSERT_EQ(run_window(fast_latency_us), qdepth_max);
+    ASSERT_EQ(m_dispatched, 0u) << "No IO is expected to be queued when IOs stay within the limit";
+}
+
+TEST_F(VDevQDepthTest, AdmitUnderSaturation) {
+    constexpr uint32_t nqueued{10};
+
+    LOGINFO("Step 1: IOs up to the limit are admitted, rest are queued without being dispatched");
+    ASSERT_EQ(admit(qdepth_max), qdepth_max);
+    ASSERT_EQ(admit(nqueued), 0u);
+    ASSERT_EQ(m_dispatched, 0u);
+
+    LOGINFO("Step 2: Each completion dispatches one queued IO in its place");
+    complete(4, fast_latency_us, false /* adjust_limit */);
+    ASSERT_EQ(m_dispatched, 4u);
+    ASSERT_EQ(admit(1), 0u) << "New IO is expected to be queued behind the waiting ones";
+
+    LOGINFO("Step 3: Completing all outstanding IOs dispatches every queued IO");
+    complete(qdepth_max, fast_latency_us, false /* adjust_limit */);
+    ASSERT_EQ(m_dispatched, nqueued + 1);
+    auto const outstanding = (qdepth_max + nqueued + 1) - (4 + qdepth_max);
+    complete(outstanding, fast_latency_us, false /* adjust_limit */);
+
+    LOGINFO("Step 4: Slow window shrinks the limit, queued IOs are dispatched only within the new limit");
+    m_dispatched = 0;
+    ASSERT_EQ(admit(qdepth_max), qdepth_max);
+    ASSERT_EQ(admit(qdepth_max), 0u);
+    complete(qdepth_max, slow_latency_us);
+    ASSERT_EQ(m_pdev->qd_limit(), qdepth_max / 2);
+    // Completions before the window ended replaced themselves with a queued IO, the last one must not
+    ASSERT_EQ(m_dispatched, qdepth_max - 1);
+    ASSERT_EQ(admit(1), 0u) << "IO is expected to be queued while outstanding IOs are above the new limit";
+
+    LOGINFO("Step 5: Queued IOs are dispatched only once the outstanding IOs fall below the new limit");
+    complete(qdepth_max - 1 - (qdepth_max / 2), fast_latency_us, false /* adjust_limit */);
+    ASSERT_EQ(m_dispatched, qdepth_max - 1) << "Queued IO dispatched while outstanding IOs are at the new limit";
+    complete(1, fast_latency_us, false /* adjust_limit */);
+    ASSERT_EQ(m_dispatched, qdepth_max);
+    complete(1, fast_latency_us, false /* adjust_limit */);
+    ASSERT_EQ(m_dispatched, qdepth_max + 1);
+}
+
+TEST_F(VDevQDepthTest, ConcurrentAdmitAndComplete) {
+    constexpr uint32_t nthreads{4};
+    constexpr uint32_t ios_per_thread{10000};
+    std::atomic< uint32_t > admitted{0};
+    std::atomic< uint32_t > queued_dispatched{0};
+    std::atomic< uint32_t > to_complete{0}; // Queued IOs which are dispatched and not completed yet
+
+    LOGINFO("Step 1: Admit and complete IOs from {} threads, queued IOs are completed by whoever sees them", nthreads);
+    auto const complete_dispatched = [&]() {
+        auto n = to_complete.load();
+        while ((n > 0) && !to_complete.compare_exchange_weak(n, n - 1)) {}
+        if (n > 0) { m_pdev->qd_on_completion(fast_latency_us, false /* adjust_limit */); }
+    };
+    std::vector< std::thread > threads;
+    for (uint32_t t{0}; t < nthreads; ++t) {
+        threads.emplace_back([&]() {
+            for (uint32_t i{0}; i < ios_per_thread; ++i) {
+                if (m_pdev->qd_admit([&]() {
+                        return [&]() {
+                            queued_dispatched.fetch_add(1);
+                            to_complete.fetch_add(1);
+                        };
+                    })) {
+                    admitted.fetch_add(1);
+                    m_pdev->qd_on_completion(fast_latency_us, false /* adjust_limit */);
+                }
+                complete_dispatched();
+            }
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    while (to_complete.load() > 0) {
+        complete_dispatched();
+    }
+
+    LOGINFO("Step 2: Every IO is expected to be admitted or dispatched and no admitted IO left outstanding");
+    ASSERT_EQ(admitted.load() + queued_dispatched.load(), nthreads * ios_per_thread) << "Queued IO is stranded";
+    ASSERT_EQ(admit(qdepth_max), qdepth_max) << "Outstanding IOs are not accounted back on completion";
+    complete(qdepth_max, fast_latency_us, false /* adjust_limit */);
+}
+
 SISL_OPTION_GROUP(
     test_vdev,
     (truncate_watermark_percentage, "", "truncate_watermark_percentage",
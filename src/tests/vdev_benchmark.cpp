@@ -0,0 +1,287 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#include <condition_variable>
+#include <cstdint>
+#include <ctime>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <iomgr/io_environment.hpp>
+#include <sisl/logging/logging.h>
+#include <sisl/options/options.h>
+
+#include <homestore/homestore.hpp>
+#include <homestore/homestore_decl.hpp>
+#include "common/homestore_assert.hpp"
+#include "common/homestore_config.hpp"
+#include "device/virtual_dev.hpp"
+
+using namespace homestore;
+
+RCU_REGISTER_INIT
+SISL_LOGGING_INIT(HOMESTORE_LOG_MODS)
+
+static const std::string VDEV_BENCH_FILE_PREFIX{"/tmp/vdev_benchmark_"};
+
+/* Benchmarks the vdev write path directly without data service.
+ * write_latency: latency of a single async write (qdepth 1) on a vdev with no mirror against a vdev with mirrors,
+ * where all the copies are written in parallel.
+ * stripe_throughput: throughput of a single stream of large writes (qdepth 1) split into stripe units on 1 to
+ * max_stripe_devs drives.
+ * small_write_iops: small writes issued qdepth at a time on preallocated blks, so that the per IO cost of vdev (request
+ * context, callback) dominates over the blk allocation.
+ *
+ * Each of them also reports the process cpu time spent per IO (cpu_us_per_io), which includes the reactor threads.
+ */
+class VDevBench {
+public:
+    VDevBench(const VDevBench&) = delete;
+    VDevBench& operator=(const VDevBench&) = delete;
+    VDevBench(VDevBench&&) noexcept = delete;
+    VDevBench& operator=(VDevBench&&) noexcept = delete;
+    ~VDevBench() = default;
+
+    static VDevBench& instance() {
+        static VDevBench inst;
+        return inst;
+    }
+
+    void start_homestore(const uint32_t ndevices, const uint32_t nmirror, const uint32_t io_size) {
+        const auto dev_size = SISL_OPTIONS["dev_size_mb"].as< uint64_t >() * 1024 * 1024;
+        const auto nthreads = SISL_OPTIONS["num_threads"].as< uint32_t >();
+
+        std::vector< dev_info > device_info;
+        LOGINFO("creating {} device files with each of size {} ", ndevices, in_bytes(dev_size));
+        for (uint32_t i{0}; i < ndevices; ++i) {
+            const std::filesystem::path fpath{VDEV_BENCH_FILE_PREFIX + std::to_string(i + 1)};
+            std::ofstream ofs{fpath.string(), std::ios::binary | std::ios::out};
+            std::filesystem::resize_file(fpath, dev_size);
+            device_info.emplace_back(std::filesystem::canonical(fpath).string(), HSDevType::Data);
+        }
+        m_ndevices = ndevices;
+
+        LOGINFO("Starting iomgr with {} threads, spdk: {}", nthreads, SISL_OPTIONS["spdk"].as< bool >());
+        ioenvironment.with_iomgr(nthreads, SISL_OPTIONS["spdk"].as< bool >());
+
+        hs_input_params params;
+        params.app_mem_size = ((ndevices * dev_size) * 15) / 100;
+        params.data_devices = device_info;
+        HomeStore::instance()->with_params(params).with_meta_service(5.0).init(true /* wait_for_init */);
+
+        m_vdev = std::make_unique< VirtualDev >(hs()->device_mgr(), "bench_vdev", PhysicalDevGroup::DATA,
+                                                blk_allocator_type_t::varsize,
+                                                (dev_size * ndevices * 30) / (100 * (nmirror + 1)), nmirror,
+                                                true /* is_stripe */, 4096 /* blk_size */, nullptr, 0);
+
+        m_io_size = io_size;
+        m_buf = iomanager.iobuf_alloc(512, m_io_size);
+        std::memset(m_buf, 0xab, m_io_size);
+    }
+
+    void shutdown() {
+        iomanager.iobuf_free(m_buf);
+        m_vdev.reset();
+        HomeStore::instance()->shutdown();
+        HomeStore::reset_instance();
+        iomanager.stop();
+
+        for (uint32_t i{0}; i < m_ndevices; ++i) {
+            std::filesystem::remove(VDEV_BENCH_FILE_PREFIX + std::to_string(i + 1));
+        }
+    }
+
+    // Allocates blks for one io (split into stripe units if configured), writes all of them in parallel and waits for
+    // all of them to be written
+    void write_one() {
+        std::vector< BlkId > bids;
+        const auto status = m_vdev->alloc_blk(m_io_size / m_vdev->block_size(), blk_alloc_hints{}, bids);
+        HS_REL_ASSERT_EQ(status, BlkAllocStatus::SUCCESS, "Blk allocation failed");
+
+        m_outstanding = bids.size();
+        iomanager.run_on(iomgr::thread_regex::random_worker, [this, &bids](iomgr::io_thread_addr_t) {
+            uint64_t offset{0};
+            for (const auto& bid : bids) {
+                const auto size = bid.get_nblks() * m_vdev->block_size();
+                m_vdev->async_write(r_cast< const char* >(m_buf + offset), size, bid,
+                                    [this](std::error_condition err, void*) {
+                                        HS_REL_ASSERT(!err, "Write failed with error {}", err.message());
+                                        bool done{false};
+                                        {
+                                            std::unique_lock< std::mutex > lk{m_mtx};
+                                            done = (--m_outstanding == 0);
+                                        }
+                                        if (done) { m_cv.notify_one(); }
+                                    });
+                offset += size;
+            }
+        });
+
+        {
+            std::unique_lock< std::mutex > lk{m_mtx};
+            m_cv.wait(lk, [this] { return (m_outstanding == 0); });
+        }
+        for (const auto& bid : bids) {
+            m_vdev->free_blk(bid);
+        }
+    }
+
+    // Writes m_io_size on each of the qdepth preallocated blks in parallel from one reactor and waits for all of them
+    void write_qdepth(uint32_t qdepth) {
+        if (m_qd_bids.size() != qdepth) {
+            for (const auto& bid : m_qd_bids) {
+                m_vdev->free_blk(bid);
+            }
+            m_qd_bids.clear();
+            blk_alloc_hints hints;
+            hints.is_contiguous = true;
+            for (uint32_t i{0}; i < qdepth; ++i) {
+                const auto status = m_vdev->alloc_blk(m_io_size / m_vdev->block_size(), hints, m_qd_bids);
+                HS_REL_ASSERT_EQ(status, BlkAllocStatus::SUCCESS, "Blk allocation failed");
+            }
+        }
+
+        m_outstanding = m_qd_bids.size();
+        iomanager.run_on(iomgr::thread_regex::random_worker, [this](iomgr::io_thread_addr_t) {
+            for (const auto& bid : m_qd_bids) {
+                m_vdev->async_write(r_cast< const char* >(m_buf), m_io_size, bid,
+                                    [this](std::error_condition err, void*) {
+                                        HS_REL_ASSERT(!err, "Write failed with error {}", err.message());
+                                        bool done{false};
+                                        {
+                                            std::unique_lock< std::mutex > lk{m_mtx};
+                                            done = (--m_outstanding == 0);
+                                        }
+                                        if (done) { m_cv.notify_one(); }
+                                    });
+            }
+        });
+
+        std::unique_lock< std::mutex > lk{m_mtx};
+        m_cv.wait(lk, [this] { return (m_outstanding == 0); });
+    }
+
+    void free_qdepth_blks() {
+        for (const auto& bid : m_qd_bids) {
+            m_vdev->free_blk(bid);
+        }
+        m_qd_bids.clear();
+    }
+
+private:
+    VDevBench() = default;
+
+    std::unique_ptr< VirtualDev > m_vdev;
+    uint32_t m_ndevices{0};
+    uint8_t* m_buf{nullptr};
+    uint32_t m_io_size{4096};
+    std::mutex m_mtx;
+    std::condition_variable m_cv;
+    size_t m_outstanding{0};
+    std::vector< BlkId > m_qd_bids;
+};
+
+#define vdev_bench VDevBench::instance()
+
+static void set_cpu_per_io(benchmark::State& state, std::clock_t cpu_start, uint64_t nios) {
+    if (nios == 0) { return; }
+    const auto cpu_us = (double(std::clock() - cpu_start) * 1000000) / CLOCKS_PER_SEC;
+    state.counters["cpu_us_per_io"] = benchmark::Counter(cpu_us / nios);
+}
+
+static void write_latency(benchmark::State& state) {
+    const auto nmirror = s_cast< uint32_t >(state.range(0));
+    vdev_bench.start_homestore(SISL_OPTIONS["num_devs"].as< uint32_t >(), nmirror,
+                               SISL_OPTIONS["io_size"].as< uint32_t >());
+    const auto cpu_start = std::clock();
+    for ([[maybe_unused]] auto s : state) {
+        vdev_bench.write_one();
+    }
+    set_cpu_per_io(state, cpu_start, state.iterations());
+    state.SetLabel(std::to_string(nmirror) + " mirror(s)");
+    vdev_bench.shutdown();
+}
+
+static void stripe_throughput(benchmark::State& state) {
+    const auto ndevices = s_cast< uint32_t >(state.range(0));
+    const auto io_size = SISL_OPTIONS["stripe_io_size"].as< uint32_t >();
+    HS_SETTINGS_FACTORY().modifiable_settings(
+        [](auto& s) { s.device.stripe_unit_size = SISL_OPTIONS["stripe_unit_size"].as< uint64_t >(); });
+    HS_SETTINGS_FACTORY().save();
+
+    vdev_bench.start_homestore(ndevices, 0 /* nmirror */, io_size);
+    for ([[maybe_unused]] auto s : state) {
+        vdev_bench.write_one();
+    }
+    state.SetBytesProcessed(state.iterations() * io_size);
+    state.SetLabel(std::to_string(ndevices) + " drive(s)");
+    vdev_bench.shutdown();
+
+    HS_SETTINGS_FACTORY().modifiable_settings([](auto& s) { s.device.stripe_unit_size = 0; });
+    HS_SETTINGS_FACTORY().save();
+}
+
+static void small_write_iops(benchmark::State& state) {
+    const auto qdepth = s_cast< uint32_t >(state.range(0));
+    vdev_bench.start_homestore(SISL_OPTIONS["num_devs"].as< uint32_t >(), 0 /* nmirror */, 4096 /* io_size */);
+    const auto cpu_start = std::clock();
+    for ([[maybe_unused]] auto s : state) {
+        vdev_bench.write_qdepth(qdepth);
+    }
+    set_cpu_per_io(state, cpu_start, state.iterations() * qdepth);
+    state.SetItemsProcessed(state.iterations() * qdepth);
+    state.SetLabel("qdepth " + std::to_string(qdepth));
+    vdev_bench.free_qdepth_blks();
+    vdev_bench.shutdown();
+}
+
+SISL_OPTIONS_ENABLE(logging, vdev_benchmark)
+SISL_OPTION_GROUP(vdev_benchmark,
+                  (num_threads, "", "num_threads", "number of threads",
+                   ::cxxopts::value< uint32_t >()->default_value("2"), "number"),
+                  (num_devs, "", "num_devs", "number of devices to create, mirrors upto num_devs - 1 are measured",
+                   ::cxxopts::value< uint32_t >()->default_value("2"), "number"),
+                  (max_stripe_devs, "", "max_stripe_devs", "stripe throughput is measured from 1 to this many devices",
+                   ::cxxopts::value< uint32_t >()->default_value("8"), "number"),
+                  (dev_size_mb, "", "dev_size_mb", "size of each device in MB",
+                   ::cxxopts::value< uint64_t >()->default_value("1024"), "number"),
+                  (io_size, "", "io_size", "size of each write in mirror benchmark",
+                   ::cxxopts::value< uint32_t >()->default_value("4096"), "number"),
+                  (stripe_io_size, "", "stripe_io_size", "size of each write in stripe benchmark",
+                   ::cxxopts::value< uint32_t >()->default_value("1048576"), "number"),
+                  (stripe_unit_size, "", "stripe_unit_size", "stripe unit size in stripe benchmark",
+                   ::cxxopts::value< uint64_t >()->default_value("131072"), "number"),
+                  (spdk, "", "spdk", "spdk", ::cxxopts::value< bool >()->default_value("false"), "true or false"));
+
+int main(int argc, char** argv) {
+    SISL_OPTIONS_LOAD(argc, argv, logging, vdev_benchmark)
+    sisl::logging::SetLogger("vdev_benchmark");
+    spdlog::set_pattern("[%D %T%z] [%^%l%$] [%n] [%t] %v");
+
+    const auto ndevices = SISL_OPTIONS["num_devs"].as< uint32_t >();
+    benchmark::RegisterBenchmark("write_latency", write_latency)->DenseRange(0, ndevices - 1)->UseRealTime();
+    benchmark::RegisterBenchmark("stripe_throughput", stripe_throughput)
+        ->DenseRange(1, SISL_OPTIONS["max_stripe_devs"].as< uint32_t >())
+        ->UseRealTime();
+    benchmark::RegisterBenchmark("small_write_iops", small_write_iops)->RangeMultiplier(4)->Range(1, 64)->UseRealTime();
+    ::benchmark::Initialize(&argc, argv);
+    ::benchmark::RunSpecifiedBenchmarks();
+}
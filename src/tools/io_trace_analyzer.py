@@ -0,0 +1,156 @@
+#!/usr/bin/env python3
+## @file io_trace_analyzer.py
+#  Offline analyzer of the "IOTrace" status dump of homestore (dumped with verbosity > 0).
+#
+#  Builds the latency breakdown of vdev IOs into the time queued on the pdev queue depth, on the drive and in the
+#  completion callback, along with the latencies of logdev flushes, cp phases and btree node reads. With --timeline it
+#  prints all the events merged across the threads in time order.
+#
+#  usage: io_trace_analyzer.py <dump.json> [--timeline] [--from-ms N] [--to-ms N] [--events e1,e2] [--slowest N]
+import argparse
+import json
+import sys
+from collections import defaultdict
+
+VDEV_OPS = {0: "read", 1: "write", 2: "format", 3: "fsync"}
+
+
+def load_events(path):
+    with open(path) as f:
+        js = json.load(f)
+    # Accept the whole status output, or just the IOTrace module of it
+    if "IOTrace" in js:
+        js = js["IOTrace"]
+    events = []
+    for thr in js.get("threads", []):
+        if "events" not in thr:
+            sys.exit("Dump has no events, take the dump with verbosity level > 0")
+        if thr["total_recorded"] > thr["records_present"]:
+            print("thread {} ({}): {} older records were overwritten".format(
+                thr["thread_idx"], thr["thread_name"], thr["total_recorded"] - thr["records_present"]))
+        for ts, ev, rid, arg, op in thr["events"]:
+            events.append((ts, ev, rid, arg, op, thr["thread_idx"]))
+    events.sort(key=lambda e: e[0])
+    return events
+
+
+def percentile(sorted_vals, pct):
+    if not sorted_vals:
+        return 0
+    idx = min(len(sorted_vals) - 1, int(round((pct / 100.0) * (len(sorted_vals) - 1))))
+    return sorted_vals[idx]
+
+
+def print_stats(title, vals_ns):
+    vals = sorted(v / 1000.0 for v in vals_ns)
+    if not vals:
+        return
+    print("  {:<28} cnt={:<8} avg={:>10.1f}us p50={:>10.1f}us p99={:>10.1f}us max={:>10.1f}us".format(
+        title, len(vals), sum(vals) / len(vals), percentile(vals, 50), percentile(vals, 99), vals[-1]))
+
+
+# Pairs the start and end events of the same id, an end without its start (overwritten in ring) is ignored
+def pair_durations(events, start_ev, end_ev):
+    starts = {}
+    durations = []
+    for ts, ev, rid, arg, op, thr in events:
+        if ev == start_ev:
+            starts[rid] = ts
+        elif ev == end_ev and rid in starts:
+            durations.append((ts - starts.pop(rid), rid, ts))
+    return durations
+
+
+def vdev_breakdown(events, slowest):
+    reqs = defaultdict(dict)
+    for ts, ev, rid, arg, op, thr in events:
+        if ev.startswith("vdev_"):
+            r = reqs[rid]
+            r[ev] = ts
+            if ev == "vdev_submit":
+                r["size"] = arg
+                r["op"] = VDEV_OPS.get(op, str(op))
+
+    per_op = defaultdict(lambda: defaultdict(list))
+    totals = []
+    for rid, r in reqs.items():
+        if "vdev_submit" not in r or "vdev_device_complete" not in r:
+            continue
+        op = per_op[r["op"]]
+        if "vdev_queued" in r:
+            op["queued on pdev"].append(r["vdev_submit"] - r["vdev_queued"])
+        op["on drive"].append(r["vdev_device_complete"] - r["vdev_submit"])
+        if "vdev_callback_done" in r:
+            op["completion callback"].append(r["vdev_callback_done"] - r["vdev_device_complete"])
+            start = r.get("vdev_queued", r["vdev_submit"])
+            op["total"].append(r["vdev_callback_done"] - start)
+            totals.append((r["vdev_callback_done"] - start, rid, r))
+
+    print("vdev IOs:")
+    for op_name, phases in sorted(per_op.items()):
+        print(" {}:".format(op_name))
+        for phase in ["queued on pdev", "on drive", "completion callback", "total"]:
+            print_stats(phase, phases.get(phase, []))
+
+    if slowest:
+        print(" slowest {} IOs:".format(slowest))
+        for total, rid, r in sorted(totals, key=lambda t: t[0], reverse=True)[:slowest]:
+            queued = (r["vdev_submit"] - r["vdev_queued"]) if "vdev_queued" in r else 0
+            print("  req={} op={} size={} total={:.1f}us queued={:.1f}us drive={:.1f}us callback={:.1f}us".format(
+                rid, r["op"], r["size"], total / 1000.0, queued / 1000.0,
+                (r["vdev_device_complete"] - r["vdev_submit"]) / 1000.0,
+                (r["vdev_callback_done"] - r["vdev_device_complete"]) / 1000.0))
+
+
+def other_breakdowns(events):
+    print("logdev:")
+    print_stats("flush", [d for d, _, _ in pair_durations(events, "logdev_flush_start", "logdev_flush_done")])
+
+    print("cp:")
+    print_stats("switchover to flush start", [d for d, _, _ in pair_durations(events, "cp_switchover",
+                                                                               "cp_flush_start")])
+    print_stats("flush", [d for d, _, _ in pair_durations(events, "cp_flush_start", "cp_flush_done")])
+
+    print("btree:")
+    print_stats("node read", [d for d, _, _ in pair_durations(events, "btree_node_read_start",
+                                                               "btree_node_read_done")])
+
+
+def timeline(events, from_ms, to_ms, only_events):
+    if not events:
+        return
+    base = events[0][0]
+    for ts, ev, rid, arg, op, thr in events:
+        rel_ms = (ts - base) / 1000000.0
+        if (from_ms is not None and rel_ms < from_ms) or (to_ms is not None and rel_ms > to_ms):
+            continue
+        if only_events and ev not in only_events:
+            continue
+        print("{:>14.3f}ms thr={:<3} {:<22} id={:<12} arg={}".format(rel_ms, thr, ev, rid, arg))
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Latency breakdown and timeline of homestore IOTrace dump")
+    parser.add_argument("dump", help="json file of the IOTrace status dump")
+    parser.add_argument("--timeline", action="store_true", help="print the merged timeline of events")
+    parser.add_argument("--from-ms", type=float, default=None, help="timeline start, relative to first event")
+    parser.add_argument("--to-ms", type=float, default=None, help="timeline end, relative to first event")
+    parser.add_argument("--events", default="", help="comma separated events to include in timeline")
+    parser.add_argument("--slowest", type=int, default=10, help="number of slowest vdev IOs to list")
+    args = parser.parse_args()
+
+    events = load_events(args.dump)
+    if not events:
+        print("No events in the dump")
+        return
+
+    print("{} events over {:.3f}ms".format(len(events), (events[-1][0] - events[0][0]) / 1000000.0))
+    vdev_breakdown(events, args.slowest)
+    other_breakdowns(events)
+    if args.timeline:
+        only = set(e for e in args.events.split(",") if e)
+        timeline(events, args.from_ms, args.to_ms, only)
+
+
+if __name__ == "__main__":
+    main()